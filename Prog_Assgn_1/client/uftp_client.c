@@ -5,26 +5,172 @@
  *
  */
 
+#define _GNU_SOURCE										/* recvmmsg() / sendmmsg() */
+#define _FILE_OFFSET_BITS 64							/* 64-bit off_t / file offsets on 32-bit builds too */
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
 #include <netdb.h> 
 #include <stdbool.h>
 #include <time.h>
-#include <dirent.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>									/* _mm_crc32_u64(), built for SSE4.2 per function */
+#include <tmmintrin.h>									/* _mm_shuffle_epi8(), built for SSSE3 per function */
+#define CRC32C_HW								(1)
+#define GF256_HW								(1)
+#else
+#define CRC32C_HW								(0)
+#define GF256_HW								(0)
+#endif
 
 #define NSEC_PER_MSEC							(1000000)
-#define BUFSIZE 							(3100)
+#define BUFSIZE 							(DATA_FIELD_MAX_LENGTH + 64)	/* largest data packet + header */
 #define CMD_BUFSIZE							(64)
 #define FILENAME_BUFSIZE						(64)
-#define DATA_PACKET_RECV_BUFSIZE				        ((2*1024) + 15)
-#define DATA_FIELD_LENGTH						(2*1024)
-#define MAX_DATA_PACKET_COUNT_110MB			                (55*1024)
-#define MAX_FILE_SIZE							(110*1024*1024)
+#define DATA_PACKET_RECV_BUFSIZE				        (DATA_FIELD_MAX_LENGTH + 64)	/* largest data / repair packet + header */
+#define DATA_FIELD_LENGTH						(2*1024)	/* payload if the path MTU is not probed */
+#define DATA_FIELD_MAX_LENGTH					(8*1024)	/* largest payload offered in the hello */
+#define DATA_FIELD_MIN_LENGTH					(512)
+#define UDP_IP_HDR_SIZE							(28)		/* IPv4 + UDP headers */
+#define PMTU_PROBE_COUNT						(2)			/* probes of one size before trying a smaller one */
+#define SOCKET_BUFSIZE							(2*MAX_WINDOW_SIZE*DATA_FIELD_MAX_LENGTH)	/* SO_RCVBUF / SO_SNDBUF, a full window of large packets */
+
+#define MAX_WINDOW_SIZE							(256)		/* max packets in flight / receiver reorder slots */
+#define DEFAULT_WINDOW_SIZE						(32)
+#define SACK_BITMAP_SIZE						(MAX_WINDOW_SIZE/8)
+#define SEND_RING_SIZE							(2*MAX_WINDOW_SIZE)	/* file chunks read ahead of the window base */
+#define SEQ_SLOT(seq)							((seq) % MAX_WINDOW_SIZE)
+#define RING_SLOT(seq)							((seq) % SEND_RING_SIZE)
+#define RTO_INITIAL_MSEC						(1000)		/* RTO before the first RTT sample (RFC 6298) */
+#define RTO_MIN_MSEC							(200)
+#define RTO_MAX_MSEC							(4000)
+#define RTO_GRANULARITY_MSEC					(1)			/* clock granularity G of the RTO formula */
+#define MAX_RETX_COUNT							(10)		/* timeouts without progress before abort */
+#define LINGER_RTO_COUNT						(3)			/* RTOs to re-ACK retransmissions after a get */
+#define EXIT_RETRY_COUNT						(3)			/* exit commands sent without an ACK */
+#define CMD_SEQ_MAX								(999999)	/* 6 ASCII digits, then wraps to 1 */
+#define JOURNAL_SUFFIX							".part"		/* sidecar journal of a partial file ... */
+#define STATE_DIR								".uftp"		/* ... kept in this hidden directory */
+#define JOURNAL_INTERVAL						(1024*1024)	/* bytes received between journal updates */
+#define RESUME_TAIL_SIZE						(64*1024)	/* bytes before the resume offset compared by hash */
+#define FNV_OFFSET_BASIS						(14695981039346656037ull)	/* FNV-1a 64 bit start value ... */
+#define FNV_PRIME								(1099511628211ull)			/* ... and multiplier */
+#define DELTA_BLOCK_MIN							(2*1024)	/* pd block size range of the server */
+#define DELTA_BLOCK_MAX							(64*1024)
+#define DELTA_SIG_HDR_SIZE						(12)		/* block size + file size */
+#define DELTA_SIG_ENTRY_SIZE					(12)		/* weak + strong checksum of a block */
+#define DELTA_LITERAL_MAX						(64*1024)	/* longest literal record */
+#define WEAK_CHECKSUM(a, b)						(((a) & 0xffff) | ((b) << 16))
+#define LZ_HASH_BITS							(12)		/* match finder of the packet compressor */
+#define LZ_MIN_MATCH							(4)
+#define LZ_LAST_LITERALS						(5)			/* LZ4 block format - the last bytes are literals ... */
+#define LZ_MATCH_LIMIT							(12)		/* ... and no match starts this close to the end */
+#define LZ_SKIP_SHIFT							(6)			/* search step grows by one every 64 misses */
+#define COMPRESS_MISS_LIMIT						(8)			/* packets in a row that did not shrink before compression backs off */
+#define COMPRESS_PROBE_INTERVAL					(32)		/* ring slots between tries once backed off */
+
+#define SEND_BATCH_SIZE							(MAX_WINDOW_SIZE)	/* datagrams per sendmmsg() - a whole window */
+#define SEND_BATCH_HDR_SIZE						(64)		/* copied part of a queued datagram - header or small packet */
+#define RECV_BATCH_SIZE							(32)		/* datagrams per recvmmsg() */
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT								(103)		/* linux/udp.h, not in older libc headers */
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO									(104)
+#endif
+#define GSO_MAX_SEGMENTS						(64)		/* datagrams per UDP_SEGMENT send (UDP_MAX_SEGMENTS) */
+#define GSO_MAX_BYTES							(65000)		/* one IPv4 UDP datagram before segmentation */
+#define GRO_BUFSIZE								(64*1024)	/* coalesced receive buffer */
+#define RECV_SEG_MAX							(RECV_BATCH_SIZE*GSO_MAX_SEGMENTS)	/* datagrams of one receive batch, split */
+#define RECV_UNPACK_SLOTS						(RECV_BATCH_SIZE)	/* decompressed get packets held for the write queue */
+
+#define LOG_LEVEL_ERROR							(0)
+#define LOG_LEVEL_INFO							(1)			/* default */
+#define LOG_LEVEL_DEBUG							(2)			/* -v */
+#define LOG_LEVEL_TRACE							(3)			/* -vv, per-packet logs */
+
+#ifndef LOG_TRACE_ENABLE
+#define LOG_TRACE_ENABLE						(0)			/* build with -DLOG_TRACE_ENABLE=1 to keep trace logs */
+#endif
+
+#define log_msg(level, ...)						do { if ((level) <= log_level) { printf(__VA_ARGS__); } } while (0)
+#define log_error(...)							log_msg(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define log_info(...)							log_msg(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_debug(...)							log_msg(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#if LOG_TRACE_ENABLE
+#define log_trace(...)							log_msg(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define log_trace(...)							do { } while (0)
+#endif
+
+#define WINDOW_MODE_GBN							(0)			/* Go-Back-N */
+#define WINDOW_MODE_SR							(1)			/* Selective Repeat */
+
+#define CC_INIT_CWND							(10)		/* initial cwnd in packets (RFC 6928) */
+#define CC_MIN_CWND								(4)
+#define CC_DUP_THRESH							(3)			/* packets ACKed beyond a hole before it counts as lost */
+#define CC_RTT_UNKNOWN							((long unsigned int)-1)
+#define BBR_STARTUP								(0)
+#define BBR_DRAIN								(1)
+#define BBR_PROBE_BW							(2)
+#define BBR_PROBE_RTT							(3)
+#define BBR_HIGH_GAIN							(2.885)		/* 2/ln(2) - doubles the rate every round */
+#define BBR_CWND_GAIN							(2.0)
+#define BBR_BW_ROUNDS							(10)		/* rounds of the bandwidth max filter */
+#define BBR_GAIN_CYCLE							(8)			/* PROBE_BW pacing gain cycle */
+#define BBR_MIN_RTT_USEC						(10000000)	/* min RTT expires after 10 s */
+#define BBR_PROBE_RTT_USEC						(200000)
+
+#define TIMER_TICK_USEC							(1000)		/* timer wheel resolution */
+#define TIMER_WHEEL_BITS						(8)
+#define TIMER_WHEEL_SLOTS						(1 << TIMER_WHEEL_BITS)	/* level 0 - one tick per slot */
+#define TIMER_WHEEL_L1_SLOTS					(64)		/* level 1 - TIMER_WHEEL_SLOTS ticks per slot, 16 s span */
+#define PACING_QUANTUM_USEC						(TIMER_TICK_USEC)	/* send credit a paced sender may catch up */
+
+#define HDR_MAGIC								(0xB1)		/* first byte of a binary header */
+#define HDR_VERSION								(2)			/* highest binary header version supported */
+#define BIN_HDR_V1_SIZE							(12)
+#define BIN_HDR_SIZE							(16)		/* v2 - v1 + session ID */
+#define ASCII_HDR_SIZE							(13)		/* type + 6 char seq + 6 char length */
+#define ASCII_HAS_CMD(type)						(((type) == 'C') || ((type) == 'A') || ((type) == 'K'))
+#define HELLO_TIMEOUT_MSEC						(500)
+#define HELLO_RETRY_COUNT						(3)
+
+#define HDR_MODE_ASCII							(0)			/* otherwise the binary header version */
+#define HDR_FLAG_COMPRESSED						(0x0001)	/* data packet payload is LZ compressed */
+#define HDR_FLAG_CRC							(0x0002)	/* CRC32C of the packet follows the header */
+#define HELLO_FEATURE_COMPRESS					(0x0001)	/* hello feature bits - takes compressed data packets */
+#define HELLO_FEATURE_CRC						(0x0002)	/* checks packet CRCs and file digests */
+#define HELLO_FEATURE_FEC						(0x0004)	/* FEC repair packets, block geometry follows */
+#define CRC_SIZE								(4)
+#define CRC_HEX_SIZE							(8)			/* file digest in the K data */
+#define CRC32C_POLY								(0x82F63B78)	/* Castagnoli, reflected */
+#define FEC_MAX_DATA							(64)		/* K - data packets per FEC block */
+#define FEC_MAX_REPAIR							(4)			/* M - repair packets per block */
+#define FEC_ENCODE_SETS							(8)			/* blocks whose repair packets may wait in the send batch */
+#define FEC_BLOCK_SLOTS							(32)		/* blocks being decoded */
+#define FEC_REPAIR_HDR_SIZE						(8)			/* K, M, index, first, end, 0, symbol length */
+#define FEC_SYMBOL_HDR_SIZE						(4)			/* data length and flags, in front of the data */
+#define GF256_POLY								(0x11D)
+#define FEC_SYMBOL_MAX							(FEC_SYMBOL_HDR_SIZE + DATA_FIELD_MAX_LENGTH)
 					
 
 /*------------------ Socket Variables ------------------------*/
@@ -39,10 +185,15 @@ char *hostname;
 
 /*------------------ data variables -------------------------*/
 
-bool recv_data_ack_arr[MAX_DATA_PACKET_COUNT_110MB];
-int recv_data_ack_arr_index;
-bool send_data_ack_arr[MAX_DATA_PACKET_COUNT_110MB];
-int send_data_ack_arr_index;
+bool recv_data_ack_arr[MAX_WINDOW_SIZE];					/* received packets in receive window, by SEQ_SLOT() (gt) */
+int recv_data_ack_arr_index;								/* next in-order data packet expected */
+bool send_data_ack_arr[MAX_WINDOW_SIZE];					/* ACKed in-flight packets, by SEQ_SLOT() (pt) */
+int send_data_ack_arr_index;								/* send window base - oldest unACKed packet */
+int send_data_next_index;									/* next new data packet to be sent */
+int send_data_read_index;									/* next data packet to be read from put file */
+int send_retx_count;										/* retransmit rounds without window progress */
+long unsigned int send_pkt_time_arr[MAX_WINDOW_SIZE];		/* last send time of each in-flight packet (msec) */
+bool send_pkt_retx_arr[MAX_WINDOW_SIZE];					/* packet was retransmitted - no RTT sample (Karn) */
 int max_packet_count;
 int filename_len;
 char cmd_buff[CMD_BUFSIZE];
@@ -55,18 +206,41 @@ char client_data_buf[BUFSIZE];
 char cmd_detect[3];
 char ack_buf[5];
 
+char list_pattern_buf[CMD_BUFSIZE];						/* ls glob, "" for all */
+char list_cursor[NAME_MAX + 1];							/* last name of the list page received */
+bool list_more;											/* more list pages at the server */
+
 /*-----------------------------------------------------------*/
 
-char *file_data_init_ptr = NULL;
-char *file_data_end_ptr = NULL;
-char *file_data_current_ptr = NULL;
+char send_ring_buf[SEND_RING_SIZE][DATA_FIELD_MAX_LENGTH];	/* pt file chunks, indexed by RING_SLOT() */
+int send_ring_len[SEND_RING_SIZE];
+char send_ring_zbuf[SEND_RING_SIZE][DATA_FIELD_MAX_LENGTH];	/* compressed chunk of a slot ... */
+int send_ring_zlen[SEND_RING_SIZE];						/* ... and its length, 0 if the slot is sent raw */
+int compress_misses;									/* chunks in a row that did not shrink */
+long compress_in_bytes, compress_out_bytes;				/* data of the put and its size on the wire */
+pthread_t compress_thread;								/* compresses the put ring off the network thread */
+pthread_mutex_t compress_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t compress_work_cond = PTHREAD_COND_INITIALIZER;	/* slots were queued */
+pthread_cond_t compress_done_cond = PTHREAD_COND_INITIALIZER;	/* no slot left queued */
+int compress_queue_index;								/* data packets read and queued for compression ... */
+int send_data_ready_index;								/* ... and compressed, packets are only sent up to it */
+int compress_done_fd = -1;								/* eventfd, signalled when a slot is compressed */
+
+char recv_unpack_buf[RECV_UNPACK_SLOTS][DATA_FIELD_MAX_LENGTH];	/* decompressed get packets, until written */
+int recv_unpack_count;
 
-char file_data_buf[MAX_FILE_SIZE];
+uint32_t send_ring_crc[SEND_RING_SIZE];					/* CRC32C of the data a slot is sent with */
+uint32_t put_file_crc;									/* CRC32C of the put file up to the read index */
+uint32_t recv_crc_arr[MAX_WINDOW_SIZE];					/* CRC32C of the received get packets, by SEQ_SLOT() */
+int recv_crc_len[MAX_WINDOW_SIZE];
+uint32_t get_file_crc;									/* CRC32C of the get file up to the receive window base */
+uint32_t get_file_digest;								/* sent by the server in the file info */
+bool get_digest_valid;
 
 /*------------------- Data Packet Variables ------------------*/
 
 int data_pkt_max_count;
-int data_byte_max_count;
+off_t data_byte_max_count;
 int data_byte_count;
 int current_data_pkt_count;
 int recv_data_pkt_data_len;
@@ -80,17 +254,231 @@ char *recv_data_pkt_init_ptr = NULL;
 char *recv_data_pkt_current_ptr = NULL;
 char *recv_data_pkt_end_ptr = NULL;
 
-char data_pkt_recv_buf[DATA_PACKET_RECV_BUFSIZE];
-char data_pkt_data_buf[DATA_FIELD_LENGTH];
+char data_pkt_data_buf[DATA_FIELD_MAX_LENGTH];
+char data_pkt_hdr_buf[SEND_BATCH_HDR_SIZE];
+
+/*------------------------------------------------------------*/
+
+/*------------------ Batch I/O Variables ---------------------*/
+
+struct mmsghdr send_batch_msg[SEND_BATCH_SIZE];			/* messages queued for one sendmmsg() */
+struct iovec send_batch_iov[SEND_BATCH_SIZE][2];		/* copied header + data by reference, per datagram */
+char send_batch_hdr_buf[SEND_BATCH_SIZE][SEND_BATCH_HDR_SIZE];
+char send_batch_ctrl_buf[SEND_BATCH_SIZE][CMSG_SPACE(sizeof(uint16_t))];	/* UDP_SEGMENT size */
+int send_batch_seg_size[SEND_BATCH_SIZE];				/* GSO segment size of a message, 0 if it has no data */
+int send_batch_seg_count[SEND_BATCH_SIZE];				/* datagrams in a message */
+int send_batch_byte_count[SEND_BATCH_SIZE];
+int send_batch_count;									/* messages */
+int send_batch_dgram_count;								/* datagrams */
+long send_batch_flush_count;							/* batches sent - data queued by reference is free after the next */
+
+struct mmsghdr recv_batch_msg[RECV_BATCH_SIZE];			/* datagrams drained by one recvmmsg() */
+struct iovec recv_batch_iov[RECV_BATCH_SIZE];
+char recv_batch_buf[RECV_BATCH_SIZE][DATA_PACKET_RECV_BUFSIZE];
+char *recv_gro_buf;										/* RECV_BATCH_SIZE x GRO_BUFSIZE, with UDP_GRO */
+char recv_batch_ctrl_buf[RECV_BATCH_SIZE][CMSG_SPACE(sizeof(int))];	/* UDP_GRO segment size */
+char *recv_seg_ptr_arr[RECV_SEG_MAX];					/* received datagrams, coalesced ones split */
+int recv_seg_len_arr[RECV_SEG_MAX];
+
+bool udp_gso_enable;									/* -g, UDP_SEGMENT sends, off after a failure */
+bool udp_gro_enable;									/* -g, kernel supports UDP_GRO */
+bool udp_gro_active;									/* UDP_GRO set on the socket (during gt) */
+
+/*------------------------------------------------------------*/
+
+/*------------------- Header Variables -----------------------*/
+
+struct packet_info {
+	char type;										/* packet type (D,C,A,F,K) */
+	char cmd;										/* command type */
+	int flags;
+	long seq_no;
+	int data_len;
+	char *data_ptr;									/* ptr to packet data */
+	bool binary;									/* received with binary header */
+	uint32_t data_crc;								/* CRC32C of the data, checked with HDR_FLAG_CRC */
+};
+
+int hdr_mode;										/* header negotiated with the server */
+uint32_t session_id;								/* assigned by the server, sent in v2 headers */
+int data_size;										/* data packet payload, from the path MTU probes */
+bool compress_opt = true;							/* -z clears it */
+bool compress_enable;								/* data packets compressed both ways, from the hello */
+bool crc_enable;									/* packets carry a CRC32C, file digests at K, from the hello */
+uint32_t data_crc_op[32];							/* crc32c_shift_op() of a full data packet */
+uint32_t crc32c_table[8][256];						/* slicing-by-8, without SSE4.2 */
+bool crc32c_hw_enable;								/* CPU has the crc32 instruction */
+int pmtu_candidate_arr[] = {9000, 1500, 1492, 1280, 576};	/* jumbo, Ethernet, PPPoE, IPv6 minimum, IPv4 minimum */
+
+/*------------------------------------------------------------*/
+
+/*------------------- FEC Variables --------------------------*/
+
+struct fec_encoder {
+	int k, m;										/* data / repair packets per block, from the hello, k = 0 - off */
+	int sym_max;									/* symbol of a full data packet */
+	int last_seq;									/* last data packet of the transfer */
+	int block;										/* block being encoded, -1 if none */
+	int first, count;								/* data packets encoded, by index in the block */
+	int sym_len;									/* longest symbol of the block */
+	int set;										/* repair buffers of the block */
+	long queued_flush[FEC_ENCODE_SETS];				/* send_batch_flush_count when a set was queued, -1 if sent */
+	char parity[FEC_ENCODE_SETS][FEC_MAX_REPAIR][FEC_REPAIR_HDR_SIZE + FEC_SYMBOL_MAX];
+	long repair_count;								/* repair packets sent for the transfer */
+};
+
+struct fec_block {
+	int block;										/* block number, -1 if the slot is free */
+	uint64_t data_mask;								/* data packets taken out, by index in the block */
+	int repair_mask;								/* repair packets added */
+	int first, count;								/* data packets encoded, from a repair packet */
+	int sym_len;
+	bool done;										/* rebuilt, or nothing was missing */
+	char sym[FEC_MAX_REPAIR][FEC_SYMBOL_MAX];		/* repair symbols, less the data packets received */
+};
+
+struct fec_decoder {
+	int k, m;
+	int sym_max;
+	struct fec_block blk[FEC_BLOCK_SLOTS];			/* by block number */
+	char out[FEC_MAX_REPAIR][FEC_SYMBOL_MAX];		/* rebuilt data packets, until the next decode */
+	long rebuilt_count;								/* packets rebuilt for the transfer */
+};
+
+uint8_t gf256_exp[510], gf256_log[256];
+uint8_t gf256_mul_table[256][256];					/* products, a row per factor */
+uint8_t gf256_mul_hi_table[256][16];				/* products of the high nibbles, for pshufb */
+uint8_t fec_coef_table[FEC_MAX_REPAIR][FEC_MAX_DATA];	/* factor of a data packet in a repair packet */
+bool gf256_hw_enable;								/* CPU has SSSE3 */
+int fec_opt_k, fec_opt_m;							/* -f K:M, FEC block asked for in the hello */
+struct fec_encoder fec_enc;							/* repair packets of puts, k = 0 - no FEC, from the hello */
+struct fec_decoder fec_dec;							/* rebuilds lost data packets of gets */
+
+/*------------------------------------------------------------*/
+
+/*------------------- Log Variables --------------------------*/
+
+int log_level = LOG_LEVEL_INFO;						/* messages above this level are dropped */
+
+/*------------------------------------------------------------*/
+
+/*------------------- Window Variables -----------------------*/
+
+int window_size;									/* send window (packets) */
+int window_mode;									/* WINDOW_MODE_GBN / WINDOW_MODE_SR */
+
+struct file_write{
+	long offset;										/* data packet position in the get file */
+	char *data_ptr;										/* into the receive batch buffers */
+	int data_len;
+};
+struct file_write file_write_arr[RECV_SEG_MAX];			/* write-behind queue of the receive batch */
+int file_write_count;
+
+/*------------------------------------------------------------*/
+
+/*------------------- Timer Wheel Variables ------------------*/
+
+struct wheel_timer {
+	struct wheel_timer *next, *prev;					/* slot list, NULL if not armed */
+	long unsigned int expires;							/* expiry tick */
+	void (*fn)(struct wheel_timer *t);
+	void *arg;
+	int seq_no;
+};
+
+struct timer_wheel {
+	struct wheel_timer slot[TIMER_WHEEL_SLOTS];			/* level 0 list heads, one tick each */
+	struct wheel_timer l1_slot[TIMER_WHEEL_L1_SLOTS];	/* level 1 list heads, TIMER_WHEEL_SLOTS ticks each */
+	long unsigned int tick;								/* next tick to run */
+	int count;											/* armed timers */
+};
+
+struct timer_wheel send_timer_wheel;				/* retransmit and pace timers of the put transfer */
+struct wheel_timer send_pkt_timer_arr[MAX_WINDOW_SIZE];	/* retransmit timer of each in-flight packet */
+struct wheel_timer pace_timer;						/* sends the window on when pacing held it back */
+bool send_data_aborted;								/* no progress for MAX_RETX_COUNT timeouts */
+
+/*------------------------------------------------------------*/
+
+/*------------------- Congestion Control Variables -----------*/
+
+struct cc_state;
+
+struct cc_ops {
+	char *name;
+	void (*init)(struct cc_state *cc);
+	void (*on_ack)(struct cc_state *cc, int base_seq, int inflight);	/* after the packets of an ACK are counted */
+	void (*on_loss)(struct cc_state *cc, int next_seq);					/* packets declared lost by SACK */
+	void (*on_timeout)(struct cc_state *cc);							/* RTO of the window base */
+};
+
+struct cc_pkt {
+	long unsigned int sent_usec;						/* last send time */
+	long delivered;										/* delivered count when sent */
+	long unsigned int delivered_usec;					/* last delivery time when sent */
+	bool retx;
+};
+
+struct cc_state {
+	struct cc_ops *ops;
+	double cwnd;										/* congestion window (packets) */
+	double ssthresh;									/* slow start threshold (packets) */
+	int pkt_size;										/* data packet payload (bytes) */
+	double pacing_rate;									/* rate the sender should not exceed (bytes/sec) */
+	long unsigned int pace_next_usec;					/* earliest send time of the next packet when paced */
+	long loss_count;									/* packets declared lost by SACK */
+	long retx_count;									/* packets retransmitted */
+	long timeout_count;									/* retransmit timeouts */
+	long delivered;										/* packets ACKed / SACKed */
+	long unsigned int delivered_usec;					/* time of the last delivery */
+	long unsigned int srtt_usec;
+	long unsigned int min_rtt_usec;
+	long unsigned int min_rtt_stamp;					/* time min_rtt_usec was measured */
+	long rs_prior_delivered;							/* rate sample of the current ACK */
+	long unsigned int rs_prior_usec;
+	int rs_acked;										/* packets delivered by the current ACK */
+
+	/* NewReno */
+	bool in_recovery;
+	int recover_seq;									/* recovery ends when this packet is ACKed */
+
+	/* BBR */
+	int bbr_mode;
+	double btl_bw;										/* bottleneck bandwidth (packets/sec) */
+	double bw_samples[BBR_BW_ROUNDS];					/* max delivery rate of each round */
+	long round_count;
+	long next_round_delivered;
+	bool round_start;
+	double full_bw;
+	int full_bw_count;
+	bool full_pipe;
+	double pacing_gain;
+	double cwnd_gain;
+	int cycle_index;
+	long unsigned int cycle_stamp;
+	long unsigned int probe_rtt_done_stamp;
+
+	struct cc_pkt pkt[MAX_WINDOW_SIZE];					/* in-flight packets, by SEQ_SLOT() */
+};
+
+double bbr_pacing_gain_cycle[BBR_GAIN_CYCLE] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+char *bbr_mode_names[] = {"STARTUP", "DRAIN", "PROBE_BW", "PROBE_RTT"};
+
+struct cc_state cc;											/* congestion control of the put transfer */
+int send_high_ack_seq;										/* highest packet the server reported, -1 if none */
 
 /*------------------------------------------------------------*/
 
 /*----------------- Bool Variables --------------------------*/
 
-bool get_cmd_ack;		// for get command ack from server
 bool get_cmd_enable;		// for first iteration of get command
 bool put_cmd_enable;		// for first iteration of put command
 bool def_print_enable;		// to print default print command list
+bool get_resume_enable;		// rg - resume the get from the partial local file
+bool put_resume_enable;		// rp - resume the put from the partial file at server
+bool put_delta_enable;		// pd - put only the changes against the copy at server
+bool put_delta_failed;		// server could not rebuild the file from the delta
 bool exit_check;
 
 /*-----------------------------------------------------------*/
@@ -101,248 +489,1621 @@ FILE *client_get_file;
 FILE *client_put_file;
 
 int put_file_found;
-long unsigned int put_max_byte_count;
+off_t put_max_byte_count;
+int put_start_seq;										/* first data packet of the put, > 0 when resumed */
+
+FILE *put_delta_file;									/* delta sent by the running pd, NULL for pt */
+
+int state_dir_fd = -1;									/* STATE_DIR, -1 - no journals */
+int get_journal_fd = -1;								/* journal of the running get, -1 if none */
+off_t get_journal_done;									/* bytes of the get file recorded as received */
+off_t get_resume_offset;								/* offset asked for by rg, 0 if none */
 
 /*-----------------------------------------------------------*/
 
 /*------------ Acknowledgement Variables --------------------*/
 
-int get_cmd_seq_no;
-int put_cmd_seq_no;
+int cmd_seq_no;			// sequence number of the last command, retransmissions reuse it
+bool ctrl_ack_enable;		// server ACKs 'K' and exit (answered the hello)
 
 /*-----------------------------------------------------------*/
 
 /*----------------- Time Variables --------------------------*/
 
-struct timespec get_cmd_send_time;
-struct timeval recv_timeout = {2,0};		// timeout - 2 seconds
+struct rto_state {
+	long srtt;				// smoothed RTT x8 (msec)
+	long rttvar;			// RTT variation x4 (msec)
+	long rto;				// retransmit timeout incl. backoff (msec)
+	bool has_sample;
+};
+
+struct rto_state rtt;		// RTO estimate of the path to the server
 
 /*-----------------------------------------------------------*/
 
+int open_packet_client(char *pkt_ptr, char *data_ptr, int pkt_len);
+void renew_session(void);
+
+/*------------------------------- get_time_msec()----------------------------*/
+
+/*
+*	@brief : monotonic time in milliseconds(msec), base of all protocol timers
+*/
+
+long unsigned int get_time_msec(void){
+	struct timespec spec;
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return ((long unsigned int)spec.tv_sec * 1000) + (spec.tv_nsec / NSEC_PER_MSEC);
+}
+
+/*---------------------------------------------------------------------------*/
+
 /*------------------------------- time_diff()---------------------------------*/
 
 /*
-*	@brief : returns time in milliseconds(msec)
+*	@brief : returns time in milliseconds(msec) elapsed since a 
+*			 get_time_msec() reading
 */
 
-int open_packet_client(char *pkt_ptr, char *data_ptr, int pkt_len);
+long unsigned int time_diff(long unsigned int start_msec){
+	return get_time_msec() - start_msec;
+}
 
-long unsigned int time_diff(struct timespec *spec_1){
-	struct timespec *spec_2;
-	clock_gettime(CLOCK_REALTIME, spec_2);
-	if(spec_2->tv_nsec > spec_1->tv_nsec){
-		return ((long unsigned int)((spec_2->tv_nsec  - spec_1->tv_nsec)/NSEC_PER_MSEC));}
-	else{
-		return ((long unsigned int)((spec_1->tv_nsec  - spec_2->tv_nsec)/NSEC_PER_MSEC));}
+/*----------------- get_time_usec() ----------------------
+
+	@brief : Monotonic clock reading used for congestion control 
+			 RTT and delivery rate samples
+	
+	@param : none
+	
+	@return : time in microseconds
+
+-----------------------------------------------------------*/
+
+long unsigned int get_time_usec(void){
+	struct timespec spec;
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return ((long unsigned int)spec.tv_sec * 1000000) + (spec.tv_nsec / 1000);
 }
 
 /*---------------------------------------------------------------------------*/
 
-/*------------------------------- get_time()---------------------------------*/
+/*----------------- rto_init() ----------------------
+
+	@brief : Reset RTO estimate before the first RTT sample
+	
+	@param : rs - RTO estimate
+	
+	@return : none
+
+-----------------------------------------------------------*/
 
-void get_time(struct timespec *strct){
-	clock_gettime(CLOCK_REALTIME, strct);
+void rto_init(struct rto_state *rs){
+	rs->srtt = 0;
+	rs->rttvar = 0;
+	rs->rto = RTO_INITIAL_MSEC;
+	rs->has_sample = false;
 }
 
-/*---------------------------------------------------------------------------*/	
+/*----------------- rto_update() ----------------------
 
-/*------------------ bool_vars_init() -----------------------*/
+	@brief : Fold an RTT sample into SRTT / RTTVAR and recompute 
+			 the RTO as in RFC 6298, clearing any backoff. SRTT and 
+			 RTTVAR are kept scaled by 8 and 4 so the 1/8 and 1/4 
+			 gains work in integer msec. Only packets that were not 
+			 retransmitted may be sampled (Karn's rule).
+	
+	@param : rs - RTO estimate
+			 rtt_msec - measured round trip time
+	
+	@return : none
 
-/*
-*	@brief : initialize declared bool variables used as flags
-*/
+-----------------------------------------------------------*/
 
-void bool_vars_init(void){
-	get_cmd_ack = false;
-	get_cmd_enable = false;
-	def_print_enable = true;
-	exit_check = true;
+void rto_update(struct rto_state *rs, long rtt_msec){
+	long delta;
+	if(rtt_msec < 0){rtt_msec = 0;}
+	if(!rs->has_sample){
+		rs->srtt = rtt_msec << 3;						/* SRTT = R */
+		rs->rttvar = rtt_msec << 1;						/* RTTVAR = R/2 */
+		rs->has_sample = true;
+	}
+	else{
+		delta = rtt_msec - (rs->srtt >> 3);
+		rs->srtt += delta;								/* SRTT = 7/8 SRTT + 1/8 R */
+		if(delta < 0){delta = -delta;}
+		rs->rttvar += delta - (rs->rttvar >> 2);		/* RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R| */
+	}
+	rs->rto = (rs->srtt >> 3) + ((rs->rttvar > RTO_GRANULARITY_MSEC) ? rs->rttvar : RTO_GRANULARITY_MSEC);
+	if(rs->rto < RTO_MIN_MSEC){rs->rto = RTO_MIN_MSEC;}
+	if(rs->rto > RTO_MAX_MSEC){rs->rto = RTO_MAX_MSEC;}
 }
 
-/*-----------------------------------------------------------*/
+/*----------------- rto_backoff() ----------------------
 
-/* 
- * error - wrapper for perror
- */
- 
-void error(char *msg) {
-    perror(msg);
-    exit(0);
+	@brief : Double the RTO after a retransmit timeout, kept until 
+			 the next RTT sample
+	
+	@param : rs - RTO estimate
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void rto_backoff(struct rto_state *rs){
+	rs->rto = ((rs->rto << 1) < RTO_MAX_MSEC) ? (rs->rto << 1) : RTO_MAX_MSEC;
 }
 
+/*----------------- timer_wheel_init() ----------------------
 
+	@brief : Empty a timer wheel, every slot is a circular list 
+			 whose head is the slot itself
+	
+	@param : w - timer wheel
+	
+	@return : none
 
-int copy_filename(char* src, char* dst) {
-        int l;
-		l = 3;
-		while(src[l] != '\n'){
-			dst[l-3] = src[l];
-			l++;
-		}
-		dst[l-3] = '\0';
-		l++;
-return (l-3);
+-----------------------------------------------------------*/
+
+void timer_wheel_init(struct timer_wheel *w){
+	int var1;
+	for(var1 = 0; var1 < TIMER_WHEEL_SLOTS; var1++){
+		w->slot[var1].next = w->slot[var1].prev = &w->slot[var1];
+	}
+	for(var1 = 0; var1 < TIMER_WHEEL_L1_SLOTS; var1++){
+		w->l1_slot[var1].next = w->l1_slot[var1].prev = &w->l1_slot[var1];
+	}
+	w->tick = get_time_usec() / TIMER_TICK_USEC;
+	w->count = 0;
 }
 
-/*----------------- calculate_filesize() -------------------
+/*----------------- timer_init() ----------------------
 
-	@brief : Calculate file size of the requested file
+	@brief : Set up an unarmed timer
 	
-	@param : filename - ptr to file name buffer
+	@param : t - timer
+			 fn - called when the timer expires
+			 arg - passed to fn through the timer
+			 seq_no - passed to fn through the timer
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void timer_init(struct wheel_timer *t, void (*fn)(struct wheel_timer *t), void *arg, int seq_no){
+	t->next = t->prev = NULL;
+	t->fn = fn;
+	t->arg = arg;
+	t->seq_no = seq_no;
+}
+
+/*----------------- timer_link() ----------------------
+
+	@brief : Put an unlinked timer in the slot of its expiry tick - 
+			 level 0 if it expires within TIMER_WHEEL_SLOTS ticks, 
+			 else level 1, from where it is moved down when its 
+			 block of ticks comes up. Expired ticks go to the next 
+			 tick run.
+	
+	@param : w - timer wheel
+			 t - timer
 	
-	@return : file size of the requested file
+	@return : none
 
 -----------------------------------------------------------*/
 
-long unsigned int calculate_filesize(char *filename){
-	long unsigned int cnt;
-	cnt = 0;
-	char temp;
-	FILE *fd;
-	fd = fopen(filename,"rb");
-	if(fd == NULL){
-		perror("\nNo file found\n"); 
+void timer_link(struct timer_wheel *w, struct wheel_timer *t){
+	struct wheel_timer *head;
+	long unsigned int delta;
+	if(t->expires < w->tick){t->expires = w->tick;}
+	delta = t->expires - w->tick;
+	if(delta >= (TIMER_WHEEL_SLOTS * TIMER_WHEEL_L1_SLOTS)){
+		t->expires = w->tick + (TIMER_WHEEL_SLOTS * TIMER_WHEEL_L1_SLOTS) - 1;
+	}
+	if(delta < TIMER_WHEEL_SLOTS){
+		head = &w->slot[t->expires & (TIMER_WHEEL_SLOTS - 1)];
 	}
 	else{
-		file_data_init_ptr = file_data_buf;
-		file_data_current_ptr = file_data_buf;
-		while(!(feof(fd))){
-			*file_data_current_ptr++ = fgetc(fd);	
-		}
-		cnt = (long unsigned int)(file_data_current_ptr - file_data_init_ptr) - 1;
-		file_data_end_ptr = file_data_current_ptr;
-		file_data_current_ptr = file_data_buf;
-		printf("\ncount - %ld bytes",cnt);
-		max_packet_count = (int)((cnt/2048) + 1);
-		printf("\nTotal packets to be sent : %ld",((cnt/2048) + 1));
-		printf("\nlast packet byte count : %ld\n",(cnt%2048));
-	}
-	fclose(fd);
-	return cnt;
-} 
+		head = &w->l1_slot[(t->expires >> TIMER_WHEEL_BITS) & (TIMER_WHEEL_L1_SLOTS - 1)];
+	}
+	t->next = head;
+	t->prev = head->prev;
+	head->prev->next = t;
+	head->prev = t;
+}
 
-/*----------------- calculate_power() -------------------
+/*----------------- timer_del() ----------------------
 
-	@brief : calculate base number multiplied by power of 10 
+	@brief : Disarm a timer, nothing if it is not armed
 	
-	@param : base - char to be multiplied by power of 10
-			 power - power of 10
+	@param : w - timer wheel
+			 t - timer
 	
-	@return : base number
+	@return : none
 
 -----------------------------------------------------------*/
 
-int calculate_power(char base, int power){
-    int var1, var2;
-    var1 = 10;
-    var2 = 1;
-    while(power>0){
-        var2 *= var1;
-        power--;
-    }
-    return ((var2)*((int)(base - '0')));
+void timer_del(struct timer_wheel *w, struct wheel_timer *t){
+	if(t->next == NULL){return;}
+	t->prev->next = t->next;
+	t->next->prev = t->prev;
+	t->next = t->prev = NULL;
+	w->count--;
 }
 
-/*----------------- int_to_str() ----------------------------
+/*----------------- timer_add() ----------------------
 
-	@brief : Convert integer (int) to a char string (6 bytes)
+	@brief : (Re)arm a timer. It fires on the first tick at or after 
+			 the expiry time, never before.
 	
-	@param : ptr - ptr to string buffer
-			 num - number to be converted to string
+	@param : w - timer wheel
+			 t - timer
+			 expires_usec - expiry time (usec, get_time_usec())
 	
-	@return : length of char string
+	@return : none
 
 -----------------------------------------------------------*/
 
-int int_to_str(int num, char *ptr){
-    
-    int len,p,d;
-    char swap;
-    len = 0;
-    p = 0;
-    if(num == 0){
-        *(ptr + len) = (char)((num%10) + '0');
-        len++;
-    }
-    while(num>0){
-        *(ptr + len) = (char)((num%10) + '0');
-        num /= 10;
-        len++;
-    }
-    for(p=0;p<(len/2);p++){
-        swap = *(ptr + p);
-        *(ptr + p) = *(ptr + len - 1 - p);
-        *(ptr + len - 1 - p) = swap;
-    }
-    d = 6 - len;
-    if(len < 6){
-        for(p=len-1;p>=0;p--){
-            *(ptr + p + d) = *(ptr + p);
-        }
-        for(p=0;p<d;p++){
-            *(ptr + p) = '*';
-        }
-        //ptr += 6;
-        return 6;
-    }
-    else{return len;}
+void timer_add(struct timer_wheel *w, struct wheel_timer *t, long unsigned int expires_usec){
+	timer_del(w, t);
+	if(w->count == 0){w->tick = get_time_usec() / TIMER_TICK_USEC;}
+	t->expires = (expires_usec + TIMER_TICK_USEC - 1) / TIMER_TICK_USEC;
+	timer_link(w, t);
+	w->count++;
 }
 
-/*------------------ create_packet()------------------------
+/*----------------- timer_list_move() ----------------------
 
-    @brief : Creates packet of specified type - 
-			 D - Data Packet type
-             C - Command packet type
-             A - Acknowledgement packet type
-             F - File Size packet type 
-             K - File Size Acknowledgement packet type 
-			 
-    @param  : 1. pkt_type - type of packet (D,C,A,F,K)
-			  2. cmd_type - type of command
-			  3. pkt_ptr  - ptr to packet buffer
-			  4. seq_no   - packet sequence number
-			  5. data_ptr - ptr to packet data buffer
-			  6. data_len - length of packet data
-			  
-    @return : packet length
-----------------------------------------------------------*/
+	@brief : Move the timers of a slot list to another list head
+	
+	@param : dst - list head, its old contents are dropped
+			 src - list head, left empty
+	
+	@return : none
 
-/*--------------------------------------------------------*/
-int create_packet(char pkt_type, char cmd_type, char *pkt_ptr, int seq_no, char *data_ptr,int data_len){
-    
-    char *pkt_temp_ptr;
-    pkt_temp_ptr = pkt_ptr;
-    int pkt_len;
-    int temp_var1;
-    
-    if(data_ptr != NULL){
-        switch(pkt_type){
-            
-            /*-------------------- Data packet type -------------------*/
-            case 'D':
-               *pkt_ptr++ = 'D';
-               temp_var1 = int_to_str(seq_no,pkt_ptr);
-               pkt_ptr += temp_var1;
-               temp_var1 = int_to_str(data_len,pkt_ptr);
-               pkt_ptr += temp_var1;
-               for(temp_var1=0;temp_var1<data_len;temp_var1++){
-                   *pkt_ptr++ = *(data_ptr + temp_var1);
-               }
-               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
-            break;
-            /*-------------------- Command packet type -------------------*/
-            case 'C':
-                *pkt_ptr++ = 'C';
-               temp_var1 = int_to_str(seq_no,pkt_ptr);
-               pkt_ptr += temp_var1;
-               temp_var1 = int_to_str(data_len,pkt_ptr);
-               pkt_ptr += temp_var1;
-			   *pkt_ptr++ = cmd_type;
-               for(temp_var1=0;temp_var1<data_len;temp_var1++){
-                   *pkt_ptr++ = *(data_ptr + temp_var1);
-               }
-               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
-                
+-----------------------------------------------------------*/
+
+void timer_list_move(struct wheel_timer *dst, struct wheel_timer *src){
+	if(src->next == src){
+		dst->next = dst->prev = dst;
+		return;
+	}
+	dst->next = src->next;
+	dst->prev = src->prev;
+	dst->next->prev = dst;
+	dst->prev->next = dst;
+	src->next = src->prev = src;
+}
+
+/*----------------- timer_wheel_run() ----------------------
+
+	@brief : Run the ticks up to now - at the start of each block of 
+			 TIMER_WHEEL_SLOTS ticks move its level 1 timers down, 
+			 then fire the timers of the tick. A fired timer is 
+			 disarmed before its function runs, which may re-arm it 
+			 or disarm other timers.
+	
+	@param : w - timer wheel
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void timer_wheel_run(struct timer_wheel *w){
+	struct wheel_timer expired, *t;
+	long unsigned int now_tick;
+	now_tick = get_time_usec() / TIMER_TICK_USEC;
+	while((w->count > 0) && (w->tick <= now_tick)){
+		if((w->tick & (TIMER_WHEEL_SLOTS - 1)) == 0){
+			timer_list_move(&expired, &w->l1_slot[(w->tick >> TIMER_WHEEL_BITS) & (TIMER_WHEEL_L1_SLOTS - 1)]);
+			while(expired.next != &expired){
+				t = expired.next;
+				expired.next = t->next;
+				t->next->prev = &expired;
+				timer_link(w, t);
+			}
+		}
+		/* Move the tick out of the wheel first, so timers re-armed 
+		 * by the functions land in a later tick */
+		timer_list_move(&expired, &w->slot[w->tick & (TIMER_WHEEL_SLOTS - 1)]);
+		w->tick++;
+		while(expired.next != &expired){
+			t = expired.next;
+			timer_del(w, t);
+			t->fn(t);
+		}
+	}
+	if(w->count == 0){w->tick = now_tick + 1;}
+}
+
+/*----------------- timer_wheel_next() ----------------------
+
+	@brief : Time left until the next tick the wheel has work for - 
+			 the earliest armed level 0 slot, or the start of the 
+			 next block with level 1 timers to move down
+	
+	@param : w - timer wheel
+	
+	@return : timeout in msec, -1 if no timer is armed
+
+-----------------------------------------------------------*/
+
+int timer_wheel_next(struct timer_wheel *w){
+	long unsigned int now_tick, next_tick, block;
+	int var1;
+	if(w->count == 0){return -1;}
+	next_tick = w->tick + (TIMER_WHEEL_SLOTS * TIMER_WHEEL_L1_SLOTS);
+	for(var1 = 0; var1 < TIMER_WHEEL_SLOTS; var1++){
+		if(w->slot[(w->tick + var1) & (TIMER_WHEEL_SLOTS - 1)].next != &w->slot[(w->tick + var1) & (TIMER_WHEEL_SLOTS - 1)]){
+			next_tick = w->tick + var1;
+			break;
+		}
+	}
+	for(var1 = 0; var1 < TIMER_WHEEL_L1_SLOTS; var1++){
+		block = ((w->tick + TIMER_WHEEL_SLOTS - 1) >> TIMER_WHEEL_BITS) + var1;
+		if((block << TIMER_WHEEL_BITS) >= next_tick){break;}
+		if(w->l1_slot[block & (TIMER_WHEEL_L1_SLOTS - 1)].next != &w->l1_slot[block & (TIMER_WHEEL_L1_SLOTS - 1)]){
+			next_tick = block << TIMER_WHEEL_BITS;
+			break;
+		}
+	}
+	now_tick = get_time_usec() / TIMER_TICK_USEC;
+	if(next_tick <= now_tick){return 0;}
+	return (int)((next_tick - now_tick) * TIMER_TICK_USEC / 1000);
+}
+
+/*----------------- cc_init() ----------------------
+
+	@brief : Start congestion control of a new transfer
+	
+	@param : cc - congestion control state
+			 ops - algorithm
+			 pkt_size - data packet payload (bytes)
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_init(struct cc_state *cc, struct cc_ops *ops, int pkt_size){
+	bzero(cc, sizeof(*cc));
+	cc->ops = ops;
+	cc->pkt_size = pkt_size;
+	cc->cwnd = CC_INIT_CWND;
+	cc->ssthresh = MAX_WINDOW_SIZE;
+	cc->delivered_usec = get_time_usec();
+	cc->min_rtt_usec = CC_RTT_UNKNOWN;
+	cc->min_rtt_stamp = cc->delivered_usec;
+	ops->init(cc);
+}
+
+/*----------------- cc_window() ----------------------
+
+	@brief : Packets the sender may have in flight - the congestion 
+			 window, limited by the send window (-w)
+	
+	@param : cc - congestion control state
+	
+	@return : window in packets, at least 1
+
+-----------------------------------------------------------*/
+
+int cc_window(struct cc_state *cc){
+	int cwnd;
+	cwnd = (cc->cwnd < 1) ? 1 : (int)cc->cwnd;
+	return (cwnd < window_size) ? cwnd : window_size;
+}
+
+/*----------------- cc_pacing_delay() ----------------------
+
+	@brief : Time the sender has to wait before its next packet to 
+			 keep to the pacing rate
+	
+	@param : cc - congestion control state
+			 now - current time (usec)
+	
+	@return : delay in usec, 0 if the packet may go now
+
+-----------------------------------------------------------*/
+
+long unsigned int cc_pacing_delay(struct cc_state *cc, long unsigned int now){
+	if((cc->pacing_rate <= 0) || (cc->pace_next_usec <= now)){return 0;}
+	return cc->pace_next_usec - now;
+}
+
+/*----------------- cc_on_send() ----------------------
+
+	@brief : Stamp a data packet with its send time and the delivery 
+			 state, the base of the RTT and delivery rate samples 
+			 taken when it is ACKed, and move the pacing clock on by 
+			 one packet. A sender that fell behind the pacing clock 
+			 may catch up by PACING_QUANTUM_USEC, the timer resolution.
+	
+	@param : cc - congestion control state
+			 seq_no - data packet sequence number
+			 now - send time (usec)
+			 retx - packet was sent before
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_on_send(struct cc_state *cc, int seq_no, long unsigned int now, bool retx){
+	struct cc_pkt *pkt;
+	pkt = &cc->pkt[SEQ_SLOT(seq_no)];
+	pkt->sent_usec = now;
+	pkt->delivered = cc->delivered;
+	pkt->delivered_usec = cc->delivered_usec;
+	pkt->retx = retx;
+	if(retx){cc->retx_count++;}
+	if(cc->pacing_rate > 0){
+		if((cc->pace_next_usec + PACING_QUANTUM_USEC) < now){cc->pace_next_usec = now - PACING_QUANTUM_USEC;}
+		cc->pace_next_usec += (long unsigned int)(cc->pkt_size * 1e6 / cc->pacing_rate);
+	}
+}
+
+/*----------------- cc_on_delivered() ----------------------
+
+	@brief : Count a data packet newly ACKed or SACKed. Packets sent 
+			 once give an RTT sample, the most recently sent packet 
+			 of the ACK is the base of its delivery rate sample.
+	
+	@param : cc - congestion control state
+			 seq_no - data packet sequence number
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_on_delivered(struct cc_state *cc, int seq_no){
+	struct cc_pkt *pkt;
+	long unsigned int now, rtt_usec;
+	pkt = &cc->pkt[SEQ_SLOT(seq_no)];
+	now = get_time_usec();
+	cc->delivered++;
+	cc->delivered_usec = now;
+	if(!pkt->retx){
+		rtt_usec = now - pkt->sent_usec;
+		cc->srtt_usec = (cc->srtt_usec == 0) ? rtt_usec : ((7 * cc->srtt_usec) + rtt_usec) / 8;
+		if(rtt_usec <= cc->min_rtt_usec){
+			cc->min_rtt_usec = rtt_usec;
+			cc->min_rtt_stamp = now;
+		}
+	}
+	if((cc->rs_acked == 0) || (pkt->delivered > cc->rs_prior_delivered)){
+		cc->rs_prior_delivered = pkt->delivered;
+		cc->rs_prior_usec = pkt->delivered_usec;
+	}
+	cc->rs_acked++;
+}
+
+/*----------------- cc_on_ack() ----------------------
+
+	@brief : Let the algorithm update cwnd and pacing rate once the 
+			 packets of an ACK are counted
+	
+	@param : cc - congestion control state
+			 base_seq - send window base after the ACK
+			 inflight - packets sent and not cumulatively ACKed
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_on_ack(struct cc_state *cc, int base_seq, int inflight){
+	if(cc->rs_acked == 0){return;}
+	cc->ops->on_ack(cc, base_seq, inflight);
+	if(cc->cwnd > MAX_WINDOW_SIZE){cc->cwnd = MAX_WINDOW_SIZE;}
+	cc->rs_acked = 0;
+}
+
+/*----------------- cc_on_loss() ----------------------
+
+	@brief : Report data packets declared lost by the SACK scoreboard
+	
+	@param : cc - congestion control state
+			 lost - packets declared lost
+			 next_seq - next new data packet to be sent
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_on_loss(struct cc_state *cc, int lost, int next_seq){
+	cc->loss_count += lost;
+	cc->ops->on_loss(cc, next_seq);
+}
+
+/*----------------- cc_on_timeout() ----------------------
+
+	@brief : Report a retransmit timeout of the send window base
+	
+	@param : cc - congestion control state
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_on_timeout(struct cc_state *cc){
+	cc->timeout_count++;
+	cc->ops->on_timeout(cc);
+}
+
+/*----------------- cc_log_stats() ----------------------
+
+	@brief : Log the congestion control counters of a transfer
+	
+	@param : cc - congestion control state
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_log_stats(struct cc_state *cc){
+	log_info("\nCongestion control %s : cwnd %.1f packets, pacing rate %.2f MB/s, min RTT %.3f ms", 
+			 cc->ops->name, cc->cwnd, cc->pacing_rate / 1e6, 
+			 (cc->min_rtt_usec == CC_RTT_UNKNOWN) ? 0.0 : cc->min_rtt_usec / 1e3);
+	log_info("\n%ld packets lost, %ld retransmitted, %ld retransmit timeouts\n", 
+			 cc->loss_count, cc->retx_count, cc->timeout_count);
+}
+
+/*----------------- newreno_init() ----------------------
+
+	@brief : NewReno (RFC 6582) - slow start, then AIMD
+	
+	@param : cc - congestion control state
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void newreno_init(struct cc_state *cc){
+	cc->in_recovery = false;
+}
+
+/*----------------- newreno_on_ack() ----------------------
+
+	@brief : Grow cwnd by one packet per ACKed packet in slow start 
+			 and by one packet per window after, not while in fast 
+			 recovery. Recovery ends when every packet sent before 
+			 the loss is ACKed. Paced at 2x (slow start) or 1.2x 
+			 cwnd per SRTT.
+	
+	@param : cc - congestion control state
+			 base_seq - send window base after the ACK
+			 inflight - packets sent and not cumulatively ACKed
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void newreno_on_ack(struct cc_state *cc, int base_seq, int inflight){
+	if(cc->in_recovery && (base_seq >= cc->recover_seq)){
+		cc->in_recovery = false;
+	}
+	if(!cc->in_recovery){
+		if(cc->cwnd < cc->ssthresh){
+			cc->cwnd += cc->rs_acked;
+		}
+		else{
+			cc->cwnd += (double)cc->rs_acked / cc->cwnd;
+		}
+	}
+	if(cc->srtt_usec > 0){
+		cc->pacing_rate = ((cc->cwnd < cc->ssthresh) ? 2.0 : 1.2) * cc->cwnd * cc->pkt_size * 1e6 / cc->srtt_usec;
+	}
+}
+
+/*----------------- newreno_on_loss() ----------------------
+
+	@brief : Halve cwnd once per window of data and enter fast recovery
+	
+	@param : cc - congestion control state
+			 next_seq - next new data packet to be sent
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void newreno_on_loss(struct cc_state *cc, int next_seq){
+	if(cc->in_recovery){return;}
+	cc->ssthresh = (cc->cwnd / 2 > 2) ? cc->cwnd / 2 : 2;
+	cc->cwnd = cc->ssthresh;
+	cc->in_recovery = true;
+	cc->recover_seq = next_seq;
+}
+
+/*----------------- newreno_on_timeout() ----------------------
+
+	@brief : Halve ssthresh and restart from a one packet window
+	
+	@param : cc - congestion control state
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void newreno_on_timeout(struct cc_state *cc){
+	cc->ssthresh = (cc->cwnd / 2 > 2) ? cc->cwnd / 2 : 2;
+	cc->cwnd = 1;
+	cc->in_recovery = false;
+}
+
+/*----------------- bbr_set_mode() ----------------------
+
+	@brief : Switch the BBR state machine and its gains
+	
+	@param : cc - congestion control state
+			 mode - BBR_STARTUP / BBR_DRAIN / BBR_PROBE_BW / BBR_PROBE_RTT
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void bbr_set_mode(struct cc_state *cc, int mode){
+	cc->bbr_mode = mode;
+	switch(mode){
+		case BBR_STARTUP:
+			cc->pacing_gain = BBR_HIGH_GAIN;
+			cc->cwnd_gain = BBR_HIGH_GAIN;
+		break;
+		case BBR_DRAIN:
+			cc->pacing_gain = 1 / BBR_HIGH_GAIN;
+			cc->cwnd_gain = BBR_HIGH_GAIN;
+		break;
+		case BBR_PROBE_BW:
+			cc->cycle_index = 0;
+			cc->cycle_stamp = cc->delivered_usec;
+			cc->pacing_gain = bbr_pacing_gain_cycle[0];
+			cc->cwnd_gain = BBR_CWND_GAIN;
+		break;
+		default:
+			cc->pacing_gain = 1;
+			cc->cwnd_gain = 1;
+		break;
+	}
+	log_debug("\nBBR mode %s, bottleneck bandwidth %.0f packets/s", bbr_mode_names[mode], cc->btl_bw);
+}
+
+/*----------------- bbr_init() ----------------------
+
+	@brief : BBR-like delay based control - cwnd and pacing rate 
+			 follow a model of the bottleneck bandwidth (max delivery 
+			 rate) and the min RTT instead of reacting to loss
+	
+	@param : cc - congestion control state
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void bbr_init(struct cc_state *cc){
+	bbr_set_mode(cc, BBR_STARTUP);
+}
+
+/*----------------- bbr_on_ack() ----------------------
+
+	@brief : Update the bandwidth / min RTT model from the delivery 
+			 rate sample of an ACK and run the state machine - 
+			 STARTUP doubles the rate every round until the bandwidth 
+			 stops growing, DRAIN empties the queue built meanwhile, 
+			 PROBE_BW cycles the pacing gain around the bandwidth and 
+			 PROBE_RTT shrinks cwnd to refresh a min RTT older than 
+			 10 s.
+	
+	@param : cc - congestion control state
+			 base_seq - send window base after the ACK
+			 inflight - packets sent and not cumulatively ACKed
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void bbr_on_ack(struct cc_state *cc, int base_seq, int inflight){
+	long unsigned int now;
+	double bw, bdp, target;
+	int var1;
+	now = cc->delivered_usec;
+	/* A round trip ends when a packet sent after it started is delivered */
+	cc->round_start = false;
+	if(cc->rs_prior_delivered >= cc->next_round_delivered){
+		cc->next_round_delivered = cc->delivered;
+		cc->round_count++;
+		cc->round_start = true;
+		cc->bw_samples[cc->round_count % BBR_BW_ROUNDS] = 0;
+	}
+	/* Bottleneck bandwidth - max delivery rate of the last BBR_BW_ROUNDS rounds */
+	if(now > cc->rs_prior_usec){
+		bw = (double)(cc->delivered - cc->rs_prior_delivered) * 1e6 / (double)(now - cc->rs_prior_usec);
+		if(bw > cc->bw_samples[cc->round_count % BBR_BW_ROUNDS]){
+			cc->bw_samples[cc->round_count % BBR_BW_ROUNDS] = bw;
+		}
+	}
+	cc->btl_bw = 0;
+	for(var1 = 0; var1 < BBR_BW_ROUNDS; var1++){
+		if(cc->bw_samples[var1] > cc->btl_bw){cc->btl_bw = cc->bw_samples[var1];}
+	}
+	/* Pipe is full once the bandwidth grew less than 25% in 3 rounds */
+	if(!cc->full_pipe && cc->round_start){
+		if(cc->btl_bw >= cc->full_bw * 1.25){
+			cc->full_bw = cc->btl_bw;
+			cc->full_bw_count = 0;
+		}
+		else if(++cc->full_bw_count >= 3){
+			cc->full_pipe = true;
+			bbr_set_mode(cc, BBR_DRAIN);
+		}
+	}
+	bdp = (cc->min_rtt_usec == CC_RTT_UNKNOWN) ? 0 : cc->btl_bw * cc->min_rtt_usec / 1e6;
+	if((cc->bbr_mode == BBR_DRAIN) && (inflight <= bdp)){
+		bbr_set_mode(cc, BBR_PROBE_BW);
+	}
+	if((cc->bbr_mode == BBR_PROBE_BW) && ((now - cc->cycle_stamp) > cc->min_rtt_usec)){
+		cc->cycle_index = (cc->cycle_index + 1) % BBR_GAIN_CYCLE;
+		cc->cycle_stamp = now;
+		cc->pacing_gain = bbr_pacing_gain_cycle[cc->cycle_index];
+	}
+	if((cc->bbr_mode != BBR_PROBE_RTT) && ((now - cc->min_rtt_stamp) > BBR_MIN_RTT_USEC)){
+		bbr_set_mode(cc, BBR_PROBE_RTT);
+		cc->probe_rtt_done_stamp = now + BBR_PROBE_RTT_USEC;
+	}
+	if((cc->bbr_mode == BBR_PROBE_RTT) && (now > cc->probe_rtt_done_stamp)){
+		cc->min_rtt_stamp = now;
+		bbr_set_mode(cc, cc->full_pipe ? BBR_PROBE_BW : BBR_STARTUP);
+	}
+	/* cwnd - cwnd_gain x BDP, grown by the ACKed packets up to it */
+	target = cc->cwnd_gain * bdp;
+	if(target < CC_MIN_CWND){target = CC_MIN_CWND;}
+	if(cc->bbr_mode == BBR_PROBE_RTT){
+		cc->cwnd = CC_MIN_CWND;
+	}
+	else if(cc->full_pipe){
+		cc->cwnd = ((cc->cwnd + cc->rs_acked) < target) ? (cc->cwnd + cc->rs_acked) : target;
+	}
+	else if((cc->cwnd < target) || (cc->delivered < CC_INIT_CWND)){
+		cc->cwnd += cc->rs_acked;
+	}
+	if(cc->btl_bw > 0){
+		cc->pacing_rate = cc->pacing_gain * cc->btl_bw * cc->pkt_size;
+	}
+	else if(cc->srtt_usec > 0){
+		cc->pacing_rate = cc->pacing_gain * cc->cwnd * cc->pkt_size * 1e6 / cc->srtt_usec;
+	}
+}
+
+/*----------------- bbr_on_loss() ----------------------
+
+	@brief : Loss is no congestion signal for BBR, only counted
+	
+	@param : cc - congestion control state
+			 next_seq - next new data packet to be sent
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void bbr_on_loss(struct cc_state *cc, int next_seq){
+}
+
+/*----------------- bbr_on_timeout() ----------------------
+
+	@brief : Fall back to the minimum cwnd, the model grows it back 
+			 with the next ACKs
+	
+	@param : cc - congestion control state
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void bbr_on_timeout(struct cc_state *cc){
+	cc->cwnd = CC_MIN_CWND;
+}
+
+struct cc_ops cc_ops_table[] = {
+	{"newreno", newreno_init, newreno_on_ack, newreno_on_loss, newreno_on_timeout},
+	{"bbr", bbr_init, bbr_on_ack, bbr_on_loss, bbr_on_timeout},
+};
+
+struct cc_ops *cc_algo = &cc_ops_table[0];				/* selected with -c */
+
+/*----------------- find_cc_ops() ----------------------
+
+	@brief : Look up a congestion control algorithm by name
+	
+	@param : name - algorithm name (-c)
+	
+	@return : algorithm, NULL if unknown
+
+-----------------------------------------------------------*/
+
+struct cc_ops *find_cc_ops(char *name){
+	int var1;
+	for(var1 = 0; var1 < (int)(sizeof(cc_ops_table) / sizeof(cc_ops_table[0])); var1++){
+		if(strcmp(name, cc_ops_table[var1].name) == 0){return &cc_ops_table[var1];}
+	}
+	return NULL;
+}
+
+/*------------------ bool_vars_init() -----------------------*/
+
+/*
+*	@brief : initialize declared bool variables used as flags
+*/
+
+void bool_vars_init(void){
+	get_cmd_enable = false;
+	def_print_enable = true;
+	exit_check = true;
+}
+
+/*-----------------------------------------------------------*/
+
+/* 
+ * error - wrapper for perror
+ */
+ 
+void error(char *msg) {
+    perror(msg);
+    exit(0);
+}
+
+
+
+int copy_filename(char* src, char* dst) {
+        int l;
+		l = 3;
+		while(src[l] != '\n'){
+			dst[l-3] = src[l];
+			l++;
+		}
+		dst[l-3] = '\0';
+		l++;
+return (l-3);
+}
+
+/*----------------- lookup_file() -------------------
+
+	@brief : Look up a regular file of the current directory with 
+			 one fstatat(), instead of scanning the directory for 
+			 the name and seeking through the file for its size. 
+			 Only plain names are accepted, like the scan did.
+	
+	@param : filename - ptr to file name buffer
+			 st - file metadata, filled if found
+	
+	@return : true if found
+
+-----------------------------------------------------------*/
+
+bool lookup_file(char *filename, struct stat *st){
+	if((*filename == '\0') || (strchr(filename,'/') != NULL) || 
+	   (strcmp(filename,".") == 0) || (strcmp(filename,"..") == 0)){return false;}
+	return ((fstatat(AT_FDCWD, filename, st, 0) == 0) && S_ISREG(st->st_mode));
+} 
+
+/*----------------- crc32c_init() -------------------
+
+	@brief : Build the slicing-by-8 tables of the CRC32C fallback 
+			 and check the CPU for the SSE4.2 crc32 instruction
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void crc32c_init(void){
+	uint32_t crc;
+	int var1, var2;
+	for(var1 = 0; var1 < 256; var1++){
+		crc = (uint32_t)var1;
+		for(var2 = 0; var2 < 8; var2++){
+			crc = (crc & 1) ? ((crc >> 1) ^ CRC32C_POLY) : (crc >> 1);
+		}
+		crc32c_table[0][var1] = crc;
+	}
+	for(var1 = 0; var1 < 256; var1++){
+		crc = crc32c_table[0][var1];
+		for(var2 = 1; var2 < 8; var2++){
+			crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+			crc32c_table[var2][var1] = crc;
+		}
+	}
+#if CRC32C_HW
+	crc32c_hw_enable = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#if CRC32C_HW
+/*----------------- crc32c_hw() -------------------
+
+	@brief : CRC32C register update with the SSE4.2 crc32 
+			 instruction, 8 bytes at a time. The data is copied to 
+			 dst on the way when dst is not NULL, so a payload copy 
+			 and its CRC take one pass.
+	
+	@param : crc - CRC register (not inverted)
+			 dst - copy destination, NULL for none
+			 src - data
+			 len - data length
+	
+	@return : CRC register
+
+-----------------------------------------------------------*/
+
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw(uint32_t crc, char *dst, char *src, long len){
+	uint64_t crc64, var64;
+	crc64 = crc;
+	while(len >= 8){
+		memcpy(&var64, src, 8);
+		crc64 = _mm_crc32_u64(crc64, var64);
+		if(dst != NULL){
+			memcpy(dst, &var64, 8);
+			dst += 8;
+		}
+		src += 8;
+		len -= 8;
+	}
+	crc = (uint32_t)crc64;
+	while(len > 0){
+		crc = _mm_crc32_u8(crc, (unsigned char)*src);
+		if(dst != NULL){*dst++ = *src;}
+		src++;
+		len--;
+	}
+	return crc;
+}
+#endif
+
+/*----------------- crc32c_sw() -------------------
+
+	@brief : CRC32C register update with the slicing-by-8 tables, 
+			 copying the data to dst on the way like crc32c_hw()
+	
+	@param : same as crc32c_hw()
+	
+	@return : CRC register
+
+-----------------------------------------------------------*/
+
+uint32_t crc32c_sw(uint32_t crc, char *dst, char *src, long len){
+	unsigned char *ptr;
+	uint32_t var32;
+	if(dst != NULL){memcpy(dst, src, len);}
+	ptr = (unsigned char *)src;
+	while(len >= 8){
+		var32 = crc ^ ((uint32_t)ptr[0] | ((uint32_t)ptr[1] << 8) | ((uint32_t)ptr[2] << 16) | ((uint32_t)ptr[3] << 24));
+		crc = crc32c_table[7][var32 & 0xff] ^ crc32c_table[6][(var32 >> 8) & 0xff] ^ 
+			  crc32c_table[5][(var32 >> 16) & 0xff] ^ crc32c_table[4][var32 >> 24] ^ 
+			  crc32c_table[3][ptr[4]] ^ crc32c_table[2][ptr[5]] ^ crc32c_table[1][ptr[6]] ^ crc32c_table[0][ptr[7]];
+		ptr += 8;
+		len -= 8;
+	}
+	while(len > 0){
+		crc = crc32c_table[0][(crc ^ *ptr++) & 0xff] ^ (crc >> 8);
+		len--;
+	}
+	return crc;
+}
+
+/*----------------- crc32c_copy() -------------------
+
+	@brief : CRC32C (Castagnoli) of a buffer, continuing the CRC of 
+			 the data before it, and copy the buffer to dst in the 
+			 same pass. crc32c_copy(crc32c_copy(0, A), B) is the CRC 
+			 of A followed by B.
+	
+	@param : crc - CRC of the data before, 0 to start
+			 dst - copy destination, NULL for none
+			 src - data
+			 len - data length
+	
+	@return : CRC
+
+-----------------------------------------------------------*/
+
+uint32_t crc32c_copy(uint32_t crc, char *dst, char *src, long len){
+#if CRC32C_HW
+	if(crc32c_hw_enable){return ~crc32c_hw(~crc, dst, src, len);}
+#endif
+	return ~crc32c_sw(~crc, dst, src, len);
+}
+
+/*----------------- crc32c() -------------------
+
+	@brief : CRC32C of a buffer, as crc32c_copy() without the copy
+	
+	@param : crc - CRC of the data before, 0 to start
+			 buf - data
+			 len - data length
+	
+	@return : CRC
+
+-----------------------------------------------------------*/
+
+uint32_t crc32c(uint32_t crc, char *buf, long len){
+	return crc32c_copy(crc, NULL, buf, len);
+}
+
+/*----------------- gf2_matrix_times() -------------------
+
+	@brief : Multiply a 32x32 GF(2) matrix by a vector
+	
+	@param : mat - matrix, one column per vector bit
+			 vec - vector
+	
+	@return : product
+
+-----------------------------------------------------------*/
+
+uint32_t gf2_matrix_times(uint32_t *mat, uint32_t vec){
+	uint32_t sum;
+	sum = 0;
+	while(vec != 0){
+		if(vec & 1){sum ^= *mat;}
+		vec >>= 1;
+		mat++;
+	}
+	return sum;
+}
+
+/*----------------- gf2_matrix_mul() -------------------
+
+	@brief : Multiply two 32x32 GF(2) matrices
+	
+	@param : dst - product, may not be a or b
+			 a, b - matrices
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void gf2_matrix_mul(uint32_t *dst, uint32_t *a, uint32_t *b){
+	int var1;
+	for(var1 = 0; var1 < 32; var1++){
+		dst[var1] = gf2_matrix_times(a, b[var1]);
+	}
+}
+
+/*----------------- crc32c_shift_op() -------------------
+
+	@brief : Build the operator that moves a CRC32C over len zero 
+			 bytes - the matrix for one zero byte raised to the 
+			 power len by squaring
+	
+	@param : op - 32 word matrix, filled
+			 len - bytes
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void crc32c_shift_op(uint32_t *op, long len){
+	uint32_t base[32], tmp[32];
+	int var1;
+	base[0] = CRC32C_POLY;								// one zero bit
+	for(var1 = 1; var1 < 32; var1++){
+		base[var1] = (uint32_t)1 << (var1 - 1);
+	}
+	for(var1 = 0; var1 < 3; var1++){					// squared three times - one zero byte
+		gf2_matrix_mul(tmp, base, base);
+		memcpy(base, tmp, sizeof(base));
+	}
+	for(var1 = 0; var1 < 32; var1++){
+		op[var1] = (uint32_t)1 << var1;
+	}
+	while(len > 0){
+		if(len & 1){
+			gf2_matrix_mul(tmp, base, op);
+			memcpy(op, tmp, sizeof(tmp));
+		}
+		len >>= 1;
+		if(len > 0){
+			gf2_matrix_mul(tmp, base, base);
+			memcpy(base, tmp, sizeof(base));
+		}
+	}
+}
+
+/*----------------- crc32c_combine() -------------------
+
+	@brief : CRC32C of A followed by B from the CRCs of A and B
+	
+	@param : crc1 - CRC of A
+			 crc2 - CRC of B
+			 len2 - length of B
+			 op - crc32c_shift_op() of len2, NULL to build it here
+	
+	@return : CRC of A followed by B
+
+-----------------------------------------------------------*/
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, long len2, uint32_t *op){
+	uint32_t tmp_op[32];
+	if(op == NULL){
+		crc32c_shift_op(tmp_op, len2);
+		op = tmp_op;
+	}
+	return gf2_matrix_times(op, crc1) ^ crc2;
+}
+
+/*----------------- fnv1a_update() -------------------
+
+	@brief : Add a buffer to an FNV-1a hash - the strong checksum of 
+			 a pd block, the resume check and the check of the rebuilt file
+	
+	@param : hash - running hash, starts at the FNV offset basis
+			 buf - data
+			 len - data length
+	
+	@return : updated hash
+
+-----------------------------------------------------------*/
+
+uint64_t fnv1a_update(uint64_t hash, char *buf, long len){
+	long var1;
+	for(var1 = 0; var1 < len; var1++){
+		hash ^= (unsigned char)buf[var1];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+/*----------------- hash_file_range() -------------------
+
+	@brief : FNV-1a hash of a byte range of a file, to check that 
+			 both ends hold the same data before resuming
+	
+	@param : fd - file descriptor
+			 offset - start of the range
+			 len - length of the range
+			 hash - hash of the range
+	
+	@return : false if the range could not be read in full
+
+-----------------------------------------------------------*/
+
+bool hash_file_range(int fd, off_t offset, off_t len, uint64_t *hash){
+	char buf[16*1024];
+	ssize_t read_len;
+	*hash = FNV_OFFSET_BASIS;
+	while(len > 0){
+		read_len = pread(fd, buf, (len < (off_t)sizeof(buf)) ? (size_t)len : sizeof(buf), offset);
+		if(read_len <= 0){return false;}
+		*hash = fnv1a_update(*hash, buf, (long)read_len);
+		offset += read_len;
+		len -= read_len;
+	}
+	return true;
+}
+
+/*----------------- crc_file_range() -------------------
+
+	@brief : CRC32C of a range of a file
+	
+	@param : fd - file
+			 offset - start of the range
+			 len - length of the range
+			 crc - CRC of the range
+	
+	@return : false if the range could not be read in full
+
+-----------------------------------------------------------*/
+
+bool crc_file_range(int fd, off_t offset, off_t len, uint32_t *crc){
+	char buf[64*1024];
+	ssize_t read_len;
+	*crc = 0;
+	while(len > 0){
+		read_len = pread(fd, buf, (len < (off_t)sizeof(buf)) ? (size_t)len : sizeof(buf), offset);
+		if(read_len <= 0){return false;}
+		*crc = crc32c(*crc, buf, read_len);
+		offset += read_len;
+		len -= read_len;
+	}
+	return true;
+}
+
+/*----------------- hash_resume_tail() -------------------
+
+	@brief : Hash the RESUME_TAIL_SIZE bytes of a partial file 
+			 before the resume offset
+	
+	@param : filename - ptr to file name buffer
+			 offset - resume offset
+			 hash - hash of the tail
+	
+	@return : false if the file or the tail could not be read
+
+-----------------------------------------------------------*/
+
+bool hash_resume_tail(char *filename, off_t offset, uint64_t *hash){
+	off_t len;
+	int fd;
+	bool ret;
+	fd = open(filename, O_RDONLY);
+	if(fd < 0){return false;}
+	len = (offset < RESUME_TAIL_SIZE) ? offset : RESUME_TAIL_SIZE;
+	ret = hash_file_range(fd, offset - len, len, hash);
+	close(fd);
+	return ret;
+}
+
+/*----------------- state_dir_open() -------------------
+
+	@brief : Create and open STATE_DIR, the directory of the get 
+			 journals, so a journal never takes the name of a file 
+			 of the current directory. A link in its place is not 
+			 followed.
+	
+	@param : none
+	
+	@return : directory descriptor, -1 if it cannot be used
+
+-----------------------------------------------------------*/
+
+int state_dir_open(void){
+	if((mkdir(STATE_DIR, 0700) < 0) && (errno != EEXIST)){return -1;}
+	return open(STATE_DIR, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+}
+
+/*----------------- journal_read() -------------------
+
+	@brief : Read the journal of a partial file (in STATE_DIR) - its 
+			 full size and the bytes from its start known to be 
+			 written
+	
+	@param : filename - ptr to file name buffer
+			 size - size of the complete file
+			 done - completed range, from offset 0
+	
+	@return : false if there is no journal
+
+-----------------------------------------------------------*/
+
+bool journal_read(char *filename, off_t *size, off_t *done){
+	char name[FILENAME_BUFSIZE + sizeof(JOURNAL_SUFFIX)];
+	long long var1, var2;
+	FILE *fp;
+	bool ret;
+	int fd;
+	snprintf(name, sizeof(name), "%s%s", filename, JOURNAL_SUFFIX);
+	fd = openat(state_dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if(fd < 0){return false;}
+	fp = fdopen(fd, "r");
+	if(fp == NULL){
+		close(fd);
+		return false;
+	}
+	ret = (fscanf(fp, "%lld %lld", &var1, &var2) == 2) && (var2 >= 0);
+	fclose(fp);
+	*size = (off_t)var1;
+	*done = (off_t)var2;
+	return ret;
+}
+
+/*----------------- journal_open() -------------------
+
+	@brief : Create the journal of a file being received in 
+			 STATE_DIR
+	
+	@param : filename - ptr to file name buffer
+	
+	@return : journal descriptor, -1 on failure
+
+-----------------------------------------------------------*/
+
+int journal_open(char *filename){
+	char name[FILENAME_BUFSIZE + sizeof(JOURNAL_SUFFIX)];
+	snprintf(name, sizeof(name), "%s%s", filename, JOURNAL_SUFFIX);
+	return openat(state_dir_fd, name, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+}
+
+/*----------------- journal_write() -------------------
+
+	@brief : Record the completed range of a file being received. 
+			 The record has a fixed width and is rewritten in place.
+	
+	@param : fd - journal descriptor
+			 size - size of the complete file
+			 done - completed range, from offset 0
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void journal_write(int fd, off_t size, off_t done){
+	char record[64];
+	int len;
+	len = snprintf(record, sizeof(record), "%20lld %20lld\n", (long long)size, (long long)done);
+	if(pwrite(fd, record, len, 0) != len){log_error("\nJournal write failed");}
+}
+
+/*----------------- journal_remove() -------------------
+
+	@brief : Delete the sidecar journal of a complete file
+	
+	@param : filename - ptr to file name buffer
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void journal_remove(char *filename){
+	char name[FILENAME_BUFSIZE + sizeof(JOURNAL_SUFFIX)];
+	snprintf(name, sizeof(name), "%s%s", filename, JOURNAL_SUFFIX);
+	unlinkat(state_dir_fd, name, 0);
+}
+
+/*----------------- calculate_power() -------------------
+
+	@brief : calculate base number multiplied by power of 10 
+	
+	@param : base - char to be multiplied by power of 10
+			 power - power of 10
+	
+	@return : base number
+
+-----------------------------------------------------------*/
+
+int calculate_power(char base, int power){
+    int var1, var2;
+    var1 = 10;
+    var2 = 1;
+    while(power>0){
+        var2 *= var1;
+        power--;
+    }
+    return ((var2)*((int)(base - '0')));
+}
+
+/*----------------- int_to_str() ----------------------------
+
+	@brief : Convert integer (int) to a char string (6 bytes)
+	
+	@param : ptr - ptr to string buffer
+			 num - number to be converted to string
+	
+	@return : length of char string
+
+-----------------------------------------------------------*/
+
+int int_to_str(int num, char *ptr){
+    
+    int len,p,d;
+    char swap;
+    len = 0;
+    p = 0;
+    if(num == 0){
+        *(ptr + len) = (char)((num%10) + '0');
+        len++;
+    }
+    while(num>0){
+        *(ptr + len) = (char)((num%10) + '0');
+        num /= 10;
+        len++;
+    }
+    for(p=0;p<(len/2);p++){
+        swap = *(ptr + p);
+        *(ptr + p) = *(ptr + len - 1 - p);
+        *(ptr + len - 1 - p) = swap;
+    }
+    d = 6 - len;
+    if(len < 6){
+        for(p=len-1;p>=0;p--){
+            *(ptr + p + d) = *(ptr + p);
+        }
+        for(p=0;p<d;p++){
+            *(ptr + p) = '*';
+        }
+        //ptr += 6;
+        return 6;
+    }
+    else{return len;}
+}
+
+/*----------------- create_bin_header() -------------------
+
+	@brief : Writes the negotiated binary header - magic, version, 
+			 packet type, command type, flags, data length and 32 
+			 bit sequence number, plus the session ID from v2 on, 
+			 all multi-byte fields in network byte order. With CRCs 
+			 negotiated the header gets HDR_FLAG_CRC and a zero CRC 
+			 field, filled by set_packet_crc().
+	
+	@param : pkt_type, cmd_type, pkt_ptr, seq_no - as create_packet()
+			 data_len - length of the data that follows the header
+			 flags - HDR_FLAG_COMPRESSED
+	
+	@return : header length
+
+-----------------------------------------------------------*/
+
+int create_bin_header(char pkt_type, char cmd_type, char *pkt_ptr, long seq_no, int data_len, int flags){
+	uint16_t var16;
+	uint32_t var32;
+	int hdr_len;
+	if(crc_enable){flags |= HDR_FLAG_CRC;}
+	*(pkt_ptr + 0) = (char)HDR_MAGIC;
+	*(pkt_ptr + 1) = (char)hdr_mode;
+	*(pkt_ptr + 2) = pkt_type;
+	*(pkt_ptr + 3) = cmd_type;
+	var16 = htons((uint16_t)flags);
+	memcpy(pkt_ptr + 4, &var16, 2);
+	var16 = htons((uint16_t)data_len);
+	memcpy(pkt_ptr + 6, &var16, 2);
+	var32 = htonl((uint32_t)seq_no);
+	memcpy(pkt_ptr + 8, &var32, 4);
+	hdr_len = BIN_HDR_V1_SIZE;
+	if(hdr_mode >= 2){
+		var32 = htonl(session_id);
+		memcpy(pkt_ptr + 12, &var32, 4);
+		hdr_len = BIN_HDR_SIZE;
+	}
+	if(flags & HDR_FLAG_CRC){
+		bzero(pkt_ptr + hdr_len, CRC_SIZE);
+		hdr_len += CRC_SIZE;
+	}
+	return hdr_len;
+}
+
+/*----------------- set_packet_crc() -------------------
+
+	@brief : Fill the CRC field of a header from create_bin_header() 
+			 - the CRC of the data, continued over the header with 
+			 the field still zero
+	
+	@param : hdr_ptr - ptr to header
+			 hdr_len - header length, CRC field included
+			 data_crc - CRC32C of the packet data
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void set_packet_crc(char *hdr_ptr, int hdr_len, uint32_t data_crc){
+	uint32_t var32;
+	var32 = htonl(crc32c(data_crc, hdr_ptr, hdr_len));
+	memcpy(hdr_ptr + hdr_len - CRC_SIZE, &var32, CRC_SIZE);
+}
+
+/*----------------- create_bin_packet() -------------------
+
+	@brief : Creates packet with the negotiated binary header, the 
+			 data is copied and its CRC taken in one pass
+	
+	@param : same as create_packet()
+	
+	@return : packet length
+
+-----------------------------------------------------------*/
+
+int create_bin_packet(char pkt_type, char cmd_type, char *pkt_ptr, long seq_no, char *data_ptr,int data_len){
+	int hdr_len;
+	hdr_len = create_bin_header(pkt_type, cmd_type, pkt_ptr, seq_no, data_len, 0);
+	if(crc_enable){
+		set_packet_crc(pkt_ptr, hdr_len, crc32c_copy(0, pkt_ptr + hdr_len, data_ptr, data_len));
+	}
+	else{
+		memcpy(pkt_ptr + hdr_len, data_ptr, data_len);
+	}
+	return (hdr_len + data_len);
+}
+
+/*----------------- create_data_header() -------------------
+
+	@brief : Writes only the header of a data packet (D) in the 
+			 current header mode, for packets whose data is sent 
+			 from a separate iovec
+	
+	@param : hdr_ptr - ptr to header buffer
+			 seq_no - packet sequence number
+			 data_len - length of packet data
+			 flags - HDR_FLAG_COMPRESSED, binary header only
+			 data_crc - CRC32C of the packet data, if CRCs were 
+						negotiated
+	
+	@return : header length
+
+-----------------------------------------------------------*/
+
+int create_data_header(char *hdr_ptr, long seq_no, int data_len, int flags, uint32_t data_crc){
+	int len;
+	if(hdr_mode != HDR_MODE_ASCII){
+		len = create_bin_header('D', '0', hdr_ptr, seq_no, data_len, flags);
+		if(crc_enable){set_packet_crc(hdr_ptr, len, data_crc);}
+		return len;
+	}
+	*hdr_ptr = 'D';
+	len = 1;
+	len += int_to_str((int)seq_no, hdr_ptr + len);
+	len += int_to_str(data_len, hdr_ptr + len);
+	return len;
+}
+
+/*----------------- put_seq_field() -------------------
+
+	@brief : Write a sequence number into a packet data field in 
+			 the current header mode (4 byte binary / 6 char ASCII)
+	
+	@param : ptr - ptr to data field
+			 seq_no - sequence number
+	
+	@return : length of the field
+
+-----------------------------------------------------------*/
+
+int put_seq_field(char *ptr, long seq_no){
+	uint32_t var32;
+	if(hdr_mode != HDR_MODE_ASCII){
+		var32 = htonl((uint32_t)seq_no);
+		memcpy(ptr, &var32, 4);
+		return 4;
+	}
+	return int_to_str((int)seq_no, ptr);
+}
+
+/*------------------ create_packet()------------------------
+
+    @brief : Creates packet of specified type - 
+			 D - Data Packet type
+             C - Command packet type
+             A - Acknowledgement packet type
+             F - File Size packet type 
+             K - File Size Acknowledgement packet type 
+			 The binary header is used once negotiated with the 
+			 server (hdr_mode), the ASCII header otherwise.
+			 
+    @param  : 1. pkt_type - type of packet (D,C,A,F,K)
+			  2. cmd_type - type of command
+			  3. pkt_ptr  - ptr to packet buffer
+			  4. seq_no   - packet sequence number
+			  5. data_ptr - ptr to packet data buffer
+			  6. data_len - length of packet data
+			  
+    @return : packet length
+----------------------------------------------------------*/
+
+/*--------------------------------------------------------*/
+int create_packet(char pkt_type, char cmd_type, char *pkt_ptr, long seq_no, char *data_ptr,int data_len){
+    
+    char *pkt_temp_ptr;
+    pkt_temp_ptr = pkt_ptr;
+    int pkt_len;
+    int temp_var1;
+    
+    if((data_ptr != NULL) && (hdr_mode != HDR_MODE_ASCII)){
+        pkt_len = create_bin_packet(pkt_type, cmd_type, pkt_ptr, seq_no, data_ptr, data_len);
+    }
+    else if(data_ptr != NULL){
+        switch(pkt_type){
+            
+            /*-------------------- Data packet type -------------------*/
+            case 'D':
+               *pkt_ptr++ = 'D';
+               temp_var1 = int_to_str(seq_no,pkt_ptr);
+               pkt_ptr += temp_var1;
+               temp_var1 = int_to_str(data_len,pkt_ptr);
+               pkt_ptr += temp_var1;
+               for(temp_var1=0;temp_var1<data_len;temp_var1++){
+                   *pkt_ptr++ = *(data_ptr + temp_var1);
+               }
+               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
+            break;
+            /*-------------------- Command packet type -------------------*/
+            case 'C':
+                *pkt_ptr++ = 'C';
+               temp_var1 = int_to_str(seq_no,pkt_ptr);
+               pkt_ptr += temp_var1;
+               temp_var1 = int_to_str(data_len,pkt_ptr);
+               pkt_ptr += temp_var1;
+			   *pkt_ptr++ = cmd_type;
+               for(temp_var1=0;temp_var1<data_len;temp_var1++){
+                   *pkt_ptr++ = *(data_ptr + temp_var1);
+               }
+               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
+                
             
             break;
             /*-------------------- Acknowledgement packet type -------------------*/
@@ -393,175 +2154,2582 @@ int create_packet(char pkt_type, char cmd_type, char *pkt_ptr, int seq_no, char
         }
     }
     else{
-        printf("\nInvalid data ptr\n");
+        log_error("\nInvalid data ptr\n");
     }
     return pkt_len;
 }
 
-/*----------- estimate_data_packet_count() -------------------
+/*----------- estimate_data_packet_count() -------------------
+
+	@brief : Estimate the number of data packets and open the get 
+			 file. The file info is "size", or "size offset" if the 
+			 server accepted an rg - the partial file is then kept 
+			 and the transfer starts at the packet of the offset. 
+			 With CRCs the server adds the file digest, "size offset 
+			 digest", and the digest of the kept part is read in. 
+			 The journal of the file is (re)started.
+	
+	@param : pkt_ptr - ptr to packet buffer
+			 data_len - data length of char string
+	
+	@return : total packet count
+
+-----------------------------------------------------------*/
+
+int estimate_data_packet_count(char *str_ptr, int data_len){
+	int loop_var1,filename_len;
+	off_t filesize, offset;
+	char temp_buf[50], *end_ptr, *digest_ptr;
+	if(data_len >= sizeof(temp_buf)){data_len = sizeof(temp_buf) - 1;}
+	for(loop_var1 = 0; loop_var1 < data_len; loop_var1++){
+		temp_buf[loop_var1] = *(str_ptr + loop_var1);
+	}
+	temp_buf[data_len] = '\0';
+	filesize = (off_t)strtoll(temp_buf, &end_ptr, 10);
+	offset = (off_t)strtoll(end_ptr, &digest_ptr, 10);		// 0 if the server sent the size only
+	get_file_digest = (uint32_t)strtoul(digest_ptr, &end_ptr, 16);
+	get_digest_valid = crc_enable && (end_ptr != digest_ptr);
+	get_file_crc = 0;
+	if((offset != get_resume_offset) || (offset > filesize) || ((offset % data_size) != 0)){offset = 0;}
+	filename_len = (int)(strlen(filename_buf));
+	log_debug("\nfilename : %s",filename_buf);
+	filename_buf[filename_len] = '\0'; 
+	client_get_file = (offset > 0) ? fopen(filename_buf,"r+b") : NULL;
+	if(client_get_file == NULL){
+		offset = 0;
+		client_get_file = fopen(filename_buf,"wb");
+	}
+	if(client_get_file == NULL){
+		log_error("\nfile could not be created\n");
+	}
+	else{
+		if(get_digest_valid && (offset > 0) && !crc_file_range(fileno(client_get_file), 0, offset, &get_file_crc)){
+			get_digest_valid = false;
+		}
+		data_byte_max_count = filesize;
+		recv_data_ack_arr_index = (int)(offset / data_size);
+		bzero(recv_data_ack_arr,sizeof(recv_data_ack_arr));
+		if(offset > 0){log_info("\nResuming at %lld of %lld bytes", (long long)offset, (long long)filesize);}
+		else if(get_resume_offset > 0){log_info("\nPartial file differs from the server, getting the whole file");}
+		get_journal_fd = journal_open(filename_buf);
+		get_journal_done = offset;
+		if(get_journal_fd >= 0){journal_write(get_journal_fd, filesize, offset);}
+	}
+	log_debug("\nfilesize : %lld bytes",(long long)filesize);
+	return (int)((filesize/data_size) + 1);
+}
+
+/*----------------- str_to_int() ------------------------------
+
+	@brief : Converts given string of 6 bytes to int datatype
+	
+	@param : str - ptr to string buffer
+	
+	@return : number (int)
+
+-----------------------------------------------------------*/
+
+int str_to_int(char *str){
+	int var1,var2,var3;
+	char temp_buf[6];
+	var2 = 0;
+	for(var1 = 5; var1 >= 0;var1--){
+		if(*(str + var1) != '*'){
+			var3 = calculate_power(*(str + var1),5-var1);
+			var2 += var3;
+		}
+	}
+	return var2;
+}
+
+/*----------------- get_seq_field() -------------------
+
+	@brief : Read a sequence number from a packet data field
+	
+	@param : ptr - ptr to data field
+			 binary - field written in binary header mode
+	
+	@return : sequence number
+
+-----------------------------------------------------------*/
+
+long get_seq_field(char *ptr, bool binary){
+	uint32_t var32;
+	if(binary){
+		memcpy(&var32, ptr, 4);
+		return (long)ntohl(var32);
+	}
+	return str_to_int(ptr);
+}
+
+/*----------------- check_packet_crc() -------------------
+
+	@brief : Check the CRC32C of a packet with HDR_FLAG_CRC. It 
+			 covers the data, then the header with the CRC field as 
+			 zero, so the CRC of the data alone falls out on the way 
+			 for the file digest.
+	
+	@param : pkt_ptr - ptr to packet buffer
+			 info - decoded header fields, data_crc is set
+	
+	@return : false if the CRC does not match
+
+-----------------------------------------------------------*/
+
+bool check_packet_crc(char *pkt_ptr, struct packet_info *info){
+	char hdr_buf[BIN_HDR_SIZE + CRC_SIZE];
+	uint32_t var32;
+	int hdr_len;
+	hdr_len = (int)(info->data_ptr - pkt_ptr);
+	memcpy(hdr_buf, pkt_ptr, hdr_len);
+	memcpy(&var32, hdr_buf + hdr_len - CRC_SIZE, CRC_SIZE);
+	bzero(hdr_buf + hdr_len - CRC_SIZE, CRC_SIZE);
+	info->data_crc = crc32c(0, info->data_ptr, info->data_len);
+	if(crc32c(info->data_crc, hdr_buf, hdr_len) == ntohl(var32)){return true;}
+	log_debug("\nCRC mismatch, packet %c %ld dropped", info->type, info->seq_no);
+	return false;
+}
+
+/*----------------- parse_packet() -------------------
+
+	@brief : Decode the header of a received packet. Binary headers 
+			 are recognised by HDR_MAGIC in byte 0, anything else is 
+			 treated as the ASCII header. A binary header with 
+			 HDR_FLAG_CRC is followed by the CRC of the packet.
+	
+	@param : pkt_ptr - ptr to packet buffer
+			 pkt_len - length of received packet
+			 info - decoded header fields
+	
+	@return : false if the packet is malformed or corrupt
+
+-----------------------------------------------------------*/
+
+bool parse_packet(char *pkt_ptr, int pkt_len, struct packet_info *info){
+	uint16_t var16;
+	uint32_t var32;
+	info->data_crc = 0;
+	if((unsigned char)*pkt_ptr == HDR_MAGIC){
+		if((pkt_len < BIN_HDR_V1_SIZE) || (*(pkt_ptr + 1) < 1) || (*(pkt_ptr + 1) > HDR_VERSION)){return false;}
+		info->binary = true;
+		info->type = *(pkt_ptr + 2);
+		info->cmd = *(pkt_ptr + 3);
+		memcpy(&var16, pkt_ptr + 4, 2);
+		info->flags = ntohs(var16);
+		memcpy(&var16, pkt_ptr + 6, 2);
+		info->data_len = ntohs(var16);
+		memcpy(&var32, pkt_ptr + 8, 4);
+		info->seq_no = (long)ntohl(var32);
+		info->data_ptr = pkt_ptr + ((*(pkt_ptr + 1) >= 2) ? BIN_HDR_SIZE : BIN_HDR_V1_SIZE);
+		if(info->flags & HDR_FLAG_CRC){info->data_ptr += CRC_SIZE;}
+		if(info->data_ptr > (pkt_ptr + pkt_len)){return false;}
+	}
+	else{
+		if(pkt_len < ASCII_HDR_SIZE){return false;}
+		info->binary = false;
+		info->type = *pkt_ptr;
+		info->flags = 0;
+		info->seq_no = str_to_int(pkt_ptr + 1);
+		info->data_len = str_to_int(pkt_ptr + 7);
+		info->data_ptr = pkt_ptr + ASCII_HDR_SIZE;
+		info->cmd = '0';
+		if(ASCII_HAS_CMD(info->type)){
+			info->cmd = *(pkt_ptr + ASCII_HDR_SIZE);
+			info->data_ptr++;
+		}
+	}
+	if((info->data_ptr + info->data_len) > (pkt_ptr + pkt_len)){return false;}
+	if(info->flags & HDR_FLAG_CRC){return check_packet_crc(pkt_ptr, info);}
+	return true;
+}
+
+/*----------------- wait_for_packet() ----------------------
+
+	@brief : Wait for a packet from server for at most timeout msec
+	
+	@param : buf - ptr to receive buffer
+			 buf_len - size of receive buffer
+			 timeout - wait time in msec
+	
+	@return : received packet size, 0 on timeout
+
+-----------------------------------------------------------*/
+
+int wait_for_packet(char *buf, int buf_len, int timeout){
+	struct pollfd pfd = {sockfd, POLLIN, 0};
+	if(poll(&pfd,1,timeout) <= 0){return 0;}
+	return recvfrom(sockfd, buf, buf_len, 0, (struct sockaddr *)&serveraddr, &serverlen);
+}
+
+/*----------------- next_cmd_seq_no() ----------------------
+
+	@brief : Number a new command. The server answers a command 
+			 that repeats the sequence number of the last one with 
+			 its saved reply instead of running it again.
+	
+	@param : none
+	
+	@return : command sequence number, never 0
+
+-----------------------------------------------------------*/
+
+int next_cmd_seq_no(void){
+	cmd_seq_no = (cmd_seq_no % CMD_SEQ_MAX) + 1;
+	return cmd_seq_no;
+}
+
+/*----------------- send_request() ----------------------
+
+	@brief : Send the control packet in client_send_buf and wait for 
+			 its reply. The packet is retransmitted every RTO, with 
+			 the RTO doubled each time, until a reply of the expected 
+			 type arrives. Anything else (late data packets, duplicate 
+			 replies of earlier requests) is dropped. The RTT is only 
+			 sampled when the first send was answered (Karn's rule). 
+			 A server that no longer knows the session answers 'N' - 
+			 the session is renewed once and the request is rebuilt 
+			 with the new session ID and sent again.
+	
+	@param : pkt_len - length of the request
+			 reply_type - packet type of the reply
+			 reply_cmd - command of the reply, 0 for any
+			 max_tries - sends before giving up
+	
+	@return : length of the reply in client_recv_buf, -1 if none came
+
+-----------------------------------------------------------*/
+
+int send_request(int pkt_len, char reply_type, char reply_cmd, int max_tries){
+	static char request_buf[BUFSIZE];
+	struct packet_info info, request_info;
+	long unsigned int send_time;
+	int tries, recv_len, timeout;
+	bool renewed, resend;
+	renewed = false;
+	resend = false;
+	for(tries = 0; tries < max_tries; tries++){
+		if(sendto(sockfd, client_send_buf, pkt_len, 0, (struct sockaddr *)&serveraddr, serverlen) < 0){error("ERROR in sendto");}
+		send_time = get_time_msec();
+		if(tries > 0){log_debug("\nNo reply, request retransmitted (RTO %ld msec)", rtt.rto);}
+		while((timeout = (int)(rtt.rto - (long)time_diff(send_time))) > 0){
+			recv_len = wait_for_packet(client_recv_buf,BUFSIZE,timeout);
+			if(recv_len <= 0){break;}
+			if(parse_packet(client_recv_buf,recv_len,&info) && (info.type == reply_type) && 
+			   ((reply_cmd == 0) || (info.cmd == reply_cmd))){
+				if(tries == 0){rto_update(&rtt, (long)time_diff(send_time));}
+				return recv_len;
+			}
+			if(!renewed && (info.type == 'N') && (hdr_mode >= 2)){
+				memcpy(request_buf, client_send_buf, pkt_len);
+				if(parse_packet(request_buf,pkt_len,&request_info) && (info.seq_no == request_info.seq_no)){
+					log_info("\nSession %u expired at the server, connecting again\n", session_id);
+					renew_session();
+					bzero(client_send_buf,BUFSIZE);
+					pkt_len = create_packet(request_info.type,request_info.cmd,client_send_buf,request_info.seq_no,
+											request_info.data_ptr,request_info.data_len);
+					renewed = true;
+					resend = true;
+					break;
+				}
+			}
+			log_trace("\nUnexpected packet dropped while waiting for reply");
+		}
+		if(resend){
+			resend = false;
+			tries = -1;
+			continue;
+		}
+		rto_backoff(&rtt);
+	}
+	return -1;
+}
+
+/*----------------- send_gso_segments() ----------------------
+
+	@brief : Send the datagrams of a UDP_SEGMENT message one by one, 
+			 after the kernel or the device refused to segment it
+	
+	@param : msg - queued message
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_gso_segments(struct msghdr *msg){
+	struct msghdr seg_msg;
+	int var1;
+	seg_msg = *msg;
+	seg_msg.msg_control = NULL;
+	seg_msg.msg_controllen = 0;
+	seg_msg.msg_iovlen = 2;
+	for(var1 = 0; var1 < (int)msg->msg_iovlen; var1 += 2){
+		seg_msg.msg_iov = msg->msg_iov + var1;
+		if (sendmsg(sockfd, &seg_msg, 0) < 0){error("ERROR in sendmsg");}
+	}
+}
+
+/*----------------- flush_send_batch() ----------------------
+
+	@brief : Send all queued datagrams with as few sendmmsg() calls 
+			 as the kernel allows. A UDP_SEGMENT message the kernel 
+			 cannot segment is sent one datagram at a time and GSO 
+			 is turned off.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void flush_send_batch(void){
+	int var1,var2;
+	var1 = 0;
+	while(var1 < send_batch_count){
+		var2 = sendmmsg(sockfd, &send_batch_msg[var1], send_batch_count - var1, 0);
+		if (var2 < 0){
+			if((send_batch_msg[var1].msg_hdr.msg_controllen == 0) || 
+			   ((errno != EIO) && (errno != EINVAL) && (errno != EOPNOTSUPP))){error("ERROR in sendmmsg");}
+			if(udp_gso_enable){
+				log_info("\nUDP GSO send failed (%s), sending datagrams one by one\n", strerror(errno));
+				udp_gso_enable = false;
+			}
+			send_gso_segments(&send_batch_msg[var1].msg_hdr);
+			var2 = 1;
+		}
+		var1 += var2;
+	}
+	send_batch_count = 0;
+	send_batch_dgram_count = 0;
+	send_batch_flush_count++;
+}
+
+/*----------------- gso_append() ----------------------
+
+	@brief : Check if a datagram can go out as the next segment of 
+			 the last queued message. Segments of one UDP_SEGMENT 
+			 send have the same size, only the last may be shorter.
+	
+	@param : len - datagram length
+	
+	@return : true if the datagram can be appended
+
+-----------------------------------------------------------*/
+
+bool gso_append(int len){
+	int var1;
+	if(!udp_gso_enable || (send_batch_count == 0)){return false;}
+	var1 = send_batch_count - 1;
+	return ((send_batch_seg_size[var1] == len) && 
+			(send_batch_byte_count[var1] == (send_batch_seg_size[var1] * send_batch_seg_count[var1])) && 
+			(send_batch_seg_count[var1] < GSO_MAX_SEGMENTS) && 
+			((send_batch_byte_count[var1] + len) <= GSO_MAX_BYTES));
+}
+
+/*----------------- queue_datagram() ----------------------
+
+	@brief : Queue a datagram to the server for the next 
+			 flush_send_batch(). The header is copied, the data is 
+			 sent by reference and must stay valid until the flush. 
+			 With GSO, data packets of the same size are joined into 
+			 one UDP_SEGMENT message of up to 64 KB.
+	
+	@param : hdr_ptr - ptr to header (or whole small packet)
+			 hdr_len - header length, at most SEND_BATCH_HDR_SIZE
+			 data_ptr - ptr to data, NULL if none
+			 data_len - length of data
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void queue_datagram(char *hdr_ptr, int hdr_len, char *data_ptr, int data_len){
+	struct msghdr *msg;
+	struct cmsghdr *cmsg;
+	int var1;
+	if(send_batch_dgram_count == SEND_BATCH_SIZE){flush_send_batch();}
+	var1 = send_batch_dgram_count++;
+	memcpy(send_batch_hdr_buf[var1], hdr_ptr, hdr_len);
+	send_batch_iov[var1][0].iov_base = send_batch_hdr_buf[var1];
+	send_batch_iov[var1][0].iov_len = hdr_len;
+	send_batch_iov[var1][1].iov_base = data_ptr;
+	send_batch_iov[var1][1].iov_len = data_len;
+	if((data_len > 0) && gso_append(hdr_len + data_len)){
+		/* iovecs of consecutive datagrams are adjacent, the message just grows */
+		msg = &send_batch_msg[send_batch_count - 1].msg_hdr;
+		msg->msg_iovlen += 2;
+		send_batch_seg_count[send_batch_count - 1]++;
+		send_batch_byte_count[send_batch_count - 1] += hdr_len + data_len;
+		if(msg->msg_control == NULL){
+			msg->msg_control = send_batch_ctrl_buf[send_batch_count - 1];
+			msg->msg_controllen = sizeof(send_batch_ctrl_buf[0]);
+			cmsg = CMSG_FIRSTHDR(msg);
+			cmsg->cmsg_level = SOL_UDP;
+			cmsg->cmsg_type = UDP_SEGMENT;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			*(uint16_t *)CMSG_DATA(cmsg) = (uint16_t)(hdr_len + data_len);
+		}
+		return;
+	}
+	send_batch_seg_size[send_batch_count] = (data_len > 0) ? (hdr_len + data_len) : 0;
+	send_batch_seg_count[send_batch_count] = 1;
+	send_batch_byte_count[send_batch_count] = hdr_len + data_len;
+	msg = &send_batch_msg[send_batch_count].msg_hdr;
+	bzero(msg,sizeof(*msg));
+	msg->msg_name = &serveraddr;
+	msg->msg_namelen = serverlen;
+	msg->msg_iov = send_batch_iov[var1];
+	msg->msg_iovlen = (data_len > 0) ? 2 : 1;
+	send_batch_count++;
+}
+
+/*----------------- recv_datagram_batch() ----------------------
+
+	@brief : Receive up to RECV_BATCH_SIZE messages with one 
+			 recvmmsg() into the receive batch buffers. While UDP_GRO 
+			 is on a message may hold several datagrams coalesced by 
+			 the kernel, they are split again at the segment size it 
+			 reports. The datagrams are listed in recv_seg_ptr_arr / 
+			 recv_seg_len_arr.
+	
+	@param : timeout - wait time in msec for the first datagram, 
+					   -1 to block
+	
+	@return : number of datagrams received, 0 on timeout, -1 on error
+
+-----------------------------------------------------------*/
+
+int recv_datagram_batch(int timeout){
+	struct cmsghdr *cmsg;
+	int var1, var2, recv_count, seg_count, seg_size, msg_len;
+	struct pollfd pfd = {sockfd, POLLIN, 0};
+	if((timeout >= 0) && (poll(&pfd,1,timeout) <= 0)){return 0;}
+	for(var1 = 0; var1 < RECV_BATCH_SIZE; var1++){
+		if(udp_gro_active){
+			recv_batch_iov[var1].iov_base = recv_gro_buf + ((long)var1 * GRO_BUFSIZE);
+			recv_batch_iov[var1].iov_len = GRO_BUFSIZE;
+		}
+		else{
+			recv_batch_iov[var1].iov_base = recv_batch_buf[var1];
+			recv_batch_iov[var1].iov_len = DATA_PACKET_RECV_BUFSIZE;
+		}
+		bzero(&recv_batch_msg[var1].msg_hdr,sizeof(struct msghdr));
+		recv_batch_msg[var1].msg_hdr.msg_iov = &recv_batch_iov[var1];
+		recv_batch_msg[var1].msg_hdr.msg_iovlen = 1;
+		recv_batch_msg[var1].msg_hdr.msg_control = recv_batch_ctrl_buf[var1];
+		recv_batch_msg[var1].msg_hdr.msg_controllen = sizeof(recv_batch_ctrl_buf[0]);
+	}
+	recv_count = recvmmsg(sockfd, recv_batch_msg, RECV_BATCH_SIZE, MSG_WAITFORONE, NULL);
+	seg_count = 0;
+	for(var1 = 0; var1 < recv_count; var1++){
+		msg_len = (int)recv_batch_msg[var1].msg_len;
+		seg_size = msg_len;
+		for(cmsg = CMSG_FIRSTHDR(&recv_batch_msg[var1].msg_hdr); cmsg != NULL; 
+			cmsg = CMSG_NXTHDR(&recv_batch_msg[var1].msg_hdr, cmsg)){
+			if((cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO)){
+				memcpy(&seg_size, CMSG_DATA(cmsg), sizeof(int));
+			}
+		}
+		if(seg_size <= 0){seg_size = msg_len;}
+		var2 = 0;
+		do{
+			if(seg_count == RECV_SEG_MAX){break;}
+			recv_seg_ptr_arr[seg_count] = (char *)recv_batch_iov[var1].iov_base + var2;
+			recv_seg_len_arr[seg_count] = ((msg_len - var2) < seg_size) ? (msg_len - var2) : seg_size;
+			seg_count++;
+			var2 += seg_size;
+		}while(var2 < msg_len);
+	}
+	return (recv_count < 0) ? recv_count : seg_count;
+}
+
+/*----------------- set_udp_gro() ----------------------
+
+	@brief : Turn UDP_GRO on the socket on or off. It is only on 
+			 while a get receives data, every other receive reads 
+			 single datagrams into packet sized buffers.
+	
+	@param : enable - true to coalesce received datagrams
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void set_udp_gro(bool enable){
+	int sockopt_val;
+	if(!udp_gro_enable || (udp_gro_active == enable)){return;}
+	sockopt_val = enable ? 1 : 0;
+	if(setsockopt(sockfd, SOL_UDP, UDP_GRO, (const void *)&sockopt_val, sizeof(int)) == 0){
+		udp_gro_active = enable;
+	}
+}
+
+/*----------------- create_sack_data() -------------------
+
+	@brief : Fill data ACK payload - cumulative ACK (next in-order 
+			 packet expected) followed by a selective ACK bitmap of 
+			 the MAX_WINDOW_SIZE packets after it
+	
+	@param : ptr - ptr to payload buffer
+			 cum_seq_no - next in-order packet expected
+			 recv_arr - receive window bitmap, indexed by SEQ_SLOT()
+	
+	@return : payload length
+
+-----------------------------------------------------------*/
+
+int create_sack_data(char *ptr, int cum_seq_no, bool *recv_arr){
+	int len,var1,seq_no;
+	len = put_seq_field(ptr,cum_seq_no);
+	bzero(ptr + len,SACK_BITMAP_SIZE);
+	for(var1 = 0; var1 < MAX_WINDOW_SIZE; var1++){
+		seq_no = cum_seq_no + 1 + var1;
+		if(recv_arr[SEQ_SLOT(seq_no)]){
+			*(ptr + len + (var1/8)) |= (char)(1 << (var1%8));
+		}
+	}
+	return (len + SACK_BITMAP_SIZE);
+}
+
+/*----------------- lz_compress() -------------------
+
+	@brief : Compress a data packet payload in the LZ4 block format - 
+			 sequences of a token (literal / match length nibbles), 
+			 literals and a 2 byte match offset. Matches are found 
+			 with a hash of the next 4 bytes, the search steps over 
+			 more bytes the longer it misses, so incompressible data 
+			 (JPEG, MP3) is passed over quickly.
+	
+	@param : src - payload
+			 len - payload length, at most 64 KB
+			 dst - compressed output
+			 dst_max - room in dst
+	
+	@return : compressed length, 0 if it does not fit in dst_max
+
+-----------------------------------------------------------*/
+
+int lz_compress(char *src, int len, char *dst, int dst_max){
+	uint16_t table[1 << LZ_HASH_BITS];
+	unsigned char *ip, *ref, *anchor, *end, *match_end, *op, *op_end, *token;
+	uint32_t seq, ref_seq;
+	int lit_len, match_len, misses, var1;
+	if(len <= LZ_MATCH_LIMIT){return 0;}
+	bzero(table, sizeof(table));
+	ip = (unsigned char *)src + 1;
+	anchor = (unsigned char *)src;
+	end = (unsigned char *)src + len;
+	match_end = end - LZ_MATCH_LIMIT;
+	op = (unsigned char *)dst;
+	op_end = (unsigned char *)dst + dst_max;
+	misses = 0;
+	while(ip < match_end){
+		memcpy(&seq, ip, 4);
+		var1 = (int)((seq * 2654435761U) >> (32 - LZ_HASH_BITS));
+		ref = (unsigned char *)src + table[var1];
+		table[var1] = (uint16_t)(ip - (unsigned char *)src);
+		memcpy(&ref_seq, ref, 4);
+		if((ref >= ip) || (ref_seq != seq)){
+			ip += 1 + (misses++ >> LZ_SKIP_SHIFT);
+			continue;
+		}
+		while((ip > anchor) && (ref > (unsigned char *)src) && (ip[-1] == ref[-1])){
+			ip--;
+			ref--;
+		}
+		match_len = LZ_MIN_MATCH;
+		while(((ip + match_len) < (end - LZ_LAST_LITERALS)) && (ip[match_len] == ref[match_len])){match_len++;}
+		lit_len = (int)(ip - anchor);
+		if((op + 1 + (lit_len / 255) + 1 + lit_len + 2 + ((match_len - LZ_MIN_MATCH) / 255) + 1) > op_end){return 0;}
+		token = op++;
+		*token = (unsigned char)(((lit_len < 15) ? lit_len : 15) << 4);
+		if(lit_len >= 15){
+			for(var1 = lit_len - 15; var1 >= 255; var1 -= 255){*op++ = 255;}
+			*op++ = (unsigned char)var1;
+		}
+		memcpy(op, anchor, lit_len);
+		op += lit_len;
+		*op++ = (unsigned char)((ip - ref) & 0xff);
+		*op++ = (unsigned char)((ip - ref) >> 8);
+		var1 = match_len - LZ_MIN_MATCH;
+		*token |= (unsigned char)((var1 < 15) ? var1 : 15);
+		if(var1 >= 15){
+			for(var1 -= 15; var1 >= 255; var1 -= 255){*op++ = 255;}
+			*op++ = (unsigned char)var1;
+		}
+		ip += match_len;
+		anchor = ip;
+		misses = 0;
+	}
+	lit_len = (int)(end - anchor);
+	if((op + 1 + (lit_len / 255) + 1 + lit_len) > op_end){return 0;}
+	token = op++;
+	*token = (unsigned char)(((lit_len < 15) ? lit_len : 15) << 4);
+	if(lit_len >= 15){
+		for(var1 = lit_len - 15; var1 >= 255; var1 -= 255){*op++ = 255;}
+		*op++ = (unsigned char)var1;
+	}
+	memcpy(op, anchor, lit_len);
+	op += lit_len;
+	return (int)(op - (unsigned char *)dst);
+}
+
+/*----------------- lz_decompress() -------------------
+
+	@brief : Decompress an LZ4 block written by lz_compress(). Every 
+			 length and offset is checked against the input and the 
+			 output, a corrupt packet fails instead of overrunning.
+	
+	@param : src - compressed payload
+			 len - compressed length
+			 dst - payload output
+			 dst_max - room in dst
+	
+	@return : payload length, -1 if the block is corrupt
+
+-----------------------------------------------------------*/
+
+int lz_decompress(char *src, int len, char *dst, int dst_max){
+	unsigned char *ip, *ip_end, *op, *op_end, *ref;
+	int token, lit_len, match_len, offset, var1;
+	ip = (unsigned char *)src;
+	ip_end = (unsigned char *)src + len;
+	op = (unsigned char *)dst;
+	op_end = (unsigned char *)dst + dst_max;
+	while(ip < ip_end){
+		token = *ip++;
+		lit_len = token >> 4;
+		if(lit_len == 15){
+			do{
+				if(ip >= ip_end){return -1;}
+				var1 = *ip++;
+				lit_len += var1;
+			}while(var1 == 255);
+		}
+		if((lit_len > (ip_end - ip)) || (lit_len > (op_end - op))){return -1;}
+		memcpy(op, ip, lit_len);
+		op += lit_len;
+		ip += lit_len;
+		if(ip == ip_end){break;}						/* the last sequence has no match */
+		if((ip_end - ip) < 2){return -1;}
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if((offset == 0) || (offset > (op - (unsigned char *)dst))){return -1;}
+		match_len = token & 15;
+		if(match_len == 15){
+			do{
+				if(ip >= ip_end){return -1;}
+				var1 = *ip++;
+				match_len += var1;
+			}while(var1 == 255);
+		}
+		match_len += LZ_MIN_MATCH;
+		if(match_len > (op_end - op)){return -1;}
+		ref = op - offset;
+		while(match_len-- > 0){*op++ = *ref++;}		/* byte by byte - the match may overlap its output */
+	}
+	return (int)(op - (unsigned char *)dst);
+}
+
+/*----------------- compress_slot() -------------------
+
+	@brief : Compress the put file chunk of a send ring slot when 
+			 the server takes compressed data packets, on the 
+			 compression thread. A chunk that does not shrink is sent 
+			 raw. After COMPRESS_MISS_LIMIT such chunks in a row only 
+			 every COMPRESS_PROBE_INTERVAL-th slot is tried, until one 
+			 shrinks again. With CRCs a compressed chunk is sent with 
+			 the CRC of the compressed data.
+	
+	@param : slot - send ring slot
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void compress_slot(int slot){
+	int zlen;
+	zlen = 0;
+	if(compress_enable && ((compress_misses < COMPRESS_MISS_LIMIT) || ((slot % COMPRESS_PROBE_INTERVAL) == 0))){
+		zlen = lz_compress(send_ring_buf[slot], send_ring_len[slot], send_ring_zbuf[slot], send_ring_len[slot] - 1);
+		compress_misses = (zlen > 0) ? 0 : (compress_misses + 1);
+	}
+	send_ring_zlen[slot] = zlen;
+	if(crc_enable && (zlen > 0)){send_ring_crc[slot] = crc32c(0, send_ring_zbuf[slot], zlen);}
+	compress_in_bytes += send_ring_len[slot];
+	compress_out_bytes += (zlen > 0) ? zlen : send_ring_len[slot];
+}
+
+/*----------------- compress_worker() -------------------
+
+	@brief : Compression thread - compress the put ring slots the 
+			 network thread queued, in order, and wake it with the 
+			 eventfd as each is ready to send
+	
+	@param : arg - unused
+	
+	@return : NULL
+
+-----------------------------------------------------------*/
+
+void *compress_worker(void *arg){
+	uint64_t one = 1;
+	int slot;
+	pthread_mutex_lock(&compress_lock);
+	while(1){
+		while(send_data_ready_index == compress_queue_index){
+			pthread_cond_wait(&compress_work_cond, &compress_lock);
+		}
+		slot = RING_SLOT(send_data_ready_index);
+		pthread_mutex_unlock(&compress_lock);
+		compress_slot(slot);
+		pthread_mutex_lock(&compress_lock);
+		send_data_ready_index++;
+		if(send_data_ready_index == compress_queue_index){pthread_cond_broadcast(&compress_done_cond);}
+		if(write(compress_done_fd, &one, sizeof(one)) < 0){perror("\nERROR on eventfd write");}
+	}
+	return NULL;
+}
+
+/*----------------- compress_start() -------------------
+
+	@brief : Start the compression thread once the server took 
+			 compression in the hello. Without the thread the put is 
+			 sent raw.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void compress_start(void){
+	if(compress_done_fd >= 0){return;}				// running since the first hello
+	compress_done_fd = eventfd(0, EFD_NONBLOCK);
+	if((compress_done_fd < 0) || (pthread_create(&compress_thread, NULL, compress_worker, NULL) != 0)){
+		log_error("\nCould not start the compression thread, sending raw data packets\n");
+		if(compress_done_fd >= 0){close(compress_done_fd);}
+		compress_done_fd = -1;
+		compress_enable = false;
+	}
+}
+
+/*----------------- compress_queue() -------------------
+
+	@brief : Hand the slots read into the put ring up to the read 
+			 index to the compression thread. Without compression 
+			 they are ready to send at once.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void compress_queue(void){
+	pthread_mutex_lock(&compress_lock);
+	compress_queue_index = send_data_read_index;
+	if(compress_enable){pthread_cond_signal(&compress_work_cond);}
+	else{send_data_ready_index = send_data_read_index;}
+	pthread_mutex_unlock(&compress_lock);
+}
+
+/*----------------- compress_ready_index() -------------------
+
+	@brief : Data packets up to which the put ring is compressed
+	
+	@param : none
+	
+	@return : ready index
+
+-----------------------------------------------------------*/
+
+int compress_ready_index(void){
+	int ready_index;
+	pthread_mutex_lock(&compress_lock);
+	ready_index = send_data_ready_index;
+	pthread_mutex_unlock(&compress_lock);
+	return ready_index;
+}
+
+/*----------------- compress_reset() -------------------
+
+	@brief : Wait until the compression thread is done with the 
+			 queued slots, then start the ring of a put at the given 
+			 data packet
+	
+	@param : seq_no - first data packet of the put
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void compress_reset(int seq_no){
+	uint64_t count;
+	pthread_mutex_lock(&compress_lock);
+	while(send_data_ready_index != compress_queue_index){
+		pthread_cond_wait(&compress_done_cond, &compress_lock);
+	}
+	compress_queue_index = seq_no;
+	send_data_ready_index = seq_no;
+	compress_misses = 0;
+	compress_in_bytes = 0;
+	compress_out_bytes = 0;
+	pthread_mutex_unlock(&compress_lock);
+	if(compress_done_fd >= 0){
+		while(read(compress_done_fd, &count, sizeof(count)) > 0){}	/* drop stale wakeups */
+	}
+}
+
+/*----------------- compress_log_stats() -------------------
+
+	@brief : Log the data compressed for the put
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void compress_log_stats(void){
+	if(!compress_enable || (compress_in_bytes == 0)){return;}
+	log_info("\nCompression : %ld bytes sent as %ld (%.2fx)", compress_in_bytes, compress_out_bytes, 
+			 (double)compress_in_bytes / (double)((compress_out_bytes > 0) ? compress_out_bytes : 1));
+}
+
+/*----------------- gf256_inv() -------------------
+
+	@brief : Inverse in GF(256)
+	
+	@param : val - non-zero element
+	
+	@return : 1 / val
+
+-----------------------------------------------------------*/
+
+uint8_t gf256_inv(int val){
+	return gf256_exp[255 - gf256_log[val]];
+}
+
+/*----------------- fec_init() -------------------
+
+	@brief : Build the GF(256) tables (polynomial 0x11D) and the FEC 
+			 coefficients, and check the CPU for SSSE3. Repair row j 
+			 of data packet i is the Cauchy matrix 1/(x_j + y_i), 
+			 x_j = j, y_i = FEC_MAX_REPAIR + i, with every column 
+			 scaled so row 0 is all ones - one repair packet is plain 
+			 XOR parity, and any square part of the matrix stays 
+			 invertible, so any K of the K + M packets of a block 
+			 rebuild it.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void fec_init(void){
+	int var1, var2, val;
+	val = 1;
+	for(var1 = 0; var1 < 255; var1++){
+		gf256_exp[var1] = (uint8_t)val;
+		gf256_exp[var1 + 255] = (uint8_t)val;
+		gf256_log[val] = (uint8_t)var1;
+		val <<= 1;
+		if(val & 0x100){val ^= GF256_POLY;}
+	}
+	for(var1 = 0; var1 < 256; var1++){
+		for(var2 = 0; var2 < 256; var2++){
+			gf256_mul_table[var1][var2] = ((var1 == 0) || (var2 == 0)) ? 0 : 
+										  gf256_exp[gf256_log[var1] + gf256_log[var2]];
+		}
+		for(var2 = 0; var2 < 16; var2++){
+			gf256_mul_hi_table[var1][var2] = gf256_mul_table[var1][var2 << 4];
+		}
+	}
+	for(var1 = 0; var1 < FEC_MAX_REPAIR; var1++){
+		for(var2 = 0; var2 < FEC_MAX_DATA; var2++){
+			fec_coef_table[var1][var2] = gf256_mul_table[gf256_inv(var1 ^ (FEC_MAX_REPAIR + var2))][FEC_MAX_REPAIR + var2];
+		}
+	}
+#if GF256_HW
+	gf256_hw_enable = __builtin_cpu_supports("ssse3");
+#endif
+}
+
+#if GF256_HW
+/*----------------- gf256_mul_add_hw() -------------------
+
+	@brief : dst ^= c * src with SSSE3 - pshufb looks up the products 
+			 of the low and the high nibble of 16 bytes at once
+	
+	@param : dst - ptr to accumulated symbol
+			 src - ptr to symbol added
+			 coef - constant factor
+			 len - length in bytes
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+__attribute__((target("ssse3")))
+void gf256_mul_add_hw(char *dst, char *src, int coef, long len){
+	__m128i lo_table, hi_table, mask, val;
+	long var1;
+	lo_table = _mm_loadu_si128((__m128i *)gf256_mul_table[coef]);
+	hi_table = _mm_loadu_si128((__m128i *)gf256_mul_hi_table[coef]);
+	mask = _mm_set1_epi8(0x0f);
+	for(var1 = 0; (var1 + 16) <= len; var1 += 16){
+		val = _mm_loadu_si128((__m128i *)(src + var1));
+		val = _mm_xor_si128(_mm_shuffle_epi8(lo_table, _mm_and_si128(val, mask)), 
+							_mm_shuffle_epi8(hi_table, _mm_and_si128(_mm_srli_epi64(val, 4), mask)));
+		_mm_storeu_si128((__m128i *)(dst + var1), _mm_xor_si128(_mm_loadu_si128((__m128i *)(dst + var1)), val));
+	}
+	for(; var1 < len; var1++){
+		dst[var1] ^= gf256_mul_table[coef][(uint8_t)src[var1]];
+	}
+}
+#endif
+
+/*----------------- gf256_mul_add() -------------------
+
+	@brief : dst ^= c * src over GF(256) - the one kernel of FEC 
+			 encoding and decoding. A factor of 1 is plain XOR.
+	
+	@param : dst - ptr to accumulated symbol
+			 src - ptr to symbol added
+			 coef - constant factor
+			 len - length in bytes
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void gf256_mul_add(char *dst, char *src, int coef, long len){
+	uint64_t var64, dst64;
+	uint8_t *row;
+	long var1;
+	if(coef == 0){return;}
+	if(coef == 1){
+		for(var1 = 0; (var1 + 8) <= len; var1 += 8){
+			memcpy(&var64, src + var1, 8);
+			memcpy(&dst64, dst + var1, 8);
+			dst64 ^= var64;
+			memcpy(dst + var1, &dst64, 8);
+		}
+		for(; var1 < len; var1++){dst[var1] ^= src[var1];}
+		return;
+	}
+#if GF256_HW
+	if(gf256_hw_enable){
+		gf256_mul_add_hw(dst, src, coef, len);
+		return;
+	}
+#endif
+	row = gf256_mul_table[coef];
+	for(var1 = 0; var1 < len; var1++){
+		dst[var1] ^= row[(uint8_t)src[var1]];
+	}
+}
+
+/*----------------- gf256_invert() -------------------
+
+	@brief : Invert a small matrix over GF(256) by Gauss-Jordan 
+			 elimination
+	
+	@param : mat - matrix, destroyed
+			 inv - inverse
+			 size - rows / columns, at most FEC_MAX_REPAIR
+	
+	@return : false if the matrix is singular
+
+-----------------------------------------------------------*/
+
+bool gf256_invert(uint8_t mat[FEC_MAX_REPAIR][FEC_MAX_REPAIR], uint8_t inv[FEC_MAX_REPAIR][FEC_MAX_REPAIR], int size){
+	int var1, var2, var3;
+	uint8_t val, *row;
+	for(var1 = 0; var1 < size; var1++){
+		for(var2 = 0; var2 < size; var2++){inv[var1][var2] = (var1 == var2);}
+	}
+	for(var1 = 0; var1 < size; var1++){
+		for(var2 = var1; (var2 < size) && (mat[var2][var1] == 0); var2++);
+		if(var2 == size){return false;}
+		for(var3 = 0; var3 < size; var3++){
+			val = mat[var1][var3]; mat[var1][var3] = mat[var2][var3]; mat[var2][var3] = val;
+			val = inv[var1][var3]; inv[var1][var3] = inv[var2][var3]; inv[var2][var3] = val;
+		}
+		row = gf256_mul_table[gf256_inv(mat[var1][var1])];
+		for(var3 = 0; var3 < size; var3++){
+			mat[var1][var3] = row[mat[var1][var3]];
+			inv[var1][var3] = row[inv[var1][var3]];
+		}
+		for(var2 = 0; var2 < size; var2++){
+			if((var2 == var1) || (mat[var2][var1] == 0)){continue;}
+			row = gf256_mul_table[mat[var2][var1]];
+			for(var3 = 0; var3 < size; var3++){
+				mat[var2][var3] ^= row[mat[var1][var3]];
+				inv[var2][var3] ^= row[inv[var1][var3]];
+			}
+		}
+	}
+	return true;
+}
+
+/*----------------- fec_symbol_header() -------------------
+
+	@brief : Write the part of a data packet's FEC symbol in front of 
+			 its data - data length and the header flags that 
+			 describe the data, so a rebuilt packet gets them back
+	
+	@param : ptr - ptr to FEC_SYMBOL_HDR_SIZE bytes
+			 flags - header flags of the data packet
+			 data_len - length of packet data
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void fec_symbol_header(char *ptr, int flags, int data_len){
+	*(ptr + 0) = (char)(data_len >> 8);
+	*(ptr + 1) = (char)data_len;
+	*(ptr + 2) = 0;
+	*(ptr + 3) = (char)(flags & HDR_FLAG_COMPRESSED);
+}
+
+/*----------------- fec_encoder_start() -------------------
+
+	@brief : Start FEC encoding of a transfer
+	
+	@param : enc - encoder, k and m set from the hello
+			 data_size - data packet payload
+			 last_seq - last data packet of the transfer
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void fec_encoder_start(struct fec_encoder *enc, int data_size, int last_seq){
+	int var1;
+	enc->sym_max = FEC_SYMBOL_HDR_SIZE + data_size;
+	enc->last_seq = last_seq;
+	enc->block = -1;
+	enc->repair_count = 0;
+	for(var1 = 0; var1 < FEC_ENCODE_SETS; var1++){enc->queued_flush[var1] = -1;}
+}
+
+/*----------------- fec_encode_packet() -------------------
+
+	@brief : Add the first send of a data packet to the repair 
+			 symbols of its block. Data packets are first sent in 
+			 order, so a block is done with its K-th packet or the 
+			 last packet of the transfer. The repair buffers of a 
+			 block are reused FEC_ENCODE_SETS blocks later - if 
+			 they are still queued for the send batch it is flushed.
+	
+	@param : enc - encoder
+			 seq_no - data packet sequence number
+			 flags - header flags of the data packet
+			 data_ptr - ptr to packet data, as sent
+			 data_len - length of packet data
+	
+	@return : true if the repair packets of the block are due
+
+-----------------------------------------------------------*/
+
+bool fec_encode_packet(struct fec_encoder *enc, int seq_no, int flags, char *data_ptr, int data_len){
+	char sym_hdr[FEC_SYMBOL_HDR_SIZE];
+	char *ptr;
+	int index, var1;
+	index = seq_no % enc->k;
+	if((seq_no / enc->k) != enc->block){
+		enc->block = seq_no / enc->k;
+		enc->set = (enc->set + 1) % FEC_ENCODE_SETS;
+		if(enc->queued_flush[enc->set] == send_batch_flush_count){flush_send_batch();}
+		enc->queued_flush[enc->set] = -1;
+		for(var1 = 0; var1 < enc->m; var1++){
+			bzero(enc->parity[enc->set][var1] + FEC_REPAIR_HDR_SIZE, enc->sym_max);
+		}
+		enc->first = index;
+		enc->sym_len = FEC_SYMBOL_HDR_SIZE;
+	}
+	enc->count = index + 1;
+	if((FEC_SYMBOL_HDR_SIZE + data_len) > enc->sym_len){enc->sym_len = FEC_SYMBOL_HDR_SIZE + data_len;}
+	fec_symbol_header(sym_hdr, flags, data_len);
+	for(var1 = 0; var1 < enc->m; var1++){
+		ptr = enc->parity[enc->set][var1] + FEC_REPAIR_HDR_SIZE;
+		gf256_mul_add(ptr, sym_hdr, fec_coef_table[var1][index], FEC_SYMBOL_HDR_SIZE);
+		gf256_mul_add(ptr + FEC_SYMBOL_HDR_SIZE, data_ptr, fec_coef_table[var1][index], data_len);
+	}
+	return ((index == (enc->k - 1)) || (seq_no >= enc->last_seq));
+}
+
+/*----------------- fec_repair_packet() -------------------
+
+	@brief : Get the data of a repair packet of the block just 
+			 encoded - K, M, repair index, first and end index of the 
+			 data packets encoded, symbol length, then the symbol. 
+			 It is sent with the first data packet of the block as 
+			 sequence number and stays valid until the send batch is 
+			 flushed.
+	
+	@param : enc - encoder
+			 index - repair packet, below M
+			 data_ptr - set to the repair packet data
+	
+	@return : length of the repair packet data
+
+-----------------------------------------------------------*/
+
+int fec_repair_packet(struct fec_encoder *enc, int index, char **data_ptr){
+	char *ptr;
+	ptr = enc->parity[enc->set][index];
+	*(ptr + 0) = (char)enc->k;
+	*(ptr + 1) = (char)enc->m;
+	*(ptr + 2) = (char)index;
+	*(ptr + 3) = (char)enc->first;
+	*(ptr + 4) = (char)enc->count;
+	*(ptr + 5) = 0;
+	*(ptr + 6) = (char)(enc->sym_len >> 8);
+	*(ptr + 7) = (char)enc->sym_len;
+	enc->queued_flush[enc->set] = send_batch_flush_count;
+	enc->repair_count++;
+	*data_ptr = ptr;
+	return (FEC_REPAIR_HDR_SIZE + enc->sym_len);
+}
+
+/*----------------- fec_loss_seq() -------------------
+
+	@brief : Packet the receiver has to report before a hole counts 
+			 as lost. With FEC the repair packets of the hole's block 
+			 go out after its last data packet, so once they are sent 
+			 the count starts there - the receiver may rebuild the 
+			 packet instead. It stops at the last packet sent, which 
+			 is all the receiver can report while the window is full. 
+			 Before the repair packets are sent it is the plain 
+			 count, the window may not reach the end of the block.
+	
+	@param : enc - encoder
+			 seq_no - unACKed data packet
+			 sent_seq - last data packet sent
+	
+	@return : sequence number
+
+-----------------------------------------------------------*/
+
+int fec_loss_seq(struct fec_encoder *enc, int seq_no, int sent_seq){
+	int end;
+	if(enc->k == 0){return (seq_no + CC_DUP_THRESH);}
+	end = (((seq_no / enc->k) + 1) * enc->k) - 1;
+	if(end > enc->last_seq){end = enc->last_seq;}
+	if(end > sent_seq){return (seq_no + CC_DUP_THRESH);}
+	end += CC_DUP_THRESH;
+	if(end > sent_seq){end = sent_seq;}
+	return (end > (seq_no + CC_DUP_THRESH)) ? end : (seq_no + CC_DUP_THRESH);
+}
+
+/*----------------- fec_decoder_start() -------------------
+
+	@brief : Start FEC decoding of a transfer, no block is open
+	
+	@param : dec - decoder, k and m set from the hello
+			 data_size - data packet payload
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void fec_decoder_start(struct fec_decoder *dec, int data_size){
+	int var1;
+	dec->sym_max = FEC_SYMBOL_HDR_SIZE + data_size;
+	dec->rebuilt_count = 0;
+	for(var1 = 0; var1 < FEC_BLOCK_SLOTS; var1++){dec->blk[var1].block = -1;}
+}
+
+/*----------------- fec_find_block() -------------------
+
+	@brief : Find the decoder slot of a block. A newer block takes 
+			 over its slot, packets of a block that lost its slot are 
+			 left to retransmission.
+	
+	@param : dec - decoder
+			 block - block number
+	
+	@return : block, NULL if its slot was taken over
+
+-----------------------------------------------------------*/
+
+struct fec_block *fec_find_block(struct fec_decoder *dec, int block){
+	struct fec_block *blk;
+	int var1;
+	blk = &dec->blk[block % FEC_BLOCK_SLOTS];
+	if(blk->block == block){return blk;}
+	if(blk->block > block){return NULL;}
+	blk->block = block;
+	blk->data_mask = 0;
+	blk->repair_mask = 0;
+	blk->first = 0;
+	blk->count = 0;
+	blk->sym_len = 0;
+	blk->done = false;
+	for(var1 = 0; var1 < dec->m; var1++){bzero(blk->sym[var1], dec->sym_max);}
+	return blk;
+}
+
+/*----------------- fec_decode_block() -------------------
+
+	@brief : Rebuild the missing data packets of a block once it has 
+			 as many repair packets as holes. Each repair symbol has 
+			 had the data packets received taken out already, what is 
+			 left is a linear combination of the missing ones - the 
+			 small matrix of their coefficients is inverted and 
+			 applied.
+	
+	@param : dec - decoder
+			 blk - block
+			 info_arr - rebuilt data packets, valid until the next 
+						decode
+	
+	@return : number of packets rebuilt
+
+-----------------------------------------------------------*/
+
+int fec_decode_block(struct fec_decoder *dec, struct fec_block *blk, struct packet_info *info_arr){
+	uint8_t mat[FEC_MAX_REPAIR][FEC_MAX_REPAIR], inv[FEC_MAX_REPAIR][FEC_MAX_REPAIR];
+	int miss_arr[FEC_MAX_REPAIR], row_arr[FEC_MAX_REPAIR];
+	int miss, rows, count, len, var1, var2;
+	if(blk->done || (blk->repair_mask == 0)){return 0;}
+	miss = 0;
+	for(var1 = blk->first; var1 < blk->count; var1++){
+		if(blk->data_mask & (1ULL << var1)){continue;}
+		if(miss == FEC_MAX_REPAIR){return 0;}
+		miss_arr[miss++] = var1;
+	}
+	rows = 0;
+	for(var1 = 0; (var1 < dec->m) && (rows < miss); var1++){
+		if(blk->repair_mask & (1 << var1)){row_arr[rows++] = var1;}
+	}
+	if(rows < miss){return 0;}
+	blk->done = true;
+	for(var1 = 0; var1 < miss; var1++){
+		for(var2 = 0; var2 < miss; var2++){mat[var1][var2] = fec_coef_table[row_arr[var1]][miss_arr[var2]];}
+	}
+	if((miss == 0) || !gf256_invert(mat, inv, miss)){return 0;}
+	count = 0;
+	for(var1 = 0; var1 < miss; var1++){
+		bzero(dec->out[var1], blk->sym_len);
+		for(var2 = 0; var2 < miss; var2++){
+			gf256_mul_add(dec->out[var1], blk->sym[row_arr[var2]], inv[var1][var2], blk->sym_len);
+		}
+		len = ((uint8_t)dec->out[var1][0] << 8) | (uint8_t)dec->out[var1][1];
+		if(len > (blk->sym_len - FEC_SYMBOL_HDR_SIZE)){continue;}
+		bzero(&info_arr[count], sizeof(struct packet_info));
+		info_arr[count].type = 'D';
+		info_arr[count].cmd = '0';
+		info_arr[count].binary = true;
+		info_arr[count].flags = (uint8_t)dec->out[var1][3] & HDR_FLAG_COMPRESSED;
+		info_arr[count].seq_no = ((long)blk->block * dec->k) + miss_arr[var1];
+		info_arr[count].data_ptr = dec->out[var1] + FEC_SYMBOL_HDR_SIZE;
+		info_arr[count].data_len = len;
+		count++;
+	}
+	dec->rebuilt_count += count;
+	return count;
+}
+
+/*----------------- fec_add_data() -------------------
+
+	@brief : Take a received data packet out of the repair symbols of 
+			 its block, then try to rebuild the block
+	
+	@param : dec - decoder
+			 info - received data packet, data as sent
+			 info_arr - rebuilt data packets
+	
+	@return : number of packets rebuilt
+
+-----------------------------------------------------------*/
+
+int fec_add_data(struct fec_decoder *dec, struct packet_info *info, struct packet_info *info_arr){
+	struct fec_block *blk;
+	char sym_hdr[FEC_SYMBOL_HDR_SIZE];
+	int index, var1;
+	if((info->seq_no < 0) || ((FEC_SYMBOL_HDR_SIZE + info->data_len) > dec->sym_max)){return 0;}
+	blk = fec_find_block(dec, (int)(info->seq_no / dec->k));
+	index = (int)(info->seq_no % dec->k);
+	if((blk == NULL) || blk->done || (blk->data_mask & (1ULL << index))){return 0;}
+	fec_symbol_header(sym_hdr, info->flags, info->data_len);
+	for(var1 = 0; var1 < dec->m; var1++){
+		gf256_mul_add(blk->sym[var1], sym_hdr, fec_coef_table[var1][index], FEC_SYMBOL_HDR_SIZE);
+		gf256_mul_add(blk->sym[var1] + FEC_SYMBOL_HDR_SIZE, info->data_ptr, fec_coef_table[var1][index], info->data_len);
+	}
+	blk->data_mask |= 1ULL << index;
+	return fec_decode_block(dec, blk, info_arr);
+}
+
+/*----------------- fec_add_repair() -------------------
+
+	@brief : Add a received repair packet to its block, then try to 
+			 rebuild the block
+	
+	@param : dec - decoder
+			 info - received repair packet
+			 info_arr - rebuilt data packets
+	
+	@return : number of packets rebuilt
+
+-----------------------------------------------------------*/
+
+int fec_add_repair(struct fec_decoder *dec, struct packet_info *info, struct packet_info *info_arr){
+	struct fec_block *blk;
+	uint8_t *ptr;
+	int index, first, count, sym_len;
+	if(info->data_len < FEC_REPAIR_HDR_SIZE){return 0;}
+	ptr = (uint8_t *)info->data_ptr;
+	index = ptr[2];
+	first = ptr[3];
+	count = ptr[4];
+	sym_len = (ptr[6] << 8) | ptr[7];
+	if((ptr[0] != dec->k) || (ptr[1] != dec->m) || (index >= dec->m) || (first >= count) || (count > dec->k) || 
+	   (sym_len < FEC_SYMBOL_HDR_SIZE) || (sym_len > dec->sym_max) || (info->data_len != (FEC_REPAIR_HDR_SIZE + sym_len)) || 
+	   (info->seq_no < 0) || ((info->seq_no % dec->k) != 0)){
+		return 0;
+	}
+	blk = fec_find_block(dec, (int)(info->seq_no / dec->k));
+	if((blk == NULL) || blk->done || (blk->repair_mask & (1 << index))){return 0;}
+	gf256_mul_add(blk->sym[index], info->data_ptr + FEC_REPAIR_HDR_SIZE, 1, sym_len);
+	blk->repair_mask |= 1 << index;
+	blk->first = first;
+	blk->count = count;
+	blk->sym_len = sym_len;
+	return fec_decode_block(dec, blk, info_arr);
+}
+
+
+/*----------------- flush_file_writes() -------------------
+
+	@brief : Write the queued data packets to the get file with 
+			 pwrite(), each at its own offset. Called after the ACKs 
+			 of a receive batch went out, so disk writes do not 
+			 delay them.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void flush_file_writes(void){
+	int var1;
+	for(var1 = 0; var1 < file_write_count; var1++){
+		if(pwrite(fileno(client_get_file), file_write_arr[var1].data_ptr, file_write_arr[var1].data_len, 
+				  file_write_arr[var1].offset) != file_write_arr[var1].data_len){
+			log_error("\nWrite to get file failed");
+		}
+	}
+	file_write_count = 0;
+	recv_unpack_count = 0;
+}
+
+/*----------------- unpack_data_packet() -------------------
+
+	@brief : Decompress a data packet the server sent compressed. 
+			 The data is held in recv_unpack_buf until the write 
+			 queue is flushed, like received packets stay in the 
+			 receive batch buffers.
+	
+	@param : info - decoded packet, data pointer, length and CRC 
+					are set to the decompressed data
+	
+	@return : false if the packet is corrupt
+
+-----------------------------------------------------------*/
+
+bool unpack_data_packet(struct packet_info *info){
+	int len;
+	if(recv_unpack_count == RECV_UNPACK_SLOTS){flush_file_writes();}
+	len = lz_decompress(info->data_ptr, info->data_len, recv_unpack_buf[recv_unpack_count], data_size);
+	if(len <= 0){return false;}
+	info->data_ptr = recv_unpack_buf[recv_unpack_count++];
+	info->data_len = len;
+	if(crc_enable){info->data_crc = crc32c(0, info->data_ptr, len);}		// the digest is of the file data
+	return true;
+}
+
+/*----------------- store_data_packet() -------------------
+
+	@brief : Queue a received data packet for writing at its offset 
+			 in the get file - out-of-order packets land in place, 
+			 nothing is held back until the gap is filled. The data 
+			 stays in the receive batch buffer until 
+			 flush_file_writes(). The packet CRCs are folded into 
+			 the file digest as the window base passes them.
+	
+	@param : seq_no - data packet sequence number
+			 data_ptr - ptr to packet data
+			 data_len - length of packet data
+			 data_crc - CRC32C of packet data
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void store_data_packet(int seq_no, char *data_ptr, int data_len, uint32_t data_crc){
+	int slot;
+	if((seq_no < recv_data_ack_arr_index) || (seq_no >= (recv_data_ack_arr_index + MAX_WINDOW_SIZE)) || (seq_no >= data_pkt_max_count)){
+		return;											/* duplicate or outside receive window */
+	}
+	if(recv_data_ack_arr[SEQ_SLOT(seq_no)] || (client_get_file == NULL)){return;}
+	if(file_write_count == RECV_SEG_MAX){flush_file_writes();}
+	file_write_arr[file_write_count].offset = (long)seq_no * data_size;
+	file_write_arr[file_write_count].data_ptr = data_ptr;
+	file_write_arr[file_write_count].data_len = data_len;
+	file_write_count++;
+	recv_data_ack_arr[SEQ_SLOT(seq_no)] = true;
+	recv_crc_arr[SEQ_SLOT(seq_no)] = data_crc;
+	recv_crc_len[SEQ_SLOT(seq_no)] = data_len;
+	while(recv_data_ack_arr[SEQ_SLOT(recv_data_ack_arr_index)]){
+		slot = SEQ_SLOT(recv_data_ack_arr_index);
+		if(get_digest_valid){
+			get_file_crc = crc32c_combine(get_file_crc, recv_crc_arr[slot], recv_crc_len[slot], 
+										  (recv_crc_len[slot] == data_size) ? data_crc_op : NULL);
+		}
+		recv_data_ack_arr[slot] = false;
+		recv_data_ack_arr_index++;
+	}
+}
+
+/*----------------- client_send_data_ack() ----------------------
+
+	@brief : Queue data ACK when data received from server, the ACKs 
+			 of a receive batch go out together
+	
+	@param : ack_seq_no - sequence number for the ACK to be sent
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void client_send_data_ack(int ack_seq_no){
+	
+	int var1;
+	char sack_buf[6 + SACK_BITMAP_SIZE];
+	var1 = create_sack_data(sack_buf,recv_data_ack_arr_index,recv_data_ack_arr);
+	bzero(client_send_buf,BUFSIZE);
+	var1 = create_packet('A','D',client_send_buf,ack_seq_no,sack_buf,var1);
+	queue_datagram(client_send_buf,var1,NULL,0);
+	log_trace("\nACK for packet %d sent\n",ack_seq_no + 1);
+}
+
+/*----------------- recv_rebuilt_packets() ----------------------
+
+	@brief : Queue and ACK the data packets FEC rebuilt. Their data 
+			 is only valid until the next decode, so it is copied to 
+			 recv_unpack_buf (or decompressed there) and held until 
+			 the write queue is flushed.
+	
+	@param : info_arr - rebuilt data packets
+			 count - number of packets
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void recv_rebuilt_packets(struct packet_info *info_arr, int count){
+	struct packet_info *info;
+	int var1;
+	for(var1 = 0; var1 < count; var1++){
+		info = &info_arr[var1];
+		if(info->flags & HDR_FLAG_COMPRESSED){
+			if(!unpack_data_packet(info)){continue;}
+		}
+		else{
+			if(recv_unpack_count == RECV_UNPACK_SLOTS){flush_file_writes();}
+			memcpy(recv_unpack_buf[recv_unpack_count], info->data_ptr, info->data_len);
+			info->data_ptr = recv_unpack_buf[recv_unpack_count++];
+			if(crc_enable){info->data_crc = crc32c(0, info->data_ptr, info->data_len);}
+		}
+		log_trace("\nData packet %ld rebuilt by FEC\n",info->seq_no + 1);
+		store_data_packet((int)info->seq_no,info->data_ptr,info->data_len,info->data_crc);
+		client_send_data_ack((int)info->seq_no);
+	}
+}
+
+/*----------------- recv_data_packet() ----------------------
+
+	@brief : Take a data packet of the get - decompress it if the 
+			 server compressed it, queue it for the file and ACK it. 
+			 With FEC it is first added to its block, which may 
+			 rebuild lost packets.
+	
+	@param : info - decoded data packet
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void recv_data_packet(struct packet_info *info){
+	struct packet_info rebuilt_arr[FEC_MAX_REPAIR];
+	int count;
+	count = (fec_dec.k > 0) ? fec_add_data(&fec_dec, info, rebuilt_arr) : 0;	// data as sent
+	if((info->flags & HDR_FLAG_COMPRESSED) && !unpack_data_packet(info)){
+		log_debug("\nCorrupt compressed data packet %ld dropped", info->seq_no + 1);
+	}
+	else{
+		recv_data_pkt_data_len = info->data_len;
+		log_trace("\nReceived data packet %ld of %d bytes\n",info->seq_no + 1,recv_data_pkt_data_len);
+		store_data_packet((int)info->seq_no,info->data_ptr,recv_data_pkt_data_len,info->data_crc);
+		client_send_data_ack((int)info->seq_no);
+	}
+	recv_rebuilt_packets(rebuilt_arr, count);
+}
+
+/*----------------- recv_repair_packet() ----------------------
+
+	@brief : Take an FEC repair packet of the get
+	
+	@param : info - decoded repair packet
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void recv_repair_packet(struct packet_info *info){
+	struct packet_info rebuilt_arr[FEC_MAX_REPAIR];
+	if(fec_dec.k == 0){return;}
+	log_trace("\nReceived repair packet of block %ld\n",info->seq_no / fec_dec.k);
+	recv_rebuilt_packets(rebuilt_arr, fec_add_repair(&fec_dec, info, rebuilt_arr));
+}
+
+/*----------------- send_file_size_ack() ----------------------
+
+	@brief : Send the file size ACK that starts the transfer of a 
+			 found file
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_file_size_ack(void){
+	int var1;
+	bzero(client_send_buf,BUFSIZE);
+	var1 = create_packet('A','F',client_send_buf,1,ack_buf,0);
+	if(sendto(sockfd, client_send_buf, var1, 0, (struct sockaddr *)&serveraddr, serverlen) < 0){error("ERROR in sendto");}
+	bzero(client_send_buf,BUFSIZE);
+}
+
+/*----------------- update_get_journal() ----------------------
+
+	@brief : Record the data packets written in order in the journal 
+			 of the get file, every JOURNAL_INTERVAL bytes or when 
+			 forced. Called after flush_file_writes().
+	
+	@param : force - record even a small advance
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void update_get_journal(bool force){
+	off_t done;
+	if(get_journal_fd < 0){return;}
+	done = (off_t)recv_data_ack_arr_index * data_size;
+	if(done > data_byte_max_count){done = data_byte_max_count;}
+	if((done == get_journal_done) || (!force && ((done - get_journal_done) < JOURNAL_INTERVAL))){return;}
+	journal_write(get_journal_fd, data_byte_max_count, done);
+	get_journal_done = done;
+}
+
+/*----------------- wait_for_data_pkt() ----------------------
+
+	@brief : Receive data packets from server until the whole file 
+			 is written, then linger to re-ACK retransmissions. The 
+			 file size ACK is resent until the first data packet 
+			 arrives. Each RTO without data doubles the wait, like 
+			 the retransmissions of the server, until the transfer 
+			 is given up. The journal of the get file is removed once 
+			 it is complete, and kept for rg if it is given up. A 
+			 complete file that does not match the digest of the 
+			 server is removed.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void wait_for_data_pkt(void){
+	struct packet_info info;
+	int idle_count,recv_count,recv_index;
+	bool data_started;
+	idle_count = 0;
+	data_started = false;
+	if(fec_dec.k > 0){fec_decoder_start(&fec_dec, data_size);}
+	set_udp_gro(true);
+	while(recv_data_ack_arr_index < data_pkt_max_count){
+		recv_count = recv_datagram_batch((int)rtt.rto);
+		if (recv_count < 0) {error("ERROR in recvmmsg");}
+		for(recv_index = 0; recv_index < recv_count; recv_index++){
+			if(parse_packet(recv_seg_ptr_arr[recv_index],recv_seg_len_arr[recv_index],&info) && 
+			   ((info.type == 'D') || (info.type == 'R'))){
+				if(info.type == 'D'){recv_data_packet(&info);}
+				else{recv_repair_packet(&info);}
+				data_started = true;
+				idle_count = 0;
+			}
+		}
+		flush_send_batch();
+		flush_file_writes();
+		update_get_journal(false);
+		if(recv_count > 0){continue;}
+		if(++idle_count > MAX_RETX_COUNT){
+			log_error("\nNo data from server, aborting transfer\n");
+			break;
+		}
+		if(!data_started){
+			log_debug("\nNo data yet, file size ACK retransmitted");
+			send_file_size_ack();
+		}
+		rto_backoff(&rtt);
+	}
+	if(recv_data_ack_arr_index == data_pkt_max_count){
+		if(ftruncate(fileno(client_get_file), data_byte_max_count) < 0){log_error("\nCould not truncate get file");}
+		fsync(fileno(client_get_file));
+	}
+	else{
+		update_get_journal(true);
+	}
+	fclose(client_get_file);
+	if(get_journal_fd >= 0){
+		close(get_journal_fd);
+		get_journal_fd = -1;
+		if(recv_data_ack_arr_index == data_pkt_max_count){journal_remove(filename_buf);}
+	}
+	if(recv_data_ack_arr_index < data_pkt_max_count){
+		set_udp_gro(false);
+		def_print_enable = true;
+		return;
+	}
+	if(get_digest_valid && (get_file_crc != get_file_digest)){
+		log_error("\nFile digest does not match the server's, %s is corrupt and was removed\n", filename_buf);
+		unlink(filename_buf);
+	}
+	else{
+		log_info("\nFile transfer complete%s\n", get_digest_valid ? ", digest verified" : "");
+		if(fec_dec.k > 0){log_info("\nFEC : %ld packets rebuilt\n", fec_dec.rebuilt_count);}
+	}
+	/* Our last ACKs may be lost - answer retransmitted packets until the server goes quiet */
+	while((recv_count = recv_datagram_batch((int)(LINGER_RTO_COUNT * rtt.rto))) > 0){
+		for(recv_index = 0; recv_index < recv_count; recv_index++){
+			if(parse_packet(recv_seg_ptr_arr[recv_index],recv_seg_len_arr[recv_index],&info) && (info.type == 'D')){
+				client_send_data_ack((int)info.seq_no);
+			}
+		}
+		flush_send_batch();
+	}
+	set_udp_gro(false);
+	def_print_enable = true;
+}
+
+/*----------------- fill_send_ring() ----------------------
+
+	@brief : Read the put file ahead of the send window into the 
+			 ring of packet sized chunks, and queue them to the 
+			 compression thread. Chunks stay in the ring until ACKed 
+			 so they can be retransmitted. With CRCs the CRC of each 
+			 chunk is folded into the file digest (chunks are read in 
+			 order) and kept for the packet, the compression thread 
+			 replaces it with the CRC of a compressed chunk.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void fill_send_ring(void){
+	int slot;
+	uint32_t crc;
+	while((send_data_read_index < max_packet_count) && 
+		  (send_data_read_index < (send_data_ack_arr_index + SEND_RING_SIZE))){
+		slot = RING_SLOT(send_data_read_index);
+		send_ring_len[slot] = (int)fread(send_ring_buf[slot],1,data_size,client_put_file);
+		send_ring_zlen[slot] = 0;
+		if(crc_enable){
+			crc = crc32c(0, send_ring_buf[slot], send_ring_len[slot]);
+			put_file_crc = crc32c_combine(put_file_crc, crc, send_ring_len[slot], (send_ring_len[slot] == data_size) ? data_crc_op : NULL);
+			send_ring_crc[slot] = crc;
+		}
+		send_data_read_index++;
+	}
+	compress_queue();
+}
+
+/*----------------- send_repair_packets() ----------------------
+
+	@brief : Queue the FEC repair packets of the block just encoded 
+			 behind its last data packet. They are not numbered, timed 
+			 or retransmitted - the server ACKs the data packets it 
+			 rebuilds from them.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_repair_packets(void){
+	char *data_ptr;
+	int hdr_len, data_len, var1;
+	for(var1 = 0; var1 < fec_enc.m; var1++){
+		data_len = fec_repair_packet(&fec_enc, var1, &data_ptr);
+		hdr_len = create_bin_header('R','0',data_pkt_hdr_buf,(long)fec_enc.block * fec_enc.k,data_len,0);
+		if(crc_enable){set_packet_crc(data_pkt_hdr_buf, hdr_len, crc32c(0, data_ptr, data_len));}
+		queue_datagram(data_pkt_hdr_buf,hdr_len,data_ptr,data_len);
+	}
+	log_trace("\nSent to server - %d repair packets of block %d",fec_enc.m,fec_enc.block);
+}
+
+/*----------------- send_data_packet() ----------------------
+
+	@brief : Queue data packet of the put file and arm its 
+			 retransmit timer, the data (compressed if it shrank) is 
+			 sent straight from the ring
+	
+	@param : seq_no - data packet sequence number
+			 retx - packet was sent before
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_data_packet(int seq_no, bool retx){
+	int hdr_len, flags;
+	long unsigned int now;
+	char *data_ptr;
+	if(send_ring_zlen[RING_SLOT(seq_no)] > 0){
+		send_data_packet_size = send_ring_zlen[RING_SLOT(seq_no)];
+		data_ptr = send_ring_zbuf[RING_SLOT(seq_no)];
+		flags = HDR_FLAG_COMPRESSED;
+	}
+	else{
+		send_data_packet_size = send_ring_len[RING_SLOT(seq_no)];
+		data_ptr = send_ring_buf[RING_SLOT(seq_no)];
+		flags = 0;
+	}
+	hdr_len = create_data_header(data_pkt_hdr_buf,seq_no,send_data_packet_size,flags,send_ring_crc[RING_SLOT(seq_no)]);
+	queue_datagram(data_pkt_hdr_buf,hdr_len,data_ptr,send_data_packet_size);
+	if(!retx && (fec_enc.k > 0) && fec_encode_packet(&fec_enc, seq_no, flags, data_ptr, send_data_packet_size)){
+		send_repair_packets();
+	}
+	now = get_time_usec();
+	send_pkt_time_arr[SEQ_SLOT(seq_no)] = now / 1000;
+	send_pkt_retx_arr[SEQ_SLOT(seq_no)] = retx;
+	cc_on_send(&cc, seq_no, now, retx);
+	send_pkt_timer_arr[SEQ_SLOT(seq_no)].seq_no = seq_no;
+	timer_add(&send_timer_wheel, &send_pkt_timer_arr[SEQ_SLOT(seq_no)], now + (rtt.rto * 1000));
+	log_trace("\nSent to server - data packet %d of %d bytes",seq_no + 1,send_data_packet_size);
+}
+
+/*----------------- send_data_window() ----------------------
+
+	@brief : Top up the file ring and send new data packets while 
+			 the congestion window has room, no faster than the 
+			 pacing rate. When pacing holds a packet back, the pace 
+			 timer sends the window on. Packets are only sent once 
+			 compressed, the compression thread wakes the loop of 
+			 wait_for_data_ack() for the rest.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_data_window(void){
+	long unsigned int now, delay;
+	int ready_index;
+	fill_send_ring();
+	ready_index = compress_ready_index();
+	now = get_time_usec();
+	while((send_data_next_index < ready_index) && 
+		  (send_data_next_index < (send_data_ack_arr_index + cc_window(&cc)))){
+		delay = cc_pacing_delay(&cc, now);
+		if(delay > 0){
+			timer_add(&send_timer_wheel, &pace_timer, now + delay);
+			break;
+		}
+		send_data_ack_arr[SEQ_SLOT(send_data_next_index)] = false;
+		send_data_packet(send_data_next_index, false);
+		send_data_next_index++;
+	}
+}
+
+/*----------------- send_paced_window() ----------------------
+
+	@brief : Pace timer function - send the data packets pacing held 
+			 back
+	
+	@param : t - pace timer
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_paced_window(struct wheel_timer *t){
+	send_data_window();
+}
+
+/*----------------- ack_data_packet() ----------------------
+
+	@brief : Mark an in-flight data packet ACKed, disarm its 
+			 retransmit timer and count it for congestion control
+	
+	@param : seq_no - data packet sequence number
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void ack_data_packet(int seq_no){
+	if(send_data_ack_arr[SEQ_SLOT(seq_no)]){return;}
+	send_data_ack_arr[SEQ_SLOT(seq_no)] = true;
+	timer_del(&send_timer_wheel, &send_pkt_timer_arr[SEQ_SLOT(seq_no)]);
+	cc_on_delivered(&cc, seq_no);
+}
+
+/*----------------- detect_lost_packets() ----------------------
+
+	@brief : Retransmit packets the server reported CC_DUP_THRESH 
+			 packets beyond without ACKing them (FACK), before their 
+			 timer expires. With FEC the count starts at the end of 
+			 the packet's block (fec_loss_seq()). Go-Back-N resends the window from its 
+			 base. Each packet is only resent this way once, later 
+			 losses are left to the retransmit timer.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void detect_lost_packets(void){
+	int seq_no, lost;
+	lost = 0;
+	for(seq_no = send_data_ack_arr_index; 
+		(seq_no < send_data_next_index) && (fec_loss_seq(&fec_enc, seq_no, send_data_next_index - 1) <= send_high_ack_seq); seq_no++){
+		if(send_data_ack_arr[SEQ_SLOT(seq_no)] || send_pkt_retx_arr[SEQ_SLOT(seq_no)]){continue;}
+		lost++;
+		if(window_mode == WINDOW_MODE_GBN){
+			for(seq_no = send_data_ack_arr_index; seq_no < send_data_next_index; seq_no++){
+				send_data_packet(seq_no, true);
+			}
+			break;
+		}
+		send_data_packet(seq_no, true);
+	}
+	if(lost > 0){
+		log_trace("\n%d packets lost, window base : %d", lost, send_data_ack_arr_index);
+		cc_on_loss(&cc, lost, send_data_next_index);
+	}
+}
+
+/*----------------- process_data_ack() -------------------
+
+	@brief : Update send window from a received data ACK. Go-Back-N 
+			 uses the cumulative ACK only, Selective Repeat also 
+			 marks the individually ACKed / SACKed packets. The ACK 
+			 of a packet sent only once is an RTT sample. Newly ACKed 
+			 packets and losses are passed to congestion control.
+	
+	@param : info - decoded ACK packet, data holds cumulative ACK + bitmap
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void process_data_ack(struct packet_info *info){
+	int ack_seq_no,cum_seq_no,cum_len,var1,seq_no;
+	long unsigned int expires;
+	struct wheel_timer *base_timer;
+	ack_seq_no = (int)info->seq_no;
+	cum_len = info->binary ? 4 : 6;
+	if(info->data_len >= cum_len){
+		cum_seq_no = (int)get_seq_field(info->data_ptr,info->binary);
+	}
+	else{
+		cum_seq_no = (window_mode == WINDOW_MODE_GBN) ? (ack_seq_no + 1) : send_data_ack_arr_index;
+	}
+	if(cum_seq_no > send_data_next_index){cum_seq_no = send_data_next_index;}
+	if((ack_seq_no >= send_data_ack_arr_index) && (ack_seq_no < send_data_next_index) && 
+	   !send_data_ack_arr[SEQ_SLOT(ack_seq_no)] && !send_pkt_retx_arr[SEQ_SLOT(ack_seq_no)]){
+		rto_update(&rtt, (long)time_diff(send_pkt_time_arr[SEQ_SLOT(ack_seq_no)]));
+	}
+	for(seq_no = send_data_ack_arr_index; seq_no < cum_seq_no; seq_no++){
+		ack_data_packet(seq_no);
+	}
+	if((ack_seq_no > send_high_ack_seq) && (ack_seq_no < send_data_next_index)){
+		send_high_ack_seq = ack_seq_no;
+	}
+	if(window_mode == WINDOW_MODE_SR){
+		if((ack_seq_no >= send_data_ack_arr_index) && (ack_seq_no < send_data_next_index)){
+			ack_data_packet(ack_seq_no);
+		}
+		for(var1 = 0; (info->data_len >= (cum_len + SACK_BITMAP_SIZE)) && (var1 < MAX_WINDOW_SIZE); var1++){
+			seq_no = cum_seq_no + 1 + var1;
+			if(seq_no >= send_data_next_index){break;}
+			if(*(info->data_ptr + cum_len + (var1/8)) & (1 << (var1%8))){
+				ack_data_packet(seq_no);
+				if(seq_no > send_high_ack_seq){send_high_ack_seq = seq_no;}
+			}
+		}
+	}
+	while((send_data_ack_arr_index < send_data_next_index) && send_data_ack_arr[SEQ_SLOT(send_data_ack_arr_index)]){
+		send_data_ack_arr_index++;
+		send_retx_count = 0;
+	}
+	/* Timers keep the RTO of their send time - pull the one of the new 
+	 * window base in when the RTO has shrunk since */
+	if(send_data_ack_arr_index < send_data_next_index){
+		base_timer = &send_pkt_timer_arr[SEQ_SLOT(send_data_ack_arr_index)];
+		expires = (send_pkt_time_arr[SEQ_SLOT(send_data_ack_arr_index)] + rtt.rto) * 1000;
+		if((base_timer->next != NULL) && ((base_timer->expires * TIMER_TICK_USEC) > expires)){
+			timer_add(&send_timer_wheel, base_timer, expires);
+		}
+	}
+	detect_lost_packets();
+	cc_on_ack(&cc, send_data_ack_arr_index, send_data_next_index - send_data_ack_arr_index);
+	log_trace("\nACK for packet %d received from server",ack_seq_no + 1);
+}
+
+/*----------------- data_packet_timeout() ----------------------
+
+	@brief : Retransmit timer function of an in-flight packet. 
+			 Go-Back-N resends the whole window from its base, 
+			 Selective Repeat only the expired packet. Like the 
+			 single timer of RFC 6298, only the expiry of the window 
+			 base backs off the RTO and counts towards the abort. 
+			 Timers armed before a backoff are moved on to the 
+			 backed off RTO.
+	
+	@param : t - retransmit timer of the packet
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void data_packet_timeout(struct wheel_timer *t){
+	int seq_no;
+	long elapsed;
+	seq_no = t->seq_no;
+	elapsed = (long)time_diff(send_pkt_time_arr[SEQ_SLOT(seq_no)]);
+	if(elapsed < rtt.rto){
+		timer_add(&send_timer_wheel, t, get_time_usec() + ((rtt.rto - elapsed) * 1000));
+		return;
+	}
+	if(seq_no == send_data_ack_arr_index){
+		if(++send_retx_count > MAX_RETX_COUNT){
+			send_data_aborted = true;
+			return;
+		}
+		rto_backoff(&rtt);
+		cc_on_timeout(&cc);
+	}
+	if(window_mode == WINDOW_MODE_GBN){
+		for(seq_no = send_data_ack_arr_index; seq_no < send_data_next_index; seq_no++){
+			send_data_packet(seq_no, true);
+		}
+		return;
+	}
+	send_data_packet(seq_no, true);
+}
+
+/*----------------- wait_for_data_ack() ----------------------
+
+	@brief : Keep the send window full and process data packet ACKs 
+			 from server until every packet of the put file is ACKed. 
+			 The ACKs are drained in batches and the data packets they 
+			 release go out with one sendmmsg(). Other packets, like a 
+			 duplicate put command ACK, are dropped. Retransmissions 
+			 and paced packets are sent by the timer wheel, polled 
+			 until its next timer, compressed packets when the 
+			 compression thread signals them.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void wait_for_data_ack(void){
+	struct packet_info info;
+	int var1,recv_count;
+	uint64_t count;
+	timer_wheel_init(&send_timer_wheel);
+	for(var1 = 0; var1 < MAX_WINDOW_SIZE; var1++){
+		timer_init(&send_pkt_timer_arr[var1], data_packet_timeout, NULL, var1);
+	}
+	timer_init(&pace_timer, send_paced_window, NULL, 0);
+	send_data_aborted = false;
+	send_data_window();
+	flush_send_batch();
+	while(send_data_ack_arr_index < max_packet_count){
+		struct pollfd pfd[2] = {{sockfd, POLLIN, 0}, {compress_done_fd, POLLIN, 0}};
+		poll(pfd, 2, timer_wheel_next(&send_timer_wheel));
+		if((pfd[1].revents & POLLIN) && (read(compress_done_fd, &count, sizeof(count)) > 0)){
+			send_data_window();
+		}
+		recv_count = (pfd[0].revents & POLLIN) ? recv_datagram_batch(0) : 0;
+		if (recv_count < 0) {error("ERROR in recvmmsg");}
+		for(var1 = 0; var1 < recv_count; var1++){
+			if(parse_packet(recv_seg_ptr_arr[var1],recv_seg_len_arr[var1],&info) && (info.type == 'A') && (info.cmd == 'D')){
+				open_packet_client(recv_seg_ptr_arr[var1],data_pkt_data_buf,recv_seg_len_arr[var1]);
+			}
+		}
+		timer_wheel_run(&send_timer_wheel);
+		if(send_data_aborted){
+			send_batch_count = 0;
+			send_batch_dgram_count = 0;
+			log_error("\nNo ACK from server, aborting transfer\n");
+			cc_log_stats(&cc);
+			def_print_enable = true;
+			return;
+		}
+		flush_send_batch();
+	}
+}
+
+/*----------------- send_put_complete() ----------------------
+
+	@brief : Tell the server that every packet of the put file is 
+			 ACKed so it closes the file. Resent until the server 
+			 ACKs it, servers that did not answer the hello never do. 
+			 With CRCs it carries the file digest, the server checks 
+			 it against the file it wrote.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_put_complete(void){
+	struct packet_info info;
+	int var1;
+	char temp_buf[CRC_HEX_SIZE + 1];
+	bzero(client_send_buf,BUFSIZE);
+	temp_buf[0] = '0';
+	if(crc_enable){snprintf(temp_buf, sizeof(temp_buf), "%08x", put_file_crc);}
+	var1 = create_packet('K','0',client_send_buf,cmd_seq_no,temp_buf,crc_enable ? CRC_HEX_SIZE : 1);
+	if(!ctrl_ack_enable){
+		if(sendto(sockfd, client_send_buf, var1, 0, (struct sockaddr *)&serveraddr, serverlen) < 0){error("ERROR in sendto");}
+	}
+	else if((var1 = send_request(var1,'A','K',MAX_RETX_COUNT)) < 0){
+		log_error("\nNo ACK for file transfer complete message from server\n");
+		return;
+	}
+	else if(parse_packet(client_recv_buf,var1,&info) && (info.data_len > 0) && (*info.data_ptr == 'F')){
+		put_delta_failed = true;						// pd delta could not be applied
+	}
+	else if((info.data_len > 0) && (*info.data_ptr == 'C')){
+		log_error("\nFile digest does not match at server, %s was removed there\n", filename_buf);
+	}
+	else if((info.data_len > 0) && (*info.data_ptr == 'W')){
+		log_error("\nServer could not write %s to disk, it was removed there\n", filename_buf);
+	}
+	log_debug("\nSent file transfer complete message to server");
+}
+
+/*----------------- print_file_list() -------------------
+
+	@brief : Print one page of the file list as it arrives. Lines 
+			 are "size mtime name", the last name is kept as the 
+			 cursor of the next page.
+	
+	@param : ptr - ptr to list page
+			 len - length of list page
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void print_file_list(char *ptr, int len){
+	char line_buf[NAME_MAX + 64], name_buf[NAME_MAX + 1], time_buf[32];
+	long long size, mtime;
+	time_t mtime_var;
+	char *line_end;
+	int line_len;
+	while(len > 0){
+		line_end = memchr(ptr, '\n', len);
+		line_len = (line_end != NULL) ? (int)(line_end - ptr) : len;
+		if(line_len < (int)sizeof(line_buf)){
+			memcpy(line_buf, ptr, line_len);
+			line_buf[line_len] = '\0';
+			if(sscanf(line_buf, "%lld %lld %255[^\n]", &size, &mtime, name_buf) == 3){
+				mtime_var = (time_t)mtime;
+				strftime(time_buf, sizeof(time_buf), "%Y-%m-%d %H:%M", localtime(&mtime_var));
+				printf("%12lld  %s  %s\n", size, time_buf, name_buf);
+				strcpy(list_cursor, name_buf);
+			}
+		}
+		ptr += line_len + 1;
+		len -= line_len + 1;
+	}
+	fflush(stdout);
+}
+
+/*----------------- create_get_request() -------------------
 
-	@brief : Estimate the number of data packets 
+	@brief : Create the data of a get command - the file name. For 
+			 rg the journal of the partial file adds the offset to 
+			 resume at (packet aligned) and the hash of the bytes 
+			 before it, for the server to check against its file.
 	
-	@param : pkt_ptr - ptr to packet buffer
-			 data_len - data length of char string
+	@param : ptr - ptr to data buffer
+			 resume - rg command
 	
-	@return : total packet count
+	@return : data length
 
 -----------------------------------------------------------*/
 
-int estimate_data_packet_count(char *str_ptr, int data_len){
-	int loop_var1,filesize,filename_len;
-	char temp_buf[50];
-	for(loop_var1 = 0; loop_var1 < data_len; loop_var1++){
-		temp_buf[loop_var1] = *(str_ptr + loop_var1);
-	}
-	filesize = atoi(temp_buf);
-	filename_len = (int)(strlen(filename_buf));
-	printf("\nfilename : %s",filename_buf);
-	filename_buf[filename_len] = '\0'; 
-	client_get_file = fopen(filename_buf,"wb");
-	if(client_get_file == NULL){
-		printf("\nfile could not be created\n");
+int create_get_request(char *ptr, bool resume){
+	off_t size, done;
+	uint64_t hash;
+	int len;
+	memcpy(ptr, filename_buf, filename_len);			// name and its '\0'
+	len = filename_len;
+	get_resume_offset = 0;
+	if(!resume){return len;}
+	if(!journal_read(filename_buf, &size, &done)){
+		log_info("\nNo partial %s to resume, getting the whole file", filename_buf);
+		return len;
 	}
-	else{
-		data_byte_max_count = filesize;
-		recv_data_ack_arr_index = 0;
+	get_resume_offset = (done / data_size) * data_size;
+	if((get_resume_offset == 0) || !hash_resume_tail(filename_buf, get_resume_offset, &hash)){
+		get_resume_offset = 0;
+		return len;
 	}
-	printf("\nfilesize : %d bytes",filesize);
-	return ((filesize/(2*1024)) + 1);
+	len += snprintf(ptr + len, BUFSIZE - len, "%lld %016llx", (long long)get_resume_offset, (unsigned long long)hash) + 1;
+	log_debug("\nResume requested at %lld bytes", (long long)get_resume_offset);
+	return len;
 }
 
-/*----------------- str_to_int() ------------------------------
+/*----------------- create_put_request() -------------------
 
-	@brief : Converts given string of 6 bytes to int datatype
+	@brief : Create the data of a put command - the file name, then 
+			 the file size and 1 for rp, so the server offers to 
+			 resume from its partial file. Older servers take the 
+			 name and ignore the rest.
 	
-	@param : str - ptr to string buffer
+	@param : ptr - ptr to data buffer
+			 resume - rp command
 	
-	@return : number (int)
+	@return : data length
 
 -----------------------------------------------------------*/
 
-int str_to_int(char *str){
-	int var1,var2,var3;
-	char temp_buf[6];
-	var2 = 0;
-	for(var1 = 5; var1 >= 0;var1--){
-		if(*(str + var1) != '*'){
-			var3 = calculate_power(*(str + var1),5-var1);
-			var2 += var3;
-		}
+int create_put_request(char *ptr, bool resume){
+	int len;
+	len = (int)strlen(filename_buf) + 1;
+	memcpy(ptr, filename_buf, len);
+	len += snprintf(ptr + len, BUFSIZE - len, "%lld %d", (long long)put_max_byte_count, resume ? 1 : 0);
+	return len;
+}
+
+/*----------------- check_put_resume() -------------------
+
+	@brief : Check the resume offer of a put ACK - "offset hash" 
+			 after the name. The hash is compared with the same 
+			 bytes of the local file; if they differ the put command 
+			 is sent again without resume, so the server starts over.
+	
+	@param : data_ptr - ptr to ACK data
+			 data_len - length of ACK data
+	
+	@return : first data packet to send, -1 if the restart got no reply
+
+-----------------------------------------------------------*/
+
+int check_put_resume(char *data_ptr, int data_len){
+	char temp_buf[64];
+	long long offset;
+	unsigned long long server_hash;
+	uint64_t hash;
+	int var1;
+	var1 = (int)strnlen(data_ptr, data_len) + 1;
+	if(var1 >= data_len){return 0;}						// no offer - older server or nothing to resume
+	snprintf(temp_buf, sizeof(temp_buf), "%.*s", data_len - var1, data_ptr + var1);
+	if((sscanf(temp_buf, "%lld %llx", &offset, &server_hash) != 2) || (offset <= 0)){return 0;}
+	if((offset <= put_max_byte_count) && ((offset % data_size) == 0) && 
+	   hash_resume_tail(filename_buf, (off_t)offset, &hash) && (hash == server_hash)){
+		log_info("\nResuming at %lld of %lld bytes", offset, (long long)put_max_byte_count);
+		return (int)(offset / data_size);
 	}
-	return var2;
+	log_info("\nPartial file at server differs, sending the whole file");
+	bzero(client_data_buf,BUFSIZE);
+	var1 = create_put_request(client_data_buf, false);
+	bzero(client_send_buf,BUFSIZE);
+	var1 = create_packet('C','P',client_send_buf,next_cmd_seq_no(),client_data_buf,var1);
+	if(send_request(var1,'A','P',MAX_RETX_COUNT) < 0){
+		log_error("\nNo reply from server\n");
+		return -1;
+	}
+	return 0;
 }
 
-/*----------------- wait_for_data_pkt() ----------------------
+/*----------------- put_be32() -------------------
 
-	@brief : Waits for data packet to be received from server
+	@brief : Store a big endian 32 bit field of a pd delta record
 	
-	@param : none
+	@param : ptr - ptr to field
+			 val - value
 	
 	@return : none
 
 -----------------------------------------------------------*/
 
-void wait_for_data_pkt(void){
-	int recv_pkt_size;
-	bzero(data_pkt_recv_buf,DATA_PACKET_RECV_BUFSIZE);
-	bzero(data_pkt_data_buf,DATA_FIELD_LENGTH);
-	recv_pkt_size = recvfrom(sockfd, data_pkt_recv_buf, DATA_PACKET_RECV_BUFSIZE, 0, (struct sockaddr *)&serveraddr, &serverlen);
-		    if (recv_pkt_size < 0) {printf("ERROR in recvfrom");}
-			else{
-				open_packet_client(data_pkt_recv_buf,data_pkt_data_buf,recv_pkt_size);
-			}
+void put_be32(char *ptr, uint32_t val){
+	val = htonl(val);
+	memcpy(ptr, &val, 4);
 }
 
-/*----------------- client_send_data_ack() ----------------------
+/*----------------- put_be64() -------------------
 
-	@brief : Send data ACK when data received from server
+	@brief : Store a big endian 64 bit field
 	
-	@param : ack_seq_no - sequence number for the ACK to be sent
+	@param : ptr - ptr to field
+			 val - value
 	
 	@return : none
 
 -----------------------------------------------------------*/
 
-void client_send_data_ack(int ack_seq_no){
+void put_be64(char *ptr, uint64_t val){
+	put_be32(ptr, (uint32_t)(val >> 32));
+	put_be32(ptr + 4, (uint32_t)val);
+}
+
+/*----------------- get_be32() -------------------
+
+	@brief : Load a big endian 32 bit field of the pd signatures
 	
-	int var1, var2;
-	bzero(client_send_buf,BUFSIZE);
-	char temp;
-	char *temp_ptr;
-	temp_ptr = &temp;
-	var1 = create_packet('A','D',client_send_buf,ack_seq_no,temp_ptr,0);
-	var2 = sendto(sockfd, client_send_buf, var1, 0, (struct sockaddr *)&serveraddr, serverlen);
-	if (var2 < 0){error("ERROR in sendto");}
-	else{printf("\nACK for packet %d sent\n",ack_seq_no + 1);}
-	
-	if(ack_seq_no < (data_pkt_max_count - 1)){
-		printf("\n ack no before wait data pkt : %d",ack_seq_no + 1);
-		wait_for_data_pkt();
+	@param : ptr - ptr to field
+	
+	@return : value
+
+-----------------------------------------------------------*/
+
+uint32_t get_be32(char *ptr){
+	uint32_t val;
+	memcpy(&val, ptr, 4);
+	return ntohl(val);
+}
+
+/*----------------- get_be64() -------------------
+
+	@brief : Load a big endian 64 bit field
+	
+	@param : ptr - ptr to field
+	
+	@return : value
+
+-----------------------------------------------------------*/
+
+uint64_t get_be64(char *ptr){
+	return ((uint64_t)get_be32(ptr) << 32) | get_be32(ptr + 4);
+}
+
+/*----------------- weak_sums() -------------------
+
+	@brief : Sums of the rolling (rsync) checksum of a block - a is 
+			 the byte sum, b the sum weighted by the distance to the 
+			 block end. WEAK_CHECKSUM() combines their low 16 bits.
+	
+	@param : buf - block data
+			 len - block length
+			 a, b - sums
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void weak_sums(char *buf, int len, uint32_t *a, uint32_t *b){
+	int var1;
+	*a = 0;
+	*b = 0;
+	for(var1 = 0; var1 < len; var1++){
+		*a += (unsigned char)buf[var1];
+		*b += (uint32_t)(len - var1) * (unsigned char)buf[var1];
 	}
-	else{
-		fclose(client_get_file);
-		printf("\nFile transfer complete\n");
-		def_print_enable = true;
+}
+
+/*----------------- write_delta_literal() -------------------
+
+	@brief : Write 'L' records of literal data to the delta
+	
+	@param : delta_file - delta
+			 ptr - literal data
+			 len - literal length
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void write_delta_literal(FILE *delta_file, char *ptr, long len){
+	char rec[5];
+	int var1;
+	while(len > 0){
+		var1 = (len < DELTA_LITERAL_MAX) ? (int)len : DELTA_LITERAL_MAX;
+		rec[0] = 'L';
+		put_be32(rec + 1, var1);
+		fwrite(rec, 1, 5, delta_file);
+		fwrite(ptr, 1, var1, delta_file);
+		ptr += var1;
+		len -= var1;
 	}
 }
 
-/*----------------- wait_for_data_ack() ----------------------
+/*----------------- write_delta_blocks() -------------------
 
-	@brief : Waits for data packet ACK to be received from server
+	@brief : Write a 'B' record - a run of blocks of the copy at server
 	
-	@param : none
+	@param : delta_file - delta
+			 first - first block
+			 count - block count
 	
 	@return : none
 
 -----------------------------------------------------------*/
 
-void wait_for_data_ack(void){
-	int var1, var2;
-	bzero(client_recv_buf,BUFSIZE);
-	var1 = recvfrom(sockfd, data_pkt_recv_buf, BUFSIZE, 0, (struct sockaddr *)&serveraddr, &serverlen);
-		    if (var1 < 0) {printf("ERROR in recvfrom");}
-			else{
-				open_packet_client(data_pkt_recv_buf,data_pkt_data_buf,var1);
+void write_delta_blocks(FILE *delta_file, int first, int count){
+	char rec[9];
+	if(count == 0){return;}
+	rec[0] = 'B';
+	put_be32(rec + 1, first);
+	put_be32(rec + 5, count);
+	fwrite(rec, 1, 9, delta_file);
+}
+
+/*----------------- build_delta() -------------------
+
+	@brief : Compare the put file with the block signatures of the 
+			 copy at server (rsync). The weak checksum is rolled over 
+			 the file one byte at a time and looked up in a hash 
+			 table of the blocks, the strong checksum confirms a 
+			 match. Matched blocks become 'B' records, runs of 
+			 consecutive blocks are merged, the bytes in between 'L' 
+			 records. 'H' gives the block layout, 'E' the size and 
+			 hash of the whole file for the server to check.
+	
+	@param : sig_file - block signatures from server
+			 delta_file - delta, written from its start
+	
+	@return : false if the signatures or the put file are unusable
+
+-----------------------------------------------------------*/
+
+bool build_delta(FILE *sig_file, FILE *delta_file){
+	char hdr[24], *map;								// signature entries and H / E records
+	uint32_t *weak_arr, a, b, weak;
+	uint64_t *strong_arr, basis_size, strong;
+	int *head_arr, *next_arr, block_size, block_count, hash_mask, var1, run_first, run_count, fd, match;
+	off_t pos, literal_pos, file_size, literal_bytes;
+	struct stat st;
+	fseeko(sig_file, 0, SEEK_SET);
+	if(fread(hdr, 1, DELTA_SIG_HDR_SIZE, sig_file) != DELTA_SIG_HDR_SIZE){return false;}
+	block_size = (int)get_be32(hdr);
+	basis_size = get_be64(hdr + 4);
+	if((block_size < DELTA_BLOCK_MIN) || (block_size > DELTA_BLOCK_MAX)){return false;}
+	block_count = (int)(basis_size / block_size);
+	for(hash_mask = 1023; hash_mask < block_count; hash_mask = (hash_mask << 1) | 1);
+	weak_arr = malloc((block_count + 1) * sizeof(uint32_t));
+	strong_arr = malloc((block_count + 1) * sizeof(uint64_t));
+	next_arr = malloc((block_count + 1) * sizeof(int));
+	head_arr = malloc((hash_mask + 1) * sizeof(int));
+	fd = open(filename_buf, O_RDONLY);
+	map = NULL;
+	if((weak_arr == NULL) || (strong_arr == NULL) || (next_arr == NULL) || (head_arr == NULL) || 
+	   (fd < 0) || (fstat(fd, &st) < 0)){block_count = -1;}
+	for(var1 = 0; var1 <= hash_mask && (block_count >= 0); var1++){head_arr[var1] = -1;}
+	for(var1 = 0; var1 < block_count; var1++){
+		if(fread(hdr, 1, DELTA_SIG_ENTRY_SIZE, sig_file) != DELTA_SIG_ENTRY_SIZE){
+			block_count = -1;
+			break;
+		}
+		weak_arr[var1] = get_be32(hdr);
+		strong_arr[var1] = get_be64(hdr + 4);
+		next_arr[var1] = head_arr[weak_arr[var1] & hash_mask];
+		head_arr[weak_arr[var1] & hash_mask] = var1;
+	}
+	file_size = (block_count >= 0) ? st.st_size : 0;
+	if((block_count >= 0) && (file_size > 0)){
+		map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(map == MAP_FAILED){
+			map = NULL;
+			block_count = -1;
+		}
+	}
+	if(block_count < 0){
+		if(fd >= 0){close(fd);}
+		free(weak_arr);
+		free(strong_arr);
+		free(next_arr);
+		free(head_arr);
+		return false;
+	}
+	fseeko(delta_file, 0, SEEK_SET);
+	hdr[0] = 'H';
+	put_be32(hdr + 1, block_size);
+	put_be64(hdr + 5, basis_size);
+	fwrite(hdr, 1, 13, delta_file);
+	pos = 0;
+	literal_pos = 0;
+	literal_bytes = 0;
+	run_first = 0;
+	run_count = 0;
+	a = 0;
+	b = 0;
+	if(file_size >= block_size){weak_sums(map, block_size, &a, &b);}
+	while((pos + block_size) <= file_size){
+		weak = WEAK_CHECKSUM(a, b);
+		match = -1;
+		strong = 0;
+		for(var1 = head_arr[weak & hash_mask]; var1 >= 0; var1 = next_arr[var1]){
+			if(weak_arr[var1] != weak){continue;}
+			if(strong == 0){strong = fnv1a_update(FNV_OFFSET_BASIS, map + pos, block_size);}
+			if(strong_arr[var1] == strong){
+				match = var1;
+				if(var1 == (run_first + run_count)){break;}	// prefer the block that extends the run
+			}
+		}
+		if(match >= 0){
+			if((pos > literal_pos) || (match != (run_first + run_count))){
+				write_delta_blocks(delta_file, run_first, run_count);
+				write_delta_literal(delta_file, map + literal_pos, pos - literal_pos);
+				literal_bytes += pos - literal_pos;
+				run_first = match;
+				run_count = 0;
 			}
+			run_count++;
+			pos += block_size;
+			literal_pos = pos;
+			if((pos + block_size) <= file_size){weak_sums(map + pos, block_size, &a, &b);}
+			continue;
+		}
+		if((pos + block_size) < file_size){				// roll one byte on
+			a = a - (unsigned char)map[pos] + (unsigned char)map[pos + block_size];
+			b = b - ((uint32_t)block_size * (unsigned char)map[pos]) + a;
+		}
+		pos++;
+	}
+	write_delta_blocks(delta_file, run_first, run_count);
+	write_delta_literal(delta_file, map + literal_pos, file_size - literal_pos);
+	literal_bytes += file_size - literal_pos;
+	hdr[0] = 'E';
+	put_be64(hdr + 1, (uint64_t)file_size);
+	put_be64(hdr + 9, fnv1a_update(FNV_OFFSET_BASIS, map, file_size));
+	fwrite(hdr, 1, 17, delta_file);
+	log_info("\nDelta : %lld of %lld bytes changed, %d of %d blocks of %d bytes reused", (long long)literal_bytes, 
+			 (long long)file_size, (int)((file_size - literal_bytes) / block_size), block_count, block_size);
+	if(map != NULL){munmap(map, file_size);}
+	close(fd);
+	free(weak_arr);
+	free(strong_arr);
+	free(next_arr);
+	free(head_arr);
+	return (fflush(delta_file) == 0);
 }
 
-/*----------------- send_data_packet() ----------------------
+/*----------------- get_signature() -------------------
 
-	@brief : Send data packet when ACK for previous packet received from server
+	@brief : Ask the server for the block signatures of its copy of 
+			 the put file and receive them like a get, into sig_file
 	
-	@param : none
+	@param : sig_file - temporary file for the signatures
 	
-	@return : none
+	@return : false if the server has no copy or no delta support
 
 -----------------------------------------------------------*/
 
-void send_data_packet(void){
-	int loop_var1,pkt_len1,pkt_len2,var2;
-	bzero(data_pkt_data_buf,DATA_FIELD_LENGTH);
-					
-					if((file_data_end_ptr - file_data_current_ptr) < DATA_FIELD_LENGTH){
-						send_data_packet_size = (int)(file_data_end_ptr - file_data_current_ptr) - 1;
-					}
-					else{send_data_packet_size = DATA_FIELD_LENGTH;}
-					send_data_pkt_init_ptr = data_pkt_data_buf;
-					send_data_pkt_current_ptr = send_data_pkt_init_ptr;
-					for(loop_var1 = 0; loop_var1 < send_data_packet_size; loop_var1++){
-						 *send_data_pkt_current_ptr++ = *file_data_current_ptr++;
-					}					
-					send_data_pkt_current_ptr = send_data_pkt_init_ptr;
-					bzero(client_send_buf,BUFSIZE);
-					pkt_len1 = create_packet('D','0',client_send_buf,send_data_ack_arr_index,data_pkt_data_buf,send_data_packet_size);
-					pkt_len2 = sendto(sockfd, client_send_buf, pkt_len1, 0, (struct sockaddr *)&serveraddr, serverlen);
-					if (pkt_len2 < 0){error("ERROR in sendto");}
-					else{
-						printf("\nSent to server - data packet %d of %d bytes",send_data_ack_arr_index + 1,send_data_packet_size);
-						wait_for_data_ack();
-					}
+bool get_signature(FILE *sig_file){
+	struct packet_info info;
+	char temp_buf[32];
+	int var1;
+	bzero(client_send_buf,BUFSIZE);
+	var1 = create_packet('C','S',client_send_buf,next_cmd_seq_no(),filename_buf,filename_len);
+	var1 = send_request(var1,'K',0,MAX_RETX_COUNT);
+	if(var1 < 0){
+		log_info("\nNo delta support at server, sending the whole file");
+		return false;
+	}
+	if(!parse_packet(client_recv_buf,var1,&info) || (info.seq_no != 1)){
+		log_info("\nNo copy of %s at server, sending the whole file", filename_buf);
+		return false;
+	}
+	snprintf(temp_buf, sizeof(temp_buf), "%.*s", info.data_len, info.data_ptr);
+	client_get_file = fdopen(dup(fileno(sig_file)), "wb");
+	if(client_get_file == NULL){return false;}
+	data_byte_max_count = (off_t)strtoll(temp_buf, NULL, 10);
+	data_pkt_max_count = (int)((data_byte_max_count/data_size) + 1);
+	get_digest_valid = false;
+	recv_data_ack_arr_index = 0;
+	bzero(recv_data_ack_arr,sizeof(recv_data_ack_arr));
+	get_journal_fd = -1;
+	send_file_size_ack();
+	wait_for_data_pkt();
+	def_print_enable = false;
+	return (recv_data_ack_arr_index == data_pkt_max_count);
 }
 
+/*----------------- put_delta() -------------------
+
+	@brief : pd - send only the changes of the put file against the 
+			 copy at server. The block signatures of the copy are 
+			 fetched, the delta is built in a temporary file and put 
+			 like a file with command 'Q', and the server rebuilds 
+			 the file from it at K.
+	
+	@param : none
+	
+	@return : false if the whole file has to be put instead
+
+-----------------------------------------------------------*/
+
+bool put_delta(void){
+	FILE *sig_file;
+	off_t delta_size;
+	int var1, packet_count;
+	bool ret;
+	ret = false;
+	sig_file = tmpfile();
+	put_delta_file = tmpfile();
+	if((sig_file != NULL) && (put_delta_file != NULL) && get_signature(sig_file) && build_delta(sig_file, put_delta_file)){
+		delta_size = ftello(put_delta_file);
+		packet_count = max_packet_count;
+		max_packet_count = (int)((delta_size/data_size) + 1);
+		bzero(client_data_buf,BUFSIZE);
+		var1 = (int)strlen(filename_buf) + 1;
+		memcpy(client_data_buf, filename_buf, var1);
+		var1 += snprintf(client_data_buf + var1, BUFSIZE - var1, "%lld", (long long)delta_size);
+		bzero(client_send_buf,BUFSIZE);
+		var1 = create_packet('C','Q',client_send_buf,next_cmd_seq_no(),client_data_buf,var1);
+		var1 = send_request(var1,'A','P',MAX_RETX_COUNT);
+		bzero(client_send_buf,BUFSIZE);
+		if(var1 < 0){log_error("\nNo reply from server\n");}
+		else{
+			put_delta_failed = false;
+			open_packet_client(client_recv_buf,client_data_buf,var1);
+			ret = !put_delta_failed;
+			if(put_delta_failed){log_info("\nServer could not rebuild %s, sending the whole file", filename_buf);}
+		}
+		max_packet_count = packet_count;
+	}
+	if(sig_file != NULL){fclose(sig_file);}
+	if(put_delta_file != NULL){fclose(put_delta_file);}
+	put_delta_file = NULL;
+	def_print_enable = false;
+	return ret;
+}
 
 /*----------------- open_packet_server() -------------------
 
@@ -574,96 +4742,96 @@ void send_data_packet(void){
 -----------------------------------------------------------*/
 
 int open_packet_client(char *pkt_ptr, char *data_ptr, int pkt_len){
-	int pkt_len1, pkt_len2,loop_var1,data_len,seq_number;
-	char pkt_type;
-	pkt_type = *pkt_ptr;
-	switch(pkt_type){
+	struct packet_info info;
+	int loop_var1,data_len,seq_number;
+	if(!parse_packet(pkt_ptr,pkt_len,&info)){
+		log_error("\nMalformed packet dropped");
+		return -1;
+	}
+	seq_number = (int)info.seq_no;
+	data_len = info.data_len;
+	switch(info.type){
 		case 'D':				
-				pkt_ptr++;
-				recv_data_ack_arr_index = str_to_int(pkt_ptr);
-				pkt_ptr += 6;
-				recv_data_pkt_data_len = str_to_int(pkt_ptr);
-				pkt_ptr += 6;
-				printf("\nReceived data packet %d of %d bytes\n",recv_data_ack_arr_index + 1,recv_data_pkt_data_len);
-				
-				for(loop_var1 = 0;loop_var1 < recv_data_pkt_data_len; loop_var1++){
-					fputc(*(pkt_ptr + loop_var1),client_get_file);
-				}
-				recv_data_ack_arr[recv_data_ack_arr_index] = true;
-				client_send_data_ack(recv_data_ack_arr_index);
-				
+				recv_data_packet(&info);
 		break;
 		case 'C':
 		break;
 		case 'A':
-				if(*(pkt_ptr + 13) == 'P'){
-					printf("\n\nACK from server received\nStarting File Transfer ....\n");
-					send_data_ack_arr_index = 0;
-					bzero(data_pkt_data_buf,DATA_FIELD_LENGTH);
-					if(put_max_byte_count < DATA_FIELD_LENGTH){
-						send_data_packet_size = put_max_byte_count;
+				if(info.cmd == 'P'){
+					if(seq_number == 2){
+						log_error("\nServer refused to write %s\n", filename_buf);
+						def_print_enable = true;
+						break;
 					}
-					else{send_data_packet_size = DATA_FIELD_LENGTH;}
-					send_data_pkt_init_ptr = data_pkt_data_buf;
-					send_data_pkt_current_ptr = send_data_pkt_init_ptr;
-					for(loop_var1 = 0; loop_var1 < send_data_packet_size; loop_var1++){
-						 *send_data_pkt_current_ptr++ = *file_data_current_ptr++;
-					}					
-					send_data_pkt_current_ptr = send_data_pkt_init_ptr;
-					bzero(client_send_buf,BUFSIZE);
-					pkt_len1 = create_packet('D','0',client_send_buf,send_data_ack_arr_index,data_pkt_data_buf,send_data_packet_size);
-					pkt_len2 = sendto(sockfd, client_send_buf, pkt_len1, 0, (struct sockaddr *)&serveraddr, serverlen);
-					if (pkt_len2 < 0){error("ERROR in sendto");}
-					else{
-						printf("\nSent to server - data packet %d of %d bytes",send_data_ack_arr_index + 1,send_data_packet_size);
-						wait_for_data_ack();
+					log_debug("\n\nACK from server received\nStarting File Transfer ....\n");
+					put_start_seq = check_put_resume(info.data_ptr,data_len);
+					if(put_start_seq < 0){
+						def_print_enable = true;
+						break;
+					}
+					client_put_file = (put_delta_file != NULL) ? fdopen(dup(fileno(put_delta_file)),"rb") : fopen(filename_buf,"rb");
+					if(client_put_file == NULL){
+						log_error("\nCould not open file\n");
+						def_print_enable = true;
+						break;
+					}
+					put_file_crc = 0;
+					if(crc_enable && !crc_file_range(fileno(client_put_file), 0, (off_t)put_start_seq * data_size, &put_file_crc)){
+						log_error("\nCould not read %s for its digest", filename_buf);
+					}
+					fseeko(client_put_file, (off_t)put_start_seq * data_size, SEEK_SET);
+					bzero(send_data_ack_arr,sizeof(send_data_ack_arr));
+					compress_reset(put_start_seq);
+					send_data_ack_arr_index = put_start_seq;
+					send_data_next_index = put_start_seq;
+					send_data_read_index = put_start_seq;
+					send_retx_count = 0;
+					send_high_ack_seq = put_start_seq - 1;
+					if(fec_enc.k > 0){fec_encoder_start(&fec_enc, data_size, max_packet_count - 1);}
+					cc_init(&cc, cc_algo, data_size);
+					wait_for_data_ack();
+					fclose(client_put_file);
+					if(send_data_ack_arr_index >= max_packet_count){
+						send_put_complete();
 					}
 				}
-				if(*(pkt_ptr + 13) == 'D'){
-					pkt_ptr++;
-					if((str_to_int(pkt_ptr)) == send_data_ack_arr_index){
-						send_data_ack_arr[send_data_ack_arr_index] = true;
-						printf("\nACK for packet %d received from server",send_data_ack_arr_index + 1);
-						
-						if(send_data_ack_arr_index < (max_packet_count - 1)){
-							send_data_ack_arr_index++;
-							send_data_packet();
-						}
-						else{
-							printf("\nAll packets sent!");
-							int temp_var1,temp_var2;
-							def_print_enable = true;
-							bzero(client_send_buf,BUFSIZE);
-							char temp1;
-							temp_var1 = create_packet('K','0',client_send_buf,0,&temp1,1);
-							temp_var2 = sendto(sockfd, client_send_buf, temp_var1, 0, (struct sockaddr *)&serveraddr, serverlen);
-							if (temp_var2 < 0){error("ERROR in sendto");}
-							else{
-								printf("\nSent file transfer complete message to server");
-							}
-							break;
+				if(info.cmd == 'D'){
+					if(send_data_ack_arr_index >= max_packet_count){break;}
+					process_data_ack(&info);
+					
+					if(send_data_ack_arr_index < max_packet_count){
+						send_data_window();
+					}
+					else{
+						log_info("\nAll packets sent!");
+						cc_log_stats(&cc);
+						compress_log_stats();
+						if(fec_enc.k > 0){
+							log_info("\nFEC : %ld repair packets sent, %d + %d per block", fec_enc.repair_count, fec_enc.k, fec_enc.m);
 						}
+						def_print_enable = true;
+						break;
 					}
-					
 				}
-				if(*(pkt_ptr + 13) == 'X'){
-					pkt_ptr++;
-					if(str_to_int(pkt_ptr) == 1){
-						printf("\nFile deleted at server\n");
+				if(info.cmd == 'X'){
+					if(seq_number == 1){
+						log_info("\nFile deleted at server\n");
 					}
-					if(str_to_int(pkt_ptr) == 2){
-						printf("\nFile not found at server!\n");
+					if(seq_number == 2){
+						log_info("\nFile not found at server!\n");
 					}
 				}
-				if(*(pkt_ptr + 13) == 'L'){
-					printf("\n\nFile List - \n\n");
-					pkt_ptr += 7;
-					data_len = str_to_int(pkt_ptr);
-					pkt_ptr += 7;
-					for(loop_var1=0;loop_var1<data_len;loop_var1++){
-						printf("%c",*(pkt_ptr + loop_var1));
+				if(info.cmd == 'L'){
+					if(seq_number == 0){				// server without paged lists - names only
+						for(loop_var1=0;loop_var1<data_len;loop_var1++){
+							printf("%c",*(info.data_ptr + loop_var1));
+						}
+						list_more = false;
+					}
+					else{
+						print_file_list(info.data_ptr,data_len);
+						list_more = (seq_number == 1);
 					}
-					printf("\n\nFile List printed\n\n");
 				}
 				
 		break;
@@ -671,34 +4839,235 @@ int open_packet_client(char *pkt_ptr, char *data_ptr, int pkt_len){
 				
 		break;
 		case 'K':
-			printf("\n%s\n",pkt_ptr);
-			pkt_ptr++;
-			seq_number = str_to_int(pkt_ptr);
 			if(seq_number == 1){
-				printf("\nFile found");	
-				pkt_ptr += 6;	
-				data_len = str_to_int(pkt_ptr);
-				pkt_ptr += 7;
-				data_pkt_max_count = estimate_data_packet_count(pkt_ptr,data_len);
-				printf("\ndata packet count : %d\n",data_pkt_max_count);
+				log_info("\nFile found");	
+				data_pkt_max_count = estimate_data_packet_count(info.data_ptr,data_len);
+				log_debug("\ndata packet count : %d\n",data_pkt_max_count);
 			
-				bzero(client_send_buf,BUFSIZE);
-				pkt_len1 = create_packet('A','F',client_send_buf,1,ack_buf,0);
-				pkt_len2 = sendto(sockfd, client_send_buf, pkt_len1, 0, (struct sockaddr *)&serveraddr, serverlen);
-				bzero(client_send_buf,BUFSIZE);
-				get_cmd_ack = false;
+				send_file_size_ack();
 				wait_for_data_pkt();
 			}
 			else{
-				printf("\n\nFILE NOT FOUND AT SERVER\n");
+				log_info("\n\nFILE NOT FOUND AT SERVER\n");
 				def_print_enable = true;
 			}		
 		break;
 		default:
 		break;
 	}
+	return 0;
+}
+
+
+/*----------------- send_pmtu_probe() -------------------
+
+	@brief : Send a path MTU probe ('C', command 'M') and wait an RTO 
+			 for the server to echo it. The probe is padded with 
+			 pad_len bytes and goes out with the DF bit set, ignoring 
+			 the path MTU cached by the kernel, so a probe too large 
+			 for a link on the way is dropped instead of fragmented. 
+			 A probe with no padding commits size as the payload of 
+			 the session.
+	
+	@param : size - payload size probed
+			 pad_len - padding sent (size, or 0 to commit)
+			 tries - probes sent before giving up
+	
+	@return : true if the server echoed the probe
+
+-----------------------------------------------------------*/
+
+bool send_pmtu_probe(int size, int pad_len, int tries){
+	struct packet_info info;
+	long unsigned int send_time;
+	int var1, recv_len, timeout;
+	bzero(client_data_buf,BUFSIZE);
+	for(var1 = 0; var1 < tries; var1++){
+		recv_len = create_packet('C','M',client_send_buf,size,client_data_buf,pad_len);
+		if(sendto(sockfd, client_send_buf, recv_len, 0, (struct sockaddr *)&serveraddr, serverlen) < 0){
+			if(errno == EMSGSIZE){return false;}		// larger than the interface MTU
+			error("ERROR in sendto");
+		}
+		send_time = get_time_msec();
+		while((timeout = (int)(rtt.rto - (long)time_diff(send_time))) > 0){
+			recv_len = wait_for_packet(client_recv_buf,BUFSIZE,timeout);
+			if(recv_len <= 0){break;}
+			if(parse_packet(client_recv_buf,recv_len,&info) && (info.type == 'A') && (info.cmd == 'M') && 
+			   (info.seq_no == size) && (info.data_len == pad_len)){
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/*----------------- discover_path_mtu() -------------------
+
+	@brief : Find the largest data payload that gets through to the 
+			 server and back (packetization layer PMTU discovery). 
+			 Payloads for the common link MTUs are probed from the 
+			 largest down while the socket sends with 
+			 IP_PMTUDISC_PROBE, and the first one echoed is committed. 
+			 Sends larger than the local interface fail right away 
+			 with EMSGSIZE. The old discovery mode is restored after.
+	
+	@param : max_size - largest payload both sides take
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void discover_path_mtu(int max_size){
+	int pmtu_mode, default_mode, var1, size, last_size;
+	socklen_t opt_len;
+	opt_len = sizeof(default_mode);
+	if(getsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &default_mode, &opt_len) < 0){default_mode = IP_PMTUDISC_WANT;}
+	pmtu_mode = IP_PMTUDISC_PROBE;
+	setsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &pmtu_mode, sizeof(pmtu_mode));
+	last_size = 0;
+	for(var1 = 0; var1 < (int)(sizeof(pmtu_candidate_arr)/sizeof(pmtu_candidate_arr[0])); var1++){
+		size = pmtu_candidate_arr[var1] - UDP_IP_HDR_SIZE - BIN_HDR_SIZE - (crc_enable ? CRC_SIZE : 0) - 
+			   ((fec_enc.k > 0) ? (FEC_REPAIR_HDR_SIZE + FEC_SYMBOL_HDR_SIZE) : 0);	// repair packets are larger
+		if(size > max_size){size = max_size;}
+		if((size == last_size) || (size < DATA_FIELD_MIN_LENGTH)){continue;}
+		last_size = size;
+		if(send_pmtu_probe(size, size, PMTU_PROBE_COUNT)){break;}
+		log_debug("\nNo echo for %d byte path MTU probe", size);
+	}
+	setsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &default_mode, sizeof(default_mode));
+	if(var1 == (int)(sizeof(pmtu_candidate_arr)/sizeof(pmtu_candidate_arr[0]))){
+		log_info("\nNo path MTU probe echoed, keeping default data packet size\n");
+		return;
+	}
+	if(send_pmtu_probe(size, 0, MAX_RETX_COUNT)){
+		data_size = size;
+	}
+	else{
+		log_info("\nServer did not ACK data packet size %d\n", size);
+	}
+}
+
+/*----------------- negotiate_header() -------------------
+
+	@brief : Offer the binary header to the server at connect time. 
+			 Both sides use the lower of their header versions, a v2 
+			 server also hands out the session ID in the reply. 
+			 Servers that do not answer the hello (ASCII only) keep 
+			 the ASCII header and are not expected to ACK 'K' or exit. 
+			 The hello also offers the largest data payload, a server 
+			 that answers with its own limit gets the path MTU probed. 
+			 Compression and packet CRCs are offered as feature bits, 
+			 FEC (-f) as a feature bit and the block geometry, which 
+			 the server echoes if it takes it. The hello also gives 
+			 the first RTT sample.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void negotiate_header(void){
+	struct packet_info info;
+	int var1,var2;
+	long unsigned int send_time;
+	uint32_t hello_data[3];
+	int max_data_size, fec_data;
+	ctrl_ack_enable = false;
+	compress_enable = false;
+	crc_enable = false;
+	fec_enc.k = fec_dec.k = 0;
+	max_data_size = 0;
+	hello_data[0] = htonl(DATA_FIELD_MAX_LENGTH);
+	hello_data[1] = htonl((compress_opt ? HELLO_FEATURE_COMPRESS : 0) | HELLO_FEATURE_CRC | ((fec_opt_k > 0) ? HELLO_FEATURE_FEC : 0));
+	hello_data[2] = htonl((fec_opt_k << 8) | fec_opt_m);
+	for(var1 = 0; var1 < HELLO_RETRY_COUNT; var1++){
+		bzero(client_send_buf,BUFSIZE);
+		var2 = create_packet('C','H',client_send_buf,HDR_VERSION,(char *)hello_data,sizeof(hello_data));
+		var2 = sendto(sockfd, client_send_buf, var2, 0, (struct sockaddr *)&serveraddr, serverlen);
+		if (var2 < 0){error("ERROR in sendto");}
+		send_time = get_time_msec();
+		var2 = wait_for_packet(client_recv_buf,BUFSIZE,HELLO_TIMEOUT_MSEC);
+		if((var2 > 0) && parse_packet(client_recv_buf,var2,&info) && (info.type == 'A') && (info.cmd == 'H')){
+			if(var1 == 0){rto_update(&rtt, (long)time_diff(send_time));}
+			ctrl_ack_enable = true;
+			hdr_mode = (info.seq_no < HDR_VERSION) ? (int)info.seq_no : HDR_VERSION;
+			if((hdr_mode >= 2) && (info.data_len >= 4)){
+				session_id = (uint32_t)get_seq_field(info.data_ptr,true);
+			}
+			if((hdr_mode >= 2) && (info.data_len >= 8)){		// server takes payload sizes
+				max_data_size = (int)get_seq_field(info.data_ptr + 4,true);
+			}
+			if((hdr_mode != HDR_MODE_ASCII) && (info.data_len >= 12)){	// features the server takes
+				compress_enable = ((int)get_seq_field(info.data_ptr + 8,true) & HELLO_FEATURE_COMPRESS) != 0;
+				crc_enable = ((int)get_seq_field(info.data_ptr + 8,true) & HELLO_FEATURE_CRC) != 0;
+			}
+			if((fec_opt_k > 0) && (info.data_len >= 16) && ((int)get_seq_field(info.data_ptr + 8,true) & HELLO_FEATURE_FEC)){
+				fec_data = (int)get_seq_field(info.data_ptr + 12,true);		// FEC block the server took, K << 8 | M
+				if(((fec_data >> 8) >= 2) && ((fec_data >> 8) <= FEC_MAX_DATA) && 
+				   ((fec_data & 0xff) >= 1) && ((fec_data & 0xff) <= FEC_MAX_REPAIR)){
+					fec_enc.k = fec_dec.k = fec_data >> 8;
+					fec_enc.m = fec_dec.m = fec_data & 0xff;
+				}
+			}
+			break;
+		}
+	}
+	bzero(client_recv_buf,BUFSIZE);
+	if(hdr_mode != HDR_MODE_ASCII){
+		log_info("\nUsing binary packet header v%d, session %u\n", hdr_mode, session_id);
+	}
+	else{
+		log_info("\nUsing ASCII packet header\n");
+	}
+	if(max_data_size > DATA_FIELD_MAX_LENGTH){max_data_size = DATA_FIELD_MAX_LENGTH;}
+	if(max_data_size >= DATA_FIELD_MIN_LENGTH){
+		discover_path_mtu(max_data_size);
+	}
+	log_info("\nUsing %d byte data packets\n", data_size);
+	if(compress_enable){compress_start();}
+	if(compress_enable){
+		log_info("\nCompressing data packets\n");
+	}
+	if(crc_enable){
+		crc32c_shift_op(data_crc_op, data_size);
+		log_info("\nCRC32C on packets and file digests (%s)\n", crc32c_hw_enable ? "SSE4.2" : "table");
+	}
+	if(fec_enc.k > 0){
+		log_info("\nFEC : %d data + %d repair packets per block (GF(256) %s)\n", fec_enc.k, fec_enc.m, 
+				 gf256_hw_enable ? "SSSE3" : "table");
+	}
+	else if(fec_opt_k > 0){
+		log_info("\nServer does not take FEC\n");
+	}
 }
 
+/*----------------- renew_session() -------------------
+
+	@brief : Get a new session from a server that dropped the old 
+			 one, with a new hello from the ASCII header and no ID. 
+			 The data payload size of the old session is committed 
+			 again if the probes found another one, so a put whose 
+			 packets are already counted keeps its size.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void renew_session(void){
+	int old_size;
+	old_size = data_size;
+	hdr_mode = HDR_MODE_ASCII;
+	session_id = 0;
+	negotiate_header();
+	if((hdr_mode >= 2) && (data_size != old_size) && send_pmtu_probe(old_size, 0, MAX_RETX_COUNT)){
+		data_size = old_size;
+		if(crc_enable){crc32c_shift_op(data_crc_op, data_size);}
+		log_info("\nKeeping %d byte data packets\n", data_size);
+	}
+}
 
 /*----------------- check_cmd() -------------------
 
@@ -720,6 +5089,9 @@ bool check_cmd(char *cmd_check_buf){
 	else if(strcmp(cmd_check_buf,"dl") == 0){
 		return true;
 	}
+	else if((strcmp(cmd_check_buf,"rg") == 0) || (strcmp(cmd_check_buf,"rp") == 0) || (strcmp(cmd_check_buf,"pd") == 0)){
+		return true;
+	}
 	else{
 		return false;
 	}
@@ -729,21 +5101,84 @@ int main(int argc, char **argv) {
 	
 	/*--------------------------------------------------------------*/
 	
-    int exit_cmd;
+    int exit_cmd, opt;
+    socklen_t opt_len;
     char exit_char;
+    bool ascii_only = false;
     /* check command line arguments */
-    if (argc != 3) {
-       fprintf(stderr,"usage: %s <hostname> <port>\n", argv[0]);
+    window_size = DEFAULT_WINDOW_SIZE;
+    window_mode = WINDOW_MODE_SR;
+    while ((opt = getopt(argc, argv, "w:m:c:f:agzv")) != -1) {
+       switch (opt) {
+          case 'w':
+             window_size = atoi(optarg);
+             break;
+          case 'm':
+             window_mode = (strcmp(optarg, "gbn") == 0) ? WINDOW_MODE_GBN : WINDOW_MODE_SR;
+             break;
+          case 'c':
+             cc_algo = find_cc_ops(optarg);
+             if (cc_algo == NULL) {
+                fprintf(stderr,"unknown congestion control %s (newreno|bbr)\n", optarg);
+                exit(0);
+             }
+             break;
+          case 'f':
+             if ((sscanf(optarg, "%d:%d", &fec_opt_k, &fec_opt_m) != 2) || (fec_opt_k < 2) || (fec_opt_k > FEC_MAX_DATA) || 
+                 (fec_opt_m < 1) || (fec_opt_m > FEC_MAX_REPAIR)) {
+                fprintf(stderr,"FEC block is K:M, 2 <= K <= %d data and 1 <= M <= %d repair packets\n", FEC_MAX_DATA, FEC_MAX_REPAIR);
+                exit(0);
+             }
+             break;
+          case 'a':
+             ascii_only = true;
+             break;
+          case 'z':
+             compress_opt = false;
+             break;
+          case 'g':
+             udp_gso_enable = true;
+             udp_gro_enable = true;
+             break;
+          case 'v':
+             log_level++;
+             break;
+          default:
+             break;
+       }
+    }
+    if (argc - optind != 2) {
+       fprintf(stderr,"usage: %s [-w window] [-m gbn|sr] [-c newreno|bbr] [-f K:M] [-a] [-g] [-z] [-v] <hostname> <port>\n", argv[0]);
        exit(0);
     }
-    hostname = argv[1];
-    portno = atoi(argv[2]);
+    if (window_size < 1) {window_size = 1;}
+    if (window_size > MAX_WINDOW_SIZE) {window_size = MAX_WINDOW_SIZE;}
+    hostname = argv[optind];
+    portno = atoi(argv[optind + 1]);
 
     /* socket: create the socket */
     sockfd = socket(AF_INET, SOCK_DGRAM, 0);
     if (sockfd < 0) 
         error("ERROR opening socket");
 
+    /* socket buffers: the default holds only a few large data packets, 
+     * the kernel caps the request at net.core.rmem_max / wmem_max */
+    opt = SOCKET_BUFSIZE;
+    setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, (const void *)&opt, sizeof(int));
+    setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, (const void *)&opt, sizeof(int));
+
+    /* segmentation offload (-g): UDP_SEGMENT sends and UDP_GRO receives, 
+     * each left off if the kernel does not know the option */
+    if (udp_gso_enable) {
+        opt_len = sizeof(opt);
+        udp_gso_enable = (getsockopt(sockfd, SOL_UDP, UDP_SEGMENT, (void *)&opt, &opt_len) == 0);
+        recv_gro_buf = malloc((size_t)RECV_BATCH_SIZE * GRO_BUFSIZE);
+        opt = 0;
+        udp_gro_enable = (recv_gro_buf != NULL) && 
+                         (setsockopt(sockfd, SOL_UDP, UDP_GRO, (const void *)&opt, sizeof(int)) == 0);
+        log_info("UDP GSO %s, GRO %s\n", udp_gso_enable ? "on" : "not supported", udp_gro_enable ? "on" : "not supported");
+    }
+
     /* gethostbyname: get the server's DNS entry */
     server = gethostbyname(hostname);
     if (server == NULL) {
@@ -758,7 +5193,21 @@ int main(int argc, char **argv) {
     serveraddr.sin_port = htons(portno);
 	serverlen = sizeof(serveraddr);
    
-	setsockopt(sockfd,SOL_SOCKET,SO_RCVTIMEO,(char*)&recv_timeout,sizeof(struct timeval));
+	rto_init(&rtt);
+
+	crc32c_init();
+	fec_init();
+	state_dir_fd = state_dir_open();
+	if(state_dir_fd < 0){log_error("\nCannot open %s, gt is not resumable\n", STATE_DIR);}
+
+	/*------ negotiate packet header --------*/
+	
+	hdr_mode = HDR_MODE_ASCII;
+	data_size = DATA_FIELD_LENGTH;
+	ctrl_ack_enable = true;
+	if(!ascii_only){
+		negotiate_header();
+	}
 
 	/*--------------------------------------------------------------*/
 	
@@ -773,8 +5222,11 @@ int main(int argc, char **argv) {
 			printf("\n\nEnter one of the following commands\n");
 			printf("gt [file_name] : Get file from server\n");
 			printf("pt [file_name] : Put/Send file to server\n");
+			printf("rg [file_name] : Resume an interrupted get\n");
+			printf("rp [file_name] : Resume an interrupted put\n");
+			printf("pd [file_name] : Put only the changes against the copy at server\n");
 			printf("dl [file_name] : Delete file at server\n");
-			printf("ls : List the files in the server\n");
+			printf("ls [pattern] : List the files in the server\n");
 			printf("ch : Chat with server");
 			printf("ex : Exit server gracefully\n\n\n - ");
 			bzero(cmd_buff, CMD_BUFSIZE);
@@ -787,22 +5239,28 @@ int main(int argc, char **argv) {
 			if(check_cmd(cmd_detect)){
 				filename_len = copy_filename(cmd_buff,filename_buf);
 			}
+			list_pattern_buf[0] = '\0';
+			if((strcmp(cmd_detect,"ls") == 0) && (cmd_buff[2] == ' ')){
+				copy_filename(cmd_buff,list_pattern_buf);
+			}
 			bzero(cmd_buff,CMD_BUFSIZE);
 		}
 		
 
 		/****************** Get File Request **********************/
 
-		if(strcmp(cmd_detect,"gt") == 0){
+		if((strcmp(cmd_detect,"gt") == 0) || (strcmp(cmd_detect,"rg") == 0)){
+			get_resume_enable = (cmd_detect[0] == 'r');
 			bzero(cmd_detect,2);
 			def_print_enable = false;
 			get_cmd_enable = true;
-			get_cmd_ack = true;
 		}
 
 		/****************** Put File Request **********************/
 
-		else if(strcmp(cmd_detect,"pt") == 0){
+		else if((strcmp(cmd_detect,"pt") == 0) || (strcmp(cmd_detect,"rp") == 0) || (strcmp(cmd_detect,"pd") == 0)){
+			put_resume_enable = (cmd_detect[0] == 'r');
+			put_delta_enable = (cmd_detect[1] == 'd');
 			bzero(cmd_detect,3);
 			def_print_enable = false;
 			put_cmd_enable = true;
@@ -815,16 +5273,13 @@ int main(int argc, char **argv) {
 			def_print_enable = false;
 			bzero(client_send_buf, BUFSIZE); 
 			bzero(client_data_buf,BUFSIZE);
-			printf("\nFile to be deleted - %s\tFilename_len : %ld bytes",filename_buf,strlen(filename_buf));
-			var1 = create_packet('C','D',client_send_buf,0,filename_buf,filename_len);	
-			n = sendto(sockfd, client_send_buf, var1, 0, (struct sockaddr *)&serveraddr, serverlen);
-			printf("\nPakcet length - %d bytes", n);
-		    if (n < 0){error("ERROR in sendto");}
-			else{printf("\nFile delete command packet sent\n");}
-			n = recvfrom(sockfd, client_recv_buf, BUFSIZE, 0, (struct sockaddr *)&serveraddr, &serverlen);
-			if (n < 0) {error("ERROR in recvfrom");}
+			log_debug("\nFile to be deleted - %s\tFilename_len : %ld bytes",filename_buf,strlen(filename_buf));
+			var1 = create_packet('C','D',client_send_buf,next_cmd_seq_no(),filename_buf,filename_len);	
+			log_debug("\nPakcet length - %d bytes", var1);
+			n = send_request(var1,'A','X',MAX_RETX_COUNT);
+			if (n < 0) {log_error("\nNo reply from server\n");}
 			else{
-				printf("\nFile delete ACK received from server");
+				log_debug("\nFile delete ACK received from server");
 				open_packet_client(client_recv_buf,client_data_buf,n);
 			}
 			bzero(client_send_buf,BUFSIZE);
@@ -836,22 +5291,28 @@ int main(int argc, char **argv) {
 		/****************** List File Request **********************/
 		
 		else if(strcmp(cmd_detect,"ls") == 0){
-			int var1;
+			int var1,var2;
 			def_print_enable = false;
-			bzero(client_send_buf, BUFSIZE); 
-			bzero(client_data_buf,BUFSIZE);
-			printf("\nFile list requested from server");
-			var1 = create_packet('C','L',client_send_buf,0,client_data_buf,1);	
-			n = sendto(sockfd, client_send_buf, var1, 0, (struct sockaddr *)&serveraddr, serverlen);
-			printf("\nPakcet length - %d bytes", n);
-		    if (n < 0){error("ERROR in sendto");}
-			else{printf("\nFile list command packet sent");}
-			n = recvfrom(sockfd, client_recv_buf, BUFSIZE, 0, (struct sockaddr *)&serveraddr, &serverlen);
-			if (n < 0) {error("ERROR in recvfrom");}
-			else{
-				printf("\nFile list received from server");
+			log_debug("\nFile list requested from server");
+			printf("\n\nFile List - \n\n");
+			/* Request pages ('#' cursor '\0' pattern) until the server has no more */
+			list_cursor[0] = '\0';
+			do{
+				bzero(client_send_buf, BUFSIZE); 
+				bzero(client_data_buf,BUFSIZE);
+				var2 = snprintf(client_data_buf, BUFSIZE, "#%s", list_cursor) + 1;
+				var2 += snprintf(client_data_buf + var2, BUFSIZE - var2, "%s", list_pattern_buf);
+				var1 = create_packet('C','L',client_send_buf,next_cmd_seq_no(),client_data_buf,var2);	
+				log_debug("\nPakcet length - %d bytes", var1);
+				n = send_request(var1,'A','L',MAX_RETX_COUNT);
+				if (n < 0) {
+					log_error("\nNo reply from server\n");
+					break;
+				}
+				log_debug("\nFile list page received from server");
 				open_packet_client(client_recv_buf,client_data_buf,n);
-			}
+			}while(list_more);
+			printf("\n\nFile List printed\n\n");
 			bzero(client_send_buf,BUFSIZE);
 			bzero(client_data_buf,BUFSIZE);
 			bzero(client_recv_buf,BUFSIZE);
@@ -865,10 +5326,16 @@ int main(int argc, char **argv) {
 			def_print_enable = false;
 			serverlen = sizeof(serveraddr);
 			bzero(client_send_buf,BUFSIZE);
-			exit_cmd = create_packet('C','E',client_send_buf,0,&exit_char,1);
-		    	n = sendto(sockfd, client_send_buf, exit_cmd, 0, (struct sockaddr *)&serveraddr, serverlen);
-		    	if (n < 0) { error("ERROR in sendto");}
-				else{printf("\nExit message sent to server");}
+			exit_cmd = create_packet('C','E',client_send_buf,next_cmd_seq_no(),&exit_char,1);
+			if(!ctrl_ack_enable){
+				n = sendto(sockfd, client_send_buf, exit_cmd, 0, (struct sockaddr *)&serveraddr, serverlen);
+				if (n < 0) { error("ERROR in sendto");}
+				else{log_debug("\nExit message sent to server");}
+			}
+			else if(send_request(exit_cmd,'A','E',EXIT_RETRY_COUNT) < 0){
+				log_debug("\nNo exit ACK from server");
+			}
+			else{log_debug("\nExit message ACKed by server");}
 
 			exit_check = false;
 			
@@ -900,81 +5367,78 @@ int main(int argc, char **argv) {
 		}
 		
 		if(get_cmd_enable){
-			if(get_cmd_ack){
-				if(get_cmd_enable){
-					get_cmd_enable = false;
-					get_cmd_seq_no = 0;
-				}
-				else{
-					get_cmd_seq_no++;
-				}
-				get_cmd_ack = false;
-				int get_cmd_send_pkt_len;
-				/*----------- clear send buffer ---------------*/
+			get_cmd_enable = false;
+			int get_cmd_send_pkt_len;
+			/*----------- clear send buffer ---------------*/
+			bzero(client_send_buf, BUFSIZE); 
+			bzero(client_data_buf, BUFSIZE); 
+			log_debug("\nRequested file - %sFilename_len : %ld bytes\n",filename_buf,strlen(filename_buf));
+			get_cmd_send_pkt_len = create_get_request(client_data_buf,get_resume_enable);
+			get_cmd_send_pkt_len = create_packet('C','G',client_send_buf,next_cmd_seq_no(),client_data_buf,get_cmd_send_pkt_len);
+			
+			/* Send get command, resent until the file info arrives */
+			n = send_request(get_cmd_send_pkt_len,'K',0,MAX_RETX_COUNT);
+			if((n < 0) && (get_resume_offset > 0)){
+				/* older servers drop a get command longer than a name */
+				log_info("\nNo reply to resume, getting the whole file");
+				get_resume_offset = 0;
 				bzero(client_send_buf, BUFSIZE); 
-				printf("\nRequested file - %sFilename_len : %ld bytes\n",filename_buf,strlen(filename_buf));
-				get_cmd_send_pkt_len = create_packet('C','G',client_send_buf,get_cmd_seq_no,filename_buf,filename_len);
-				
-		    	n = sendto(sockfd, client_send_buf, get_cmd_send_pkt_len, 0, (struct sockaddr *)&serveraddr, serverlen);
-		    	if (n < 0){error("ERROR in sendto");}
-				else{printf("\nCommand packet sent\n");}
-				bzero(client_send_buf,BUFSIZE);
+				get_cmd_send_pkt_len = create_packet('C','G',client_send_buf,next_cmd_seq_no(),filename_buf,filename_len);
+				n = send_request(get_cmd_send_pkt_len,'K',0,MAX_RETX_COUNT);
+			}
+			bzero(client_send_buf,BUFSIZE);
+			if (n < 0) {
+				log_error("\nNo reply from server\n");
+				def_print_enable = true;
 			}
-			bzero(client_recv_buf,BUFSIZE);
-			n = recvfrom(sockfd, client_recv_buf, BUFSIZE, 0, (struct sockaddr *)&serveraddr, &serverlen);
-		        if (n < 0) {printf("ERROR in recvfrom");}
 			else{
-				printf("\nFile info. received: %d\n",n);
+				log_debug("\nFile info. received: %d\n",n);
 				open_packet_client(client_recv_buf,client_data_buf,n);
 			}
 		}
 		
 		if(put_cmd_enable){
 			put_cmd_enable = false;
-			put_cmd_seq_no = 0;
 
 			int var1,var2;
-			struct dirent *pDirent;
-			DIR *pDir;
-			char *dirpath = "./";
-			pDir = opendir (dirpath);
-			if (pDir == NULL) {
-				printf ("Cannot open directory - %s\n", dirpath);
-			}
-			while ((pDirent = readdir(pDir)) != NULL) {	
-				if(strcmp(pDirent->d_name,filename_buf) == 0){
-					put_file_found = 2;
-					printf("\n%s found\n",filename_buf);
-					put_max_byte_count = calculate_filesize(filename_buf);	
-				}
+			struct stat st;
+			put_file_found = 0;
+			if(lookup_file(filename_buf, &st)){
+				put_file_found = 2;
+				log_info("\n%s found\n",filename_buf);
+				put_max_byte_count = st.st_size;
+				max_packet_count = (int)((put_max_byte_count/data_size) + 1);
+				log_debug("\nTotal packets to be sent : %d",max_packet_count);
+				log_debug("\nlast packet byte count : %lld\n",(long long)(put_max_byte_count%data_size));
 			}
-			closedir (pDir);
 			/* Check whether file exists in the directory */
-			if(put_file_found == 2){
+			if((put_file_found == 2) && put_delta_enable && put_delta()){
+				def_print_enable = true;
+			}
+			else if(put_file_found == 2){
 					
 				bzero(client_send_buf,BUFSIZE);	
 
-				/* Create put command packet */
-				var1 = create_packet('C','P',client_send_buf,0,filename_buf,strlen(filename_buf));
-				/* Send put command packet to server */
-				var2 = sendto(sockfd, client_send_buf, var1, 0, (struct sockaddr *)&serveraddr, serverlen);
-		    		if (var2 < 0){error("ERROR in sendto");}
-				
-				printf("\n Put Command packet sent");
-				bzero(client_send_buf,BUFSIZE);
-				bzero(client_recv_buf,BUFSIZE);
+				/* Create put command packet - name, size and resume flag */
+				bzero(client_data_buf,BUFSIZE);
+				var1 = create_put_request(client_data_buf,put_resume_enable);
+				var1 = create_packet('C','P',client_send_buf,next_cmd_seq_no(),client_data_buf,var1);
 				bzero(client_data_buf,BUFSIZE);
 				
-				/* Wait for Put Command ACK */
-				var2 = recvfrom(sockfd, client_recv_buf, BUFSIZE, 0, (struct sockaddr *)&serveraddr, &serverlen);
-		        	if (var2 < 0) {printf("ERROR in recvfrom");}
+				/* Send put command packet to server, resent until its ACK arrives */
+				var2 = send_request(var1,'A','P',MAX_RETX_COUNT);
+				bzero(client_send_buf,BUFSIZE);
+		        	if (var2 < 0) {
+					log_error("\nNo reply from server\n");
+					def_print_enable = true;
+				}
 				else{
-					printf("\nFileame ACK received");
+					log_debug("\nFileame ACK received");
 					open_packet_client(client_recv_buf,client_data_buf,var2);
 				}
 			}
 			else{
-				printf("\nFile not found in the directory");
+				log_info("\nFile not found in the directory");
 				def_print_enable = true;
 			}
 		}
@@ -982,7 +5446,7 @@ int main(int argc, char **argv) {
 	
 	/* Close socket and exit */
     close(sockfd);
-    printf("\nClosing socket ...");
-    printf("\nGoodbye!\n\n");
+    log_info("\nClosing socket ...");
+    log_info("\nGoodbye!\n\n");
     return 0;
 }
@@ -5,8 +5,14 @@
  *
  */
 
+#define _GNU_SOURCE										/* pthread_setaffinity_np(), recvmmsg() / sendmmsg() */
+
+#define _FILE_OFFSET_BITS 64							/* 64-bit off_t / file offsets on 32-bit builds too */
+
 #include <stdio.h>
+#include <errno.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,75 +20,680 @@
 #include <sys/types.h> 
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
 #include <arpa/inet.h>
 #include <dirent.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <setjmp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
+#include <sys/random.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <sched.h>
+#include <getopt.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>									/* _mm_crc32_u64(), built for SSE4.2 per function */
+#include <tmmintrin.h>									/* _mm_shuffle_epi8(), built for SSSE3 per function */
+#define CRC32C_HW								(1)
+#define GF256_HW								(1)
+#else
+#define CRC32C_HW								(0)
+#define GF256_HW								(0)
+#endif
+
+#define BUFSIZE 								(DATA_PACKET_MAX_SIZE + 64)	/* largest data packet + header */
+#define FILENAME_BUFF_SIZE 						(64)
+
+
+#define DATA_PACKET_DATA_SIZE					(2*1024)	/* payload for clients that do not probe the path MTU */
+#define DATA_PACKET_MAX_SIZE					(8*1024)	/* largest payload offered in the hello */
+#define DATA_PACKET_MIN_SIZE					(512)
+#define SOCKET_BUFSIZE							(2*MAX_WINDOW_SIZE*DATA_PACKET_MAX_SIZE)	/* SO_RCVBUF / SO_SNDBUF, a full window of large packets */
+
+#define MAX_WINDOW_SIZE							(256)		/* max packets in flight / receiver reorder slots */
+#define DEFAULT_WINDOW_SIZE						(32)
+#define SACK_BITMAP_SIZE						(MAX_WINDOW_SIZE/8)
+#define SEND_RING_SIZE							(2*MAX_WINDOW_SIZE)	/* file chunks read ahead of the window base */
+#define SEQ_SLOT(seq)							((seq) % MAX_WINDOW_SIZE)
+#define RING_SLOT(seq)							((seq) % SEND_RING_SIZE)
+#define RTO_INITIAL_MSEC						(1000)		/* RTO before the first RTT sample (RFC 6298) */
+#define RTO_MIN_MSEC							(200)
+#define RTO_MAX_MSEC							(4000)
+#define RTO_GRANULARITY_MSEC					(1)			/* clock granularity G of the RTO formula */
+#define MAX_RETX_COUNT							(10)		/* retransmit timeouts without progress before abort */
+#define JOURNAL_SUFFIX							".part"		/* sidecar journal of a partial put file ... */
+#define STATE_DIR								".uftp"		/* ... kept in this hidden directory, never served */
+#define JOURNAL_INTERVAL						(1024*1024)	/* bytes received between journal updates */
+#define RESUME_TAIL_SIZE						(64*1024)	/* bytes before the resume offset compared by hash */
+#define FNV_OFFSET_BASIS						(14695981039346656037ull)	/* FNV-1a 64 bit start value ... */
+#define FNV_PRIME								(1099511628211ull)			/* ... and multiplier */
+#define DELTA_BLOCK_MIN							(2*1024)	/* pd block size - about the square root of the file size */
+#define DELTA_BLOCK_MAX							(64*1024)
+#define DELTA_SIG_HDR_SIZE						(12)		/* block size + file size */
+#define DELTA_SIG_ENTRY_SIZE					(12)		/* weak + strong checksum of a block */
+#define WEAK_CHECKSUM(a, b)						(((a) & 0xffff) | ((b) << 16))
+#define LZ_HASH_BITS							(12)		/* match finder of the packet compressor */
+#define LZ_MIN_MATCH							(4)
+#define LZ_LAST_LITERALS						(5)			/* LZ4 block format - the last bytes are literals ... */
+#define LZ_MATCH_LIMIT							(12)		/* ... and no match starts this close to the end */
+#define LZ_SKIP_SHIFT							(6)			/* search step grows by one every 64 misses */
+#define COMPRESS_MISS_LIMIT						(8)			/* packets in a row that did not shrink before compression backs off */
+#define COMPRESS_PROBE_INTERVAL					(32)		/* ring slots between tries once backed off */
+
+#define SEND_BATCH_SIZE							(MAX_WINDOW_SIZE)	/* datagrams per sendmmsg() - a whole window */
+#define SEND_BATCH_HDR_SIZE						(64)		/* copied part of a queued datagram - header or small packet */
+#define RECV_BATCH_SIZE							(32)		/* datagrams per recvmmsg() */
+
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT								(103)		/* linux/udp.h, not in older libc headers */
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO									(104)
+#endif
+#define GSO_MAX_SEGMENTS						(64)		/* datagrams per UDP_SEGMENT send (UDP_MAX_SEGMENTS) */
+#define GSO_MAX_BYTES							(65000)		/* one IPv4 UDP datagram before segmentation */
+#define GRO_BUFSIZE								(64*1024)	/* coalesced receive buffer */
+#define RECV_SEG_MAX							(RECV_BATCH_SIZE*GSO_MAX_SEGMENTS)	/* datagrams of one receive batch, split */
+
+#define URING_ENTRIES							(1024)		/* submission queue size, the completion queue is twice that */
+#define URING_OP_RECV							(1)			/* request types, in the top byte of user_data */
+#define URING_OP_SEND							(2)
+#define URING_OP_READ							(3)
+#define URING_OP_WRITE							(4)
+#define URING_OP_UNLINK							(5)
+#define URING_OP_EXIT							(6)
+#define URING_OP_COMPRESS						(7)
+#define URING_OP_FORWARD						(8)
+#define URING_DATA(op, id, index)				(((uint64_t)(op) << 56) | ((uint64_t)(id) << 16) | (uint64_t)(index))
+#define URING_DATA_OP(data)						((int)((data) >> 56))
+#define URING_DATA_ID(data)						((uint32_t)((data) >> 16))
+#define URING_DATA_INDEX(data)					((int)((data) & 0xFFFF))
+
+#define WINDOW_MODE_GBN							(0)			/* Go-Back-N */
+#define WINDOW_MODE_SR							(1)			/* Selective Repeat */
+
+#define CC_INIT_CWND							(10)		/* initial cwnd in packets (RFC 6928) */
+#define CC_MIN_CWND								(4)
+#define CC_DUP_THRESH							(3)			/* packets ACKed beyond a hole before it counts as lost */
+#define CC_RTT_UNKNOWN							((long unsigned int)-1)
+#define BBR_STARTUP								(0)
+#define BBR_DRAIN								(1)
+#define BBR_PROBE_BW							(2)
+#define BBR_PROBE_RTT							(3)
+#define BBR_HIGH_GAIN							(2.885)		/* 2/ln(2) - doubles the rate every round */
+#define BBR_CWND_GAIN							(2.0)
+#define BBR_BW_ROUNDS							(10)		/* rounds of the bandwidth max filter */
+#define BBR_GAIN_CYCLE							(8)			/* PROBE_BW pacing gain cycle */
+#define BBR_MIN_RTT_USEC						(10000000)	/* min RTT expires after 10 s */
+#define BBR_PROBE_RTT_USEC						(200000)
+
+#define TIMER_TICK_USEC							(1000)		/* timer wheel resolution */
+#define TIMER_WHEEL_BITS						(8)
+#define TIMER_WHEEL_SLOTS						(1 << TIMER_WHEEL_BITS)	/* level 0 - one tick per slot */
+#define TIMER_WHEEL_L1_SLOTS					(64)		/* level 1 - TIMER_WHEEL_SLOTS ticks per slot, 16 s span */
+#define PACING_QUANTUM_USEC						(TIMER_TICK_USEC)	/* send credit a paced sender may catch up */
+
+#define HDR_MAGIC								(0xB1)		/* first byte of a binary header */
+#define HDR_VERSION								(2)			/* highest binary header version supported */
+#define BIN_HDR_V1_SIZE							(12)
+#define BIN_HDR_SIZE							(16)		/* v2 - v1 + session ID */
+#define ASCII_HDR_SIZE							(13)		/* type + 6 char seq + 6 char length */
+#define ASCII_HAS_CMD(type)						(((type) == 'C') || ((type) == 'A'))
+
+#define HDR_MODE_ASCII							(0)			/* otherwise the binary header version */
+#define HDR_FLAG_COMPRESSED						(0x0001)	/* data packet payload is LZ compressed */
+#define HDR_FLAG_CRC							(0x0002)	/* CRC32C of the packet follows the header */
+#define HELLO_FEATURE_COMPRESS					(0x0001)	/* hello feature bits - takes compressed data packets */
+#define HELLO_FEATURE_CRC						(0x0002)	/* checks packet CRCs and file digests */
+#define HELLO_FEATURE_FEC						(0x0004)	/* FEC repair packets, block geometry follows */
+#define CRC_SIZE								(4)
+#define CRC_HEX_SIZE							(8)			/* file digest in the K data */
+#define CRC32C_POLY								(0x82F63B78)	/* Castagnoli, reflected */
+#define FEC_MAX_DATA							(64)		/* K - data packets per FEC block */
+#define FEC_MAX_REPAIR							(4)			/* M - repair packets per block */
+#define FEC_ENCODE_SETS							(8)			/* blocks whose repair packets may wait in the send batch */
+#define FEC_BLOCK_SLOTS							(32)		/* blocks being decoded */
+#define FEC_REPAIR_HDR_SIZE						(8)			/* K, M, index, first, end, 0, symbol length */
+#define FEC_SYMBOL_HDR_SIZE						(4)			/* data length and flags, in front of the data */
+#define GF256_POLY								(0x11D)
+#define FEC_SYMBOL_MAX							(FEC_SYMBOL_HDR_SIZE + DATA_PACKET_MAX_SIZE)
+
+#define MAX_SESSIONS							(64)		/* concurrent clients */
+#define SESSION_IDLE_MSEC						(120*1000)	/* idle session reclaim time */
+#define SESSION_RATE_SLOTS						(256)		/* power of two - sources whose new sessions are counted */
+#define SESSION_RATE_BURST						(8)			/* new sessions a source address may open at once ... */
+#define SESSION_RATE_MSEC						(500)		/* ... and then one per this time */
+#define CMD_SEQ_MAX								(999999)	/* command numbers of the client wrap to 1 after this */
+
+#define MAX_WORKER_THREADS						(64)
+#define SESSION_WORKER(id)						((int)((id) % MAX_WORKER_THREADS))	/* worker that owns a session ID */
+#define FORWARD_QUEUE_SIZE						(64)		/* datagrams waiting in the inbox of a worker */
 
-#define BUFSIZE 								(3100)
-#define FILENAME_BUFF_SIZE 						(32)
+#define LOG_LEVEL_ERROR							(0)
+#define LOG_LEVEL_INFO							(1)			/* default */
+#define LOG_LEVEL_DEBUG							(2)			/* -v */
+#define LOG_LEVEL_TRACE							(3)			/* -vv, per-packet logs */
 
+#ifndef LOG_TRACE_ENABLE
+#define LOG_TRACE_ENABLE						(0)			/* build with -DLOG_TRACE_ENABLE=1 to keep trace logs */
+#endif
 
-#define MAX_DATA_PACKETS						(53000)
-#define MAX_FILE_SIZE							(110*1024*1024)
-#define DATA_PACKET_DATA_SIZE					(2*1024)
+#define log_msg(level, ...)						do { if ((level) <= log_level) { printf(__VA_ARGS__); } } while (0)
+#define log_error(...)							log_msg(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define log_info(...)							log_msg(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_debug(...)							log_msg(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#if LOG_TRACE_ENABLE
+#define log_trace(...)							log_msg(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define log_trace(...)							do { } while (0)
+#endif
 
 
-char server_send_buf[BUFSIZE]; 						/* message send buf */
-char server_recv_buf[BUFSIZE];						/* message recv buf */
-char server_data_buf[BUFSIZE];						/* server data buf */
+/* Variables marked __thread belong to one worker thread - each worker 
+ * has its own socket, buffers and session table. */
+
+__thread char server_send_buf[BUFSIZE]; 			/* message send buf */
+__thread char server_data_buf[BUFSIZE];				/* server data buf */
 char ack_buf[5];
-char filename_buf[FILENAME_BUFF_SIZE];				/* filename size buf */
+__thread char filename_buf[FILENAME_BUFF_SIZE];		/* filename size buf */
 
 /*-------------------- Socket Variables ----------------------------*/
 
-  int sockfd; 										/* socket */
+  __thread int sockfd; 								/* worker socket */
   int portno; 										/* port to listen on */
-  int clientlen; 									/* byte size of client's address */
+  __thread int clientlen; 							/* byte size of client's address */
   struct sockaddr_in serveraddr; 					/* server's addr */
-  struct sockaddr_in clientaddr; 					/* client addr */
-  struct hostent *hostp; 							/* client host info */
-  char *hostaddrp; 									/* dotted decimal host addr string */
+  __thread struct sockaddr_in clientaddr; 			/* client addr */
   int optval;										/* flag value for setsockopt */
-  int n; 											/* message byte size */
+  __thread int n; 									/* message byte size */
+
+/*------------------------------------------------------------------*/
+
+/*-------------------- Log Variables -------------------------------*/
+
+int log_level = LOG_LEVEL_INFO;							/* messages above this level are dropped */
+
+/*------------------------------------------------------------------*/
+
+/*-------------------- Worker Variables ----------------------------*/
+
+int worker_count;										/* SO_REUSEPORT sockets / threads */
+pthread_t worker_thread_arr[MAX_WORKER_THREADS];
+int exit_fd;											/* eventfd, signalled to stop all workers */
+__thread int worker_index;								/* this worker, in the session IDs it hands out */
+
+struct forwarded_datagram{
+	struct sockaddr_in addr;
+	int addr_len;
+	int len;
+	char buf[BUFSIZE];
+};
+
+struct worker_inbox{
+	pthread_mutex_t lock;
+	int wake_fd;										/* eventfd, signalled when a datagram is queued */
+	int count;
+	struct forwarded_datagram dgram_arr[FORWARD_QUEUE_SIZE];
+};
+
+struct worker_inbox *worker_inbox_arr;					/* per worker - datagrams of its sessions received by another worker */
+__thread struct forwarded_datagram forward_drain_arr[FORWARD_QUEUE_SIZE];	/* inbox taken over by its worker */
+__thread bool forward_kick;								/* io_uring poll of the inbox completed */
+
+/*------------------------------------------------------------------*/
+
+/*-------------------- Batch I/O Variables -------------------------*/
+
+__thread struct mmsghdr send_batch_msg[SEND_BATCH_SIZE];		/* messages queued for one sendmmsg() */
+__thread struct iovec send_batch_iov[SEND_BATCH_SIZE][2];		/* copied header + data by reference, per datagram */
+__thread char send_batch_hdr_buf[SEND_BATCH_SIZE][SEND_BATCH_HDR_SIZE];
+__thread struct sockaddr_in send_batch_addr[SEND_BATCH_SIZE];
+__thread char send_batch_ctrl_buf[SEND_BATCH_SIZE][CMSG_SPACE(sizeof(uint16_t))];	/* UDP_SEGMENT size */
+__thread int send_batch_seg_size[SEND_BATCH_SIZE];			/* GSO segment size of a message, 0 if it has no data */
+__thread int send_batch_seg_count[SEND_BATCH_SIZE];			/* datagrams in a message */
+__thread int send_batch_byte_count[SEND_BATCH_SIZE];
+__thread int send_batch_count;								/* messages */
+__thread int send_batch_dgram_count;						/* datagrams */
+__thread long send_batch_flush_count;						/* batches sent - data queued by reference is free after the next */
+
+__thread struct mmsghdr recv_batch_msg[RECV_BATCH_SIZE];		/* datagrams drained by one recvmmsg() */
+__thread struct iovec recv_batch_iov[RECV_BATCH_SIZE];
+__thread char recv_batch_buf[RECV_BATCH_SIZE][BUFSIZE];
+__thread char *recv_gro_buf;									/* RECV_BATCH_SIZE x GRO_BUFSIZE, with UDP_GRO */
+__thread char recv_batch_ctrl_buf[RECV_BATCH_SIZE][CMSG_SPACE(sizeof(int))];	/* UDP_GRO segment size */
+__thread struct sockaddr_in recv_batch_addr[RECV_BATCH_SIZE];
+__thread char *recv_seg_ptr_arr[RECV_SEG_MAX];				/* received datagrams, coalesced ones split */
+__thread int recv_seg_len_arr[RECV_SEG_MAX];
+__thread int recv_seg_msg_arr[RECV_SEG_MAX];				/* recvmmsg() message of each datagram */
+
+struct file_write{
+	struct session *sess;								/* put of the packet, marked if the write fails */
+	int fd;
+	off_t offset;										/* data packet position in the put file */
+	char *data_ptr;										/* into the receive batch buffers */
+	int data_len;
+};
+__thread struct file_write file_write_arr[RECV_SEG_MAX];	/* write-behind queue of the receive batch */
+__thread int file_write_count;
+
+__thread int send_batch_res[SEND_BATCH_SIZE];				/* io_uring send result of each message */
+__thread int send_batch_inflight;							/* io_uring sends not completed */
+__thread bool recv_batch_done[RECV_BATCH_SIZE];				/* io_uring receive completed, not handled yet */
+__thread int recv_batch_done_order[RECV_BATCH_SIZE];		/* receive batch indexes in completion order */
+__thread int recv_batch_done_count;
+
+bool udp_offload_opt;											/* -g */
+__thread bool udp_gso_enable;									/* UDP_SEGMENT sends, off after a failure */
+__thread bool udp_gro_enable;
+
+/*------------------------------------------------------------------*/
+
+/*-------------------- io_uring Variables -------------------------*/
+
+struct uring {
+	int ring_fd;
+	unsigned sq_entries;
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void *sq_ptr, *cq_ptr;
+	size_t sq_len, cq_len, sqes_len;
+};
+
+bool uring_opt = true;											/* --no-uring clears it */
+__thread bool uring_enable;										/* worker loop runs on io_uring */
+__thread struct uring io_ring;
+__thread bool uring_kick;										/* file reads / unlink completed, see service_uring_sessions() */
+__thread bool uring_exit;										/* exit signal polled by io_uring */
 
 /*------------------------------------------------------------------*/
 
 /*-------------------- File Variables ----------------------------*/
 
-int filefound;
-int file_size_var;
-int cmp_pkt_file_size;
+__thread int cmp_pkt_file_size;
+__thread char data_packet_hdr_buff[BIN_HDR_SIZE + ASCII_HDR_SIZE];	/* data packet header, data is sent from the file map */
+
+__thread bool exit_check;
+
+struct mapped_file {
+	dev_t dev;
+	ino_t ino;
+	int count;											/* gets sending from a map of the file, 0 - entry free */
+};
+
+struct mapped_file *mapped_file_arr;					/* files mapped by gets, shared by all workers */
+int mapped_file_max;									/* MAX_SESSIONS per worker */
+int state_dir_fd = -1;									/* STATE_DIR, -1 - no journals */
+pthread_mutex_t mapped_file_lock = PTHREAD_MUTEX_INITIALIZER;
+__thread sigjmp_buf map_fault_jmp;						/* SIGBUS on a get map returns here ... */
+__thread volatile sig_atomic_t map_fault_armed;			/* ... while map_read_check() reads it */
+
+/*------------------------------------------------------------------*/
+
+/*-------------------- File Index Variables ------------------------*/
+
+#define FILE_INDEX_BUCKETS						(4096)		/* power of two */
+#define FILE_HASH_BATCH							(64)		/* content hashes computed per index pass */
+#define INOTIFY_BUFSIZE							(64*1024)
+#define INOTIFY_MASK							(IN_CREATE | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE | \
+												 IN_MOVED_FROM | IN_MOVED_TO)
+
+struct file_entry{
+	struct file_entry *next;							/* hash bucket chain */
+	char name[NAME_MAX + 1];
+	off_t size;
+	time_t mtime;
+	long mtime_nsec;
+	unsigned int generation;							/* bumped by each update, a CRC is only stored for its generation */
+	uint32_t content_crc;								/* CRC32C of the contents (the gt digest), by the index thread */
+	bool hash_valid;
+};
+
+struct file_entry *file_index[FILE_INDEX_BUCKETS];		/* regular files of the server directory, by name */
+int file_index_count;
+struct file_entry **file_index_sorted;					/* entries in name order for ls, rebuilt on change */
+bool file_index_sorted_valid;
+pthread_rwlock_t file_index_lock = PTHREAD_RWLOCK_INITIALIZER;	/* workers read, the index thread and updates write */
+bool file_index_enable;									/* false if inotify is not available - fstatat / readdir */
+int inotify_fd;
+pthread_t file_index_thread;
+
+/*------------------------------------------------------------------*/
+
+/*-------------------- Block Cache Variables -----------------------*/
+
+#define BLOCK_CACHE_BUCKETS						(64*1024)	/* power of two */
+#define DEFAULT_BLOCK_CACHE_MB					(64)
+
+struct cache_block{
+	struct cache_block *hash_next;						/* hash bucket chain */
+	struct cache_block *lru_prev, *lru_next;			/* LRU list, most recently used first */
+	dev_t dev;											/* key - file identity and version ... */
+	ino_t ino;
+	long long mtime_nsec;
+	off_t file_size;
+	int data_size;										/* ... and the data packet */
+	int seq_no;
+	int len;
+	int refcount;										/* ring slots holding the block */
+	bool cached;										/* in the hash table, else freed on last release */
+	char data[];
+};
+
+struct cache_block *block_cache[BLOCK_CACHE_BUCKETS];	/* data packets of get files, shared by all sessions */
+struct cache_block *block_cache_lru_head, *block_cache_lru_tail;
+pthread_mutex_t block_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+long unsigned int block_cache_limit;					/* bytes, 0 - no cache (--cache-mb) */
+long unsigned int block_cache_bytes;
+long unsigned int block_cache_hits, block_cache_misses, block_cache_evictions;
+__thread struct cache_block **cache_release_arr;		/* released after the send batch that may use them */
+__thread int cache_release_count, cache_release_size;
+
+/*------------------------------------------------------------------*/
+
+/*-------------------- Compression Variables -----------------------*/
+
+#define COMPRESS_QUEUE_SIZE						(4096)		/* ring slots waiting for a compression thread */
+#define MAX_COMPRESS_THREADS					(16)
+#define DEFAULT_COMPRESS_THREADS				(2)
+#define RECV_UNPACK_SLOTS						(RECV_BATCH_SIZE)	/* decompressed put packets held for the write queue */
+
+struct compress_job{
+	struct session *sess;
+	int slot;											/* send ring slot */
+	int done_fd;										/* eventfd of the worker that owns the session */
+};
+
+bool compress_opt = true;								/* --no-compress clears it */
+int compress_thread_count;								/* --compress-threads, 0 - compress on the worker */
+pthread_t compress_thread_arr[MAX_COMPRESS_THREADS];
+struct compress_job compress_queue[COMPRESS_QUEUE_SIZE];	/* shared by all workers */
+int compress_queue_head, compress_queue_count;
+bool compress_exit;
+pthread_mutex_t compress_lock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t compress_work_cond = PTHREAD_COND_INITIALIZER;	/* a job was queued */
+pthread_cond_t compress_done_cond = PTHREAD_COND_INITIALIZER;	/* a session has no job left */
+__thread int compress_done_fd = -1;						/* eventfd, signalled when a slot of the worker is compressed */
+__thread char recv_unpack_buf[RECV_UNPACK_SLOTS][DATA_PACKET_MAX_SIZE];
+__thread int recv_unpack_count;
+
+/*------------------------------------------------------------------*/
+
+/*-------------------- Checksum Variables --------------------------*/
+
+uint32_t crc32c_table[8][256];							/* slicing-by-8, without SSE4.2 */
+bool crc32c_hw_enable;									/* CPU has the crc32 instruction */
+
+/*------------------------------------------------------------------*/
+
+/*-------------------- FEC Variables -------------------------------*/
+
+struct fec_encoder {
+	int k, m;											/* data / repair packets per block, from the hello, k = 0 - off */
+	int sym_max;										/* symbol of a full data packet */
+	int last_seq;										/* last data packet of the transfer */
+	int block;											/* block being encoded, -1 if none */
+	int first, count;									/* data packets encoded, by index in the block */
+	int sym_len;										/* longest symbol of the block */
+	int set;											/* repair buffers of the block */
+	long queued_flush[FEC_ENCODE_SETS];					/* send_batch_flush_count when a set was queued, -1 if sent */
+	char parity[FEC_ENCODE_SETS][FEC_MAX_REPAIR][FEC_REPAIR_HDR_SIZE + FEC_SYMBOL_MAX];
+	long repair_count;									/* repair packets sent for the transfer */
+};
+
+struct fec_block {
+	int block;											/* block number, -1 if the slot is free */
+	uint64_t data_mask;									/* data packets taken out, by index in the block */
+	int repair_mask;									/* repair packets added */
+	int first, count;									/* data packets encoded, from a repair packet */
+	int sym_len;
+	bool done;											/* rebuilt, or nothing was missing */
+	char sym[FEC_MAX_REPAIR][FEC_SYMBOL_MAX];			/* repair symbols, less the data packets received */
+};
+
+struct fec_decoder {
+	int k, m;
+	int sym_max;
+	struct fec_block blk[FEC_BLOCK_SLOTS];				/* by block number */
+	char out[FEC_MAX_REPAIR][FEC_SYMBOL_MAX];			/* rebuilt data packets, until the next decode */
+	long rebuilt_count;									/* packets rebuilt for the transfer */
+};
+
+uint8_t gf256_exp[510], gf256_log[256];
+uint8_t gf256_mul_table[256][256];						/* products, a row per factor */
+uint8_t gf256_mul_hi_table[256][16];					/* products of the high nibbles, for pshufb */
+uint8_t fec_coef_table[FEC_MAX_REPAIR][FEC_MAX_DATA];	/* factor of a data packet in a repair packet */
+bool gf256_hw_enable;									/* CPU has SSSE3 */
+bool fec_opt = true;									/* --no-fec clears it */
+
+/*------------------------------------------------------------------*/
+
+/*-------------------- Header Variables ----------------------------*/
+
+struct packet_info {
+	char type;											/* packet type (D,C,A,F,K) */
+	char cmd;											/* command type */
+	int version;										/* binary header version, HDR_MODE_ASCII if ASCII */
+	int flags;
+	long seq_no;
+	int data_len;
+	uint32_t session_id;								/* 0 if the header carries none */
+	char *data_ptr;										/* ptr to packet data */
+	bool binary;										/* received with binary header */
+	uint32_t data_crc;									/* CRC32C of the data, checked with HDR_FLAG_CRC */
+};
+
+/*------------------------------------------------------------------*/
+
+/*-------------------- Window Variables ----------------------------*/
+
+int window_size;										/* send window (packets) */
+int window_mode;										/* WINDOW_MODE_GBN / WINDOW_MODE_SR */
+
+/*------------------------------------------------------------------*/
+
+/*-------------------- Timer Wheel Variables -----------------------*/
 
-FILE *get_file;
-FILE *put_file;
+struct wheel_timer {
+	struct wheel_timer *next, *prev;					/* slot list, NULL if not armed */
+	long unsigned int expires;							/* expiry tick */
+	void (*fn)(struct wheel_timer *t);
+	void *arg;
+	int seq_no;
+};
 
-char *file_data_init_ptr = NULL;
-char *file_data_end_ptr = NULL;
-char *file_data_current_ptr = NULL;
+struct timer_wheel {
+	struct wheel_timer slot[TIMER_WHEEL_SLOTS];			/* level 0 list heads, one tick each */
+	struct wheel_timer l1_slot[TIMER_WHEEL_L1_SLOTS];	/* level 1 list heads, TIMER_WHEEL_SLOTS ticks each */
+	long unsigned int tick;								/* next tick to run */
+	int count;											/* armed timers */
+};
 
-char file_data_buff[MAX_FILE_SIZE];
-char file_name_buffer[128];
+__thread struct timer_wheel send_timer_wheel;			/* retransmit and pace timers of the worker's sessions */
 
 /*------------------------------------------------------------------*/
 
-/*-------------------- Data Packet Variables -----------------------*/
+/*-------------------- Congestion Control Variables ----------------*/
+
+struct cc_state;
+
+struct cc_ops {
+	char *name;
+	void (*init)(struct cc_state *cc);
+	void (*on_ack)(struct cc_state *cc, int base_seq, int inflight);	/* after the packets of an ACK are counted */
+	void (*on_loss)(struct cc_state *cc, int next_seq);					/* packets declared lost by SACK */
+	void (*on_timeout)(struct cc_state *cc);							/* RTO of the window base */
+};
 
-char *data_packet_current_ptr = NULL;
-char *data_packet_init_ptr = NULL;
-char *data_packet_end_ptr = NULL;
-int send_max_pkt_count;
-char data_packet_data_buff[DATA_PACKET_DATA_SIZE];
+struct cc_pkt {
+	long unsigned int sent_usec;						/* last send time */
+	long delivered;										/* delivered count when sent */
+	long unsigned int delivered_usec;					/* last delivery time when sent */
+	bool retx;
+};
+
+struct cc_state {
+	struct cc_ops *ops;
+	double cwnd;										/* congestion window (packets) */
+	double ssthresh;									/* slow start threshold (packets) */
+	int pkt_size;										/* data packet payload (bytes) */
+	double pacing_rate;									/* rate the sender should not exceed (bytes/sec) */
+	long unsigned int pace_next_usec;					/* earliest send time of the next packet when paced */
+	long loss_count;									/* packets declared lost by SACK */
+	long retx_count;									/* packets retransmitted */
+	long timeout_count;									/* retransmit timeouts */
+	long delivered;										/* packets ACKed / SACKed */
+	long unsigned int delivered_usec;					/* time of the last delivery */
+	long unsigned int srtt_usec;
+	long unsigned int min_rtt_usec;
+	long unsigned int min_rtt_stamp;					/* time min_rtt_usec was measured */
+	long rs_prior_delivered;							/* rate sample of the current ACK */
+	long unsigned int rs_prior_usec;
+	int rs_acked;										/* packets delivered by the current ACK */
+
+	/* NewReno */
+	bool in_recovery;
+	int recover_seq;									/* recovery ends when this packet is ACKed */
+
+	/* BBR */
+	int bbr_mode;
+	double btl_bw;										/* bottleneck bandwidth (packets/sec) */
+	double bw_samples[BBR_BW_ROUNDS];					/* max delivery rate of each round */
+	long round_count;
+	long next_round_delivered;
+	bool round_start;
+	double full_bw;
+	int full_bw_count;
+	bool full_pipe;
+	double pacing_gain;
+	double cwnd_gain;
+	int cycle_index;
+	long unsigned int cycle_stamp;
+	long unsigned int probe_rtt_done_stamp;
+
+	struct cc_pkt pkt[MAX_WINDOW_SIZE];					/* in-flight packets, by SEQ_SLOT() */
+};
+
+double bbr_pacing_gain_cycle[BBR_GAIN_CYCLE] = {1.25, 0.75, 1, 1, 1, 1, 1, 1};
+char *bbr_mode_names[] = {"STARTUP", "DRAIN", "PROBE_BW", "PROBE_RTT"};
 
 /*------------------------------------------------------------------*/
 
-/*----------- Data Acknowledgement Variables -----------------------*/
+/*-------------------- Session Variables ---------------------------*/
+
+struct rto_state {
+	long srtt;											/* smoothed RTT x8 (msec) */
+	long rttvar;										/* RTT variation x4 (msec) */
+	long rto;											/* retransmit timeout incl. backoff (msec) */
+	bool has_sample;
+};
+
+struct session {
+	uint32_t session_id;
+	struct sockaddr_in clientaddr;						/* client addr - session key */
+	int clientlen;
+	char peer_name[INET_ADDRSTRLEN + 8];				/* "a.b.c.d:port" of clientaddr, for logs */
+	int hdr_mode;										/* header of packets sent - mirrors the client */
+	long unsigned int last_active_time;					/* last packet received (msec) */
+	struct rto_state rtt;								/* RTO estimate of the path to the client */
+	long last_cmd_seq_no;								/* sequence number of the last command, 0 if none */
+	char reply_buf[BUFSIZE];							/* reply to the last command, resent for duplicates */
+	int reply_len;
+	int data_size;										/* data packet payload, set by the client's PMTU probes */
+	bool compress;										/* data packets compressed both ways, from the hello */
+	bool crc;											/* packets carry a CRC32C, file digests at K, from the hello */
+	struct fec_encoder fec_enc;							/* repair packets of gets, k = 0 - no FEC, from the hello */
+	struct fec_decoder fec_dec;							/* rebuilds lost data packets of puts */
+
+	/* get (gt) transfer */
+	int filefound;
+	off_t file_size_var;								/* size of the requested (gt) file */
+	char file_name_buffer[128];
+	FILE *ready_file;									/* file a K announced - the get file, or the block signatures of a pd */
+	int send_start_seq;									/* first data packet of the get, > 0 when resumed */
+	char put_file_name[64];								/* file of the running pt */
+	FILE *get_file;
+	char *get_file_map;									/* mmap of the get file, NULL if streamed through the ring */
+	int send_map_seq;									/* first packet sent from the map - 0, INT_MAX while compressing */
+	bool get_file_done;
+	int send_max_pkt_count;
+	int send_read_seq_index;							/* next data packet to be read from get file */
+	int send_ready_seq_index;							/* packets read into the ring, in order - io_uring reads complete late */
+	bool send_ring_ready[SEND_RING_SIZE];				/* io_uring read of a ring slot completed */
+	bool send_read_failed;
+	bool send_map_fault;								/* the kernel faulted on the get map (EFAULT), close the session */
+	char send_ring_buf[SEND_RING_SIZE][DATA_PACKET_MAX_SIZE];	/* gt file chunks, indexed by RING_SLOT() */
+	char *send_ring_ptr[SEND_RING_SIZE];				/* data of a slot - send_ring_buf or a cache block */
+	struct cache_block *send_ring_block[SEND_RING_SIZE];	/* cache block held by a slot, NULL if none */
+	int send_ring_len[SEND_RING_SIZE];
+	char send_ring_zbuf[SEND_RING_SIZE][DATA_PACKET_MAX_SIZE];	/* compressed data of a slot ... */
+	int send_ring_zlen[SEND_RING_SIZE];					/* ... and its length, 0 if the slot is sent raw */
+	uint32_t send_ring_crc[SEND_RING_SIZE];				/* CRC32C of the data a slot is sent with */
+	int compress_pending;								/* slots queued to the compression threads */
+	int compress_misses;								/* packets in a row that did not shrink */
+	long compress_in_bytes, compress_out_bytes;			/* data of the get and its size on the wire */
+	struct stat get_file_stat;							/* identity of the get file for the block cache */
+	bool send_ack_seq_arr[MAX_WINDOW_SIZE];				/* ACKed in-flight packets, indexed by SEQ_SLOT() */
+	int send_ack_seq_arr_index;							/* send window base - oldest unACKed packet */
+	int send_next_seq_index;							/* next new data packet to be sent */
+	int send_retx_count;								/* retransmit rounds without window progress */
+	long unsigned int send_pkt_time_arr[MAX_WINDOW_SIZE];	/* last send time of each in-flight packet (msec) */
+	bool send_pkt_retx_arr[MAX_WINDOW_SIZE];			/* packet was retransmitted - no RTT sample (Karn) */
+	int send_high_ack_seq;								/* highest packet the client reported, -1 if none */
+	struct cc_state cc;
+	struct wheel_timer send_pkt_timer_arr[MAX_WINDOW_SIZE];	/* retransmit timer of each in-flight packet */
+	struct wheel_timer pace_timer;						/* sends the window on when pacing held it back */
 
-bool send_ack_seq_arr[MAX_DATA_PACKETS];
-int send_ack_seq_arr_index;
-int recv_ack_seq_arr_index;
+	/* put (pt) transfer */
+	FILE *put_file;
+	off_t put_file_size;								/* size sent by the client, -1 if not sent */
+	int put_journal_fd;									/* journal of the put file, -1 if none */
+	off_t put_journal_done;								/* bytes of the put file recorded as received */
+	bool put_delta;										/* put file is a pd delta, applied at K */
+	bool put_delta_failed;								/* last pd could not be rebuilt, for resent K */
+	bool put_digest_failed;								/* last pt did not match the client's digest, for resent K */
+	bool put_write_failed;								/* a write or the sync of the last pt failed after its packet was ACKed */
+	uint32_t put_file_crc;								/* CRC32C of the put file up to the receive window base */
+	uint32_t recv_crc_op[32];							/* crc32c_shift_op() of a full data packet */
+	uint32_t recv_crc_arr[MAX_WINDOW_SIZE];				/* CRC32C of the received packets, by SEQ_SLOT() */
+	int recv_crc_len[MAX_WINDOW_SIZE];
+	bool recv_data_seq_arr[MAX_WINDOW_SIZE];			/* received packets in receive window, by SEQ_SLOT() */
+	int recv_ack_seq_arr_index;							/* next in-order data packet expected */
+	char recv_window_buf[MAX_WINDOW_SIZE][DATA_PACKET_MAX_SIZE];	/* packets being written by io_uring */
+	int recv_window_len[MAX_WINDOW_SIZE];
+	bool recv_write_arr[MAX_WINDOW_SIZE];				/* io_uring write of a slot not completed */
 
-bool exit_check;
-bool get_file_done;
-bool send_next_packet;
+	/* delete (dl) */
+	char unlink_name[128];
+	int unlink_res;
+	bool unlink_done;									/* io_uring unlink completed, reply not sent */
+
+	int uring_pending;									/* io_uring file requests not completed */
+};
+
+__thread struct session *session_table[MAX_SESSIONS];	/* active sessions of the worker, NULL if slot free */
+__thread int session_count;
+int active_session_count;								/* sessions of all workers */
+
+struct session_rate {
+	in_addr_t addr;										/* source address, 0 - slot free */
+	long unsigned int time;								/* msec the tokens were last topped up */
+	int tokens;											/* sessions the source may still open */
+};
+
+struct session_rate session_rate_arr[SESSION_RATE_SLOTS];	/* new sessions per source address, all workers */
+pthread_mutex_t session_rate_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /*------------------------------------------------------------------*/
 
@@ -117,28 +728,6 @@ int calculate_power(char base, int power){
     return ((var2)*((int)(base - '0')));
 }
 
-/*----------------- extract_num() -------------------
-
-	@brief : Extract number from a char string
-	
-	@param : ptr - ptr to string buffer
-	
-	@return : number extracted from string
-
------------------------------------------------------------*/
-
-int extract_num(char *ptr){
-	int num,p;
-	num = 0;
-	p=0;
-	do{
-		num += calculate_power(*(ptr-p),p);
-		p++;
-	}
-	while((p < 6) && (*(ptr - p) != '*'));
-	return num;
-}
-
 /*----------------- int_to_str() -------------------
 
 	@brief : Convert integer (int) to a char string (6 bytes)
@@ -206,300 +795,5788 @@ int str_to_int(char *str){
 	return var2;
 }
 
-/*------------------ create_packet()------------------------
+/*----------------- get_seq_field() -------------------
 
-    @brief : Creates packet of specified type - 
-			 D - Data Packet type
-             C - Command packet type
-             A - Acknowledgement packet type
-             F - File Size packet type 
-             K - File Size Acknowledgement packet type 
-			 
-    @param  : 1. pkt_type - type of packet (D,C,A,F,K)
-			  2. cmd_type - type of command
-			  3. pkt_ptr  - ptr to packet buffer
-			  4. seq_no   - packet sequence number
-			  5. data_ptr - ptr to packet data buffer
-			  6. data_len - length of packet data
-			  
-    @return : packet length
-----------------------------------------------------------*/
+	@brief : Read a sequence number from a packet data field
+	
+	@param : ptr - ptr to data field
+			 binary - field written in binary header mode
+	
+	@return : sequence number
 
-/*--------------------------------------------------------*/
-int create_packet(char pkt_type, char cmd_type, char *pkt_ptr, int seq_no, char *data_ptr,int data_len){
-    
-    char *pkt_temp_ptr;
-    pkt_temp_ptr = pkt_ptr;
-    int pkt_len;
-    int temp_var1,var2;
-    
-    if(data_ptr != NULL){
-        switch(pkt_type){
-            
-            /*-------------------- Data packet type -------------------*/
-            case 'D':
-               *pkt_ptr = 'D';
-		pkt_ptr++;
-               temp_var1 = int_to_str(seq_no,pkt_ptr);
-		for(var2=0;var2<temp_var1;var2++){
-			printf("%c",*(pkt_ptr + var2));
-		}
-               pkt_ptr += temp_var1;
-               temp_var1 = int_to_str(data_len,pkt_ptr);
-		for(var2=0;var2<temp_var1;var2++){
-			printf("%c",*(pkt_ptr + var2));
-		}
-               pkt_ptr += temp_var1;
-               for(temp_var1=0;temp_var1<data_len;temp_var1++){
-		   if(temp_var1 < 4){
-			printf("%c",*(data_ptr + temp_var1));
-		   }
-                   *pkt_ptr++ = *(data_ptr + temp_var1);
-               }
-		printf("\n");
-               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
-            break;
-            /*-------------------- Command packet type -------------------*/
-            case 'C':
-               *pkt_ptr++ = 'C';
-               temp_var1 = int_to_str(seq_no,pkt_ptr);
-               pkt_ptr += temp_var1;
-               temp_var1 = int_to_str(data_len,pkt_ptr);
-               pkt_ptr += temp_var1;
-	       *pkt_ptr++ = cmd_type;
-               for(temp_var1=0;temp_var1<data_len;temp_var1++){
-                   *pkt_ptr++ = *(data_ptr + temp_var1);
-               }
-               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
-                
-            
-            break;
-            /*-------------------- Acknowledgement packet type -------------------*/
-            case 'A':
-				
-	       *pkt_ptr++ = 'A';
-               temp_var1 = int_to_str(seq_no,pkt_ptr);
-               pkt_ptr += temp_var1;
-               temp_var1 = int_to_str(data_len,pkt_ptr);
-               pkt_ptr += temp_var1;
-			   *pkt_ptr++ = cmd_type;
-               for(temp_var1=0;temp_var1<data_len;temp_var1++){
-                   *pkt_ptr++ = *(data_ptr + temp_var1);
-               }
-               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
-				
-            break;
-            /*-------------------- File Size packet type -------------------*/
-            case 'F':
-			
-		*pkt_ptr++ = 'F';
-               temp_var1 = int_to_str(seq_no,pkt_ptr);
-               pkt_ptr += temp_var1;
-               temp_var1 = int_to_str(data_len,pkt_ptr);
-               pkt_ptr += temp_var1;
-               for(temp_var1=0;temp_var1<data_len;temp_var1++){
-                   *pkt_ptr++ = *(data_ptr + temp_var1);
-               }
-               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
-			
-            break;
-            /*--------- File Size Acknowledgement packet type -------------*/
-            case 'K':
-			
-		*pkt_ptr++ = 'K';
-               temp_var1 = int_to_str(seq_no,pkt_ptr);
-               pkt_ptr += temp_var1;
-               temp_var1 = int_to_str(data_len,pkt_ptr);
-               pkt_ptr += temp_var1;
-			   *pkt_ptr++ = cmd_type;
-               for(temp_var1=0;temp_var1<data_len;temp_var1++){
-                   *pkt_ptr++ = *(data_ptr + temp_var1);
-               }
-               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
-			
-            break;
-            
-            default:
-            break;
-        }
-    }
-    else{
-        printf("\nInvalid data ptr\n");
-    }
-    return pkt_len;
+-----------------------------------------------------------*/
+
+long get_seq_field(char *ptr, bool binary){
+	uint32_t var32;
+	if(binary){
+		memcpy(&var32, ptr, 4);
+		return (long)ntohl(var32);
+	}
+	return str_to_int(ptr);
 }
 
-/*----------------- calculate_filesize() -------------------
+/*----------------- crc32c_init() -------------------
 
-	@brief : Calculate file size of the requested file
+	@brief : Build the slicing-by-8 tables of the CRC32C fallback 
+			 and check the CPU for the SSE4.2 crc32 instruction
 	
-	@param : filename - ptr to file name buffer
+	@param : none
 	
-	@return : file size of the requested file
+	@return : none
 
 -----------------------------------------------------------*/
 
-long unsigned int calculate_filesize(char *filename){
-	int cnt;
-	cnt = 0;
-	char temp;
-	FILE *fd;
-	fd = fopen(filename,"rb");
-	if(fd == NULL){
-		perror("\nNo file found\n"); 
+void crc32c_init(void){
+	uint32_t crc;
+	int var1, var2;
+	for(var1 = 0; var1 < 256; var1++){
+		crc = (uint32_t)var1;
+		for(var2 = 0; var2 < 8; var2++){
+			crc = (crc & 1) ? ((crc >> 1) ^ CRC32C_POLY) : (crc >> 1);
+		}
+		crc32c_table[0][var1] = crc;
 	}
-	while(!(feof(fd))){
-		temp = fgetc(fd);
-		cnt++;	
+	for(var1 = 0; var1 < 256; var1++){
+		crc = crc32c_table[0][var1];
+		for(var2 = 1; var2 < 8; var2++){
+			crc = crc32c_table[0][crc & 0xff] ^ (crc >> 8);
+			crc32c_table[var2][var1] = crc;
+		}
 	}
-	printf("\ncount - %d bytes",cnt);
-	printf("\nTotal packets to be sent : %d",((cnt/2048) + 1));
-	printf("\nlast packet byte count : %d\n",(cnt%2048));
-	fclose(fd);
-	return cnt;
+#if CRC32C_HW
+	crc32c_hw_enable = __builtin_cpu_supports("sse4.2");
+#endif
 }
 
-/*----------------- check_file() -------------------
+#if CRC32C_HW
+/*----------------- crc32c_hw() -------------------
 
-	@brief : Check whether file present in the server directory
+	@brief : CRC32C register update with the SSE4.2 crc32 
+			 instruction, 8 bytes at a time. The data is copied to 
+			 dst on the way when dst is not NULL, so a payload copy 
+			 and its CRC take one pass.
 	
-	@param : filename - ptr to file name buffer
-			 filename_len - length of filename
+	@param : crc - CRC register (not inverted)
+			 dst - copy destination, NULL for none
+			 src - data
+			 len - data length
 	
-	@return : file found status ( 1 if found )
+	@return : CRC register
 
 -----------------------------------------------------------*/
 
-int check_file(char *filename, int filename_len){
-	int pkt_len1, pkt_len2,filesize, file_found;
-	file_found = 0;
-	struct dirent *pDirent;
-	*(filename + filename_len - 1) = '\0';
-    	DIR *pDir;
-    	char *dirpath = "./";
-    	pDir = opendir (dirpath);
-    	if (pDir == NULL) {
-        	printf ("Cannot open directory - %s\n", dirpath);
-    	}
-	while ((pDirent = readdir(pDir)) != NULL) {
-            //printf ("[%s]\n", pDirent->d_name);	
-	    if(strcmp(pDirent->d_name,filename) == 0){
-		file_found = 1;
-		filesize = calculate_filesize(filename);
-		sprintf(filename_buf,"%d",filesize);
-		printf("\nstrlen filesize : %ld\n", strlen(filename_buf));	
-	    }
-        }
-    	closedir (pDir);
-	bzero(server_send_buf,BUFSIZE);
-	if(file_found == 1){
-		pkt_len1 = create_packet('K','0',server_send_buf,1,filename_buf,strlen(filename_buf));
-		printf("\n%s file found",filename);
-	}
-	else{
-		pkt_len1 = create_packet('K','0',server_send_buf,2,filename_buf,strlen(filename_buf));
-		printf("\nFile not found!");
+__attribute__((target("sse4.2")))
+uint32_t crc32c_hw(uint32_t crc, char *dst, char *src, long len){
+	uint64_t crc64, var64;
+	crc64 = crc;
+	while(len >= 8){
+		memcpy(&var64, src, 8);
+		crc64 = _mm_crc32_u64(crc64, var64);
+		if(dst != NULL){
+			memcpy(dst, &var64, 8);
+			dst += 8;
+		}
+		src += 8;
+		len -= 8;
 	}
-	pkt_len2 = sendto(sockfd, server_send_buf, pkt_len1, 0, (struct sockaddr *)&clientaddr,clientlen);
-			
-	if (pkt_len2 < 0){error("ERROR in sendto");}
-	else{
-		printf("\n\nFile ACK packet sent to client\n");
-		//get_cmd_ack = false;
-	
+	crc = (uint32_t)crc64;
+	while(len > 0){
+		crc = _mm_crc32_u8(crc, (unsigned char)*src);
+		if(dst != NULL){*dst++ = *src;}
+		src++;
+		len--;
 	}
-	return file_found;
+	return crc;
 }
+#endif
 
-/*----------------- delete_file() -------------------
+/*----------------- crc32c_sw() -------------------
 
-	@brief : Delete file if present in the server directory
+	@brief : CRC32C register update with the slicing-by-8 tables, 
+			 copying the data to dst on the way like crc32c_hw()
 	
-	@param : filename - ptr to file name buffer
-			 filename_len - length of filename
+	@param : same as crc32c_hw()
 	
-	@return : none
+	@return : CRC register
 
 -----------------------------------------------------------*/
 
-void delete_file(char *filename, int filename_len){
-	int pkt_len1, pkt_len2, file_found;
-	file_found = 0;
-	struct dirent *pDirent;
-	*(filename + filename_len - 1) = '\0';
-    	DIR *pDir;
-    	char *dirpath = "./";
-    	pDir = opendir (dirpath);
-    	if (pDir == NULL) {
-        	printf ("Cannot open directory - %s\n", dirpath);
-    	}
-	while ((pDirent = readdir(pDir)) != NULL) {	
-	    if(strcmp(pDirent->d_name,filename) == 0){
-			file_found = 1;
-			
-	    }
-    }
-	closedir (pDir);
-	if(file_found){
-		printf("\n%s - File found\nDeleting file ....",filename);
-		if (remove(filename) == 0) {printf("\nFile deleted successfully"); }
-		else{printf("\nUnable to delete the file");}
-		
-		bzero(server_send_buf,BUFSIZE);
-		pkt_len1 = create_packet('A','X',server_send_buf,1,filename_buf,strlen(filename_buf));
-		pkt_len2 = sendto(sockfd, server_send_buf, pkt_len1, 0, (struct sockaddr *)&clientaddr,clientlen);		
-		if (pkt_len2 < 0){error("ERROR in sendto");}
-		else{printf("\n\nFile delete ACK packet sent to client\n");}
-		bzero(server_send_buf,BUFSIZE);
+uint32_t crc32c_sw(uint32_t crc, char *dst, char *src, long len){
+	unsigned char *ptr;
+	uint32_t var32;
+	if(dst != NULL){memcpy(dst, src, len);}
+	ptr = (unsigned char *)src;
+	while(len >= 8){
+		var32 = crc ^ ((uint32_t)ptr[0] | ((uint32_t)ptr[1] << 8) | ((uint32_t)ptr[2] << 16) | ((uint32_t)ptr[3] << 24));
+		crc = crc32c_table[7][var32 & 0xff] ^ crc32c_table[6][(var32 >> 8) & 0xff] ^ 
+			  crc32c_table[5][(var32 >> 16) & 0xff] ^ crc32c_table[4][var32 >> 24] ^ 
+			  crc32c_table[3][ptr[4]] ^ crc32c_table[2][ptr[5]] ^ crc32c_table[1][ptr[6]] ^ crc32c_table[0][ptr[7]];
+		ptr += 8;
+		len -= 8;
 	}
-	else{
-		printf("\nFile not found!");
-		bzero(server_send_buf,BUFSIZE);
-		pkt_len1 = create_packet('A','X',server_send_buf,2,filename_buf,strlen(filename_buf));
-		pkt_len2 = sendto(sockfd, server_send_buf, pkt_len1, 0, (struct sockaddr *)&clientaddr,clientlen);		
-		if (pkt_len2 < 0){error("ERROR in sendto");}
-		else{printf("\n\nFile delete ACK packet sent to client\n");}
-		bzero(server_send_buf,BUFSIZE);
+	while(len > 0){
+		crc = crc32c_table[0][(crc ^ *ptr++) & 0xff] ^ (crc >> 8);
+		len--;
 	}
-    
+	return crc;
 }
 
-/*----------------- create_file_list() -------------------
+/*----------------- crc32c_copy() -------------------
 
-	@brief : Create file of the server directory
+	@brief : CRC32C (Castagnoli) of a buffer, continuing the CRC of 
+			 the data before it, and copy the buffer to dst in the 
+			 same pass. crc32c_copy(crc32c_copy(0, A), B) is the CRC 
+			 of A followed by B.
 	
-	@param : ptr - ptr to file list buffer
+	@param : crc - CRC of the data before, 0 to start
+			 dst - copy destination, NULL for none
+			 src - data
+			 len - data length
 	
-	@return : length of file list buffer
+	@return : CRC
 
 -----------------------------------------------------------*/
 
-int create_file_list(char *ptr){
-	int var1,i;
+uint32_t crc32c_copy(uint32_t crc, char *dst, char *src, long len){
+#if CRC32C_HW
+	if(crc32c_hw_enable){return ~crc32c_hw(~crc, dst, src, len);}
+#endif
+	return ~crc32c_sw(~crc, dst, src, len);
+}
+
+/*----------------- crc32c() -------------------
+
+	@brief : CRC32C of a buffer, as crc32c_copy() without the copy
+	
+	@param : crc - CRC of the data before, 0 to start
+			 buf - data
+			 len - data length
+	
+	@return : CRC
+
+-----------------------------------------------------------*/
+
+uint32_t crc32c(uint32_t crc, char *buf, long len){
+	return crc32c_copy(crc, NULL, buf, len);
+}
+
+/*----------------- gf2_matrix_times() -------------------
+
+	@brief : Multiply a 32x32 GF(2) matrix by a vector
+	
+	@param : mat - matrix, one column per vector bit
+			 vec - vector
+	
+	@return : product
+
+-----------------------------------------------------------*/
+
+uint32_t gf2_matrix_times(uint32_t *mat, uint32_t vec){
+	uint32_t sum;
+	sum = 0;
+	while(vec != 0){
+		if(vec & 1){sum ^= *mat;}
+		vec >>= 1;
+		mat++;
+	}
+	return sum;
+}
+
+/*----------------- gf2_matrix_mul() -------------------
+
+	@brief : Multiply two 32x32 GF(2) matrices
+	
+	@param : dst - product, may not be a or b
+			 a, b - matrices
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void gf2_matrix_mul(uint32_t *dst, uint32_t *a, uint32_t *b){
+	int var1;
+	for(var1 = 0; var1 < 32; var1++){
+		dst[var1] = gf2_matrix_times(a, b[var1]);
+	}
+}
+
+/*----------------- crc32c_shift_op() -------------------
+
+	@brief : Build the operator that moves a CRC32C over len zero 
+			 bytes - the matrix for one zero byte raised to the 
+			 power len by squaring
+	
+	@param : op - 32 word matrix, filled
+			 len - bytes
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void crc32c_shift_op(uint32_t *op, long len){
+	uint32_t base[32], tmp[32];
+	int var1;
+	base[0] = CRC32C_POLY;								// one zero bit
+	for(var1 = 1; var1 < 32; var1++){
+		base[var1] = (uint32_t)1 << (var1 - 1);
+	}
+	for(var1 = 0; var1 < 3; var1++){					// squared three times - one zero byte
+		gf2_matrix_mul(tmp, base, base);
+		memcpy(base, tmp, sizeof(base));
+	}
+	for(var1 = 0; var1 < 32; var1++){
+		op[var1] = (uint32_t)1 << var1;
+	}
+	while(len > 0){
+		if(len & 1){
+			gf2_matrix_mul(tmp, base, op);
+			memcpy(op, tmp, sizeof(tmp));
+		}
+		len >>= 1;
+		if(len > 0){
+			gf2_matrix_mul(tmp, base, base);
+			memcpy(base, tmp, sizeof(base));
+		}
+	}
+}
+
+/*----------------- crc32c_combine() -------------------
+
+	@brief : CRC32C of A followed by B from the CRCs of A and B
+	
+	@param : crc1 - CRC of A
+			 crc2 - CRC of B
+			 len2 - length of B
+			 op - crc32c_shift_op() of len2, NULL to build it here
+	
+	@return : CRC of A followed by B
+
+-----------------------------------------------------------*/
+
+uint32_t crc32c_combine(uint32_t crc1, uint32_t crc2, long len2, uint32_t *op){
+	uint32_t tmp_op[32];
+	if(op == NULL){
+		crc32c_shift_op(tmp_op, len2);
+		op = tmp_op;
+	}
+	return gf2_matrix_times(op, crc1) ^ crc2;
+}
+
+/*----------------- check_packet_crc() -------------------
+
+	@brief : Check the CRC32C of a packet with HDR_FLAG_CRC. It 
+			 covers the data, then the header with the CRC field as 
+			 zero, so the CRC of the data alone falls out on the way 
+			 for the file digest.
+	
+	@param : pkt_ptr - ptr to packet buffer
+			 info - decoded header fields, data_crc is set
+	
+	@return : false if the CRC does not match
+
+-----------------------------------------------------------*/
+
+bool check_packet_crc(char *pkt_ptr, struct packet_info *info){
+	char hdr_buf[BIN_HDR_SIZE + CRC_SIZE];
+	uint32_t var32;
+	int hdr_len;
+	hdr_len = (int)(info->data_ptr - pkt_ptr);
+	memcpy(hdr_buf, pkt_ptr, hdr_len);
+	memcpy(&var32, hdr_buf + hdr_len - CRC_SIZE, CRC_SIZE);
+	bzero(hdr_buf + hdr_len - CRC_SIZE, CRC_SIZE);
+	info->data_crc = crc32c(0, info->data_ptr, info->data_len);
+	if(crc32c(info->data_crc, hdr_buf, hdr_len) == ntohl(var32)){return true;}
+	log_debug("\nCRC mismatch, packet %c %ld dropped", info->type, info->seq_no);
+	return false;
+}
+
+/*----------------- parse_packet() -------------------
+
+	@brief : Decode the header of a received packet. Binary headers 
+			 are recognised by HDR_MAGIC in byte 0, anything else is 
+			 treated as the ASCII header. A binary header with 
+			 HDR_FLAG_CRC is followed by the CRC of the packet.
+	
+	@param : pkt_ptr - ptr to packet buffer
+			 pkt_len - length of received packet
+			 info - decoded header fields
+	
+	@return : false if the packet is malformed or corrupt
+
+-----------------------------------------------------------*/
+
+bool parse_packet(char *pkt_ptr, int pkt_len, struct packet_info *info){
+	uint16_t var16;
+	uint32_t var32;
+	info->data_crc = 0;
+	if((unsigned char)*pkt_ptr == HDR_MAGIC){
+		if((pkt_len < BIN_HDR_V1_SIZE) || (*(pkt_ptr + 1) < 1) || (*(pkt_ptr + 1) > HDR_VERSION)){return false;}
+		info->binary = true;
+		info->version = *(pkt_ptr + 1);
+		info->type = *(pkt_ptr + 2);
+		info->cmd = *(pkt_ptr + 3);
+		memcpy(&var16, pkt_ptr + 4, 2);
+		info->flags = ntohs(var16);
+		memcpy(&var16, pkt_ptr + 6, 2);
+		info->data_len = ntohs(var16);
+		memcpy(&var32, pkt_ptr + 8, 4);
+		info->seq_no = (long)ntohl(var32);
+		info->session_id = 0;
+		info->data_ptr = pkt_ptr + BIN_HDR_V1_SIZE;
+		if(info->version >= 2){
+			if(pkt_len < BIN_HDR_SIZE){return false;}
+			memcpy(&var32, pkt_ptr + 12, 4);
+			info->session_id = ntohl(var32);
+			info->data_ptr = pkt_ptr + BIN_HDR_SIZE;
+		}
+		if(info->flags & HDR_FLAG_CRC){info->data_ptr += CRC_SIZE;}
+	}
+	else{
+		if(pkt_len < ASCII_HDR_SIZE){return false;}
+		info->binary = false;
+		info->version = HDR_MODE_ASCII;
+		info->session_id = 0;
+		info->type = *pkt_ptr;
+		info->flags = 0;
+		info->seq_no = str_to_int(pkt_ptr + 1);
+		info->data_len = str_to_int(pkt_ptr + 7);
+		info->data_ptr = pkt_ptr + ASCII_HDR_SIZE;
+		info->cmd = '0';
+		if(ASCII_HAS_CMD(info->type)){
+			info->cmd = *(pkt_ptr + ASCII_HDR_SIZE);
+			info->data_ptr++;
+		}
+	}
+	if((info->data_ptr + info->data_len) > (pkt_ptr + pkt_len)){return false;}
+	if(info->flags & HDR_FLAG_CRC){return check_packet_crc(pkt_ptr, info);}
+	return true;
+}
+
+/*----------------- create_bin_header() -------------------
+
+	@brief : Writes the binary header in the session's version - 
+			 magic, version, packet type, command type, flags, data 
+			 length and 32 bit sequence number, plus the session ID 
+			 from v2 on, all multi-byte fields in network byte order. 
+			 A session that negotiated CRCs gets HDR_FLAG_CRC and a 
+			 zero CRC field, filled by set_packet_crc().
+	
+	@param : sess, pkt_type, cmd_type, pkt_ptr, seq_no - as create_packet()
+			 data_len - length of the data that follows the header
+			 flags - HDR_FLAG_COMPRESSED
+	
+	@return : header length
+
+-----------------------------------------------------------*/
+
+int create_bin_header(struct session *sess, char pkt_type, char cmd_type, char *pkt_ptr, long seq_no, int data_len, int flags){
+	uint16_t var16;
+	uint32_t var32;
+	int hdr_len;
+	if(sess->crc){flags |= HDR_FLAG_CRC;}
+	*(pkt_ptr + 0) = (char)HDR_MAGIC;
+	*(pkt_ptr + 1) = (char)sess->hdr_mode;
+	*(pkt_ptr + 2) = pkt_type;
+	*(pkt_ptr + 3) = cmd_type;
+	var16 = htons((uint16_t)flags);
+	memcpy(pkt_ptr + 4, &var16, 2);
+	var16 = htons((uint16_t)data_len);
+	memcpy(pkt_ptr + 6, &var16, 2);
+	var32 = htonl((uint32_t)seq_no);
+	memcpy(pkt_ptr + 8, &var32, 4);
+	hdr_len = BIN_HDR_V1_SIZE;
+	if(sess->hdr_mode >= 2){
+		var32 = htonl(sess->session_id);
+		memcpy(pkt_ptr + 12, &var32, 4);
+		hdr_len = BIN_HDR_SIZE;
+	}
+	if(flags & HDR_FLAG_CRC){
+		bzero(pkt_ptr + hdr_len, CRC_SIZE);
+		hdr_len += CRC_SIZE;
+	}
+	return hdr_len;
+}
+
+/*----------------- set_packet_crc() -------------------
+
+	@brief : Fill the CRC field of a header from create_bin_header() 
+			 - the CRC of the data, continued over the header with 
+			 the field still zero
+	
+	@param : hdr_ptr - ptr to header
+			 hdr_len - header length, CRC field included
+			 data_crc - CRC32C of the packet data
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void set_packet_crc(char *hdr_ptr, int hdr_len, uint32_t data_crc){
+	uint32_t var32;
+	var32 = htonl(crc32c(data_crc, hdr_ptr, hdr_len));
+	memcpy(hdr_ptr + hdr_len - CRC_SIZE, &var32, CRC_SIZE);
+}
+
+/*----------------- create_bin_packet() -------------------
+
+	@brief : Creates packet with the binary header of the session, 
+			 the data is copied and its CRC taken in one pass
+	
+	@param : same as create_packet()
+	
+	@return : packet length
+
+-----------------------------------------------------------*/
+
+int create_bin_packet(struct session *sess, char pkt_type, char cmd_type, char *pkt_ptr, long seq_no, char *data_ptr,int data_len){
+	int hdr_len;
+	hdr_len = create_bin_header(sess, pkt_type, cmd_type, pkt_ptr, seq_no, data_len, 0);
+	if(sess->crc){
+		set_packet_crc(pkt_ptr, hdr_len, crc32c_copy(0, pkt_ptr + hdr_len, data_ptr, data_len));
+	}
+	else{
+		memcpy(pkt_ptr + hdr_len, data_ptr, data_len);
+	}
+	return (hdr_len + data_len);
+}
+
+/*----------------- create_data_header() -------------------
+
+	@brief : Writes only the header of a data packet (D) in the 
+			 current header mode, for packets whose data is sent 
+			 from a separate iovec
+	
+	@param : sess - session the packet is sent to
+			 hdr_ptr - ptr to header buffer
+			 seq_no - packet sequence number
+			 data_len - length of packet data
+			 flags - HDR_FLAG_COMPRESSED, binary header only
+			 data_crc - CRC32C of the packet data, if the session 
+						negotiated CRCs
+	
+	@return : header length
+
+-----------------------------------------------------------*/
+
+int create_data_header(struct session *sess, char *hdr_ptr, long seq_no, int data_len, int flags, uint32_t data_crc){
+	int len;
+	if(sess->hdr_mode != HDR_MODE_ASCII){
+		len = create_bin_header(sess, 'D', '0', hdr_ptr, seq_no, data_len, flags);
+		if(sess->crc){set_packet_crc(hdr_ptr, len, data_crc);}
+		return len;
+	}
+	*hdr_ptr = 'D';
+	len = 1;
+	len += int_to_str((int)seq_no, hdr_ptr + len);
+	len += int_to_str(data_len, hdr_ptr + len);
+	return len;
+}
+
+/*----------------- put_seq_field() -------------------
+
+	@brief : Write a sequence number into a packet data field in 
+			 the session's header mode (4 byte binary / 6 char ASCII)
+	
+	@param : sess - session the packet is sent to
+			 ptr - ptr to data field
+			 seq_no - sequence number
+	
+	@return : length of the field
+
+-----------------------------------------------------------*/
+
+int put_seq_field(struct session *sess, char *ptr, long seq_no){
+	uint32_t var32;
+	if(sess->hdr_mode != HDR_MODE_ASCII){
+		var32 = htonl((uint32_t)seq_no);
+		memcpy(ptr, &var32, 4);
+		return 4;
+	}
+	return int_to_str((int)seq_no, ptr);
+}
+
+/*------------------ create_packet()------------------------
+
+    @brief : Creates packet of specified type - 
+			 D - Data Packet type
+             C - Command packet type
+             A - Acknowledgement packet type
+             F - File Size packet type 
+             K - File Size Acknowledgement packet type 
+			 The binary header is used once the client negotiated it 
+			 (sess->hdr_mode), the ASCII header otherwise.
+			 
+    @param  : 1. sess     - session the packet is sent to
+			  2. pkt_type - type of packet (D,C,A,F,K)
+			  3. cmd_type - type of command
+			  4. pkt_ptr  - ptr to packet buffer
+			  5. seq_no   - packet sequence number
+			  6. data_ptr - ptr to packet data buffer
+			  7. data_len - length of packet data
+			  
+    @return : packet length
+----------------------------------------------------------*/
+
+/*--------------------------------------------------------*/
+int create_packet(struct session *sess, char pkt_type, char cmd_type, char *pkt_ptr, long seq_no, char *data_ptr,int data_len){
+    
+    char *pkt_temp_ptr;
+    pkt_temp_ptr = pkt_ptr;
+    int pkt_len;
+    int temp_var1;
+    
+    if((data_ptr != NULL) && (sess->hdr_mode != HDR_MODE_ASCII)){
+        pkt_len = create_bin_packet(sess, pkt_type, cmd_type, pkt_ptr, seq_no, data_ptr, data_len);
+    }
+    else if(data_ptr != NULL){
+        switch(pkt_type){
+            
+            /*-------------------- Data packet type -------------------*/
+            case 'D':
+               *pkt_ptr = 'D';
+		pkt_ptr++;
+               temp_var1 = int_to_str(seq_no,pkt_ptr);
+               pkt_ptr += temp_var1;
+               temp_var1 = int_to_str(data_len,pkt_ptr);
+               pkt_ptr += temp_var1;
+               for(temp_var1=0;temp_var1<data_len;temp_var1++){
+                   *pkt_ptr++ = *(data_ptr + temp_var1);
+               }
+		log_trace("%.12s%.*s\n", pkt_temp_ptr + 1, (data_len < 4) ? data_len : 4, data_ptr);
+               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
+            break;
+            /*-------------------- Command packet type -------------------*/
+            case 'C':
+               *pkt_ptr++ = 'C';
+               temp_var1 = int_to_str(seq_no,pkt_ptr);
+               pkt_ptr += temp_var1;
+               temp_var1 = int_to_str(data_len,pkt_ptr);
+               pkt_ptr += temp_var1;
+	       *pkt_ptr++ = cmd_type;
+               for(temp_var1=0;temp_var1<data_len;temp_var1++){
+                   *pkt_ptr++ = *(data_ptr + temp_var1);
+               }
+               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
+                
+            
+            break;
+            /*-------------------- Acknowledgement packet type -------------------*/
+            case 'A':
+				
+	       *pkt_ptr++ = 'A';
+               temp_var1 = int_to_str(seq_no,pkt_ptr);
+               pkt_ptr += temp_var1;
+               temp_var1 = int_to_str(data_len,pkt_ptr);
+               pkt_ptr += temp_var1;
+			   *pkt_ptr++ = cmd_type;
+               for(temp_var1=0;temp_var1<data_len;temp_var1++){
+                   *pkt_ptr++ = *(data_ptr + temp_var1);
+               }
+               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
+				
+            break;
+            /*-------------------- File Size packet type -------------------*/
+            case 'F':
+			
+		*pkt_ptr++ = 'F';
+               temp_var1 = int_to_str(seq_no,pkt_ptr);
+               pkt_ptr += temp_var1;
+               temp_var1 = int_to_str(data_len,pkt_ptr);
+               pkt_ptr += temp_var1;
+               for(temp_var1=0;temp_var1<data_len;temp_var1++){
+                   *pkt_ptr++ = *(data_ptr + temp_var1);
+               }
+               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
+			
+            break;
+            /*--------- File Size Acknowledgement packet type -------------*/
+            case 'K':
+			
+		*pkt_ptr++ = 'K';
+               temp_var1 = int_to_str(seq_no,pkt_ptr);
+               pkt_ptr += temp_var1;
+               temp_var1 = int_to_str(data_len,pkt_ptr);
+               pkt_ptr += temp_var1;
+			   *pkt_ptr++ = cmd_type;
+               for(temp_var1=0;temp_var1<data_len;temp_var1++){
+                   *pkt_ptr++ = *(data_ptr + temp_var1);
+               }
+               pkt_len = (int)(pkt_ptr - pkt_temp_ptr);
+			
+            break;
+            
+            default:
+            break;
+        }
+    }
+    else{
+        log_error("\nInvalid data ptr\n");
+    }
+    return pkt_len;
+}
+
+/*----------------- valid_file_name() -------------------
+
+	@brief : Check that a name from a client is a plain name of the 
+			 server directory - no path separators, no . or .., not 
+			 STATE_DIR - so gt, pt and dl stay in the served files.
+	
+	@param : filename - ptr to file name buffer
+	
+	@return : true if the name can be served
+
+-----------------------------------------------------------*/
+
+bool valid_file_name(char *filename){
+	return !((*filename == '\0') || (strchr(filename,'/') != NULL) || 
+			 (strcmp(filename,".") == 0) || (strcmp(filename,"..") == 0) || 
+			 (strcmp(filename,STATE_DIR) == 0));
+}
+
+/*----------------- lookup_file() -------------------
+
+	@brief : Look up a file of the server directory with one 
+			 fstatat(), instead of scanning the directory for the 
+			 name and reading the file for its size. Only plain 
+			 names are accepted (valid_file_name()) so a lookup 
+			 stays in the server directory like the scan did.
+	
+	@param : filename - ptr to file name buffer
+			 st - file metadata, filled if found
+			 flags - fstatat() flags, AT_SYMLINK_NOFOLLOW to find 
+					 the link itself
+	
+	@return : true if found
+
+-----------------------------------------------------------*/
+
+bool lookup_file(char *filename, struct stat *st, int flags){
+	if(!valid_file_name(filename)){return false;}
+	return (fstatat(AT_FDCWD, filename, st, flags) == 0);
+}
+
+/*----------------- send_failed() -------------------
+
+	@brief : Log a send to one client that failed. The datagram is 
+			 dropped - the client retransmits or its session times 
+			 out - and the server keeps serving the other clients, 
+			 a bad or spoofed source address cannot stop it.
+	
+	@param : addr - client address/port
+			 err - errno of the send
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_failed(struct sockaddr_in *addr, int err){
+	char addr_buf[INET_ADDRSTRLEN];
+	if(inet_ntop(AF_INET, &addr->sin_addr, addr_buf, sizeof(addr_buf)) == NULL){
+		strcpy(addr_buf, "?");
+	}
+	log_error("\nSend to %s:%d failed (%s), datagram dropped", addr_buf, ntohs(addr->sin_port), strerror(err));
+}
+
+/*----------------- send_reply() -------------------
+
+	@brief : Send the reply to a command and keep a copy, a client 
+			 that missed it retransmits the command and gets the 
+			 copy back without the command running twice
+	
+	@param : sess - client session
+			 pkt_ptr - ptr to reply packet
+			 pkt_len - length of reply packet
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_reply(struct session *sess, char *pkt_ptr, int pkt_len){
+	if(sendto(sockfd, pkt_ptr, pkt_len, 0, (struct sockaddr *)&sess->clientaddr, sess->clientlen) < 0){
+		send_failed(&sess->clientaddr, errno);
+	}
+	if(pkt_len <= sizeof(sess->reply_buf)){
+		memcpy(sess->reply_buf, pkt_ptr, pkt_len);
+		sess->reply_len = pkt_len;
+	}
+}
+
+/*----------------- send_probe_reply() -------------------
+
+	@brief : Echo a path MTU probe. Like the probe, the echo goes out 
+			 with the DF bit set and ignores the path MTU cache 
+			 (IP_PMTUDISC_PROBE), so an echo too large for the way 
+			 back is dropped instead of fragmented. The socket is 
+			 switched back after the send.
+	
+	@param : sess - client session
+			 pkt_ptr - ptr to echo packet
+			 pkt_len - echo packet length
+	
+	@return : false if the echo is larger than the interface MTU
+
+-----------------------------------------------------------*/
+
+bool send_probe_reply(struct session *sess, char *pkt_ptr, int pkt_len){
+	int pmtu_mode, default_mode, var1;
+	socklen_t opt_len;
+	opt_len = sizeof(default_mode);
+	if(getsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &default_mode, &opt_len) < 0){default_mode = IP_PMTUDISC_WANT;}
+	pmtu_mode = IP_PMTUDISC_PROBE;
+	setsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &pmtu_mode, sizeof(pmtu_mode));
+	var1 = sendto(sockfd, pkt_ptr, pkt_len, 0, (struct sockaddr *)&sess->clientaddr, sess->clientlen);
+	setsockopt(sockfd, IPPROTO_IP, IP_MTU_DISCOVER, &default_mode, sizeof(default_mode));
+	if(var1 < 0){
+		if(errno == EMSGSIZE){return false;}
+		send_failed(&sess->clientaddr, errno);
+	}
+	return true;
+}
+
+/*----------------- cache_bucket() -------------------
+
+	@brief : Hash a block cache key to its bucket
+	
+	@param : st - get file metadata
+			 data_size - data packet size
+			 seq_no - data packet sequence number
+	
+	@return : bucket number
+
+-----------------------------------------------------------*/
+
+int cache_bucket(struct stat *st, int data_size, int seq_no){
+	uint64_t hash;
+	hash = ((uint64_t)st->st_dev * 0x9e3779b97f4a7c15ull) ^ ((uint64_t)st->st_ino * 0xc2b2ae3d27d4eb4full) ^ 
+		   ((uint64_t)data_size << 40) ^ (uint64_t)seq_no;
+	hash ^= hash >> 29;
+	return (int)(hash & (BLOCK_CACHE_BUCKETS - 1));
+}
+
+/*----------------- cache_key_match() -------------------
+
+	@brief : Check if a cache block holds a data packet of this 
+			 version of the get file
+	
+	@param : block - cache block
+			 sess - client session
+			 seq_no - data packet sequence number
+	
+	@return : true if the key matches
+
+-----------------------------------------------------------*/
+
+bool cache_key_match(struct cache_block *block, struct session *sess, int seq_no){
+	return ((block->seq_no == seq_no) && (block->data_size == sess->data_size) && 
+			(block->ino == sess->get_file_stat.st_ino) && (block->dev == sess->get_file_stat.st_dev) && 
+			(block->mtime_nsec == ((long long)sess->get_file_stat.st_mtim.tv_sec * 1000000000LL + sess->get_file_stat.st_mtim.tv_nsec)) && 
+			(block->file_size == sess->get_file_stat.st_size));
+}
+
+/*----------------- cache_lru_unlink() -------------------
+
+	@brief : Take a block off the LRU list. The caller holds 
+			 block_cache_lock.
+	
+	@param : block - cache block
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cache_lru_unlink(struct cache_block *block){
+	if(block->lru_prev != NULL){block->lru_prev->lru_next = block->lru_next;}
+	else{block_cache_lru_head = block->lru_next;}
+	if(block->lru_next != NULL){block->lru_next->lru_prev = block->lru_prev;}
+	else{block_cache_lru_tail = block->lru_prev;}
+	block->lru_prev = NULL;
+	block->lru_next = NULL;
+}
+
+/*----------------- cache_lru_push() -------------------
+
+	@brief : Put a block at the head of the LRU list. The caller 
+			 holds block_cache_lock.
+	
+	@param : block - cache block
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cache_lru_push(struct cache_block *block){
+	block->lru_prev = NULL;
+	block->lru_next = block_cache_lru_head;
+	if(block_cache_lru_head != NULL){block_cache_lru_head->lru_prev = block;}
+	else{block_cache_lru_tail = block;}
+	block_cache_lru_head = block;
+}
+
+/*----------------- cache_evict() -------------------
+
+	@brief : Free least recently used blocks no session holds until 
+			 the cache is within its limit. The caller holds 
+			 block_cache_lock.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cache_evict(void){
+	struct cache_block *block, *prev, **link;
+	block = block_cache_lru_tail;
+	while((block_cache_bytes > block_cache_limit) && (block != NULL)){
+		prev = block->lru_prev;
+		if(block->refcount == 0){
+			for(link = &block_cache[cache_bucket(&(struct stat){.st_dev = block->dev, .st_ino = block->ino}, 
+												 block->data_size, block->seq_no)]; 
+				*link != block; link = &(*link)->hash_next);
+			*link = block->hash_next;
+			cache_lru_unlink(block);
+			block_cache_bytes -= sizeof(struct cache_block) + block->data_size;
+			block_cache_evictions++;
+			free(block);
+		}
+		block = prev;
+	}
+}
+
+/*----------------- cache_lookup() -------------------
+
+	@brief : Find a data packet of the get file in the block cache 
+			 and hold it for a ring slot
+	
+	@param : sess - client session
+			 seq_no - data packet sequence number
+	
+	@return : cache block, NULL on a miss
+
+-----------------------------------------------------------*/
+
+struct cache_block *cache_lookup(struct session *sess, int seq_no){
+	struct cache_block *block;
+	pthread_mutex_lock(&block_cache_lock);
+	for(block = block_cache[cache_bucket(&sess->get_file_stat, sess->data_size, seq_no)]; block != NULL; block = block->hash_next){
+		if(cache_key_match(block, sess, seq_no)){break;}
+	}
+	if(block != NULL){
+		block->refcount++;
+		cache_lru_unlink(block);
+		cache_lru_push(block);
+		block_cache_hits++;
+	}
+	else{
+		block_cache_misses++;
+	}
+	pthread_mutex_unlock(&block_cache_lock);
+	return block;
+}
+
+/*----------------- cache_alloc() -------------------
+
+	@brief : Allocate a block for a data packet that missed, held 
+			 by the ring slot it is read into. It joins the cache 
+			 once the read completed.
+	
+	@param : sess - client session
+			 seq_no - data packet sequence number
+	
+	@return : cache block, NULL if out of memory
+
+-----------------------------------------------------------*/
+
+struct cache_block *cache_alloc(struct session *sess, int seq_no){
+	struct cache_block *block;
+	block = malloc(sizeof(struct cache_block) + sess->data_size);
+	if(block == NULL){return NULL;}
+	bzero(block, sizeof(struct cache_block));
+	block->dev = sess->get_file_stat.st_dev;
+	block->ino = sess->get_file_stat.st_ino;
+	block->mtime_nsec = (long long)sess->get_file_stat.st_mtim.tv_sec * 1000000000LL + sess->get_file_stat.st_mtim.tv_nsec;
+	block->file_size = sess->get_file_stat.st_size;
+	block->data_size = sess->data_size;
+	block->seq_no = seq_no;
+	block->refcount = 1;
+	return block;
+}
+
+/*----------------- cache_insert() -------------------
+
+	@brief : Add a block whose read completed to the cache, evicting 
+			 old blocks over the limit. If another session cached the 
+			 same data packet meanwhile, the block stays private.
+	
+	@param : block - cache block
+			 len - bytes read
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cache_insert(struct cache_block *block, int len){
+	struct cache_block *entry;
+	int bucket;
+	block->len = len;
+	bucket = cache_bucket(&(struct stat){.st_dev = block->dev, .st_ino = block->ino}, block->data_size, block->seq_no);
+	pthread_mutex_lock(&block_cache_lock);
+	for(entry = block_cache[bucket]; entry != NULL; entry = entry->hash_next){
+		if((entry->seq_no == block->seq_no) && (entry->data_size == block->data_size) && (entry->ino == block->ino) && 
+		   (entry->dev == block->dev) && (entry->mtime_nsec == block->mtime_nsec) && (entry->file_size == block->file_size)){break;}
+	}
+	if(entry == NULL){
+		block->hash_next = block_cache[bucket];
+		block_cache[bucket] = block;
+		block->cached = true;
+		cache_lru_push(block);
+		block_cache_bytes += sizeof(struct cache_block) + block->data_size;
+		cache_evict();
+	}
+	pthread_mutex_unlock(&block_cache_lock);
+}
+
+/*----------------- cache_release() -------------------
+
+	@brief : Drop the hold of a ring slot on a block
+	
+	@param : block - cache block
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cache_release(struct cache_block *block){
+	pthread_mutex_lock(&block_cache_lock);
+	block->refcount--;
+	if(!block->cached && (block->refcount == 0)){free(block);}
+	else if(block_cache_bytes > block_cache_limit){cache_evict();}
+	pthread_mutex_unlock(&block_cache_lock);
+}
+
+/*----------------- cache_release_later() -------------------
+
+	@brief : Release a block after the next flush_send_batch(), 
+			 since a queued data packet may still point into it
+	
+	@param : block - cache block
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cache_release_later(struct cache_block *block){
+	struct cache_block **arr;
+	if(cache_release_count == cache_release_size){
+		arr = realloc(cache_release_arr, (cache_release_size + 256) * sizeof(struct cache_block *));
+		if(arr == NULL){error("ERROR allocating cache release list");}
+		cache_release_arr = arr;
+		cache_release_size += 256;
+	}
+	cache_release_arr[cache_release_count++] = block;
+}
+
+/*----------------- cache_release_pending() -------------------
+
+	@brief : Release the blocks put aside by cache_release_later()
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cache_release_pending(void){
+	int var1;
+	for(var1 = 0; var1 < cache_release_count; var1++){
+		cache_release(cache_release_arr[var1]);
+	}
+	cache_release_count = 0;
+}
+
+/*----------------- cache_log_stats() -------------------
+
+	@brief : Log the block cache counters
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cache_log_stats(void){
+	if((block_cache_limit == 0) || ((block_cache_hits + block_cache_misses) == 0)){return;}
+	pthread_mutex_lock(&block_cache_lock);
+	log_info("\nBlock cache : %lu hits, %lu misses, %lu evictions, %lu KB of %lu KB used", 
+			 block_cache_hits, block_cache_misses, block_cache_evictions, block_cache_bytes / 1024, block_cache_limit / 1024);
+	pthread_mutex_unlock(&block_cache_lock);
+}
+
+/*----------------- lz_compress() -------------------
+
+	@brief : Compress a data packet payload in the LZ4 block format - 
+			 sequences of a token (literal / match length nibbles), 
+			 literals and a 2 byte match offset. Matches are found 
+			 with a hash of the next 4 bytes, the search steps over 
+			 more bytes the longer it misses, so incompressible data 
+			 (JPEG, MP3) is passed over quickly.
+	
+	@param : src - payload
+			 len - payload length, at most 64 KB
+			 dst - compressed output
+			 dst_max - room in dst
+	
+	@return : compressed length, 0 if it does not fit in dst_max
+
+-----------------------------------------------------------*/
+
+int lz_compress(char *src, int len, char *dst, int dst_max){
+	uint16_t table[1 << LZ_HASH_BITS];
+	unsigned char *ip, *ref, *anchor, *end, *match_end, *op, *op_end, *token;
+	uint32_t seq, ref_seq;
+	int lit_len, match_len, misses, var1;
+	if(len <= LZ_MATCH_LIMIT){return 0;}
+	bzero(table, sizeof(table));
+	ip = (unsigned char *)src + 1;
+	anchor = (unsigned char *)src;
+	end = (unsigned char *)src + len;
+	match_end = end - LZ_MATCH_LIMIT;
+	op = (unsigned char *)dst;
+	op_end = (unsigned char *)dst + dst_max;
+	misses = 0;
+	while(ip < match_end){
+		memcpy(&seq, ip, 4);
+		var1 = (int)((seq * 2654435761U) >> (32 - LZ_HASH_BITS));
+		ref = (unsigned char *)src + table[var1];
+		table[var1] = (uint16_t)(ip - (unsigned char *)src);
+		memcpy(&ref_seq, ref, 4);
+		if((ref >= ip) || (ref_seq != seq)){
+			ip += 1 + (misses++ >> LZ_SKIP_SHIFT);
+			continue;
+		}
+		while((ip > anchor) && (ref > (unsigned char *)src) && (ip[-1] == ref[-1])){
+			ip--;
+			ref--;
+		}
+		match_len = LZ_MIN_MATCH;
+		while(((ip + match_len) < (end - LZ_LAST_LITERALS)) && (ip[match_len] == ref[match_len])){match_len++;}
+		lit_len = (int)(ip - anchor);
+		if((op + 1 + (lit_len / 255) + 1 + lit_len + 2 + ((match_len - LZ_MIN_MATCH) / 255) + 1) > op_end){return 0;}
+		token = op++;
+		*token = (unsigned char)(((lit_len < 15) ? lit_len : 15) << 4);
+		if(lit_len >= 15){
+			for(var1 = lit_len - 15; var1 >= 255; var1 -= 255){*op++ = 255;}
+			*op++ = (unsigned char)var1;
+		}
+		memcpy(op, anchor, lit_len);
+		op += lit_len;
+		*op++ = (unsigned char)((ip - ref) & 0xff);
+		*op++ = (unsigned char)((ip - ref) >> 8);
+		var1 = match_len - LZ_MIN_MATCH;
+		*token |= (unsigned char)((var1 < 15) ? var1 : 15);
+		if(var1 >= 15){
+			for(var1 -= 15; var1 >= 255; var1 -= 255){*op++ = 255;}
+			*op++ = (unsigned char)var1;
+		}
+		ip += match_len;
+		anchor = ip;
+		misses = 0;
+	}
+	lit_len = (int)(end - anchor);
+	if((op + 1 + (lit_len / 255) + 1 + lit_len) > op_end){return 0;}
+	token = op++;
+	*token = (unsigned char)(((lit_len < 15) ? lit_len : 15) << 4);
+	if(lit_len >= 15){
+		for(var1 = lit_len - 15; var1 >= 255; var1 -= 255){*op++ = 255;}
+		*op++ = (unsigned char)var1;
+	}
+	memcpy(op, anchor, lit_len);
+	op += lit_len;
+	return (int)(op - (unsigned char *)dst);
+}
+
+/*----------------- lz_decompress() -------------------
+
+	@brief : Decompress an LZ4 block written by lz_compress(). Every 
+			 length and offset is checked against the input and the 
+			 output, a corrupt packet fails instead of overrunning.
+	
+	@param : src - compressed payload
+			 len - compressed length
+			 dst - payload output
+			 dst_max - room in dst
+	
+	@return : payload length, -1 if the block is corrupt
+
+-----------------------------------------------------------*/
+
+int lz_decompress(char *src, int len, char *dst, int dst_max){
+	unsigned char *ip, *ip_end, *op, *op_end, *ref;
+	int token, lit_len, match_len, offset, var1;
+	ip = (unsigned char *)src;
+	ip_end = (unsigned char *)src + len;
+	op = (unsigned char *)dst;
+	op_end = (unsigned char *)dst + dst_max;
+	while(ip < ip_end){
+		token = *ip++;
+		lit_len = token >> 4;
+		if(lit_len == 15){
+			do{
+				if(ip >= ip_end){return -1;}
+				var1 = *ip++;
+				lit_len += var1;
+			}while(var1 == 255);
+		}
+		if((lit_len > (ip_end - ip)) || (lit_len > (op_end - op))){return -1;}
+		memcpy(op, ip, lit_len);
+		op += lit_len;
+		ip += lit_len;
+		if(ip == ip_end){break;}						/* the last sequence has no match */
+		if((ip_end - ip) < 2){return -1;}
+		offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if((offset == 0) || (offset > (op - (unsigned char *)dst))){return -1;}
+		match_len = token & 15;
+		if(match_len == 15){
+			do{
+				if(ip >= ip_end){return -1;}
+				var1 = *ip++;
+				match_len += var1;
+			}while(var1 == 255);
+		}
+		match_len += LZ_MIN_MATCH;
+		if(match_len > (op_end - op)){return -1;}
+		ref = op - offset;
+		while(match_len-- > 0){*op++ = *ref++;}		/* byte by byte - the match may overlap its output */
+	}
+	return (int)(op - (unsigned char *)dst);
+}
+
+/*----------------- compress_slot() -------------------
+
+	@brief : Compress the data of a send ring slot and mark the slot 
+			 ready. A packet that does not shrink is sent raw. After 
+			 COMPRESS_MISS_LIMIT such packets in a row only every 
+			 COMPRESS_PROBE_INTERVAL-th slot is tried, until one 
+			 shrinks again. The CRC of the data sent is taken here too. 
+			 Runs on a compression thread, or on the worker when none 
+			 is free.
+	
+	@param : sess - client session
+			 slot - send ring slot
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void compress_slot(struct session *sess, int slot){
+	int len, zlen;
+	len = sess->send_ring_len[slot];
+	zlen = 0;
+	if((__atomic_load_n(&sess->compress_misses, __ATOMIC_RELAXED) < COMPRESS_MISS_LIMIT) || ((slot % COMPRESS_PROBE_INTERVAL) == 0)){
+		zlen = lz_compress(sess->send_ring_ptr[slot], len, sess->send_ring_zbuf[slot], len - 1);
+		if(zlen > 0){__atomic_store_n(&sess->compress_misses, 0, __ATOMIC_RELAXED);}
+		else{__atomic_add_fetch(&sess->compress_misses, 1, __ATOMIC_RELAXED);}
+	}
+	sess->send_ring_zlen[slot] = zlen;
+	if(sess->crc){
+		sess->send_ring_crc[slot] = (zlen > 0) ? crc32c(0, sess->send_ring_zbuf[slot], zlen) : crc32c(0, sess->send_ring_ptr[slot], len);
+	}
+	__atomic_add_fetch(&sess->compress_in_bytes, len, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&sess->compress_out_bytes, (zlen > 0) ? zlen : len, __ATOMIC_RELAXED);
+	__atomic_store_n(&sess->send_ring_ready[slot], true, __ATOMIC_RELEASE);
+}
+
+/*----------------- compress_worker() -------------------
+
+	@brief : Compression thread - takes ring slots off the shared 
+			 queue, compresses them and signals the eventfd of the 
+			 worker that owns the session, which then sends them. 
+			 The worker waits in compress_drain() for the session's 
+			 pending slots before it closes the get file, so the 
+			 session is not freed under a running job.
+	
+	@param : arg - unused
+	
+	@return : NULL
+
+-----------------------------------------------------------*/
+
+void *compress_worker(void *arg){
+	struct compress_job job;
+	uint64_t one = 1;
+	pthread_mutex_lock(&compress_lock);
+	while(1){
+		while((compress_queue_count == 0) && !compress_exit){
+			pthread_cond_wait(&compress_work_cond, &compress_lock);
+		}
+		if(compress_queue_count == 0){break;}
+		job = compress_queue[compress_queue_head];
+		compress_queue_head = (compress_queue_head + 1) % COMPRESS_QUEUE_SIZE;
+		compress_queue_count--;
+		pthread_mutex_unlock(&compress_lock);
+		compress_slot(job.sess, job.slot);
+		pthread_mutex_lock(&compress_lock);
+		if(write(job.done_fd, &one, sizeof(one)) < 0){perror("\nERROR on eventfd write");}
+		if(--job.sess->compress_pending == 0){pthread_cond_broadcast(&compress_done_cond);}
+	}
+	pthread_mutex_unlock(&compress_lock);
+	return NULL;
+}
+
+/*----------------- ring_slot_loaded() -------------------
+
+	@brief : A send ring slot holds its file data (read, or found in 
+			 the block cache) - take its CRC and mark it ready, or 
+			 queue it to the compression threads if the session 
+			 compresses. The slot is compressed on the worker when 
+			 the queue is full or there are no compression threads. 
+			 Retransmissions reuse the CRC of the slot.
+	
+	@param : sess - client session
+			 slot - send ring slot
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void ring_slot_loaded(struct session *sess, int slot){
+	struct compress_job *job;
+	if(!sess->compress){
+		if(sess->crc){sess->send_ring_crc[slot] = crc32c(0, sess->send_ring_ptr[slot], sess->send_ring_len[slot]);}
+		sess->send_ring_ready[slot] = true;
+		return;
+	}
+	__atomic_store_n(&sess->send_ring_ready[slot], false, __ATOMIC_RELAXED);
+	pthread_mutex_lock(&compress_lock);
+	if((compress_thread_count > 0) && (compress_queue_count < COMPRESS_QUEUE_SIZE)){
+		job = &compress_queue[(compress_queue_head + compress_queue_count) % COMPRESS_QUEUE_SIZE];
+		job->sess = sess;
+		job->slot = slot;
+		job->done_fd = compress_done_fd;
+		compress_queue_count++;
+		sess->compress_pending++;
+		pthread_cond_signal(&compress_work_cond);
+		pthread_mutex_unlock(&compress_lock);
+		return;
+	}
+	pthread_mutex_unlock(&compress_lock);
+	compress_slot(sess, slot);
+}
+
+/*----------------- update_ready_index() -------------------
+
+	@brief : Move send_ready_seq_index over the ring slots that are 
+			 ready, in order - io_uring reads and compression 
+			 complete out of order. Past the ring, the packets from 
+			 send_map_seq on are all ready in the map.
+	
+	@param : sess - client session
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void update_ready_index(struct session *sess){
+	while((sess->send_ready_seq_index < sess->send_read_seq_index) && 
+		  __atomic_load_n(&sess->send_ring_ready[RING_SLOT(sess->send_ready_seq_index)], __ATOMIC_ACQUIRE)){
+		sess->send_ready_seq_index++;
+	}
+	if(sess->send_ready_seq_index >= sess->send_map_seq){sess->send_ready_seq_index = sess->send_max_pkt_count;}
+}
+
+/*----------------- compress_drain() -------------------
+
+	@brief : Wait for the compression threads to finish the queued 
+			 slots of a session
+	
+	@param : sess - client session
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void compress_drain(struct session *sess){
+	pthread_mutex_lock(&compress_lock);
+	while(sess->compress_pending > 0){
+		pthread_cond_wait(&compress_done_cond, &compress_lock);
+	}
+	pthread_mutex_unlock(&compress_lock);
+}
+
+/*----------------- compress_log_stats() -------------------
+
+	@brief : Log the data compressed for the get of a session
+	
+	@param : sess - client session
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void compress_log_stats(struct session *sess){
+	if(!sess->compress || (sess->compress_in_bytes == 0)){return;}
+	log_info("\nCompression : %ld bytes sent as %ld (%.2fx)", sess->compress_in_bytes, sess->compress_out_bytes, 
+			 (double)sess->compress_in_bytes / (double)((sess->compress_out_bytes > 0) ? sess->compress_out_bytes : 1));
+}
+
+/*----------------- uring_init() -------------------
+
+	@brief : Set up an io_uring instance with raw system calls and 
+			 map its rings. Needs the EXT_ARG feature (waits with a 
+			 timeout) and every request type the worker submits, 
+			 else the worker keeps the poll() loop.
+	
+	@param : ring - io_uring of the worker
+			 entries - submission queue size
+	
+	@return : false if io_uring is not usable
+
+-----------------------------------------------------------*/
+
+bool uring_init(struct uring *ring, unsigned entries){
+	struct io_uring_params params;
+	struct io_uring_probe *probe;
+	int var1, op_arr[] = {IORING_OP_RECVMSG, IORING_OP_SENDMSG, IORING_OP_READ, 
+						  IORING_OP_WRITE, IORING_OP_UNLINKAT, IORING_OP_POLL_ADD};
+	bool usable;
+	bzero(ring, sizeof(*ring));
+	bzero(&params, sizeof(params));
+	ring->ring_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if(ring->ring_fd < 0){return false;}
+	usable = ((params.features & IORING_FEAT_EXT_ARG) != 0) && ((params.features & IORING_FEAT_NODROP) != 0);
+	probe = calloc(1, sizeof(*probe) + (256 * sizeof(struct io_uring_probe_op)));
+	if(usable && (probe != NULL) && 
+	   (syscall(__NR_io_uring_register, ring->ring_fd, IORING_REGISTER_PROBE, probe, 256) == 0)){
+		for(var1 = 0; var1 < (int)(sizeof(op_arr) / sizeof(op_arr[0])); var1++){
+			if((op_arr[var1] > probe->last_op) || !(probe->ops[op_arr[var1]].flags & IO_URING_OP_SUPPORTED)){usable = false;}
+		}
+	}
+	else{
+		usable = false;
+	}
+	free(probe);
+	if(!usable){
+		close(ring->ring_fd);
+		return false;
+	}
+	ring->sq_entries = params.sq_entries;
+	ring->sq_len = params.sq_off.array + (params.sq_entries * sizeof(unsigned));
+	ring->cq_len = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+	if(params.features & IORING_FEAT_SINGLE_MMAP){
+		if(ring->cq_len > ring->sq_len){ring->sq_len = ring->cq_len;}
+		ring->cq_len = ring->sq_len;
+	}
+	ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQ_RING);
+	if(ring->sq_ptr == MAP_FAILED){
+		close(ring->ring_fd);
+		return false;
+	}
+	ring->cq_ptr = ring->sq_ptr;
+	if(!(params.features & IORING_FEAT_SINGLE_MMAP)){
+		ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_CQ_RING);
+	}
+	ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->ring_fd, IORING_OFF_SQES);
+	if((ring->cq_ptr == MAP_FAILED) || (ring->sqes == MAP_FAILED)){
+		error("ERROR mapping io_uring");
+	}
+	ring->sq_head = (unsigned *)((char *)ring->sq_ptr + params.sq_off.head);
+	ring->sq_tail = (unsigned *)((char *)ring->sq_ptr + params.sq_off.tail);
+	ring->sq_mask = (unsigned *)((char *)ring->sq_ptr + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)((char *)ring->sq_ptr + params.sq_off.array);
+	ring->cq_head = (unsigned *)((char *)ring->cq_ptr + params.cq_off.head);
+	ring->cq_tail = (unsigned *)((char *)ring->cq_ptr + params.cq_off.tail);
+	ring->cq_mask = (unsigned *)((char *)ring->cq_ptr + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + params.cq_off.cqes);
+	return true;
+}
+
+/*----------------- uring_exit_ring() -------------------
+
+	@brief : Unmap the rings and close an io_uring instance
+	
+	@param : ring - io_uring of the worker
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void uring_exit_ring(struct uring *ring){
+	munmap(ring->sqes, ring->sqes_len);
+	if(ring->cq_ptr != ring->sq_ptr){munmap(ring->cq_ptr, ring->cq_len);}
+	munmap(ring->sq_ptr, ring->sq_len);
+	close(ring->ring_fd);
+}
+
+/*----------------- uring_enter() -------------------
+
+	@brief : Submit the queued requests and wait for completions
+	
+	@param : ring - io_uring of the worker
+			 wait_nr - completions to wait for, 0 to only submit
+			 timeout - wait time in msec, -1 to block
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void uring_enter(struct uring *ring, unsigned wait_nr, int timeout){
+	struct io_uring_getevents_arg arg;
+	struct __kernel_timespec ts;
+	unsigned to_submit, flags;
+	to_submit = *ring->sq_tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+	flags = IORING_ENTER_EXT_ARG;
+	if(wait_nr > 0){flags |= IORING_ENTER_GETEVENTS;}
+	bzero(&arg, sizeof(arg));
+	if(timeout >= 0){
+		ts.tv_sec = timeout / 1000;
+		ts.tv_nsec = (long long)(timeout % 1000) * 1000000;
+		arg.ts = (uint64_t)(uintptr_t)&ts;
+	}
+	if((syscall(__NR_io_uring_enter, ring->ring_fd, to_submit, wait_nr, flags, &arg, sizeof(arg)) < 0) && 
+	   (errno != ETIME) && (errno != EINTR) && (errno != EBUSY)){
+		error("ERROR in io_uring_enter");
+	}
+}
+
+/*----------------- uring_get_sqe() -------------------
+
+	@brief : Take the next free submission queue entry. The entry 
+			 is queued at once - the kernel only reads it at the 
+			 next io_uring_enter(). A full queue is submitted first.
+	
+	@param : ring - io_uring of the worker
+	
+	@return : zeroed submission queue entry
+
+-----------------------------------------------------------*/
+
+struct io_uring_sqe *uring_get_sqe(struct uring *ring){
+	struct io_uring_sqe *sqe;
+	unsigned tail, index;
+	tail = *ring->sq_tail;
+	while((tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE)) >= ring->sq_entries){
+		uring_enter(ring, 0, -1);
+	}
+	index = tail & *ring->sq_mask;
+	sqe = &ring->sqes[index];
+	bzero(sqe, sizeof(*sqe));
+	ring->sq_array[index] = index;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	return sqe;
+}
+
+/*----------------- uring_poll_compress_done() -------------------
+
+	@brief : Clear the compression eventfd of the worker and poll it 
+			 again, slots compressed from here on signal a new 
+			 completion
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void uring_poll_compress_done(void){
+	struct io_uring_sqe *sqe;
+	uint64_t count;
+	if((read(compress_done_fd, &count, sizeof(count)) < 0) && (errno != EAGAIN)){perror("\nERROR on eventfd read");}
+	sqe = uring_get_sqe(&io_ring);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = compress_done_fd;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = URING_DATA(URING_OP_COMPRESS, 0, 0);
+}
+
+/*----------------- find_session_by_id() -------------------
+
+	@brief : Look up a session of the worker by its ID
+	
+	@param : session_id - session ID
+	
+	@return : session, NULL if it is closed
+
+-----------------------------------------------------------*/
+
+struct session *find_session_by_id(uint32_t session_id){
+	int var1;
+	for(var1 = 0; var1 < MAX_SESSIONS; var1++){
+		if((session_table[var1] != NULL) && (session_table[var1]->session_id == session_id)){
+			return session_table[var1];
+		}
+	}
+	return NULL;
+}
+
+/*----------------- uring_complete() -------------------
+
+	@brief : Record one completion. Only state is updated here, the 
+			 work that follows (handling datagrams, sending the 
+			 window, replies) is left to the worker loop, since 
+			 completions are also reaped while a send batch or a 
+			 session close waits.
+	
+	@param : user_data - request type, session ID and index
+			 res - result of the request
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void uring_complete(uint64_t user_data, int res){
+	struct session *sess;
+	int index;
+	index = URING_DATA_INDEX(user_data);
+	switch(URING_DATA_OP(user_data)){
+		case URING_OP_RECV:
+			recv_batch_msg[index].msg_len = (res > 0) ? (unsigned)res : 0;
+			recv_batch_done[index] = true;
+			recv_batch_done_order[recv_batch_done_count++] = index;
+			return;
+		case URING_OP_SEND:
+			send_batch_res[index] = res;
+			send_batch_inflight--;
+			return;
+		case URING_OP_EXIT:
+			uring_exit = true;
+			return;
+		case URING_OP_COMPRESS:
+			uring_poll_compress_done();
+			uring_kick = true;
+			return;
+		case URING_OP_FORWARD:
+			forward_kick = true;
+			return;
+		default:
+			break;
+	}
+	sess = find_session_by_id(URING_DATA_ID(user_data));
+	if(sess == NULL){return;}
+	sess->uring_pending--;
+	switch(URING_DATA_OP(user_data)){
+		case URING_OP_READ:
+			if(res < 0){
+				sess->send_read_failed = true;
+				errno = -res;
+				perror("\nERROR reading get file");
+			}
+			else{
+				sess->send_ring_len[index] = res;
+				if(sess->send_ring_block[index] != NULL){cache_insert(sess->send_ring_block[index], res);}
+				ring_slot_loaded(sess, index);
+				update_ready_index(sess);
+			}
+			uring_kick = true;
+			break;
+		case URING_OP_WRITE:
+			if(res != sess->recv_window_len[index]){
+				log_error("\nWrite to put file failed (%s)", (res < 0) ? strerror(-res) : "short write");
+				sess->put_write_failed = true;
+			}
+			sess->recv_write_arr[index] = false;
+			break;
+		case URING_OP_UNLINK:
+			sess->unlink_res = res;
+			sess->unlink_done = true;
+			uring_kick = true;
+			break;
+		default:
+			break;
+	}
+}
+
+/*----------------- uring_reap() -------------------
+
+	@brief : Consume all completions in the completion queue
+	
+	@param : ring - io_uring of the worker
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void uring_reap(struct uring *ring){
+	struct io_uring_cqe *cqe;
+	unsigned head, tail;
+	head = *ring->cq_head;
+	tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	while(head != tail){
+		cqe = &ring->cqes[head & *ring->cq_mask];
+		uring_complete(cqe->user_data, cqe->res);
+		head++;
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*----------------- uring_drain_session() -------------------
+
+	@brief : Wait until the file requests of a session completed, 
+			 before its files are closed or its buffers reused
+	
+	@param : sess - client session
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void uring_drain_session(struct session *sess){
+	while(sess->uring_pending > 0){
+		uring_enter(&io_ring, 1, -1);
+		uring_reap(&io_ring);
+	}
+}
+
+/*----------------- uring_read_get_file() -------------------
+
+	@brief : Queue the read of one data packet of the get file into 
+			 its ring slot
+	
+	@param : sess - client session
+			 seq_no - data packet sequence number
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void uring_read_get_file(struct session *sess, int seq_no){
+	struct io_uring_sqe *sqe;
+	int slot;
+	slot = RING_SLOT(seq_no);
+	sess->send_ring_ready[slot] = false;
+	sqe = uring_get_sqe(&io_ring);
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fileno(sess->get_file);
+	sqe->addr = (uint64_t)(uintptr_t)sess->send_ring_ptr[slot];
+	sqe->len = sess->data_size;
+	sqe->off = (uint64_t)seq_no * sess->data_size;
+	sqe->user_data = URING_DATA(URING_OP_READ, sess->session_id, slot);
+	sess->uring_pending++;
+}
+
+/*----------------- uring_write_put_file() -------------------
+
+	@brief : Queue the write of the data packet held in a receive 
+			 window slot at its offset in the put file. The slot is 
+			 not reused until the write completed.
+	
+	@param : sess - client session
+			 slot - receive window slot
+			 seq_no - data packet sequence number
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void uring_write_put_file(struct session *sess, int slot, int seq_no){
+	struct io_uring_sqe *sqe;
+	sqe = uring_get_sqe(&io_ring);
+	sqe->opcode = IORING_OP_WRITE;
+	sqe->fd = fileno(sess->put_file);
+	sqe->addr = (uint64_t)(uintptr_t)sess->recv_window_buf[slot];
+	sqe->len = sess->recv_window_len[slot];
+	sqe->off = (uint64_t)seq_no * sess->data_size;
+	sqe->user_data = URING_DATA(URING_OP_WRITE, sess->session_id, slot);
+	sess->recv_write_arr[slot] = true;
+	sess->uring_pending++;
+}
+
+/*----------------- uring_unlink() -------------------
+
+	@brief : Queue the unlink of the file named in unlink_name
+	
+	@param : sess - client session
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void uring_unlink(struct session *sess){
+	struct io_uring_sqe *sqe;
+	sqe = uring_get_sqe(&io_ring);
+	sqe->opcode = IORING_OP_UNLINKAT;
+	sqe->fd = AT_FDCWD;
+	sqe->addr = (uint64_t)(uintptr_t)sess->unlink_name;
+	sqe->user_data = URING_DATA(URING_OP_UNLINK, sess->session_id, 0);
+	sess->unlink_done = false;
+	sess->uring_pending++;
+}
+
+/*----------------- file_name_hash() -------------------
+
+	@brief : FNV-1a hash of a file name, picks the index bucket
+	
+	@param : name - file name
+	
+	@return : bucket number
+
+-----------------------------------------------------------*/
+
+int file_name_hash(char *name){
+	uint32_t hash;
+	hash = 2166136261u;
+	while(*name != '\0'){
+		hash ^= (unsigned char)*name++;
+		hash *= 16777619u;
+	}
+	return (int)(hash & (FILE_INDEX_BUCKETS - 1));
+}
+
+/*----------------- index_find() -------------------
+
+	@brief : Find the index entry of a file. The caller holds 
+			 file_index_lock.
+	
+	@param : name - file name
+	
+	@return : index entry, NULL if not indexed
+
+-----------------------------------------------------------*/
+
+struct file_entry *index_find(char *name){
+	struct file_entry *entry;
+	for(entry = file_index[file_name_hash(name)]; entry != NULL; entry = entry->next){
+		if(strcmp(entry->name, name) == 0){return entry;}
+	}
+	return NULL;
+}
+
+/*----------------- index_remove() -------------------
+
+	@brief : Drop a file from the index
+	
+	@param : name - file name
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void index_remove(char *name){
+	struct file_entry **link, *entry;
+	pthread_rwlock_wrlock(&file_index_lock);
+	for(link = &file_index[file_name_hash(name)]; *link != NULL; link = &(*link)->next){
+		if(strcmp((*link)->name, name) == 0){
+			entry = *link;
+			*link = entry->next;
+			free(entry);
+			file_index_count--;
+			file_index_sorted_valid = false;
+			break;
+		}
+	}
+	pthread_rwlock_unlock(&file_index_lock);
+}
+
+/*----------------- index_update() -------------------
+
+	@brief : Bring the index entry of a file up to date with its 
+			 metadata. Names that are no longer regular files are 
+			 dropped. The content hash is recomputed by the index 
+			 thread when size or mtime changed.
+	
+	@param : name - file name
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void index_update(char *name){
+	struct file_entry *entry;
+	struct stat st;
+	int bucket;
+	if(!lookup_file(name, &st, 0) || !S_ISREG(st.st_mode) || (strlen(name) > NAME_MAX)){
+		index_remove(name);
+		return;
+	}
+	pthread_rwlock_wrlock(&file_index_lock);
+	entry = index_find(name);
+	if(entry == NULL){
+		entry = calloc(1, sizeof(struct file_entry));
+		if(entry != NULL){
+			strcpy(entry->name, name);
+			bucket = file_name_hash(name);
+			entry->next = file_index[bucket];
+			file_index[bucket] = entry;
+			file_index_count++;
+			file_index_sorted_valid = false;
+		}
+	}
+	if(entry != NULL){									/* contents may change at the same size and mtime */
+		entry->size = st.st_size;
+		entry->mtime = st.st_mtime;
+		entry->mtime_nsec = st.st_mtim.tv_nsec;
+		entry->generation++;
+		entry->hash_valid = false;
+	}
+	pthread_rwlock_unlock(&file_index_lock);
+}
+
+/*----------------- index_lookup() -------------------
+
+	@brief : Copy the index entry of a file
+	
+	@param : name - file name
+			 copy - filled with the entry if found
+	
+	@return : true if the file is indexed
+
+-----------------------------------------------------------*/
+
+bool index_lookup(char *name, struct file_entry *copy){
+	struct file_entry *entry;
+	pthread_rwlock_rdlock(&file_index_lock);
+	entry = index_find(name);
+	if(entry != NULL){*copy = *entry;}
+	pthread_rwlock_unlock(&file_index_lock);
+	return (entry != NULL);
+}
+
+/*----------------- index_build() -------------------
+
+	@brief : Index every regular file of the server directory, 
+			 dropping the old entries first
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void index_build(void){
+	struct file_entry *entry;
+	struct dirent *pDirent;
+	DIR *pDir;
+	int var1;
+	pthread_rwlock_wrlock(&file_index_lock);
+	for(var1 = 0; var1 < FILE_INDEX_BUCKETS; var1++){
+		while((entry = file_index[var1]) != NULL){
+			file_index[var1] = entry->next;
+			free(entry);
+		}
+	}
+	file_index_count = 0;
+	file_index_sorted_valid = false;
+	pthread_rwlock_unlock(&file_index_lock);
+	pDir = opendir("./");
+	if(pDir == NULL){
+		log_error("Cannot open directory - ./\n");
+		return;
+	}
+	while((pDirent = readdir(pDir)) != NULL){
+		index_update(pDirent->d_name);
+	}
+	closedir(pDir);
+}
+
+/*----------------- crc_file_contents() -------------------
+
+	@brief : CRC32C of the contents of a file - its digest
+	
+	@param : name - file name
+			 crc - filled with the CRC
+	
+	@return : false if the file could not be read
+
+-----------------------------------------------------------*/
+
+bool crc_file_contents(char *name, uint32_t *crc){
+	char buf[64*1024];
+	ssize_t len;
+	int fd;
+	fd = open(name, O_RDONLY);
+	if(fd < 0){return false;}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	*crc = 0;
+	while((len = read(fd, buf, sizeof(buf))) > 0){
+		*crc = crc32c(*crc, buf, len);
+	}
+	close(fd);
+	return (len == 0);
+}
+
+/*----------------- index_hash_pending() -------------------
+
+	@brief : Compute the content CRCs that are out of date. Files 
+			 are read without the index lock, a CRC is only stored 
+			 if the entry was not updated meanwhile.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void index_hash_pending(void){
+	struct file_entry *entry, pending_arr[FILE_HASH_BATCH];
+	uint32_t crc;
+	int var1, pending_count;
+	do{
+		pending_count = 0;
+		pthread_rwlock_rdlock(&file_index_lock);
+		for(var1 = 0; (var1 < FILE_INDEX_BUCKETS) && (pending_count < FILE_HASH_BATCH); var1++){
+			for(entry = file_index[var1]; (entry != NULL) && (pending_count < FILE_HASH_BATCH); entry = entry->next){
+				if(!entry->hash_valid){pending_arr[pending_count++] = *entry;}
+			}
+		}
+		pthread_rwlock_unlock(&file_index_lock);
+		for(var1 = 0; var1 < pending_count; var1++){
+			if(!crc_file_contents(pending_arr[var1].name, &crc)){crc = 0;}	/* unreadable, not retried until it changes */
+			pthread_rwlock_wrlock(&file_index_lock);
+			entry = index_find(pending_arr[var1].name);
+			if((entry != NULL) && (entry->generation == pending_arr[var1].generation)){
+				entry->content_crc = crc;
+				entry->hash_valid = true;
+			}
+			pthread_rwlock_unlock(&file_index_lock);
+		}
+	}while(pending_count == FILE_HASH_BATCH);
+}
+
+/*----------------- file_index_worker() -------------------
+
+	@brief : Index thread - apply the inotify events of the server 
+			 directory to the index and keep the content CRCs 
+			 current, until the exit signal. A queue overflow lost 
+			 events, the index is rebuilt.
+	
+	@param : arg - unused
+	
+	@return : NULL
+
+-----------------------------------------------------------*/
+
+void *file_index_worker(void *arg){
+	struct inotify_event *event;
+	char *buf;
+	ssize_t len;
+	long var1;
+	buf = malloc(INOTIFY_BUFSIZE);
+	if(buf == NULL){error("ERROR allocating inotify buffer");}
+	index_hash_pending();
+	while(1){
+		struct pollfd pfd[2] = {{inotify_fd, POLLIN, 0}, {exit_fd, POLLIN, 0}};
+		if(poll(pfd, 2, -1) < 0){continue;}
+		if(pfd[1].revents & POLLIN){break;}
+		len = read(inotify_fd, buf, INOTIFY_BUFSIZE);
+		for(var1 = 0; var1 < len; var1 += sizeof(struct inotify_event) + event->len){
+			event = (struct inotify_event *)(buf + var1);
+			if(event->mask & IN_Q_OVERFLOW){
+				log_debug("\ninotify queue overflow, rebuilding the file index");
+				index_build();
+			}
+			else if(event->len == 0){
+				continue;
+			}
+			else if(event->mask & (IN_DELETE | IN_MOVED_FROM)){
+				index_remove(event->name);
+			}
+			else{
+				index_update(event->name);
+			}
+		}
+		index_hash_pending();
+	}
+	free(buf);
+	return NULL;
+}
+
+/*----------------- file_index_init() -------------------
+
+	@brief : Watch the server directory with inotify and build the 
+			 index. The watch is added first, so no change between 
+			 the scan and the start of the index thread is lost.
+	
+	@param : none
+	
+	@return : false if inotify is not available
+
+-----------------------------------------------------------*/
+
+bool file_index_init(void){
+	inotify_fd = inotify_init1(IN_CLOEXEC);
+	if(inotify_fd < 0){return false;}
+	if(inotify_add_watch(inotify_fd, ".", INOTIFY_MASK) < 0){
+		close(inotify_fd);
+		return false;
+	}
+	index_build();
+	return true;
+}
+
+/*----------------- find_served_file() -------------------
+
+	@brief : Check if a file is served - from the index, or with 
+			 fstatat() when there is no index
+	
+	@param : name - file name
+			 size - filled with the file size
+	
+	@return : true if found
+
+-----------------------------------------------------------*/
+
+bool find_served_file(char *name, off_t *size){
+	struct file_entry entry;
+	struct stat st;
+	if(file_index_enable){
+		if(!index_lookup(name, &entry)){return false;}
+		*size = entry.size;
+		return true;
+	}
+	if(!lookup_file(name, &st, 0) || !S_ISREG(st.st_mode)){return false;}
+	*size = st.st_size;
+	return true;
+}
+
+/*----------------- file_digest() -------------------
+
+	@brief : Digest of a served file for the K reply of a gt - the 
+			 CRC the index thread keeps if it is current for the 
+			 opened file, else the file is read now up to the size 
+			 announced. A CRC of 0 in the index may be an unreadable 
+			 file and is read again.
+	
+	@param : name - file name
+			 fd - descriptor the get sends from
+			 st - fstat() of the descriptor
+			 crc - filled with the digest
+	
+	@return : false if the file could not be read
+
+-----------------------------------------------------------*/
+
+bool file_digest(char *name, int fd, struct stat *st, uint32_t *crc){
+	struct file_entry entry;
+	char buf[64*1024];
+	ssize_t len;
+	off_t offset;
+	if(file_index_enable && index_lookup(name, &entry) && entry.hash_valid && (entry.content_crc != 0) && 
+	   (st->st_size == entry.size) && (st->st_mtime == entry.mtime) && (st->st_mtim.tv_nsec == entry.mtime_nsec)){
+		*crc = entry.content_crc;
+		return true;
+	}
+	*crc = 0;
+	for(offset = 0; offset < st->st_size; offset += len){
+		len = pread(fd, buf, ((st->st_size - offset) < (off_t)sizeof(buf)) ? (size_t)(st->st_size - offset) : sizeof(buf), offset);
+		if(len <= 0){return false;}
+		*crc = crc32c(*crc, buf, len);
+	}
+	return true;
+}
+
+/*----------------- fnv1a_update() -------------------
+
+	@brief : Add a buffer to an FNV-1a hash - the strong checksum of 
+			 a pd block, the resume check and the check of a rebuilt file
+	
+	@param : hash - running hash, starts at the FNV offset basis
+			 buf - data
+			 len - data length
+	
+	@return : updated hash
+
+-----------------------------------------------------------*/
+
+uint64_t fnv1a_update(uint64_t hash, char *buf, int len){
+	int var1;
+	for(var1 = 0; var1 < len; var1++){
+		hash ^= (unsigned char)buf[var1];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+/*----------------- hash_file_range() -------------------
+
+	@brief : FNV-1a hash of a byte range of a file, to check that 
+			 both ends hold the same data before resuming
+	
+	@param : fd - file descriptor
+			 offset - start of the range
+			 len - length of the range
+			 hash - hash of the range
+	
+	@return : false if the range could not be read in full
+
+-----------------------------------------------------------*/
+
+bool hash_file_range(int fd, off_t offset, off_t len, uint64_t *hash){
+	char buf[16*1024];
+	ssize_t read_len;
+	*hash = FNV_OFFSET_BASIS;
+	while(len > 0){
+		read_len = pread(fd, buf, (len < (off_t)sizeof(buf)) ? (size_t)len : sizeof(buf), offset);
+		if(read_len <= 0){return false;}
+		*hash = fnv1a_update(*hash, buf, (int)read_len);
+		offset += read_len;
+		len -= read_len;
+	}
+	return true;
+}
+
+/*----------------- crc_file_range() -------------------
+
+	@brief : CRC32C of a range of a file
+	
+	@param : fd - file
+			 offset - start of the range
+			 len - length of the range
+			 crc - CRC of the range
+	
+	@return : false if the range could not be read in full
+
+-----------------------------------------------------------*/
+
+bool crc_file_range(int fd, off_t offset, off_t len, uint32_t *crc){
+	char buf[64*1024];
+	ssize_t read_len;
+	*crc = 0;
+	while(len > 0){
+		read_len = pread(fd, buf, (len < (off_t)sizeof(buf)) ? (size_t)len : sizeof(buf), offset);
+		if(read_len <= 0){return false;}
+		*crc = crc32c(*crc, buf, read_len);
+		offset += read_len;
+		len -= read_len;
+	}
+	return true;
+}
+
+/*----------------- hash_resume_tail() -------------------
+
+	@brief : Hash the RESUME_TAIL_SIZE bytes of a file before a 
+			 resume offset
+	
+	@param : filename - file name
+			 offset - resume offset
+			 hash - hash of the tail
+	
+	@return : false if the file or the tail could not be read
+
+-----------------------------------------------------------*/
+
+bool hash_resume_tail(char *filename, off_t offset, uint64_t *hash){
+	off_t len;
+	int fd;
+	bool ret;
+	fd = open(filename, O_RDONLY);
+	if(fd < 0){return false;}
+	len = (offset < RESUME_TAIL_SIZE) ? offset : RESUME_TAIL_SIZE;
+	ret = hash_file_range(fd, offset - len, len, hash);
+	close(fd);
+	return ret;
+}
+
+/*----------------- state_dir_open() -------------------
+
+	@brief : Create and open STATE_DIR, the directory of the put 
+			 journals. Journals are kept out of the served names, so 
+			 no user file is overwritten or removed for one and no 
+			 client can gt, dl or pt a journal. A link in its place 
+			 is not followed.
+	
+	@param : none
+	
+	@return : directory descriptor, -1 if it cannot be used
+
+-----------------------------------------------------------*/
+
+int state_dir_open(void){
+	if((mkdir(STATE_DIR, 0700) < 0) && (errno != EEXIST)){return -1;}
+	return open(STATE_DIR, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+}
+
+/*----------------- journal_read() -------------------
+
+	@brief : Read the journal of a partial put file (in STATE_DIR) - 
+			 its full size and the bytes from its start known to be 
+			 written
+	
+	@param : filename - file name
+			 size - size of the complete file, -1 if unknown
+			 done - completed range, from offset 0
+	
+	@return : false if there is no journal
+
+-----------------------------------------------------------*/
+
+bool journal_read(char *filename, off_t *size, off_t *done){
+	char name[NAME_MAX + sizeof(JOURNAL_SUFFIX)];
+	long long var1, var2;
+	FILE *fp;
+	bool ret;
+	int fd;
+	snprintf(name, sizeof(name), "%s%s", filename, JOURNAL_SUFFIX);
+	fd = openat(state_dir_fd, name, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if(fd < 0){return false;}
+	fp = fdopen(fd, "r");
+	if(fp == NULL){
+		close(fd);
+		return false;
+	}
+	ret = (fscanf(fp, "%lld %lld", &var1, &var2) == 2) && (var2 >= 0);
+	fclose(fp);
+	*size = (off_t)var1;
+	*done = (off_t)var2;
+	return ret;
+}
+
+/*----------------- journal_open() -------------------
+
+	@brief : Create the journal of a put file in STATE_DIR
+	
+	@param : filename - file name
+	
+	@return : journal descriptor, -1 on failure
+
+-----------------------------------------------------------*/
+
+int journal_open(char *filename){
+	char name[NAME_MAX + sizeof(JOURNAL_SUFFIX)];
+	snprintf(name, sizeof(name), "%s%s", filename, JOURNAL_SUFFIX);
+	return openat(state_dir_fd, name, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+}
+
+/*----------------- journal_write() -------------------
+
+	@brief : Record the completed range of a put file. The record 
+			 has a fixed width and is rewritten in place.
+	
+	@param : fd - journal descriptor
+			 size - size of the complete file, -1 if unknown
+			 done - completed range, from offset 0
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void journal_write(int fd, off_t size, off_t done){
+	char record[64];
+	int len;
+	len = snprintf(record, sizeof(record), "%20lld %20lld\n", (long long)size, (long long)done);
+	if(pwrite(fd, record, len, 0) != len){log_error("\nJournal write failed");}
+}
+
+/*----------------- journal_remove() -------------------
+
+	@brief : Delete the sidecar journal of a complete put file
+	
+	@param : filename - file name
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void journal_remove(char *filename){
+	char name[NAME_MAX + sizeof(JOURNAL_SUFFIX)];
+	snprintf(name, sizeof(name), "%s%s", filename, JOURNAL_SUFFIX);
+	unlinkat(state_dir_fd, name, 0);
+}
+
+/*----------------- check_get_resume() -------------------
+
+	@brief : Check the resume request of an rg - "offset hash" after 
+			 the file name. The offset must be packet aligned and 
+			 within the file, and the hash must match the bytes of 
+			 the file before it.
+	
+	@param : sess - client session
+			 filename - file name
+			 size - file size
+			 resume_ptr - "offset hash" string
+	
+	@return : offset to resume at, 0 to send the whole file
+
+-----------------------------------------------------------*/
+
+off_t check_get_resume(struct session *sess, char *filename, off_t size, char *resume_ptr){
+	long long offset;
+	unsigned long long client_hash;
+	uint64_t hash;
+	if((sscanf(resume_ptr, "%lld %llx", &offset, &client_hash) != 2) || (offset <= 0) || 
+	   (offset > size) || ((offset % sess->data_size) != 0)){return 0;}
+	if(!hash_resume_tail(filename, (off_t)offset, &hash) || (hash != client_hash)){
+		log_info("\nPartial file of the client differs, sending the whole file");
+		return 0;
+	}
+	log_info("\nResuming %s at %lld of %lld bytes", filename, offset, (long long)size);
+	return (off_t)offset;
+}
+
+/*----------------- put_be32() -------------------
+
+	@brief : Store a big endian 32 bit field of a pd signature or 
+			 delta record
+	
+	@param : ptr - ptr to field
+			 val - value
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void put_be32(char *ptr, uint32_t val){
+	val = htonl(val);
+	memcpy(ptr, &val, 4);
+}
+
+/*----------------- put_be64() -------------------
+
+	@brief : Store a big endian 64 bit field
+	
+	@param : ptr - ptr to field
+			 val - value
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void put_be64(char *ptr, uint64_t val){
+	put_be32(ptr, (uint32_t)(val >> 32));
+	put_be32(ptr + 4, (uint32_t)val);
+}
+
+/*----------------- get_be32() -------------------
+
+	@brief : Load a big endian 32 bit field
+	
+	@param : ptr - ptr to field
+	
+	@return : value
+
+-----------------------------------------------------------*/
+
+uint32_t get_be32(char *ptr){
+	uint32_t val;
+	memcpy(&val, ptr, 4);
+	return ntohl(val);
+}
+
+/*----------------- get_be64() -------------------
+
+	@brief : Load a big endian 64 bit field
+	
+	@param : ptr - ptr to field
+	
+	@return : value
+
+-----------------------------------------------------------*/
+
+uint64_t get_be64(char *ptr){
+	return ((uint64_t)get_be32(ptr) << 32) | get_be32(ptr + 4);
+}
+
+/*----------------- weak_sums() -------------------
+
+	@brief : Sums of the rolling (rsync) checksum of a block - a is 
+			 the byte sum, b the sum weighted by the distance to the 
+			 block end. WEAK_CHECKSUM() combines their low 16 bits.
+	
+	@param : buf - block data
+			 len - block length
+			 a, b - sums
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void weak_sums(char *buf, int len, uint32_t *a, uint32_t *b){
+	int var1;
+	*a = 0;
+	*b = 0;
+	for(var1 = 0; var1 < len; var1++){
+		*a += (unsigned char)buf[var1];
+		*b += (uint32_t)(len - var1) * (unsigned char)buf[var1];
+	}
+}
+
+/*----------------- build_signature() -------------------
+
+	@brief : Compute the block signatures of a file for a pd - the 
+			 block size and file size, then the weak and strong 
+			 checksum of each full block. The signatures go to a 
+			 temporary file that is sent like a get file.
+	
+	@param : filename - file name
+			 size - file size
+	
+	@return : signature file, NULL on failure
+
+-----------------------------------------------------------*/
+
+FILE *build_signature(char *filename, off_t size){
+	char buf[DELTA_BLOCK_MAX], entry[DELTA_SIG_HDR_SIZE];
+	uint32_t block_size, a, b;
+	off_t offset;
+	FILE *sig_file;
+	int fd;
+	block_size = DELTA_BLOCK_MIN;
+	while((block_size < DELTA_BLOCK_MAX) && (((off_t)block_size * block_size) < size)){block_size += 1024;}
+	fd = open(filename, O_RDONLY);
+	if(fd < 0){return NULL;}
+	sig_file = tmpfile();
+	if(sig_file == NULL){
+		close(fd);
+		return NULL;
+	}
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+	put_be32(entry, block_size);
+	put_be64(entry + 4, (uint64_t)size);
+	fwrite(entry, 1, DELTA_SIG_HDR_SIZE, sig_file);
+	for(offset = 0; (offset + block_size) <= size; offset += block_size){
+		if(pread(fd, buf, block_size, offset) != block_size){break;}
+		weak_sums(buf, block_size, &a, &b);
+		put_be32(entry, WEAK_CHECKSUM(a, b));
+		put_be64(entry + 4, fnv1a_update(FNV_OFFSET_BASIS, buf, block_size));
+		fwrite(entry, 1, DELTA_SIG_ENTRY_SIZE, sig_file);
+	}
+	close(fd);
+	if((fflush(sig_file) != 0) || ((offset + block_size) <= size)){
+		fclose(sig_file);
+		return NULL;
+	}
+	log_debug("\nSignatures of %s : %lld blocks of %u bytes", filename, (long long)(size / block_size), block_size);
+	return sig_file;
+}
+
+/*----------------- send_signature() -------------------
+
+	@brief : Answer the signature command of a pd like a get command - 
+			 K with the size of the block signatures of the file, 
+			 which are then sent as data packets once the client 
+			 ACKs it. K 2 if the file is not served.
+	
+	@param : sess - client session
+			 filename - file name
+	
+	@return : file found status ( 1 if found )
+
+-----------------------------------------------------------*/
+
+int send_signature(struct session *sess, char *filename){
+	int pkt_len1, file_found;
+	off_t size;
+	file_found = 0;
+	if(sess->ready_file != NULL){fclose(sess->ready_file);}
+	sess->ready_file = NULL;
+	if(find_served_file(filename, &size)){sess->ready_file = build_signature(filename, size);}
+	if(sess->ready_file != NULL){
+		file_found = 1;
+		sess->send_start_seq = 0;
+		sess->file_size_var = ftello(sess->ready_file);
+		snprintf(sess->file_name_buffer, sizeof(sess->file_name_buffer), "%s", filename);
+		sprintf(filename_buf,"%lld",(long long)sess->file_size_var);
+	}
+	bzero(server_send_buf,BUFSIZE);
+	pkt_len1 = create_packet(sess,'K','0',server_send_buf,file_found ? 1 : 2,filename_buf,file_found ? strlen(filename_buf) : 0);
+	send_reply(sess, server_send_buf, pkt_len1);
+	log_info("\nDelta put of %s requested, %s", filename, file_found ? "signatures sent" : "no copy to delta against");
+	return file_found;
+}
+
+/*----------------- check_file() -------------------
+
+	@brief : Check whether a regular file is served and answer with 
+			 its size. The file is opened here and the size taken with 
+			 fstat() on that descriptor, which the get then sends from, 
+			 so a file still being written is not announced with the 
+			 size of its last close. An rg is answered with 
+			 "size offset", the offset the data packets start at.
+	
+	@param : sess - client session
+			 filename - ptr to file name buffer
+			 filename_len - length of filename
+	
+	@return : file found status ( 1 if found )
+
+-----------------------------------------------------------*/
+
+int check_file(struct session *sess, char *filename, int filename_len){
+	int pkt_len1, file_found, name_len;
+	struct stat st;
+	off_t size, offset;
+	uint32_t digest;
+	file_found = 0;
+	*(filename + filename_len - 1) = '\0';
+	name_len = (int)strlen(filename);
+	sess->send_start_seq = 0;
+	if(sess->ready_file != NULL){						// file of a K that was not ACKed
+		fclose(sess->ready_file);
+		sess->ready_file = NULL;
+	}
+	if(find_served_file(filename, &size)){
+		sess->ready_file = fopen(filename,"rb");
+	}
+	if((sess->ready_file != NULL) && (fstat(fileno(sess->ready_file), &st) == 0) && S_ISREG(st.st_mode)){
+		file_found = 1;
+		size = st.st_size;
+		sess->file_size_var = size;
+		sprintf(filename_buf,"%lld",(long long)size);
+		offset = 0;
+		if((name_len + 1) < filename_len){				// rg - resume request after the name
+			offset = check_get_resume(sess, filename, size, filename + name_len + 1);
+			sess->send_start_seq = (int)(offset / sess->data_size);
+			sprintf(filename_buf,"%lld %lld",(long long)size,(long long)offset);
+		}
+		if(sess->crc && file_digest(filename, fileno(sess->ready_file), &st, &digest)){	// "size offset digest"
+			sprintf(filename_buf,"%lld %lld %08x",(long long)size,(long long)offset,digest);
+		}
+		log_debug("\nfile size : %s bytes\n", filename_buf);
+	}
+	else if(sess->ready_file != NULL){
+		fclose(sess->ready_file);
+		sess->ready_file = NULL;
+	}
+	bzero(server_send_buf,BUFSIZE);
+	if(file_found == 1){
+		pkt_len1 = create_packet(sess,'K','0',server_send_buf,1,filename_buf,strlen(filename_buf));
+		log_info("\n%s file found",filename);
+	}
+	else{
+		pkt_len1 = create_packet(sess,'K','0',server_send_buf,2,filename_buf,strlen(filename_buf));
+		log_info("\nFile not found!");
+	}
+	send_reply(sess, server_send_buf, pkt_len1);
+	log_debug("\n\nFile ACK packet sent to client\n");
+	return file_found;
+}
+
+/*----------------- send_delete_reply() -------------------
+
+	@brief : Answer a delete command
+	
+	@param : sess - client session
+			 file_found - file was found
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_delete_reply(struct session *sess, int file_found){
+	int pkt_len1;
+	bzero(server_send_buf,BUFSIZE);
+	pkt_len1 = create_packet(sess,'A','X',server_send_buf,file_found ? 1 : 2,filename_buf,strlen(filename_buf));
+	send_reply(sess, server_send_buf, pkt_len1);
+	log_debug("\n\nFile delete ACK packet sent to client\n");
+	bzero(server_send_buf,BUFSIZE);
+}
+
+/*----------------- delete_file() -------------------
+
+	@brief : Delete file if present in the server directory
+	
+	@param : sess - client session
+			 filename - ptr to file name buffer
+			 filename_len - length of filename
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void delete_file(struct session *sess, char *filename, int filename_len){
+	int file_found;
+	struct stat st;
+	off_t size;
+	*(filename + filename_len - 1) = '\0';
+	if(file_index_enable){file_found = find_served_file(filename, &size) ? 1 : 0;}
+	else{file_found = (lookup_file(filename, &st, AT_SYMLINK_NOFOLLOW) && !S_ISDIR(st.st_mode)) ? 1 : 0;}
+	if(file_found){
+		log_info("\n%s - File found\nDeleting file ....",filename);
+		if(uring_enable){						// reply once the unlink completes
+			snprintf(sess->unlink_name, sizeof(sess->unlink_name), "%s", filename);
+			uring_unlink(sess);
+			return;
+		}
+		if (remove(filename) == 0) {
+			log_info("\nFile deleted successfully");
+			if(file_index_enable){index_remove(filename);}
+		}
+		else{log_info("\nUnable to delete the file");}
+	}
+	else{
+		log_info("\nFile not found!");
+	}
+	send_delete_reply(sess, file_found);
+}
+
+/*----------------- compare_entries() -------------------
+
+	@brief : qsort() comparison of two index entry pointers, by name
+	
+	@param : a, b - ptrs to index entry pointers
+	
+	@return : strcmp() order
+
+-----------------------------------------------------------*/
+
+int compare_entries(const void *a, const void *b){
+	return strcmp((*(struct file_entry * const *)a)->name, (*(struct file_entry * const *)b)->name);
+}
+
+/*----------------- fill_file_list() -------------------
+
+	@brief : Write one page of a file listing - the entries after 
+			 the cursor name that match the pattern, as many as fit 
+			 the buffer. Detailed lines are "size mtime name", the 
+			 name last so it may hold spaces.
+	
+	@param : ptr - ptr to file list buffer
+			 max_len - size of the file list buffer
+			 entry_arr - entries in name order
+			 entry_count - number of entries
+			 cursor - last name of the previous page, "" for the first
+			 pattern - glob the names must match, "" for all
+			 detailed - add size and mtime
+			 more - set if entries are left for another page
+	
+	@return : length of file list buffer
+
+-----------------------------------------------------------*/
+
+int fill_file_list(char *ptr, int max_len, struct file_entry **entry_arr, int entry_count, 
+				   char *cursor, char *pattern, bool detailed, bool *more){
+	char line_buf[NAME_MAX + 64];
+	int var1, low, high, mid, line_len;
+	low = 0;
+	high = entry_count;
+	while(low < high){									/* first name after the cursor */
+		mid = (low + high) / 2;
+		if(strcmp(entry_arr[mid]->name, cursor) <= 0){low = mid + 1;}
+		else{high = mid;}
+	}
+	var1 = 0;
+	*more = false;
+	for(; low < entry_count; low++){
+		if((*pattern != '\0') && (fnmatch(pattern, entry_arr[low]->name, 0) != 0)){continue;}
+		if(strchr(entry_arr[low]->name, '\n') != NULL){continue;}
+		if(detailed){
+			line_len = snprintf(line_buf, sizeof(line_buf), "%lld %lld %s\n", (long long)entry_arr[low]->size, 
+								(long long)entry_arr[low]->mtime, entry_arr[low]->name);
+		}
+		else{
+			line_len = snprintf(line_buf, sizeof(line_buf), "%s\n", entry_arr[low]->name);
+		}
+		if((var1 + line_len) > max_len){
+			*more = true;
+			break;
+		}
+		memcpy(ptr + var1, line_buf, line_len);
+		var1 += line_len;
+	}
+	return var1;
+}
+
+/*----------------- create_file_list() -------------------
+
+	@brief : Create one page of the file list of the server 
+			 directory in name order. With the index the sorted 
+			 entry array is kept until the index changes, so a page 
+			 costs a binary search for the cursor. Without it the 
+			 directory is scanned and sorted for each page.
+	
+	@param : ptr - ptr to file list buffer
+			 max_len - size of the file list buffer
+			 cursor - last name of the previous page, "" for the first
+			 pattern - glob the names must match, "" for all
+			 detailed - add size and mtime
+			 more - set if entries are left for another page
+	
+	@return : length of file list buffer
+
+-----------------------------------------------------------*/
+
+int create_file_list(char *ptr, int max_len, char *cursor, char *pattern, bool detailed, bool *more){
+	struct file_entry *entry, *scan_arr, **entry_arr;
+	struct dirent *pDirent;
+	struct stat st;
+	DIR *pDir;
+	int var1, var2, entry_count, scan_size;
+	var1 = 0;
+	*more = false;
+	if(file_index_enable){
+		pthread_rwlock_rdlock(&file_index_lock);
+		if(!file_index_sorted_valid){					/* rebuild under the write lock */
+			pthread_rwlock_unlock(&file_index_lock);
+			pthread_rwlock_wrlock(&file_index_lock);
+			if(!file_index_sorted_valid){
+				free(file_index_sorted);
+				file_index_sorted = malloc(((size_t)file_index_count + 1) * sizeof(struct file_entry *));
+				entry_count = 0;
+				for(var2 = 0; (file_index_sorted != NULL) && (var2 < FILE_INDEX_BUCKETS); var2++){
+					for(entry = file_index[var2]; entry != NULL; entry = entry->next){
+						file_index_sorted[entry_count++] = entry;
+					}
+				}
+				if(file_index_sorted != NULL){
+					qsort(file_index_sorted, entry_count, sizeof(struct file_entry *), compare_entries);
+					file_index_sorted_valid = true;
+				}
+			}
+		}
+		if(file_index_sorted_valid){
+			var1 = fill_file_list(ptr, max_len, file_index_sorted, file_index_count, cursor, pattern, detailed, more);
+		}
+		pthread_rwlock_unlock(&file_index_lock);
+		return var1;
+	}
+	pDir = opendir("./");
+	if(pDir == NULL){
+		log_error("Cannot open directory - ./\n");
+		return 0;
+	}
+	scan_size = 64;
+	entry_count = 0;
+	scan_arr = malloc(scan_size * sizeof(struct file_entry));
+	while((scan_arr != NULL) && ((pDirent = readdir(pDir)) != NULL)){
+		if(entry_count == scan_size){
+			scan_size *= 2;
+			entry = realloc(scan_arr, scan_size * sizeof(struct file_entry));
+			if(entry == NULL){break;}
+			scan_arr = entry;
+		}
+		bzero(&scan_arr[entry_count], sizeof(struct file_entry));
+		snprintf(scan_arr[entry_count].name, sizeof(scan_arr[0].name), "%s", pDirent->d_name);
+		if(fstatat(AT_FDCWD, pDirent->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0){
+			scan_arr[entry_count].size = st.st_size;
+			scan_arr[entry_count].mtime = st.st_mtime;
+		}
+		entry_count++;
+	}
+	closedir(pDir);
+	entry_arr = (scan_arr != NULL) ? malloc(((size_t)entry_count + 1) * sizeof(struct file_entry *)) : NULL;
+	if(entry_arr != NULL){
+		for(var2 = 0; var2 < entry_count; var2++){entry_arr[var2] = &scan_arr[var2];}
+		qsort(entry_arr, entry_count, sizeof(struct file_entry *), compare_entries);
+		var1 = fill_file_list(ptr, max_len, entry_arr, entry_count, cursor, pattern, detailed, more);
+	}
+	free(entry_arr);
+	free(scan_arr);
+	return var1;
+}
+
+/*----------------- get_time_msec() -------------------
+
+	@brief : Monotonic clock reading used for retransmit timers
+	
+	@param : none
+	
+	@return : time in milliseconds
+
+-----------------------------------------------------------*/
+
+long unsigned int get_time_msec(void){
+	struct timespec spec;
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return ((long unsigned int)spec.tv_sec * 1000) + (spec.tv_nsec / 1000000);
+}
+
+/*----------------- get_time_usec() -------------------
+
+	@brief : Monotonic clock reading used for congestion control 
+			 RTT and delivery rate samples
+	
+	@param : none
+	
+	@return : time in microseconds
+
+-----------------------------------------------------------*/
+
+long unsigned int get_time_usec(void){
+	struct timespec spec;
+	clock_gettime(CLOCK_MONOTONIC, &spec);
+	return ((long unsigned int)spec.tv_sec * 1000000) + (spec.tv_nsec / 1000);
+}
+
+/*----------------- rto_init() -------------------
+
+	@brief : Reset RTO estimate before the first RTT sample
+	
+	@param : rs - RTO estimate
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void rto_init(struct rto_state *rs){
+	rs->srtt = 0;
+	rs->rttvar = 0;
+	rs->rto = RTO_INITIAL_MSEC;
+	rs->has_sample = false;
+}
+
+/*----------------- rto_update() -------------------
+
+	@brief : Fold an RTT sample into SRTT / RTTVAR and recompute 
+			 the RTO as in RFC 6298, clearing any backoff. SRTT and 
+			 RTTVAR are kept scaled by 8 and 4 so the 1/8 and 1/4 
+			 gains work in integer msec. Only packets that were not 
+			 retransmitted may be sampled (Karn's rule).
+	
+	@param : rs - RTO estimate
+			 rtt_msec - measured round trip time
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void rto_update(struct rto_state *rs, long rtt_msec){
+	long delta;
+	if(rtt_msec < 0){rtt_msec = 0;}
+	if(!rs->has_sample){
+		rs->srtt = rtt_msec << 3;						/* SRTT = R */
+		rs->rttvar = rtt_msec << 1;						/* RTTVAR = R/2 */
+		rs->has_sample = true;
+	}
+	else{
+		delta = rtt_msec - (rs->srtt >> 3);
+		rs->srtt += delta;								/* SRTT = 7/8 SRTT + 1/8 R */
+		if(delta < 0){delta = -delta;}
+		rs->rttvar += delta - (rs->rttvar >> 2);		/* RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R| */
+	}
+	rs->rto = (rs->srtt >> 3) + ((rs->rttvar > RTO_GRANULARITY_MSEC) ? rs->rttvar : RTO_GRANULARITY_MSEC);
+	if(rs->rto < RTO_MIN_MSEC){rs->rto = RTO_MIN_MSEC;}
+	if(rs->rto > RTO_MAX_MSEC){rs->rto = RTO_MAX_MSEC;}
+}
+
+/*----------------- rto_backoff() -------------------
+
+	@brief : Double the RTO after a retransmit timeout, kept until 
+			 the next RTT sample
+	
+	@param : rs - RTO estimate
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void rto_backoff(struct rto_state *rs){
+	rs->rto = ((rs->rto << 1) < RTO_MAX_MSEC) ? (rs->rto << 1) : RTO_MAX_MSEC;
+}
+
+/*----------------- timer_wheel_init() -------------------
+
+	@brief : Empty a timer wheel, every slot is a circular list 
+			 whose head is the slot itself
+	
+	@param : w - timer wheel
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void timer_wheel_init(struct timer_wheel *w){
+	int var1;
+	for(var1 = 0; var1 < TIMER_WHEEL_SLOTS; var1++){
+		w->slot[var1].next = w->slot[var1].prev = &w->slot[var1];
+	}
+	for(var1 = 0; var1 < TIMER_WHEEL_L1_SLOTS; var1++){
+		w->l1_slot[var1].next = w->l1_slot[var1].prev = &w->l1_slot[var1];
+	}
+	w->tick = get_time_usec() / TIMER_TICK_USEC;
+	w->count = 0;
+}
+
+/*----------------- timer_init() -------------------
+
+	@brief : Set up an unarmed timer
+	
+	@param : t - timer
+			 fn - called when the timer expires
+			 arg - passed to fn through the timer
+			 seq_no - passed to fn through the timer
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void timer_init(struct wheel_timer *t, void (*fn)(struct wheel_timer *t), void *arg, int seq_no){
+	t->next = t->prev = NULL;
+	t->fn = fn;
+	t->arg = arg;
+	t->seq_no = seq_no;
+}
+
+/*----------------- timer_link() -------------------
+
+	@brief : Put an unlinked timer in the slot of its expiry tick - 
+			 level 0 if it expires within TIMER_WHEEL_SLOTS ticks, 
+			 else level 1, from where it is moved down when its 
+			 block of ticks comes up. Expired ticks go to the next 
+			 tick run.
+	
+	@param : w - timer wheel
+			 t - timer
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void timer_link(struct timer_wheel *w, struct wheel_timer *t){
+	struct wheel_timer *head;
+	long unsigned int delta;
+	if(t->expires < w->tick){t->expires = w->tick;}
+	delta = t->expires - w->tick;
+	if(delta >= (TIMER_WHEEL_SLOTS * TIMER_WHEEL_L1_SLOTS)){
+		t->expires = w->tick + (TIMER_WHEEL_SLOTS * TIMER_WHEEL_L1_SLOTS) - 1;
+	}
+	if(delta < TIMER_WHEEL_SLOTS){
+		head = &w->slot[t->expires & (TIMER_WHEEL_SLOTS - 1)];
+	}
+	else{
+		head = &w->l1_slot[(t->expires >> TIMER_WHEEL_BITS) & (TIMER_WHEEL_L1_SLOTS - 1)];
+	}
+	t->next = head;
+	t->prev = head->prev;
+	head->prev->next = t;
+	head->prev = t;
+}
+
+/*----------------- timer_del() -------------------
+
+	@brief : Disarm a timer, nothing if it is not armed
+	
+	@param : w - timer wheel
+			 t - timer
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void timer_del(struct timer_wheel *w, struct wheel_timer *t){
+	if(t->next == NULL){return;}
+	t->prev->next = t->next;
+	t->next->prev = t->prev;
+	t->next = t->prev = NULL;
+	w->count--;
+}
+
+/*----------------- timer_add() -------------------
+
+	@brief : (Re)arm a timer. It fires on the first tick at or after 
+			 the expiry time, never before.
+	
+	@param : w - timer wheel
+			 t - timer
+			 expires_usec - expiry time (usec, get_time_usec())
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void timer_add(struct timer_wheel *w, struct wheel_timer *t, long unsigned int expires_usec){
+	timer_del(w, t);
+	if(w->count == 0){w->tick = get_time_usec() / TIMER_TICK_USEC;}
+	t->expires = (expires_usec + TIMER_TICK_USEC - 1) / TIMER_TICK_USEC;
+	timer_link(w, t);
+	w->count++;
+}
+
+/*----------------- timer_list_move() -------------------
+
+	@brief : Move the timers of a slot list to another list head
+	
+	@param : dst - list head, its old contents are dropped
+			 src - list head, left empty
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void timer_list_move(struct wheel_timer *dst, struct wheel_timer *src){
+	if(src->next == src){
+		dst->next = dst->prev = dst;
+		return;
+	}
+	dst->next = src->next;
+	dst->prev = src->prev;
+	dst->next->prev = dst;
+	dst->prev->next = dst;
+	src->next = src->prev = src;
+}
+
+/*----------------- timer_wheel_run() -------------------
+
+	@brief : Run the ticks up to now - at the start of each block of 
+			 TIMER_WHEEL_SLOTS ticks move its level 1 timers down, 
+			 then fire the timers of the tick. A fired timer is 
+			 disarmed before its function runs, which may re-arm it 
+			 or disarm other timers.
+	
+	@param : w - timer wheel
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void timer_wheel_run(struct timer_wheel *w){
+	struct wheel_timer expired, *t;
+	long unsigned int now_tick;
+	now_tick = get_time_usec() / TIMER_TICK_USEC;
+	while((w->count > 0) && (w->tick <= now_tick)){
+		if((w->tick & (TIMER_WHEEL_SLOTS - 1)) == 0){
+			timer_list_move(&expired, &w->l1_slot[(w->tick >> TIMER_WHEEL_BITS) & (TIMER_WHEEL_L1_SLOTS - 1)]);
+			while(expired.next != &expired){
+				t = expired.next;
+				expired.next = t->next;
+				t->next->prev = &expired;
+				timer_link(w, t);
+			}
+		}
+		/* Move the tick out of the wheel first, so timers re-armed 
+		 * by the functions land in a later tick */
+		timer_list_move(&expired, &w->slot[w->tick & (TIMER_WHEEL_SLOTS - 1)]);
+		w->tick++;
+		while(expired.next != &expired){
+			t = expired.next;
+			timer_del(w, t);
+			t->fn(t);
+		}
+	}
+	if(w->count == 0){w->tick = now_tick + 1;}
+}
+
+/*----------------- timer_wheel_next() -------------------
+
+	@brief : Time left until the next tick the wheel has work for - 
+			 the earliest armed level 0 slot, or the start of the 
+			 next block with level 1 timers to move down
+	
+	@param : w - timer wheel
+	
+	@return : timeout in msec, -1 if no timer is armed
+
+-----------------------------------------------------------*/
+
+int timer_wheel_next(struct timer_wheel *w){
+	long unsigned int now_tick, next_tick, block;
+	int var1;
+	if(w->count == 0){return -1;}
+	next_tick = w->tick + (TIMER_WHEEL_SLOTS * TIMER_WHEEL_L1_SLOTS);
+	for(var1 = 0; var1 < TIMER_WHEEL_SLOTS; var1++){
+		if(w->slot[(w->tick + var1) & (TIMER_WHEEL_SLOTS - 1)].next != &w->slot[(w->tick + var1) & (TIMER_WHEEL_SLOTS - 1)]){
+			next_tick = w->tick + var1;
+			break;
+		}
+	}
+	for(var1 = 0; var1 < TIMER_WHEEL_L1_SLOTS; var1++){
+		block = ((w->tick + TIMER_WHEEL_SLOTS - 1) >> TIMER_WHEEL_BITS) + var1;
+		if((block << TIMER_WHEEL_BITS) >= next_tick){break;}
+		if(w->l1_slot[block & (TIMER_WHEEL_L1_SLOTS - 1)].next != &w->l1_slot[block & (TIMER_WHEEL_L1_SLOTS - 1)]){
+			next_tick = block << TIMER_WHEEL_BITS;
+			break;
+		}
+	}
+	now_tick = get_time_usec() / TIMER_TICK_USEC;
+	if(next_tick <= now_tick){return 0;}
+	return (int)((next_tick - now_tick) * TIMER_TICK_USEC / 1000);
+}
+
+/*----------------- cc_init() -------------------
+
+	@brief : Start congestion control of a new transfer
+	
+	@param : cc - congestion control state
+			 ops - algorithm
+			 pkt_size - data packet payload (bytes)
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_init(struct cc_state *cc, struct cc_ops *ops, int pkt_size){
+	bzero(cc, sizeof(*cc));
+	cc->ops = ops;
+	cc->pkt_size = pkt_size;
+	cc->cwnd = CC_INIT_CWND;
+	cc->ssthresh = MAX_WINDOW_SIZE;
+	cc->delivered_usec = get_time_usec();
+	cc->min_rtt_usec = CC_RTT_UNKNOWN;
+	cc->min_rtt_stamp = cc->delivered_usec;
+	ops->init(cc);
+}
+
+/*----------------- cc_window() -------------------
+
+	@brief : Packets the sender may have in flight - the congestion 
+			 window, limited by the send window (-w)
+	
+	@param : cc - congestion control state
+	
+	@return : window in packets, at least 1
+
+-----------------------------------------------------------*/
+
+int cc_window(struct cc_state *cc){
+	int cwnd;
+	cwnd = (cc->cwnd < 1) ? 1 : (int)cc->cwnd;
+	return (cwnd < window_size) ? cwnd : window_size;
+}
+
+/*----------------- cc_pacing_delay() -------------------
+
+	@brief : Time the sender has to wait before its next packet to 
+			 keep to the pacing rate
+	
+	@param : cc - congestion control state
+			 now - current time (usec)
+	
+	@return : delay in usec, 0 if the packet may go now
+
+-----------------------------------------------------------*/
+
+long unsigned int cc_pacing_delay(struct cc_state *cc, long unsigned int now){
+	if((cc->pacing_rate <= 0) || (cc->pace_next_usec <= now)){return 0;}
+	return cc->pace_next_usec - now;
+}
+
+/*----------------- cc_on_send() -------------------
+
+	@brief : Stamp a data packet with its send time and the delivery 
+			 state, the base of the RTT and delivery rate samples 
+			 taken when it is ACKed, and move the pacing clock on by 
+			 one packet. A sender that fell behind the pacing clock 
+			 may catch up by PACING_QUANTUM_USEC, the timer resolution.
+	
+	@param : cc - congestion control state
+			 seq_no - data packet sequence number
+			 now - send time (usec)
+			 retx - packet was sent before
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_on_send(struct cc_state *cc, int seq_no, long unsigned int now, bool retx){
+	struct cc_pkt *pkt;
+	pkt = &cc->pkt[SEQ_SLOT(seq_no)];
+	pkt->sent_usec = now;
+	pkt->delivered = cc->delivered;
+	pkt->delivered_usec = cc->delivered_usec;
+	pkt->retx = retx;
+	if(retx){cc->retx_count++;}
+	if(cc->pacing_rate > 0){
+		if((cc->pace_next_usec + PACING_QUANTUM_USEC) < now){cc->pace_next_usec = now - PACING_QUANTUM_USEC;}
+		cc->pace_next_usec += (long unsigned int)(cc->pkt_size * 1e6 / cc->pacing_rate);
+	}
+}
+
+/*----------------- cc_on_delivered() -------------------
+
+	@brief : Count a data packet newly ACKed or SACKed. Packets sent 
+			 once give an RTT sample, the most recently sent packet 
+			 of the ACK is the base of its delivery rate sample.
+	
+	@param : cc - congestion control state
+			 seq_no - data packet sequence number
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_on_delivered(struct cc_state *cc, int seq_no){
+	struct cc_pkt *pkt;
+	long unsigned int now, rtt_usec;
+	pkt = &cc->pkt[SEQ_SLOT(seq_no)];
+	now = get_time_usec();
+	cc->delivered++;
+	cc->delivered_usec = now;
+	if(!pkt->retx){
+		rtt_usec = now - pkt->sent_usec;
+		cc->srtt_usec = (cc->srtt_usec == 0) ? rtt_usec : ((7 * cc->srtt_usec) + rtt_usec) / 8;
+		if(rtt_usec <= cc->min_rtt_usec){
+			cc->min_rtt_usec = rtt_usec;
+			cc->min_rtt_stamp = now;
+		}
+	}
+	if((cc->rs_acked == 0) || (pkt->delivered > cc->rs_prior_delivered)){
+		cc->rs_prior_delivered = pkt->delivered;
+		cc->rs_prior_usec = pkt->delivered_usec;
+	}
+	cc->rs_acked++;
+}
+
+/*----------------- cc_on_ack() -------------------
+
+	@brief : Let the algorithm update cwnd and pacing rate once the 
+			 packets of an ACK are counted
+	
+	@param : cc - congestion control state
+			 base_seq - send window base after the ACK
+			 inflight - packets sent and not cumulatively ACKed
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_on_ack(struct cc_state *cc, int base_seq, int inflight){
+	if(cc->rs_acked == 0){return;}
+	cc->ops->on_ack(cc, base_seq, inflight);
+	if(cc->cwnd > MAX_WINDOW_SIZE){cc->cwnd = MAX_WINDOW_SIZE;}
+	cc->rs_acked = 0;
+}
+
+/*----------------- cc_on_loss() -------------------
+
+	@brief : Report data packets declared lost by the SACK scoreboard
+	
+	@param : cc - congestion control state
+			 lost - packets declared lost
+			 next_seq - next new data packet to be sent
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_on_loss(struct cc_state *cc, int lost, int next_seq){
+	cc->loss_count += lost;
+	cc->ops->on_loss(cc, next_seq);
+}
+
+/*----------------- cc_on_timeout() -------------------
+
+	@brief : Report a retransmit timeout of the send window base
+	
+	@param : cc - congestion control state
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_on_timeout(struct cc_state *cc){
+	cc->timeout_count++;
+	cc->ops->on_timeout(cc);
+}
+
+/*----------------- cc_log_stats() -------------------
+
+	@brief : Log the congestion control counters of a transfer
+	
+	@param : cc - congestion control state
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void cc_log_stats(struct cc_state *cc){
+	log_info("\nCongestion control %s : cwnd %.1f packets, pacing rate %.2f MB/s, min RTT %.3f ms", 
+			 cc->ops->name, cc->cwnd, cc->pacing_rate / 1e6, 
+			 (cc->min_rtt_usec == CC_RTT_UNKNOWN) ? 0.0 : cc->min_rtt_usec / 1e3);
+	log_info("\n%ld packets lost, %ld retransmitted, %ld retransmit timeouts\n", 
+			 cc->loss_count, cc->retx_count, cc->timeout_count);
+}
+
+/*----------------- newreno_init() -------------------
+
+	@brief : NewReno (RFC 6582) - slow start, then AIMD
+	
+	@param : cc - congestion control state
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void newreno_init(struct cc_state *cc){
+	cc->in_recovery = false;
+}
+
+/*----------------- newreno_on_ack() -------------------
+
+	@brief : Grow cwnd by one packet per ACKed packet in slow start 
+			 and by one packet per window after, not while in fast 
+			 recovery. Recovery ends when every packet sent before 
+			 the loss is ACKed. Paced at 2x (slow start) or 1.2x 
+			 cwnd per SRTT.
+	
+	@param : cc - congestion control state
+			 base_seq - send window base after the ACK
+			 inflight - packets sent and not cumulatively ACKed
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void newreno_on_ack(struct cc_state *cc, int base_seq, int inflight){
+	if(cc->in_recovery && (base_seq >= cc->recover_seq)){
+		cc->in_recovery = false;
+	}
+	if(!cc->in_recovery){
+		if(cc->cwnd < cc->ssthresh){
+			cc->cwnd += cc->rs_acked;
+		}
+		else{
+			cc->cwnd += (double)cc->rs_acked / cc->cwnd;
+		}
+	}
+	if(cc->srtt_usec > 0){
+		cc->pacing_rate = ((cc->cwnd < cc->ssthresh) ? 2.0 : 1.2) * cc->cwnd * cc->pkt_size * 1e6 / cc->srtt_usec;
+	}
+}
+
+/*----------------- newreno_on_loss() -------------------
+
+	@brief : Halve cwnd once per window of data and enter fast recovery
+	
+	@param : cc - congestion control state
+			 next_seq - next new data packet to be sent
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void newreno_on_loss(struct cc_state *cc, int next_seq){
+	if(cc->in_recovery){return;}
+	cc->ssthresh = (cc->cwnd / 2 > 2) ? cc->cwnd / 2 : 2;
+	cc->cwnd = cc->ssthresh;
+	cc->in_recovery = true;
+	cc->recover_seq = next_seq;
+}
+
+/*----------------- newreno_on_timeout() -------------------
+
+	@brief : Halve ssthresh and restart from a one packet window
+	
+	@param : cc - congestion control state
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void newreno_on_timeout(struct cc_state *cc){
+	cc->ssthresh = (cc->cwnd / 2 > 2) ? cc->cwnd / 2 : 2;
+	cc->cwnd = 1;
+	cc->in_recovery = false;
+}
+
+/*----------------- bbr_set_mode() -------------------
+
+	@brief : Switch the BBR state machine and its gains
+	
+	@param : cc - congestion control state
+			 mode - BBR_STARTUP / BBR_DRAIN / BBR_PROBE_BW / BBR_PROBE_RTT
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void bbr_set_mode(struct cc_state *cc, int mode){
+	cc->bbr_mode = mode;
+	switch(mode){
+		case BBR_STARTUP:
+			cc->pacing_gain = BBR_HIGH_GAIN;
+			cc->cwnd_gain = BBR_HIGH_GAIN;
+		break;
+		case BBR_DRAIN:
+			cc->pacing_gain = 1 / BBR_HIGH_GAIN;
+			cc->cwnd_gain = BBR_HIGH_GAIN;
+		break;
+		case BBR_PROBE_BW:
+			cc->cycle_index = 0;
+			cc->cycle_stamp = cc->delivered_usec;
+			cc->pacing_gain = bbr_pacing_gain_cycle[0];
+			cc->cwnd_gain = BBR_CWND_GAIN;
+		break;
+		default:
+			cc->pacing_gain = 1;
+			cc->cwnd_gain = 1;
+		break;
+	}
+	log_debug("\nBBR mode %s, bottleneck bandwidth %.0f packets/s", bbr_mode_names[mode], cc->btl_bw);
+}
+
+/*----------------- bbr_init() -------------------
+
+	@brief : BBR-like delay based control - cwnd and pacing rate 
+			 follow a model of the bottleneck bandwidth (max delivery 
+			 rate) and the min RTT instead of reacting to loss
+	
+	@param : cc - congestion control state
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void bbr_init(struct cc_state *cc){
+	bbr_set_mode(cc, BBR_STARTUP);
+}
+
+/*----------------- bbr_on_ack() -------------------
+
+	@brief : Update the bandwidth / min RTT model from the delivery 
+			 rate sample of an ACK and run the state machine - 
+			 STARTUP doubles the rate every round until the bandwidth 
+			 stops growing, DRAIN empties the queue built meanwhile, 
+			 PROBE_BW cycles the pacing gain around the bandwidth and 
+			 PROBE_RTT shrinks cwnd to refresh a min RTT older than 
+			 10 s.
+	
+	@param : cc - congestion control state
+			 base_seq - send window base after the ACK
+			 inflight - packets sent and not cumulatively ACKed
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void bbr_on_ack(struct cc_state *cc, int base_seq, int inflight){
+	long unsigned int now;
+	double bw, bdp, target;
+	int var1;
+	now = cc->delivered_usec;
+	/* A round trip ends when a packet sent after it started is delivered */
+	cc->round_start = false;
+	if(cc->rs_prior_delivered >= cc->next_round_delivered){
+		cc->next_round_delivered = cc->delivered;
+		cc->round_count++;
+		cc->round_start = true;
+		cc->bw_samples[cc->round_count % BBR_BW_ROUNDS] = 0;
+	}
+	/* Bottleneck bandwidth - max delivery rate of the last BBR_BW_ROUNDS rounds */
+	if(now > cc->rs_prior_usec){
+		bw = (double)(cc->delivered - cc->rs_prior_delivered) * 1e6 / (double)(now - cc->rs_prior_usec);
+		if(bw > cc->bw_samples[cc->round_count % BBR_BW_ROUNDS]){
+			cc->bw_samples[cc->round_count % BBR_BW_ROUNDS] = bw;
+		}
+	}
+	cc->btl_bw = 0;
+	for(var1 = 0; var1 < BBR_BW_ROUNDS; var1++){
+		if(cc->bw_samples[var1] > cc->btl_bw){cc->btl_bw = cc->bw_samples[var1];}
+	}
+	/* Pipe is full once the bandwidth grew less than 25% in 3 rounds */
+	if(!cc->full_pipe && cc->round_start){
+		if(cc->btl_bw >= cc->full_bw * 1.25){
+			cc->full_bw = cc->btl_bw;
+			cc->full_bw_count = 0;
+		}
+		else if(++cc->full_bw_count >= 3){
+			cc->full_pipe = true;
+			bbr_set_mode(cc, BBR_DRAIN);
+		}
+	}
+	bdp = (cc->min_rtt_usec == CC_RTT_UNKNOWN) ? 0 : cc->btl_bw * cc->min_rtt_usec / 1e6;
+	if((cc->bbr_mode == BBR_DRAIN) && (inflight <= bdp)){
+		bbr_set_mode(cc, BBR_PROBE_BW);
+	}
+	if((cc->bbr_mode == BBR_PROBE_BW) && ((now - cc->cycle_stamp) > cc->min_rtt_usec)){
+		cc->cycle_index = (cc->cycle_index + 1) % BBR_GAIN_CYCLE;
+		cc->cycle_stamp = now;
+		cc->pacing_gain = bbr_pacing_gain_cycle[cc->cycle_index];
+	}
+	if((cc->bbr_mode != BBR_PROBE_RTT) && ((now - cc->min_rtt_stamp) > BBR_MIN_RTT_USEC)){
+		bbr_set_mode(cc, BBR_PROBE_RTT);
+		cc->probe_rtt_done_stamp = now + BBR_PROBE_RTT_USEC;
+	}
+	if((cc->bbr_mode == BBR_PROBE_RTT) && (now > cc->probe_rtt_done_stamp)){
+		cc->min_rtt_stamp = now;
+		bbr_set_mode(cc, cc->full_pipe ? BBR_PROBE_BW : BBR_STARTUP);
+	}
+	/* cwnd - cwnd_gain x BDP, grown by the ACKed packets up to it */
+	target = cc->cwnd_gain * bdp;
+	if(target < CC_MIN_CWND){target = CC_MIN_CWND;}
+	if(cc->bbr_mode == BBR_PROBE_RTT){
+		cc->cwnd = CC_MIN_CWND;
+	}
+	else if(cc->full_pipe){
+		cc->cwnd = ((cc->cwnd + cc->rs_acked) < target) ? (cc->cwnd + cc->rs_acked) : target;
+	}
+	else if((cc->cwnd < target) || (cc->delivered < CC_INIT_CWND)){
+		cc->cwnd += cc->rs_acked;
+	}
+	if(cc->btl_bw > 0){
+		cc->pacing_rate = cc->pacing_gain * cc->btl_bw * cc->pkt_size;
+	}
+	else if(cc->srtt_usec > 0){
+		cc->pacing_rate = cc->pacing_gain * cc->cwnd * cc->pkt_size * 1e6 / cc->srtt_usec;
+	}
+}
+
+/*----------------- bbr_on_loss() -------------------
+
+	@brief : Loss is no congestion signal for BBR, only counted
+	
+	@param : cc - congestion control state
+			 next_seq - next new data packet to be sent
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void bbr_on_loss(struct cc_state *cc, int next_seq){
+}
+
+/*----------------- bbr_on_timeout() -------------------
+
+	@brief : Fall back to the minimum cwnd, the model grows it back 
+			 with the next ACKs
+	
+	@param : cc - congestion control state
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void bbr_on_timeout(struct cc_state *cc){
+	cc->cwnd = CC_MIN_CWND;
+}
+
+struct cc_ops cc_ops_table[] = {
+	{"newreno", newreno_init, newreno_on_ack, newreno_on_loss, newreno_on_timeout},
+	{"bbr", bbr_init, bbr_on_ack, bbr_on_loss, bbr_on_timeout},
+};
+
+struct cc_ops *cc_algo = &cc_ops_table[0];				/* selected with -c */
+
+/*----------------- find_cc_ops() -------------------
+
+	@brief : Look up a congestion control algorithm by name
+	
+	@param : name - algorithm name (-c)
+	
+	@return : algorithm, NULL if unknown
+
+-----------------------------------------------------------*/
+
+struct cc_ops *find_cc_ops(char *name){
+	int var1;
+	for(var1 = 0; var1 < (int)(sizeof(cc_ops_table) / sizeof(cc_ops_table[0])); var1++){
+		if(strcmp(name, cc_ops_table[var1].name) == 0){return &cc_ops_table[var1];}
+	}
+	return NULL;
+}
+
+/*----------------- send_map_faulted() -------------------
+
+	@brief : Handle an EFAULT of a send - the kernel read a get map 
+			 past the end of a file that shrank under it. The session 
+			 whose map the message points into is marked, and closed 
+			 by service_sessions().
+	
+	@param : msg - message that failed
+	
+	@return : false if the message points into no get map
+
+-----------------------------------------------------------*/
+
+bool send_map_faulted(struct msghdr *msg){
+	struct session *sess;
+	char *data_ptr;
+	int var1, var2;
+	for(var1 = 0; var1 < MAX_SESSIONS; var1++){
+		sess = session_table[var1];
+		if((sess == NULL) || (sess->get_file_map == NULL)){continue;}
+		for(var2 = 0; var2 < (int)msg->msg_iovlen; var2++){
+			data_ptr = (char *)msg->msg_iov[var2].iov_base;
+			if((data_ptr >= sess->get_file_map) && (data_ptr < (sess->get_file_map + sess->file_size_var))){
+				sess->send_map_fault = true;
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+/*----------------- send_gso_segments() -------------------
+
+	@brief : Send the datagrams of a UDP_SEGMENT message one by one, 
+			 after the kernel or the device refused to segment it
+	
+	@param : msg - queued message
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_gso_segments(struct msghdr *msg){
+	struct msghdr seg_msg;
+	int var1;
+	seg_msg = *msg;
+	seg_msg.msg_control = NULL;
+	seg_msg.msg_controllen = 0;
+	seg_msg.msg_iovlen = 2;
+	for(var1 = 0; var1 < (int)msg->msg_iovlen; var1 += 2){
+		seg_msg.msg_iov = msg->msg_iov + var1;
+		if ((sendmsg(sockfd, &seg_msg, 0) < 0) && ((errno != EFAULT) || !send_map_faulted(&seg_msg))){
+			send_failed((struct sockaddr_in *)seg_msg.msg_name, errno);
+		}
+	}
+}
+
+/*----------------- gso_send_failed() -------------------
+
+	@brief : Handle a failed send of a queued message. A UDP_SEGMENT 
+			 message the kernel cannot segment (no GSO on the route, 
+			 segment larger than the MTU) is sent one datagram at a 
+			 time and GSO is turned off for the worker. A fault on a 
+			 get map or any other error only drops the message.
+	
+	@param : msg - queued message
+			 err - errno of the send
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void gso_send_failed(struct msghdr *msg, int err){
+	errno = err;
+	if((err == EFAULT) && send_map_faulted(msg)){return;}
+	if((msg->msg_controllen == 0) || 
+	   ((err != EIO) && (err != EINVAL) && (err != EOPNOTSUPP))){
+		send_failed((struct sockaddr_in *)msg->msg_name, err);
+		return;
+	}
+	if(udp_gso_enable){
+		log_info("\nUDP GSO send failed (%s), sending datagrams one by one\n", strerror(err));
+		udp_gso_enable = false;
+	}
+	send_gso_segments(msg);
+}
+
+/*----------------- flush_send_batch() -------------------
+
+	@brief : Send all queued datagrams with as few sendmmsg() calls 
+			 as the kernel allows. With io_uring every message is a 
+			 SENDMSG request, all are submitted with one 
+			 io_uring_enter() and waited for, since the headers and 
+			 iovecs are reused by the next batch.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void flush_send_batch(void){
+	struct io_uring_sqe *sqe;
+	int var1,var2;
+	if(uring_enable && (send_batch_count > 0)){
+		for(var1 = 0; var1 < send_batch_count; var1++){
+			sqe = uring_get_sqe(&io_ring);
+			sqe->opcode = IORING_OP_SENDMSG;
+			sqe->fd = sockfd;
+			sqe->addr = (uint64_t)(uintptr_t)&send_batch_msg[var1].msg_hdr;
+			sqe->len = 1;
+			sqe->user_data = URING_DATA(URING_OP_SEND, 0, var1);
+		}
+		send_batch_inflight = send_batch_count;
+		while(send_batch_inflight > 0){
+			uring_enter(&io_ring, send_batch_inflight, -1);
+			uring_reap(&io_ring);
+		}
+		for(var1 = 0; var1 < send_batch_count; var1++){
+			if(send_batch_res[var1] < 0){gso_send_failed(&send_batch_msg[var1].msg_hdr, -send_batch_res[var1]);}
+		}
+		send_batch_count = 0;
+		send_batch_dgram_count = 0;
+		send_batch_flush_count++;
+		cache_release_pending();
+		return;
+	}
+	var1 = 0;
+	while(var1 < send_batch_count){
+		var2 = sendmmsg(sockfd, &send_batch_msg[var1], send_batch_count - var1, 0);
+		if (var2 < 0){
+			gso_send_failed(&send_batch_msg[var1].msg_hdr, errno);
+			var2 = 1;
+		}
+		var1 += var2;
+	}
+	send_batch_count = 0;
+	send_batch_dgram_count = 0;
+	send_batch_flush_count++;
+	cache_release_pending();
+}
+
+/*----------------- gso_append() -------------------
+
+	@brief : Check if a datagram can go out as the next segment of 
+			 the last queued message. Segments of one UDP_SEGMENT 
+			 send have the same destination and size, only the last 
+			 one may be shorter.
+	
+	@param : addr - destination address
+			 len - datagram length
+	
+	@return : true if the datagram can be appended
+
+-----------------------------------------------------------*/
+
+bool gso_append(struct sockaddr_in *addr, int len){
+	int var1;
+	if(!udp_gso_enable || (send_batch_count == 0)){return false;}
+	var1 = send_batch_count - 1;
+	return ((send_batch_seg_size[var1] == len) && 
+			(send_batch_byte_count[var1] == (send_batch_seg_size[var1] * send_batch_seg_count[var1])) && 
+			(send_batch_seg_count[var1] < GSO_MAX_SEGMENTS) && 
+			((send_batch_byte_count[var1] + len) <= GSO_MAX_BYTES) && 
+			(send_batch_addr[var1].sin_addr.s_addr == addr->sin_addr.s_addr) && 
+			(send_batch_addr[var1].sin_port == addr->sin_port));
+}
+
+/*----------------- queue_datagram() -------------------
+
+	@brief : Queue a datagram for the next flush_send_batch(). The 
+			 header is copied, the data is sent by reference and must 
+			 stay valid until the flush (file map / send ring). With 
+			 GSO, data packets of the same size to one client are 
+			 joined into one UDP_SEGMENT message of up to 64 KB that 
+			 the kernel splits into datagrams.
+	
+	@param : addr - destination address
+			 hdr_ptr - ptr to header (or whole small packet)
+			 hdr_len - header length, at most SEND_BATCH_HDR_SIZE
+			 data_ptr - ptr to data, NULL if none
+			 data_len - length of data
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void queue_datagram(struct sockaddr_in *addr, char *hdr_ptr, int hdr_len, char *data_ptr, int data_len){
+	struct msghdr *msg;
+	struct cmsghdr *cmsg;
+	int var1;
+	if(send_batch_dgram_count == SEND_BATCH_SIZE){flush_send_batch();}
+	var1 = send_batch_dgram_count++;
+	memcpy(send_batch_hdr_buf[var1], hdr_ptr, hdr_len);
+	send_batch_iov[var1][0].iov_base = send_batch_hdr_buf[var1];
+	send_batch_iov[var1][0].iov_len = hdr_len;
+	send_batch_iov[var1][1].iov_base = data_ptr;
+	send_batch_iov[var1][1].iov_len = data_len;
+	if((data_len > 0) && gso_append(addr, hdr_len + data_len)){
+		/* iovecs of consecutive datagrams are adjacent, the message just grows */
+		msg = &send_batch_msg[send_batch_count - 1].msg_hdr;
+		msg->msg_iovlen += 2;
+		send_batch_seg_count[send_batch_count - 1]++;
+		send_batch_byte_count[send_batch_count - 1] += hdr_len + data_len;
+		if(msg->msg_control == NULL){
+			msg->msg_control = send_batch_ctrl_buf[send_batch_count - 1];
+			msg->msg_controllen = sizeof(send_batch_ctrl_buf[0]);
+			cmsg = CMSG_FIRSTHDR(msg);
+			cmsg->cmsg_level = SOL_UDP;
+			cmsg->cmsg_type = UDP_SEGMENT;
+			cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+			*(uint16_t *)CMSG_DATA(cmsg) = (uint16_t)(hdr_len + data_len);
+		}
+		return;
+	}
+	send_batch_addr[send_batch_count] = *addr;
+	send_batch_seg_size[send_batch_count] = (data_len > 0) ? (hdr_len + data_len) : 0;
+	send_batch_seg_count[send_batch_count] = 1;
+	send_batch_byte_count[send_batch_count] = hdr_len + data_len;
+	msg = &send_batch_msg[send_batch_count].msg_hdr;
+	bzero(msg,sizeof(*msg));
+	msg->msg_name = &send_batch_addr[send_batch_count];
+	msg->msg_namelen = sizeof(struct sockaddr_in);
+	msg->msg_iov = send_batch_iov[var1];
+	msg->msg_iovlen = (data_len > 0) ? 2 : 1;
+	send_batch_count++;
+}
+
+/*----------------- prepare_recv_msg() -------------------
+
+	@brief : Point a receive batch message at its buffer - a 64 KB 
+			 slice of recv_gro_buf with UDP_GRO, else recv_batch_buf
+	
+	@param : index - receive batch index
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void prepare_recv_msg(int index){
+	if(udp_gro_enable){
+		recv_batch_iov[index].iov_base = recv_gro_buf + ((long)index * GRO_BUFSIZE);
+		recv_batch_iov[index].iov_len = GRO_BUFSIZE;
+	}
+	else{
+		recv_batch_iov[index].iov_base = recv_batch_buf[index];
+		recv_batch_iov[index].iov_len = BUFSIZE;
+	}
+	bzero(&recv_batch_msg[index].msg_hdr,sizeof(struct msghdr));
+	recv_batch_msg[index].msg_hdr.msg_name = &recv_batch_addr[index];
+	recv_batch_msg[index].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+	recv_batch_msg[index].msg_hdr.msg_iov = &recv_batch_iov[index];
+	recv_batch_msg[index].msg_hdr.msg_iovlen = 1;
+	recv_batch_msg[index].msg_hdr.msg_control = recv_batch_ctrl_buf[index];
+	recv_batch_msg[index].msg_hdr.msg_controllen = sizeof(recv_batch_ctrl_buf[0]);
+}
+
+/*----------------- split_recv_msg() -------------------
+
+	@brief : List the datagrams of a received message in 
+			 recv_seg_ptr_arr / recv_seg_len_arr / recv_seg_msg_arr. 
+			 With UDP_GRO a message may hold several datagrams of one 
+			 client coalesced by the kernel, they are split again at 
+			 the segment size it reports.
+	
+	@param : index - receive batch index
+			 seg_count - datagrams listed so far
+	
+	@return : datagrams listed
+
+-----------------------------------------------------------*/
+
+int split_recv_msg(int index, int seg_count){
+	struct cmsghdr *cmsg;
+	int var1, seg_size, msg_len;
+	msg_len = (int)recv_batch_msg[index].msg_len;
+	seg_size = msg_len;
+	for(cmsg = CMSG_FIRSTHDR(&recv_batch_msg[index].msg_hdr); cmsg != NULL; 
+		cmsg = CMSG_NXTHDR(&recv_batch_msg[index].msg_hdr, cmsg)){
+		if((cmsg->cmsg_level == SOL_UDP) && (cmsg->cmsg_type == UDP_GRO)){
+			memcpy(&seg_size, CMSG_DATA(cmsg), sizeof(int));
+		}
+	}
+	if(seg_size <= 0){seg_size = msg_len;}
 	var1 = 0;
+	do{
+		if(seg_count == RECV_SEG_MAX){break;}
+		recv_seg_ptr_arr[seg_count] = (char *)recv_batch_iov[index].iov_base + var1;
+		recv_seg_len_arr[seg_count] = ((msg_len - var1) < seg_size) ? (msg_len - var1) : seg_size;
+		recv_seg_msg_arr[seg_count] = index;
+		seg_count++;
+		var1 += seg_size;
+	}while(var1 < msg_len);
+	return seg_count;
+}
+
+/*----------------- recv_datagram_batch() -------------------
+
+	@brief : Drain up to RECV_BATCH_SIZE waiting messages with one 
+			 recvmmsg() into the receive batch buffers
+	
+	@param : none
+	
+	@return : number of datagrams received, -1 on error
+
+-----------------------------------------------------------*/
+
+int recv_datagram_batch(void){
+	int var1, recv_count, seg_count;
+	for(var1 = 0; var1 < RECV_BATCH_SIZE; var1++){
+		prepare_recv_msg(var1);
+	}
+	recv_count = recvmmsg(sockfd, recv_batch_msg, RECV_BATCH_SIZE, MSG_DONTWAIT, NULL);
+	seg_count = 0;
+	for(var1 = 0; var1 < recv_count; var1++){
+		seg_count = split_recv_msg(var1, seg_count);
+	}
+	return (recv_count < 0) ? recv_count : seg_count;
+}
+
+/*----------------- uring_post_recv() -------------------
+
+	@brief : Queue a RECVMSG request for a receive batch message. 
+			 All RECV_BATCH_SIZE messages stay posted, so the kernel 
+			 fills them while the worker handles earlier ones.
+	
+	@param : index - receive batch index
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void uring_post_recv(int index){
+	struct io_uring_sqe *sqe;
+	prepare_recv_msg(index);
+	recv_batch_done[index] = false;
+	sqe = uring_get_sqe(&io_ring);
+	sqe->opcode = IORING_OP_RECVMSG;
+	sqe->fd = sockfd;
+	sqe->addr = (uint64_t)(uintptr_t)&recv_batch_msg[index].msg_hdr;
+	sqe->len = 1;
+	sqe->user_data = URING_DATA(URING_OP_RECV, 0, index);
+}
+
+/*----------------- uring_recv_batch() -------------------
+
+	@brief : List the datagrams of the completed RECVMSG requests, 
+			 in the order they completed. The posted requests take 
+			 datagrams from the socket in arrival order but sit at 
+			 arbitrary batch indexes, so walking the indexes would 
+			 reorder the datagrams. The messages are posted again by 
+			 uring_repost_recv() once their datagrams are handled.
+	
+	@param : none
+	
+	@return : number of datagrams received
+
+-----------------------------------------------------------*/
+
+int uring_recv_batch(void){
+	int var1, index, seg_count;
+	seg_count = 0;
+	for(var1 = 0; var1 < recv_batch_done_count; var1++){
+		index = recv_batch_done_order[var1];
+		if(recv_batch_msg[index].msg_len > 0){
+			seg_count = split_recv_msg(index, seg_count);
+		}
+	}
+	return seg_count;
+}
+
+/*----------------- uring_repost_recv() -------------------
+
+	@brief : Post the completed RECVMSG requests again
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void uring_repost_recv(void){
+	int var1;
+	for(var1 = 0; var1 < RECV_BATCH_SIZE; var1++){
+		if(recv_batch_done[var1]){uring_post_recv(var1);}
+	}
+	recv_batch_done_count = 0;
+}
+
+/*----------------- gf256_inv() -------------------
+
+	@brief : Inverse in GF(256)
+	
+	@param : val - non-zero element
+	
+	@return : 1 / val
+
+-----------------------------------------------------------*/
+
+uint8_t gf256_inv(int val){
+	return gf256_exp[255 - gf256_log[val]];
+}
+
+/*----------------- fec_init() -------------------
+
+	@brief : Build the GF(256) tables (polynomial 0x11D) and the FEC 
+			 coefficients, and check the CPU for SSSE3. Repair row j 
+			 of data packet i is the Cauchy matrix 1/(x_j + y_i), 
+			 x_j = j, y_i = FEC_MAX_REPAIR + i, with every column 
+			 scaled so row 0 is all ones - one repair packet is plain 
+			 XOR parity, and any square part of the matrix stays 
+			 invertible, so any K of the K + M packets of a block 
+			 rebuild it.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void fec_init(void){
+	int var1, var2, val;
+	val = 1;
+	for(var1 = 0; var1 < 255; var1++){
+		gf256_exp[var1] = (uint8_t)val;
+		gf256_exp[var1 + 255] = (uint8_t)val;
+		gf256_log[val] = (uint8_t)var1;
+		val <<= 1;
+		if(val & 0x100){val ^= GF256_POLY;}
+	}
+	for(var1 = 0; var1 < 256; var1++){
+		for(var2 = 0; var2 < 256; var2++){
+			gf256_mul_table[var1][var2] = ((var1 == 0) || (var2 == 0)) ? 0 : 
+										  gf256_exp[gf256_log[var1] + gf256_log[var2]];
+		}
+		for(var2 = 0; var2 < 16; var2++){
+			gf256_mul_hi_table[var1][var2] = gf256_mul_table[var1][var2 << 4];
+		}
+	}
+	for(var1 = 0; var1 < FEC_MAX_REPAIR; var1++){
+		for(var2 = 0; var2 < FEC_MAX_DATA; var2++){
+			fec_coef_table[var1][var2] = gf256_mul_table[gf256_inv(var1 ^ (FEC_MAX_REPAIR + var2))][FEC_MAX_REPAIR + var2];
+		}
+	}
+#if GF256_HW
+	gf256_hw_enable = __builtin_cpu_supports("ssse3");
+#endif
+}
+
+#if GF256_HW
+/*----------------- gf256_mul_add_hw() -------------------
+
+	@brief : dst ^= c * src with SSSE3 - pshufb looks up the products 
+			 of the low and the high nibble of 16 bytes at once
+	
+	@param : dst - ptr to accumulated symbol
+			 src - ptr to symbol added
+			 coef - constant factor
+			 len - length in bytes
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+__attribute__((target("ssse3")))
+void gf256_mul_add_hw(char *dst, char *src, int coef, long len){
+	__m128i lo_table, hi_table, mask, val;
+	long var1;
+	lo_table = _mm_loadu_si128((__m128i *)gf256_mul_table[coef]);
+	hi_table = _mm_loadu_si128((__m128i *)gf256_mul_hi_table[coef]);
+	mask = _mm_set1_epi8(0x0f);
+	for(var1 = 0; (var1 + 16) <= len; var1 += 16){
+		val = _mm_loadu_si128((__m128i *)(src + var1));
+		val = _mm_xor_si128(_mm_shuffle_epi8(lo_table, _mm_and_si128(val, mask)), 
+							_mm_shuffle_epi8(hi_table, _mm_and_si128(_mm_srli_epi64(val, 4), mask)));
+		_mm_storeu_si128((__m128i *)(dst + var1), _mm_xor_si128(_mm_loadu_si128((__m128i *)(dst + var1)), val));
+	}
+	for(; var1 < len; var1++){
+		dst[var1] ^= gf256_mul_table[coef][(uint8_t)src[var1]];
+	}
+}
+#endif
+
+/*----------------- gf256_mul_add() -------------------
+
+	@brief : dst ^= c * src over GF(256) - the one kernel of FEC 
+			 encoding and decoding. A factor of 1 is plain XOR.
+	
+	@param : dst - ptr to accumulated symbol
+			 src - ptr to symbol added
+			 coef - constant factor
+			 len - length in bytes
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void gf256_mul_add(char *dst, char *src, int coef, long len){
+	uint64_t var64, dst64;
+	uint8_t *row;
+	long var1;
+	if(coef == 0){return;}
+	if(coef == 1){
+		for(var1 = 0; (var1 + 8) <= len; var1 += 8){
+			memcpy(&var64, src + var1, 8);
+			memcpy(&dst64, dst + var1, 8);
+			dst64 ^= var64;
+			memcpy(dst + var1, &dst64, 8);
+		}
+		for(; var1 < len; var1++){dst[var1] ^= src[var1];}
+		return;
+	}
+#if GF256_HW
+	if(gf256_hw_enable){
+		gf256_mul_add_hw(dst, src, coef, len);
+		return;
+	}
+#endif
+	row = gf256_mul_table[coef];
+	for(var1 = 0; var1 < len; var1++){
+		dst[var1] ^= row[(uint8_t)src[var1]];
+	}
+}
+
+/*----------------- gf256_invert() -------------------
+
+	@brief : Invert a small matrix over GF(256) by Gauss-Jordan 
+			 elimination
+	
+	@param : mat - matrix, destroyed
+			 inv - inverse
+			 size - rows / columns, at most FEC_MAX_REPAIR
+	
+	@return : false if the matrix is singular
+
+-----------------------------------------------------------*/
+
+bool gf256_invert(uint8_t mat[FEC_MAX_REPAIR][FEC_MAX_REPAIR], uint8_t inv[FEC_MAX_REPAIR][FEC_MAX_REPAIR], int size){
+	int var1, var2, var3;
+	uint8_t val, *row;
+	for(var1 = 0; var1 < size; var1++){
+		for(var2 = 0; var2 < size; var2++){inv[var1][var2] = (var1 == var2);}
+	}
+	for(var1 = 0; var1 < size; var1++){
+		for(var2 = var1; (var2 < size) && (mat[var2][var1] == 0); var2++);
+		if(var2 == size){return false;}
+		for(var3 = 0; var3 < size; var3++){
+			val = mat[var1][var3]; mat[var1][var3] = mat[var2][var3]; mat[var2][var3] = val;
+			val = inv[var1][var3]; inv[var1][var3] = inv[var2][var3]; inv[var2][var3] = val;
+		}
+		row = gf256_mul_table[gf256_inv(mat[var1][var1])];
+		for(var3 = 0; var3 < size; var3++){
+			mat[var1][var3] = row[mat[var1][var3]];
+			inv[var1][var3] = row[inv[var1][var3]];
+		}
+		for(var2 = 0; var2 < size; var2++){
+			if((var2 == var1) || (mat[var2][var1] == 0)){continue;}
+			row = gf256_mul_table[mat[var2][var1]];
+			for(var3 = 0; var3 < size; var3++){
+				mat[var2][var3] ^= row[mat[var1][var3]];
+				inv[var2][var3] ^= row[inv[var1][var3]];
+			}
+		}
+	}
+	return true;
+}
+
+/*----------------- fec_symbol_header() -------------------
+
+	@brief : Write the part of a data packet's FEC symbol in front of 
+			 its data - data length and the header flags that 
+			 describe the data, so a rebuilt packet gets them back
+	
+	@param : ptr - ptr to FEC_SYMBOL_HDR_SIZE bytes
+			 flags - header flags of the data packet
+			 data_len - length of packet data
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void fec_symbol_header(char *ptr, int flags, int data_len){
+	*(ptr + 0) = (char)(data_len >> 8);
+	*(ptr + 1) = (char)data_len;
+	*(ptr + 2) = 0;
+	*(ptr + 3) = (char)(flags & HDR_FLAG_COMPRESSED);
+}
+
+/*----------------- fec_encoder_start() -------------------
+
+	@brief : Start FEC encoding of a transfer
+	
+	@param : enc - encoder, k and m set from the hello
+			 data_size - data packet payload
+			 last_seq - last data packet of the transfer
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void fec_encoder_start(struct fec_encoder *enc, int data_size, int last_seq){
+	int var1;
+	enc->sym_max = FEC_SYMBOL_HDR_SIZE + data_size;
+	enc->last_seq = last_seq;
+	enc->block = -1;
+	enc->repair_count = 0;
+	for(var1 = 0; var1 < FEC_ENCODE_SETS; var1++){enc->queued_flush[var1] = -1;}
+}
+
+/*----------------- fec_encode_packet() -------------------
+
+	@brief : Add the first send of a data packet to the repair 
+			 symbols of its block. Data packets are first sent in 
+			 order, so a block is done with its K-th packet or the 
+			 last packet of the transfer. The repair buffers of a 
+			 block are reused FEC_ENCODE_SETS blocks later - if 
+			 they are still queued for the send batch it is flushed.
+	
+	@param : enc - encoder
+			 seq_no - data packet sequence number
+			 flags - header flags of the data packet
+			 data_ptr - ptr to packet data, as sent
+			 data_len - length of packet data
+	
+	@return : true if the repair packets of the block are due
+
+-----------------------------------------------------------*/
+
+bool fec_encode_packet(struct fec_encoder *enc, int seq_no, int flags, char *data_ptr, int data_len){
+	char sym_hdr[FEC_SYMBOL_HDR_SIZE];
+	char *ptr;
+	int index, var1;
+	index = seq_no % enc->k;
+	if((seq_no / enc->k) != enc->block){
+		enc->block = seq_no / enc->k;
+		enc->set = (enc->set + 1) % FEC_ENCODE_SETS;
+		if(enc->queued_flush[enc->set] == send_batch_flush_count){flush_send_batch();}
+		enc->queued_flush[enc->set] = -1;
+		for(var1 = 0; var1 < enc->m; var1++){
+			bzero(enc->parity[enc->set][var1] + FEC_REPAIR_HDR_SIZE, enc->sym_max);
+		}
+		enc->first = index;
+		enc->sym_len = FEC_SYMBOL_HDR_SIZE;
+	}
+	enc->count = index + 1;
+	if((FEC_SYMBOL_HDR_SIZE + data_len) > enc->sym_len){enc->sym_len = FEC_SYMBOL_HDR_SIZE + data_len;}
+	fec_symbol_header(sym_hdr, flags, data_len);
+	for(var1 = 0; var1 < enc->m; var1++){
+		ptr = enc->parity[enc->set][var1] + FEC_REPAIR_HDR_SIZE;
+		gf256_mul_add(ptr, sym_hdr, fec_coef_table[var1][index], FEC_SYMBOL_HDR_SIZE);
+		gf256_mul_add(ptr + FEC_SYMBOL_HDR_SIZE, data_ptr, fec_coef_table[var1][index], data_len);
+	}
+	return ((index == (enc->k - 1)) || (seq_no >= enc->last_seq));
+}
+
+/*----------------- fec_repair_packet() -------------------
+
+	@brief : Get the data of a repair packet of the block just 
+			 encoded - K, M, repair index, first and end index of the 
+			 data packets encoded, symbol length, then the symbol. 
+			 It is sent with the first data packet of the block as 
+			 sequence number and stays valid until the send batch is 
+			 flushed.
+	
+	@param : enc - encoder
+			 index - repair packet, below M
+			 data_ptr - set to the repair packet data
+	
+	@return : length of the repair packet data
+
+-----------------------------------------------------------*/
+
+int fec_repair_packet(struct fec_encoder *enc, int index, char **data_ptr){
+	char *ptr;
+	ptr = enc->parity[enc->set][index];
+	*(ptr + 0) = (char)enc->k;
+	*(ptr + 1) = (char)enc->m;
+	*(ptr + 2) = (char)index;
+	*(ptr + 3) = (char)enc->first;
+	*(ptr + 4) = (char)enc->count;
+	*(ptr + 5) = 0;
+	*(ptr + 6) = (char)(enc->sym_len >> 8);
+	*(ptr + 7) = (char)enc->sym_len;
+	enc->queued_flush[enc->set] = send_batch_flush_count;
+	enc->repair_count++;
+	*data_ptr = ptr;
+	return (FEC_REPAIR_HDR_SIZE + enc->sym_len);
+}
+
+/*----------------- fec_loss_seq() -------------------
+
+	@brief : Packet the receiver has to report before a hole counts 
+			 as lost. With FEC the repair packets of the hole's block 
+			 go out after its last data packet, so once they are sent 
+			 the count starts there - the receiver may rebuild the 
+			 packet instead. It stops at the last packet sent, which 
+			 is all the receiver can report while the window is full. 
+			 Before the repair packets are sent it is the plain 
+			 count, the window may not reach the end of the block.
+	
+	@param : enc - encoder
+			 seq_no - unACKed data packet
+			 sent_seq - last data packet sent
+	
+	@return : sequence number
+
+-----------------------------------------------------------*/
+
+int fec_loss_seq(struct fec_encoder *enc, int seq_no, int sent_seq){
+	int end;
+	if(enc->k == 0){return (seq_no + CC_DUP_THRESH);}
+	end = (((seq_no / enc->k) + 1) * enc->k) - 1;
+	if(end > enc->last_seq){end = enc->last_seq;}
+	if(end > sent_seq){return (seq_no + CC_DUP_THRESH);}
+	end += CC_DUP_THRESH;
+	if(end > sent_seq){end = sent_seq;}
+	return (end > (seq_no + CC_DUP_THRESH)) ? end : (seq_no + CC_DUP_THRESH);
+}
+
+/*----------------- fec_decoder_start() -------------------
+
+	@brief : Start FEC decoding of a transfer, no block is open
+	
+	@param : dec - decoder, k and m set from the hello
+			 data_size - data packet payload
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void fec_decoder_start(struct fec_decoder *dec, int data_size){
+	int var1;
+	dec->sym_max = FEC_SYMBOL_HDR_SIZE + data_size;
+	dec->rebuilt_count = 0;
+	for(var1 = 0; var1 < FEC_BLOCK_SLOTS; var1++){dec->blk[var1].block = -1;}
+}
+
+/*----------------- fec_find_block() -------------------
+
+	@brief : Find the decoder slot of a block. A newer block takes 
+			 over its slot, packets of a block that lost its slot are 
+			 left to retransmission.
+	
+	@param : dec - decoder
+			 block - block number
+	
+	@return : block, NULL if its slot was taken over
+
+-----------------------------------------------------------*/
+
+struct fec_block *fec_find_block(struct fec_decoder *dec, int block){
+	struct fec_block *blk;
+	int var1;
+	blk = &dec->blk[block % FEC_BLOCK_SLOTS];
+	if(blk->block == block){return blk;}
+	if(blk->block > block){return NULL;}
+	blk->block = block;
+	blk->data_mask = 0;
+	blk->repair_mask = 0;
+	blk->first = 0;
+	blk->count = 0;
+	blk->sym_len = 0;
+	blk->done = false;
+	for(var1 = 0; var1 < dec->m; var1++){bzero(blk->sym[var1], dec->sym_max);}
+	return blk;
+}
+
+/*----------------- fec_decode_block() -------------------
+
+	@brief : Rebuild the missing data packets of a block once it has 
+			 as many repair packets as holes. Each repair symbol has 
+			 had the data packets received taken out already, what is 
+			 left is a linear combination of the missing ones - the 
+			 small matrix of their coefficients is inverted and 
+			 applied.
+	
+	@param : dec - decoder
+			 blk - block
+			 info_arr - rebuilt data packets, valid until the next 
+						decode
+	
+	@return : number of packets rebuilt
+
+-----------------------------------------------------------*/
+
+int fec_decode_block(struct fec_decoder *dec, struct fec_block *blk, struct packet_info *info_arr){
+	uint8_t mat[FEC_MAX_REPAIR][FEC_MAX_REPAIR], inv[FEC_MAX_REPAIR][FEC_MAX_REPAIR];
+	int miss_arr[FEC_MAX_REPAIR], row_arr[FEC_MAX_REPAIR];
+	int miss, rows, count, len, var1, var2;
+	if(blk->done || (blk->repair_mask == 0)){return 0;}
+	miss = 0;
+	for(var1 = blk->first; var1 < blk->count; var1++){
+		if(blk->data_mask & (1ULL << var1)){continue;}
+		if(miss == FEC_MAX_REPAIR){return 0;}
+		miss_arr[miss++] = var1;
+	}
+	rows = 0;
+	for(var1 = 0; (var1 < dec->m) && (rows < miss); var1++){
+		if(blk->repair_mask & (1 << var1)){row_arr[rows++] = var1;}
+	}
+	if(rows < miss){return 0;}
+	blk->done = true;
+	for(var1 = 0; var1 < miss; var1++){
+		for(var2 = 0; var2 < miss; var2++){mat[var1][var2] = fec_coef_table[row_arr[var1]][miss_arr[var2]];}
+	}
+	if((miss == 0) || !gf256_invert(mat, inv, miss)){return 0;}
+	count = 0;
+	for(var1 = 0; var1 < miss; var1++){
+		bzero(dec->out[var1], blk->sym_len);
+		for(var2 = 0; var2 < miss; var2++){
+			gf256_mul_add(dec->out[var1], blk->sym[row_arr[var2]], inv[var1][var2], blk->sym_len);
+		}
+		len = ((uint8_t)dec->out[var1][0] << 8) | (uint8_t)dec->out[var1][1];
+		if(len > (blk->sym_len - FEC_SYMBOL_HDR_SIZE)){continue;}
+		bzero(&info_arr[count], sizeof(struct packet_info));
+		info_arr[count].type = 'D';
+		info_arr[count].cmd = '0';
+		info_arr[count].binary = true;
+		info_arr[count].flags = (uint8_t)dec->out[var1][3] & HDR_FLAG_COMPRESSED;
+		info_arr[count].seq_no = ((long)blk->block * dec->k) + miss_arr[var1];
+		info_arr[count].data_ptr = dec->out[var1] + FEC_SYMBOL_HDR_SIZE;
+		info_arr[count].data_len = len;
+		count++;
+	}
+	dec->rebuilt_count += count;
+	return count;
+}
+
+/*----------------- fec_add_data() -------------------
+
+	@brief : Take a received data packet out of the repair symbols of 
+			 its block, then try to rebuild the block
+	
+	@param : dec - decoder
+			 info - received data packet, data as sent
+			 info_arr - rebuilt data packets
+	
+	@return : number of packets rebuilt
+
+-----------------------------------------------------------*/
+
+int fec_add_data(struct fec_decoder *dec, struct packet_info *info, struct packet_info *info_arr){
+	struct fec_block *blk;
+	char sym_hdr[FEC_SYMBOL_HDR_SIZE];
+	int index, var1;
+	if((info->seq_no < 0) || ((FEC_SYMBOL_HDR_SIZE + info->data_len) > dec->sym_max)){return 0;}
+	blk = fec_find_block(dec, (int)(info->seq_no / dec->k));
+	index = (int)(info->seq_no % dec->k);
+	if((blk == NULL) || blk->done || (blk->data_mask & (1ULL << index))){return 0;}
+	fec_symbol_header(sym_hdr, info->flags, info->data_len);
+	for(var1 = 0; var1 < dec->m; var1++){
+		gf256_mul_add(blk->sym[var1], sym_hdr, fec_coef_table[var1][index], FEC_SYMBOL_HDR_SIZE);
+		gf256_mul_add(blk->sym[var1] + FEC_SYMBOL_HDR_SIZE, info->data_ptr, fec_coef_table[var1][index], info->data_len);
+	}
+	blk->data_mask |= 1ULL << index;
+	return fec_decode_block(dec, blk, info_arr);
+}
+
+/*----------------- fec_add_repair() -------------------
+
+	@brief : Add a received repair packet to its block, then try to 
+			 rebuild the block
+	
+	@param : dec - decoder
+			 info - received repair packet
+			 info_arr - rebuilt data packets
+	
+	@return : number of packets rebuilt
+
+-----------------------------------------------------------*/
+
+int fec_add_repair(struct fec_decoder *dec, struct packet_info *info, struct packet_info *info_arr){
+	struct fec_block *blk;
+	uint8_t *ptr;
+	int index, first, count, sym_len;
+	if(info->data_len < FEC_REPAIR_HDR_SIZE){return 0;}
+	ptr = (uint8_t *)info->data_ptr;
+	index = ptr[2];
+	first = ptr[3];
+	count = ptr[4];
+	sym_len = (ptr[6] << 8) | ptr[7];
+	if((ptr[0] != dec->k) || (ptr[1] != dec->m) || (index >= dec->m) || (first >= count) || (count > dec->k) || 
+	   (sym_len < FEC_SYMBOL_HDR_SIZE) || (sym_len > dec->sym_max) || (info->data_len != (FEC_REPAIR_HDR_SIZE + sym_len)) || 
+	   (info->seq_no < 0) || ((info->seq_no % dec->k) != 0)){
+		return 0;
+	}
+	blk = fec_find_block(dec, (int)(info->seq_no / dec->k));
+	if((blk == NULL) || blk->done || (blk->repair_mask & (1 << index))){return 0;}
+	gf256_mul_add(blk->sym[index], info->data_ptr + FEC_REPAIR_HDR_SIZE, 1, sym_len);
+	blk->repair_mask |= 1 << index;
+	blk->first = first;
+	blk->count = count;
+	blk->sym_len = sym_len;
+	return fec_decode_block(dec, blk, info_arr);
+}
+
+
+/*----------------- create_sack_data() -------------------
+
+	@brief : Fill data ACK payload - cumulative ACK (next in-order 
+			 packet expected) followed by a selective ACK bitmap of 
+			 the MAX_WINDOW_SIZE packets after it
+	
+	@param : sess - client session
+			 ptr - ptr to payload buffer
+			 cum_seq_no - next in-order packet expected
+			 recv_arr - receive window bitmap, indexed by SEQ_SLOT()
+	
+	@return : payload length
+
+-----------------------------------------------------------*/
+
+int create_sack_data(struct session *sess, char *ptr, int cum_seq_no, bool *recv_arr){
+	int len,var1,seq_no;
+	len = put_seq_field(sess,ptr,cum_seq_no);
+	bzero(ptr + len,SACK_BITMAP_SIZE);
+	for(var1 = 0; var1 < MAX_WINDOW_SIZE; var1++){
+		seq_no = cum_seq_no + 1 + var1;
+		if(recv_arr[SEQ_SLOT(seq_no)]){
+			*(ptr + len + (var1/8)) |= (char)(1 << (var1%8));
+		}
+	}
+	return (len + SACK_BITMAP_SIZE);
+}
+
+/*----------------- send_recvd_data_ack() -------------------
+
+	@brief : Queue ACK for each data packet received, the ACKs of a 
+			 receive batch go out together
+	
+	@param : sess - client session
+			 seq_no - sequence number of the received data packet
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_recvd_data_ack(struct session *sess, int seq_no){
+	int var1;
+	char sack_buf[6 + SACK_BITMAP_SIZE];
+	var1 = create_sack_data(sess, sack_buf,sess->recv_ack_seq_arr_index,sess->recv_data_seq_arr);
+	bzero(server_send_buf,BUFSIZE);
+	var1 = create_packet(sess,'A','D',server_send_buf,seq_no,sack_buf,var1);
+	queue_datagram(&sess->clientaddr,server_send_buf,var1,NULL,0);
+	log_trace("\n ACK packet %d sent to client", seq_no + 1);
+}
+
+/*----------------- flush_file_writes() -------------------
+
+	@brief : Write the queued data packets to their put files with 
+			 pwrite(), each at its own offset. Called after the ACKs 
+			 of a receive batch went out, so disk writes do not 
+			 delay them. A failed write marks the put, which fails 
+			 at its K.
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void flush_file_writes(void){
+	int var1;
+	for(var1 = 0; var1 < file_write_count; var1++){
+		if(pwrite(file_write_arr[var1].fd, file_write_arr[var1].data_ptr, file_write_arr[var1].data_len, 
+				  file_write_arr[var1].offset) != file_write_arr[var1].data_len){
+			log_error("\nWrite to put file failed");
+			file_write_arr[var1].sess->put_write_failed = true;
+		}
+	}
+	file_write_count = 0;
+	recv_unpack_count = 0;
+}
+
+/*----------------- drain_file_writes() -------------------
+
+	@brief : Complete the queued writes of a session before its put 
+			 file is closed or synced
+	
+	@param : sess - client session
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void drain_file_writes(struct session *sess){
+	if(uring_enable){uring_drain_session(sess);}
+	else{flush_file_writes();}
+}
+
+/*----------------- update_put_journal() -------------------
+
+	@brief : Record the received part of the put file in its journal, 
+			 every JOURNAL_INTERVAL bytes or when forced. The window 
+			 base may be ahead of io_uring writes, but the write of a 
+			 slot completes before the slot is reused, so all packets 
+			 a window below the base are in the file. A forced record 
+			 follows drain_file_writes() and takes the base itself.
+	
+	@param : sess - client session
+			 force - record the exact base, writes are drained
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void update_put_journal(struct session *sess, bool force){
+	off_t done;
+	if((sess->put_journal_fd < 0) || sess->put_write_failed){return;}	/* the written range is not known */
+	done = (off_t)(sess->recv_ack_seq_arr_index - (force ? 0 : MAX_WINDOW_SIZE)) * sess->data_size;
+	if(done < 0){done = 0;}
+	if((sess->put_file_size >= 0) && (done > sess->put_file_size)){done = sess->put_file_size;}
+	if((done == sess->put_journal_done) || (!force && ((done - sess->put_journal_done) < JOURNAL_INTERVAL))){return;}
+	journal_write(sess->put_journal_fd, sess->put_file_size, done);
+	sess->put_journal_done = done;
+}
+
+/*----------------- close_put_file() -------------------
+
+	@brief : Complete the writes of the put file and close it. A 
+			 complete file is cut to the size the client sent and 
+			 synced, and its journal removed; an incomplete one keeps 
+			 its journal for rp. A failed truncate or sync marks the 
+			 put failed like a failed write.
+	
+	@param : sess - client session
+			 complete - the client reported the put complete
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void close_put_file(struct session *sess, bool complete){
+	if(sess->put_file == NULL){return;}
+	drain_file_writes(sess);
+	if(complete){
+		if((sess->put_file_size >= 0) && (ftruncate(fileno(sess->put_file), sess->put_file_size) < 0)){
+			log_error("\nCould not truncate put file");
+			sess->put_write_failed = true;
+		}
+		if(fsync(fileno(sess->put_file)) < 0){			// the file is on disk before the ACK
+			log_error("\nCould not sync put file (%s)", strerror(errno));
+			sess->put_write_failed = true;
+		}
+	}
+	else{
+		update_put_journal(sess, true);
+	}
+	fclose(sess->put_file);
+	sess->put_file = NULL;
+	sess->put_delta = false;
+	if(sess->put_journal_fd >= 0){
+		close(sess->put_journal_fd);
+		sess->put_journal_fd = -1;
+		if(complete){journal_remove(sess->put_file_name);}
+	}
+}
+
+/*----------------- mapped_file_count() -------------------
+
+	@brief : Count a get that sends from a map of a file in the 
+			 table of mapped files, or uncount it
+	
+	@param : st - identity of the file
+			 delta - 1 when mapped, -1 when unmapped
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void mapped_file_count(struct stat *st, int delta){
+	int var1, free_index;
+	pthread_mutex_lock(&mapped_file_lock);
+	free_index = -1;
+	for(var1 = 0; var1 < mapped_file_max; var1++){
+		if(mapped_file_arr[var1].count == 0){
+			if(free_index < 0){free_index = var1;}
+			continue;
+		}
+		if((mapped_file_arr[var1].dev == st->st_dev) && (mapped_file_arr[var1].ino == st->st_ino)){break;}
+	}
+	if(var1 < mapped_file_max){
+		mapped_file_arr[var1].count += delta;
+	}
+	else if((delta > 0) && (free_index >= 0)){
+		mapped_file_arr[free_index].dev = st->st_dev;
+		mapped_file_arr[free_index].ino = st->st_ino;
+		mapped_file_arr[free_index].count = delta;
+	}
+	pthread_mutex_unlock(&mapped_file_lock);
+}
+
+/*----------------- mapped_file_busy() -------------------
+
+	@brief : Check if a get of any session sends from a map of the 
+			 file with the given name
+	
+	@param : filename - file name
+	
+	@return : true if the file is mapped
+
+-----------------------------------------------------------*/
+
+bool mapped_file_busy(char *filename){
+	struct stat st;
+	int var1;
+	if(fstatat(AT_FDCWD, filename, &st, 0) < 0){return false;}
+	pthread_mutex_lock(&mapped_file_lock);
+	for(var1 = 0; var1 < mapped_file_max; var1++){
+		if((mapped_file_arr[var1].count > 0) && 
+		   (mapped_file_arr[var1].dev == st.st_dev) && (mapped_file_arr[var1].ino == st.st_ino)){break;}
+	}
+	pthread_mutex_unlock(&mapped_file_lock);
+	return (var1 < mapped_file_max);
+}
+
+/*----------------- map_fault_handler() -------------------
+
+	@brief : SIGBUS handler - a page of a get map past the end of 
+			 a file that shrank was touched. Inside map_read_check() 
+			 it returns there, anywhere else the signal kills the 
+			 server as before.
+	
+	@param : sig - SIGBUS
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void map_fault_handler(int sig){
+	if(map_fault_armed){
+		map_fault_armed = 0;
+		siglongjmp(map_fault_jmp, 1);
+	}
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+/*----------------- map_read_check() -------------------
+
+	@brief : Take the CRC of the data of a packet from a get map, 
+			 catching the SIGBUS of a file that shrank under the map. 
+			 The signal mask is not saved (the handler runs with 
+			 SA_NODEFER), so arming the jump costs no syscall.
+	
+	@param : data_ptr - ptr into the map
+			 data_len - length of packet data
+			 crc - set to the CRC32C of the data
+	
+	@return : false if the data is no longer in the file
+
+-----------------------------------------------------------*/
+
+bool map_read_check(char *data_ptr, int data_len, uint32_t *crc){
+	if(data_len <= 0){return true;}
+	if(sigsetjmp(map_fault_jmp, 0) != 0){return false;}
+	map_fault_armed = 1;
+	*crc = crc32c(0, data_ptr, data_len);
+	map_fault_armed = 0;
+	return true;
+}
+
+/*----------------- open_put_file() -------------------
+
+	@brief : Open the file of a put command. For rp, a partial file 
+			 with a journal is kept and the transfer resumes at the 
+			 completed range (packet aligned), otherwise the file is 
+			 created empty. The journal is (re)started either way. 
+			 The file digest starts with the CRC of the kept part. A 
+			 file a get sends from a map of is not written in place - 
+			 its name is unlinked and the put gets a new file, the 
+			 map keeps the old one. Names a gt would not serve and 
+			 files that are not regular (links, fifos, directories) 
+			 are refused.
+	
+	@param : sess - client session
+			 filename - file name
+			 size - file size sent by the client, -1 if not sent
+			 resume - rp command
+			 hash - hash of the bytes before the resume offset
+	
+	@return : offset the data packets start at, -1 if the name is 
+			  refused or the file could not be opened
+
+-----------------------------------------------------------*/
+
+off_t open_put_file(struct session *sess, char *filename, off_t size, bool resume, uint64_t *hash){
+	struct stat st;
+	off_t journal_size, offset;
+	bool mapped;
+	if(!valid_file_name(filename) || 
+	   (lookup_file(filename, &st, AT_SYMLINK_NOFOLLOW) && !S_ISREG(st.st_mode))){
+		log_error("\nPut of %s refused", filename);
+		return -1;
+	}
+	offset = 0;
+	mapped = mapped_file_busy(filename);
+	if(resume && !mapped && journal_read(filename, &journal_size, &offset)){
+		if((size >= 0) && (offset > size)){offset = size;}
+		offset = (offset / sess->data_size) * sess->data_size;
+		if((offset > 0) && !hash_resume_tail(filename, offset, hash)){offset = 0;}
+	}
+	sess->put_file = (offset > 0) ? fopen(filename,"r+b") : NULL;
+	if(sess->put_file == NULL){
+		offset = 0;
+		if(mapped){unlink(filename);}
+		sess->put_file = fopen(filename,"wb");
+	}
+	if(sess->put_file == NULL){return -1;}
+	sess->put_file_crc = 0;
+	if(sess->crc){
+		crc32c_shift_op(sess->recv_crc_op, sess->data_size);
+		if((offset > 0) && !crc_file_range(fileno(sess->put_file), 0, offset, &sess->put_file_crc)){
+			offset = 0;
+			sess->put_file_crc = 0;
+		}
+	}
+	if(sess->fec_dec.k > 0){fec_decoder_start(&sess->fec_dec, sess->data_size);}
+	sess->put_file_size = size;
+	sess->recv_ack_seq_arr_index = (int)(offset / sess->data_size);
+	bzero(sess->recv_data_seq_arr,sizeof(sess->recv_data_seq_arr));
+	sess->put_journal_fd = journal_open(filename);
+	sess->put_journal_done = offset;
+	if(sess->put_journal_fd >= 0){journal_write(sess->put_journal_fd, size, offset);}
+	if(offset > 0){log_info("\nResuming %s at %lld bytes", filename, (long long)offset);}
+	return offset;
+}
+
+/*----------------- apply_delta() -------------------
+
+	@brief : Rebuild the file of a pd from the received delta and the 
+			 old copy. Records : 'H' block size, old file size; 'L' 
+			 length, literal data; 'B' first block, block count; 'E' 
+			 new file size, FNV-1a hash of the new file. The file is 
+			 written to a new file of STATE_DIR, named after the file 
+			 and the session so no served file is touched and two pd 
+			 of a name do not share it, and only renamed over the old 
+			 copy if size and hash match.
+	
+	@param : sess - client session
+	
+	@return : true if the file was rebuilt
+
+-----------------------------------------------------------*/
+
+bool apply_delta(struct session *sess){
+	char buf[DELTA_BLOCK_MAX], rec[16], tmp_name[NAME_MAX + 24];
+	uint32_t block_size, len, var1;
+	uint64_t block_index, block_count, hash;
+	off_t out_size;
+	bool done, ok;
+	FILE *out;
+	int fd, out_fd, type;
+	drain_file_writes(sess);
+	fseeko(sess->put_file, 0, SEEK_SET);
+	snprintf(tmp_name, sizeof(tmp_name), "%s.%u.delta", sess->put_file_name, sess->session_id);
+	fd = open(sess->put_file_name, O_RDONLY | O_NOFOLLOW);
+	unlinkat(state_dir_fd, tmp_name, 0);			// left by a server that stopped mid pd
+	out_fd = openat(state_dir_fd, tmp_name, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0666);
+	out = (out_fd >= 0) ? fdopen(out_fd, "wb") : NULL;
+	if((out == NULL) && (out_fd >= 0)){close(out_fd);}
+	block_size = 0;
+	hash = FNV_OFFSET_BASIS;
+	out_size = 0;
+	done = false;
+	ok = (out != NULL);
+	while(ok && !done){
+		type = fgetc(sess->put_file);
+		switch(type){
+			case 'H':
+				ok = (fread(rec, 1, 12, sess->put_file) == 12);
+				block_size = get_be32(rec);
+				ok = ok && (block_size >= DELTA_BLOCK_MIN) && (block_size <= DELTA_BLOCK_MAX);
+			break;
+			case 'L':
+				ok = (fread(rec, 1, 4, sess->put_file) == 4);
+				len = get_be32(rec);
+				ok = ok && (len <= sizeof(buf)) && (fread(buf, 1, len, sess->put_file) == len) && 
+					 (fwrite(buf, 1, len, out) == len);
+				hash = fnv1a_update(hash, buf, len);
+				out_size += len;
+			break;
+			case 'B':
+				ok = (fread(rec, 1, 8, sess->put_file) == 8) && (block_size > 0) && (fd >= 0);
+				block_index = get_be32(rec);
+				block_count = get_be32(rec + 4);
+				for(var1 = 0; ok && (var1 < block_count); var1++){
+					ok = (pread(fd, buf, block_size, (off_t)(block_index + var1) * block_size) == block_size) && 
+						 (fwrite(buf, 1, block_size, out) == block_size);
+					hash = fnv1a_update(hash, buf, block_size);
+					out_size += block_size;
+				}
+			break;
+			case 'E':
+				ok = (fread(rec, 1, 16, sess->put_file) == 16) && (get_be64(rec) == (uint64_t)out_size) && 
+					 (get_be64(rec + 8) == hash);
+				done = true;
+			break;
+			default:
+				ok = false;
+			break;
+		}
+	}
+	if(fd >= 0){close(fd);}
+	if(out != NULL){
+		ok = ok && (fflush(out) == 0) && (fsync(fileno(out)) == 0);
+		fclose(out);
+		ok = ok && (renameat(state_dir_fd, tmp_name, AT_FDCWD, sess->put_file_name) == 0);
+		if(!ok){unlinkat(state_dir_fd, tmp_name, 0);}
+	}
+	fclose(sess->put_file);
+	sess->put_file = NULL;
+	sess->put_delta = false;
+	if(ok){log_info("\n%s rebuilt from delta, %lld bytes", sess->put_file_name, (long long)out_size);}
+	else{log_error("\nDelta of %s could not be applied", sess->put_file_name);}
+	return ok;
+}
+
+/*----------------- unpack_data_packet() -------------------
+
+	@brief : Decompress a data packet the client sent compressed. 
+			 The data is held in recv_unpack_buf until the write 
+			 queue is flushed, like received packets stay in the 
+			 receive batch buffers.
+	
+	@param : sess - client session
+			 info - decoded packet, data pointer, length and CRC 
+					are set to the decompressed data
+	
+	@return : false if the packet is corrupt
+
+-----------------------------------------------------------*/
+
+bool unpack_data_packet(struct session *sess, struct packet_info *info){
+	int len;
+	if(recv_unpack_count == RECV_UNPACK_SLOTS){flush_file_writes();}
+	len = lz_decompress(info->data_ptr, info->data_len, recv_unpack_buf[recv_unpack_count], sess->data_size);
+	if(len <= 0){return false;}
+	info->data_ptr = recv_unpack_buf[recv_unpack_count++];
+	info->data_len = len;
+	if(sess->crc){info->data_crc = crc32c(0, info->data_ptr, len);}		// the digest is of the file data
+	return true;
+}
+
+/*----------------- store_data_packet() -------------------
+
+	@brief : Write received data packet at its offset in the put 
+			 file - out-of-order packets land in place, nothing is 
+			 held back until the gap is filled. The write is queued 
+			 behind the ACK, to io_uring (the data is copied to its 
+			 window slot) or to the write-behind queue that 
+			 flush_file_writes() runs after the batch. The packet 
+			 CRCs are folded into the file digest as the window base 
+			 passes them.
+	
+	@param : sess - client session
+			 seq_no - data packet sequence number
+			 data_ptr - ptr to packet data
+			 data_len - length of packet data
+			 data_crc - CRC32C of packet data
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void store_data_packet(struct session *sess, int seq_no, char *data_ptr, int data_len, uint32_t data_crc){
+	int slot;
+	if((seq_no < sess->recv_ack_seq_arr_index) || (seq_no >= (sess->recv_ack_seq_arr_index + MAX_WINDOW_SIZE))){
+		return;											/* duplicate or outside receive window */
+	}
+	slot = SEQ_SLOT(seq_no);
+	if(sess->recv_data_seq_arr[slot] || sess->recv_write_arr[slot]){return;}	/* held, or slot still being written */
+	if(sess->put_file == NULL){return;}
+	if(uring_enable){
+		memcpy(sess->recv_window_buf[slot],data_ptr,data_len);
+		sess->recv_window_len[slot] = data_len;
+		uring_write_put_file(sess, slot, seq_no);
+	}
+	else{
+		if(file_write_count == RECV_SEG_MAX){flush_file_writes();}
+		file_write_arr[file_write_count].sess = sess;
+		file_write_arr[file_write_count].fd = fileno(sess->put_file);
+		file_write_arr[file_write_count].offset = (off_t)seq_no * sess->data_size;
+		file_write_arr[file_write_count].data_ptr = data_ptr;
+		file_write_arr[file_write_count].data_len = data_len;
+		file_write_count++;
+	}
+	sess->recv_data_seq_arr[slot] = true;
+	sess->recv_crc_arr[slot] = data_crc;
+	sess->recv_crc_len[slot] = data_len;
+	while(sess->recv_data_seq_arr[SEQ_SLOT(sess->recv_ack_seq_arr_index)]){
+		slot = SEQ_SLOT(sess->recv_ack_seq_arr_index);
+		if(sess->crc){
+			sess->put_file_crc = crc32c_combine(sess->put_file_crc, sess->recv_crc_arr[slot], sess->recv_crc_len[slot], 
+												(sess->recv_crc_len[slot] == sess->data_size) ? sess->recv_crc_op : NULL);
+		}
+		sess->recv_data_seq_arr[slot] = false;
+		sess->recv_ack_seq_arr_index++;
+	}
+	update_put_journal(sess, false);
+}
+
+/*----------------- store_rebuilt_packets() -------------------
+
+	@brief : Store and ACK the data packets FEC rebuilt. Their data 
+			 is only valid until the next decode, so it is copied to 
+			 recv_unpack_buf (or decompressed there) and held until 
+			 the write queue is flushed.
+	
+	@param : sess - client session
+			 info_arr - rebuilt data packets
+			 count - number of packets
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void store_rebuilt_packets(struct session *sess, struct packet_info *info_arr, int count){
+	struct packet_info *info;
+	int var1;
+	for(var1 = 0; var1 < count; var1++){
+		info = &info_arr[var1];
+		if(info->flags & HDR_FLAG_COMPRESSED){
+			if(!unpack_data_packet(sess, info)){continue;}
+		}
+		else{
+			if(recv_unpack_count == RECV_UNPACK_SLOTS){flush_file_writes();}
+			memcpy(recv_unpack_buf[recv_unpack_count], info->data_ptr, info->data_len);
+			info->data_ptr = recv_unpack_buf[recv_unpack_count++];
+			if(sess->crc){info->data_crc = crc32c(0, info->data_ptr, info->data_len);}
+		}
+		log_trace("\nData packet %ld rebuilt by FEC", info->seq_no + 1);
+		store_data_packet(sess, (int)info->seq_no,info->data_ptr,info->data_len,info->data_crc);
+		send_recvd_data_ack(sess, (int)info->seq_no);
+	}
+}
+
+/*----------------- open_get_file() -------------------
+
+	@brief : Open the requested file for a get and map it, so data 
+			 packets are sent straight from the page cache. The 
+			 signatures of a pd are sent the same way. Files 
+			 that cannot be mapped (empty, special) are streamed 
+			 through the ring instead. A session that compresses 
+			 streams through the ring too, where its packets are 
+			 compressed, and only turns to the map once compression 
+			 backs off (fill_send_ring()). With io_uring the kernel is asked to read the map 
+			 ahead, so the worker seldom faults on it. The file is 
+			 only mapped if its size is still the one sent to the 
+			 client, and counted in the table of mapped files so a 
+			 put does not truncate it under the map.
+	
+	@param : sess - client session
+			 filename - ptr to file name buffer
+	
+	@return : false if the file could not be opened
+
+-----------------------------------------------------------*/
+
+bool open_get_file(struct session *sess, char *filename){
+	void *map;
+	sess->get_file = (sess->ready_file != NULL) ? sess->ready_file : fopen(filename,"rb");
+	sess->ready_file = NULL;
+	if(sess->get_file == NULL){return false;}
+	sess->get_file_map = NULL;
+	sess->send_map_seq = INT_MAX;
+	if(fstat(fileno(sess->get_file), &sess->get_file_stat) < 0){bzero(&sess->get_file_stat, sizeof(struct stat));}
+	if((sess->file_size_var > 0) && (sess->file_size_var == sess->get_file_stat.st_size)){
+		map = mmap(NULL, sess->file_size_var, PROT_READ, MAP_SHARED, fileno(sess->get_file), 0);
+		if(map != MAP_FAILED){
+			madvise(map, sess->file_size_var, MADV_SEQUENTIAL);
+			if(uring_enable){madvise(map, sess->file_size_var, MADV_WILLNEED);}
+			sess->get_file_map = (char *)map;
+			sess->send_map_seq = sess->compress ? INT_MAX : 0;
+			mapped_file_count(&sess->get_file_stat, 1);
+		}
+	}
+	return true;
+}
+
+/*----------------- close_get_file() -------------------
+
+	@brief : Disarm the retransmit and pace timers, then unmap and 
+			 close the get file. Queued data packets may still point 
+			 into the map, so the send batch is flushed first, and 
+			 io_uring reads and compression of the ring are waited 
+			 for.
+	
+	@param : sess - client session
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void close_get_file(struct session *sess){
+	int var1;
+	for(var1 = 0; var1 < MAX_WINDOW_SIZE; var1++){
+		timer_del(&send_timer_wheel, &sess->send_pkt_timer_arr[var1]);
+	}
+	timer_del(&send_timer_wheel, &sess->pace_timer);
+	if((sess->get_file_map != NULL) || (sess->get_file != NULL)){flush_send_batch();}
+	drain_file_writes(sess);
+	compress_drain(sess);
+	for(var1 = 0; var1 < SEND_RING_SIZE; var1++){
+		if(sess->send_ring_block[var1] != NULL){
+			cache_release(sess->send_ring_block[var1]);
+			sess->send_ring_block[var1] = NULL;
+		}
+	}
+	if(sess->get_file_map != NULL){
+		munmap(sess->get_file_map, sess->file_size_var);
+		sess->get_file_map = NULL;
+		mapped_file_count(&sess->get_file_stat, -1);
+	}
+	if(sess->get_file != NULL){
+		fclose(sess->get_file);
+		sess->get_file = NULL;
+	}
+}
+
+/*----------------- fill_send_ring() -------------------
+
+	@brief : Read the get file ahead of the send window into the 
+			 ring of packet sized chunks, up to send_map_seq. A 
+			 mapped file of a session whose packets stopped 
+			 shrinking (COMPRESS_MISS_LIMIT) is sent from the map 
+			 from the next unread packet on. 
+			 Chunks stay in the ring until ACKed so they can be 
+			 retransmitted. A chunk found in the block cache is 
+			 held instead of read, a chunk that missed is read into 
+			 a new cache block. With io_uring the reads are queued, 
+			 a compressing session queues the chunks read to the 
+			 compression threads, and send_ready_seq_index moves as 
+			 they complete - packets are only sent up to it.
+	
+	@param : sess - client session
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void fill_send_ring(struct session *sess){
+	struct cache_block *block;
+	int slot, seq_no;
+	if((sess->get_file_map != NULL) && (sess->send_map_seq == INT_MAX) && 
+	   (__atomic_load_n(&sess->compress_misses, __ATOMIC_RELAXED) >= COMPRESS_MISS_LIMIT)){
+		sess->send_map_seq = sess->send_read_seq_index;
+		log_debug("\nData of session %u does not compress, sending from packet %d from the map", 
+				  sess->session_id, sess->send_map_seq);
+	}
+	while((sess->send_read_seq_index < sess->send_max_pkt_count) && (sess->send_read_seq_index < sess->send_map_seq) && 
+		  (sess->send_read_seq_index < (sess->send_ack_seq_arr_index + SEND_RING_SIZE))){
+		seq_no = sess->send_read_seq_index++;
+		slot = RING_SLOT(seq_no);
+		if(sess->send_ring_block[slot] != NULL){cache_release_later(sess->send_ring_block[slot]);}
+		block = ((block_cache_limit > 0) && (sess->get_file_stat.st_nlink > 0)) ? cache_lookup(sess, seq_no) : NULL;	// not temporary files
+		if(block != NULL){
+			sess->send_ring_block[slot] = block;
+			sess->send_ring_ptr[slot] = block->data;
+			sess->send_ring_len[slot] = block->len;
+			ring_slot_loaded(sess, slot);
+			continue;
+		}
+		block = ((block_cache_limit > 0) && (sess->get_file_stat.st_nlink > 0)) ? cache_alloc(sess, seq_no) : NULL;
+		sess->send_ring_block[slot] = block;
+		sess->send_ring_ptr[slot] = (block != NULL) ? block->data : sess->send_ring_buf[slot];
+		if(uring_enable){
+			uring_read_get_file(sess, seq_no);
+			continue;
+		}
+		sess->send_ring_len[slot] = (int)pread(fileno(sess->get_file), sess->send_ring_ptr[slot], sess->data_size, 
+											   (off_t)seq_no * sess->data_size);
+		if(sess->send_ring_len[slot] < 0){
+			sess->send_ring_len[slot] = 0;
+			sess->send_read_failed = true;
+		}
+		else if(block != NULL){
+			cache_insert(block, sess->send_ring_len[slot]);
+		}
+		ring_slot_loaded(sess, slot);
+	}
+	update_ready_index(sess);
+}
+
+/*----------------- send_repair_packets() -------------------
+
+	@brief : Queue the FEC repair packets of the block just encoded 
+			 behind its last data packet. They are not numbered, timed 
+			 or retransmitted - the client ACKs the data packets it 
+			 rebuilds from them.
+	
+	@param : sess - client session
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_repair_packets(struct session *sess){
+	char *data_ptr;
+	int hdr_len, data_len, var1;
+	for(var1 = 0; var1 < sess->fec_enc.m; var1++){
+		data_len = fec_repair_packet(&sess->fec_enc, var1, &data_ptr);
+		hdr_len = create_bin_header(sess,'R','0',data_packet_hdr_buff,(long)sess->fec_enc.block * sess->fec_enc.k,data_len,0);
+		if(sess->crc){set_packet_crc(data_packet_hdr_buff, hdr_len, crc32c(0, data_ptr, data_len));}
+		queue_datagram(&sess->clientaddr,data_packet_hdr_buff,hdr_len,data_ptr,data_len);
+	}
+	log_trace("\nSent %d repair packets of block %d", sess->fec_enc.m, sess->fec_enc.block);
+}
+
+/*----------------- send_data_packet() -------------------
+
+	@brief : Queue data packet of the requested file and arm its 
+			 retransmit timer. The header and the file data (file map 
+			 or ring, compressed if it shrank) go out as two iovecs 
+			 of the next sendmmsg(), without copying the data. The 
+			 CRC of ring data was taken when the slot was loaded, 
+			 file map data is checksummed here, under map_read_check() 
+			 like the FEC encoder's read of it. A session with neither 
+			 does not touch the map, a file that shrank faults in the 
+			 send instead (send_map_faulted()).
+	
+	@param : sess - client session
+			 seq_no - data packet sequence number
+			 retx - packet was sent before
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_data_packet(struct session *sess, int seq_no, bool retx){
+	int hdr_len, flags;
+	off_t offset;
+	long unsigned int now;
+	uint32_t data_crc;
+	char *data_ptr;
+	flags = 0;
+	data_crc = sess->send_ring_crc[RING_SLOT(seq_no)];
+	if((sess->get_file_map != NULL) && (seq_no >= sess->send_map_seq)){
+		offset = (off_t)seq_no * sess->data_size;
+		data_ptr = sess->get_file_map + offset;
+		cmp_pkt_file_size = ((sess->file_size_var - offset) < sess->data_size) ? (int)(sess->file_size_var - offset) : sess->data_size;
+		if((sess->crc || (sess->fec_enc.k > 0)) && !map_read_check(data_ptr, cmp_pkt_file_size, &data_crc)){
+			/* the file shrank under the map - send what is left of it, the digest tells the client */
+			log_debug("\nGet file shrank, packet %d read from the file", seq_no);
+			data_ptr = sess->send_ring_buf[RING_SLOT(seq_no)];
+			cmp_pkt_file_size = (int)pread(fileno(sess->get_file), data_ptr, cmp_pkt_file_size, offset);
+			if(cmp_pkt_file_size < 0){cmp_pkt_file_size = 0;}
+			if(sess->crc){data_crc = crc32c(0, data_ptr, cmp_pkt_file_size);}
+		}
+	}
+	else if(sess->send_ring_zlen[RING_SLOT(seq_no)] > 0){
+		data_ptr = sess->send_ring_zbuf[RING_SLOT(seq_no)];
+		cmp_pkt_file_size = sess->send_ring_zlen[RING_SLOT(seq_no)];
+		flags = HDR_FLAG_COMPRESSED;
+	}
+	else{
+		data_ptr = sess->send_ring_ptr[RING_SLOT(seq_no)];
+		cmp_pkt_file_size = sess->send_ring_len[RING_SLOT(seq_no)];
+	}
+	hdr_len = create_data_header(sess,data_packet_hdr_buff,seq_no,cmp_pkt_file_size,flags,data_crc);
+	queue_datagram(&sess->clientaddr,data_packet_hdr_buff,hdr_len,data_ptr,cmp_pkt_file_size);
+	if(!retx && (sess->fec_enc.k > 0) && fec_encode_packet(&sess->fec_enc, seq_no, flags, data_ptr, cmp_pkt_file_size)){
+		send_repair_packets(sess);
+	}
+	now = get_time_usec();
+	sess->send_pkt_time_arr[SEQ_SLOT(seq_no)] = now / 1000;
+	sess->send_pkt_retx_arr[SEQ_SLOT(seq_no)] = retx;
+	cc_on_send(&sess->cc, seq_no, now, retx);
+	sess->send_pkt_timer_arr[SEQ_SLOT(seq_no)].seq_no = seq_no;
+	timer_add(&send_timer_wheel, &sess->send_pkt_timer_arr[SEQ_SLOT(seq_no)], now + (sess->rtt.rto * 1000));
+	log_trace("\nSent data packet %d of %d bytes", seq_no, cmp_pkt_file_size);
+}
+
+/*----------------- send_data_window() -------------------
+
+	@brief : Top up the file ring and send new data packets while 
+			 the congestion window has room, no faster than the 
+			 pacing rate. When pacing holds a packet back, the pace 
+			 timer sends the window on.
+	
+	@param : sess - client session
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_data_window(struct session *sess){
+	long unsigned int now, delay;
+	fill_send_ring(sess);
+	now = get_time_usec();
+	while((sess->send_next_seq_index < sess->send_ready_seq_index) && 
+		  (sess->send_next_seq_index < (sess->send_ack_seq_arr_index + cc_window(&sess->cc)))){
+		delay = cc_pacing_delay(&sess->cc, now);
+		if(delay > 0){
+			timer_add(&send_timer_wheel, &sess->pace_timer, now + delay);
+			break;
+		}
+		sess->send_ack_seq_arr[SEQ_SLOT(sess->send_next_seq_index)] = false;
+		send_data_packet(sess, sess->send_next_seq_index, false);
+		sess->send_next_seq_index++;
+	}
+}
+
+/*----------------- send_paced_window() -------------------
+
+	@brief : Pace timer function - send the data packets pacing held 
+			 back
+	
+	@param : t - pace timer of the session
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_paced_window(struct wheel_timer *t){
+	struct session *sess;
+	sess = (struct session *)t->arg;
+	if(!sess->get_file_done){send_data_window(sess);}
+}
+
+/*----------------- ack_data_packet() -------------------
+
+	@brief : Mark an in-flight data packet ACKed, disarm its 
+			 retransmit timer and count it for congestion control
+	
+	@param : sess - client session
+			 seq_no - data packet sequence number
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void ack_data_packet(struct session *sess, int seq_no){
+	if(sess->send_ack_seq_arr[SEQ_SLOT(seq_no)]){return;}
+	sess->send_ack_seq_arr[SEQ_SLOT(seq_no)] = true;
+	timer_del(&send_timer_wheel, &sess->send_pkt_timer_arr[SEQ_SLOT(seq_no)]);
+	cc_on_delivered(&sess->cc, seq_no);
+}
+
+/*----------------- detect_lost_packets() -------------------
+
+	@brief : Retransmit packets the client reported CC_DUP_THRESH 
+			 packets beyond without ACKing them (FACK), before their 
+			 timer expires. With FEC the count starts at the end of 
+			 the packet's block (fec_loss_seq()). Go-Back-N resends the window from its 
+			 base. Each packet is only resent this way once, later 
+			 losses are left to the retransmit timer.
+	
+	@param : sess - client session
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void detect_lost_packets(struct session *sess){
+	int seq_no, lost;
+	lost = 0;
+	for(seq_no = sess->send_ack_seq_arr_index; 
+		(seq_no < sess->send_next_seq_index) && (fec_loss_seq(&sess->fec_enc, seq_no, sess->send_next_seq_index - 1) <= sess->send_high_ack_seq); seq_no++){
+		if(sess->send_ack_seq_arr[SEQ_SLOT(seq_no)] || sess->send_pkt_retx_arr[SEQ_SLOT(seq_no)]){continue;}
+		lost++;
+		if(window_mode == WINDOW_MODE_GBN){
+			for(seq_no = sess->send_ack_seq_arr_index; seq_no < sess->send_next_seq_index; seq_no++){
+				send_data_packet(sess, seq_no, true);
+			}
+			break;
+		}
+		send_data_packet(sess, seq_no, true);
+	}
+	if(lost > 0){
+		log_trace("\n%d packets lost, window base : %d", lost, sess->send_ack_seq_arr_index);
+		cc_on_loss(&sess->cc, lost, sess->send_next_seq_index);
+	}
+}
+
+/*----------------- process_data_ack() -------------------
+
+	@brief : Update send window from a received data ACK. Go-Back-N 
+			 uses the cumulative ACK only, Selective Repeat also 
+			 marks the individually ACKed / SACKed packets. The ACK 
+			 of a packet sent only once is an RTT sample. Newly ACKed 
+			 packets and losses are passed to congestion control.
+	
+	@param : sess - client session
+			 info - decoded ACK packet, data holds cumulative ACK + bitmap
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void process_data_ack(struct session *sess, struct packet_info *info){
+	int ack_seq_no,cum_seq_no,cum_len,var1,seq_no;
+	long unsigned int expires;
+	struct wheel_timer *base_timer;
+	ack_seq_no = (int)info->seq_no;
+	cum_len = info->binary ? 4 : 6;
+	if(info->data_len >= cum_len){
+		cum_seq_no = (int)get_seq_field(info->data_ptr,info->binary);
+	}
+	else{
+		cum_seq_no = (window_mode == WINDOW_MODE_GBN) ? (ack_seq_no + 1) : sess->send_ack_seq_arr_index;
+	}
+	if(cum_seq_no > sess->send_next_seq_index){cum_seq_no = sess->send_next_seq_index;}
+	if((ack_seq_no >= sess->send_ack_seq_arr_index) && (ack_seq_no < sess->send_next_seq_index) && 
+	   !sess->send_ack_seq_arr[SEQ_SLOT(ack_seq_no)] && !sess->send_pkt_retx_arr[SEQ_SLOT(ack_seq_no)]){
+		rto_update(&sess->rtt, (long)(get_time_msec() - sess->send_pkt_time_arr[SEQ_SLOT(ack_seq_no)]));
+	}
+	for(seq_no = sess->send_ack_seq_arr_index; seq_no < cum_seq_no; seq_no++){
+		ack_data_packet(sess, seq_no);
+	}
+	if((ack_seq_no > sess->send_high_ack_seq) && (ack_seq_no < sess->send_next_seq_index)){
+		sess->send_high_ack_seq = ack_seq_no;
+	}
+	if(window_mode == WINDOW_MODE_SR){
+		if((ack_seq_no >= sess->send_ack_seq_arr_index) && (ack_seq_no < sess->send_next_seq_index)){
+			ack_data_packet(sess, ack_seq_no);
+		}
+		for(var1 = 0; (info->data_len >= (cum_len + SACK_BITMAP_SIZE)) && (var1 < MAX_WINDOW_SIZE); var1++){
+			seq_no = cum_seq_no + 1 + var1;
+			if(seq_no >= sess->send_next_seq_index){break;}
+			if(*(info->data_ptr + cum_len + (var1/8)) & (1 << (var1%8))){
+				ack_data_packet(sess, seq_no);
+				if(seq_no > sess->send_high_ack_seq){sess->send_high_ack_seq = seq_no;}
+			}
+		}
+	}
+	while((sess->send_ack_seq_arr_index < sess->send_next_seq_index) && sess->send_ack_seq_arr[SEQ_SLOT(sess->send_ack_seq_arr_index)]){
+		sess->send_ack_seq_arr_index++;
+		sess->send_retx_count = 0;
+	}
+	/* Timers keep the RTO of their send time - pull the one of the new 
+	 * window base in when the RTO has shrunk since */
+	if(sess->send_ack_seq_arr_index < sess->send_next_seq_index){
+		base_timer = &sess->send_pkt_timer_arr[SEQ_SLOT(sess->send_ack_seq_arr_index)];
+		expires = (sess->send_pkt_time_arr[SEQ_SLOT(sess->send_ack_seq_arr_index)] + sess->rtt.rto) * 1000;
+		if((base_timer->next != NULL) && ((base_timer->expires * TIMER_TICK_USEC) > expires)){
+			timer_add(&send_timer_wheel, base_timer, expires);
+		}
+	}
+	detect_lost_packets(sess);
+	cc_on_ack(&sess->cc, sess->send_ack_seq_arr_index, sess->send_next_seq_index - sess->send_ack_seq_arr_index);
+	log_trace("\nACK for packet %d received, window base : %d\n",ack_seq_no,sess->send_ack_seq_arr_index);
+}
+
+/*----------------- data_packet_timeout() -------------------
+
+	@brief : Retransmit timer function of an in-flight packet. 
+			 Go-Back-N resends the whole window from its base, 
+			 Selective Repeat only the expired packet. Like the 
+			 single timer of RFC 6298, only the expiry of the window 
+			 base backs off the RTO and counts towards the abort. 
+			 Timers armed before a backoff are moved on to the 
+			 backed off RTO.
+	
+	@param : t - retransmit timer of the packet
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void data_packet_timeout(struct wheel_timer *t){
+	struct session *sess;
+	int seq_no;
+	long elapsed;
+	sess = (struct session *)t->arg;
+	seq_no = t->seq_no;
+	elapsed = (long)(get_time_msec() - sess->send_pkt_time_arr[SEQ_SLOT(seq_no)]);
+	if(elapsed < sess->rtt.rto){
+		timer_add(&send_timer_wheel, t, get_time_usec() + ((sess->rtt.rto - elapsed) * 1000));
+		return;
+	}
+	if(seq_no == sess->send_ack_seq_arr_index){
+		if(++sess->send_retx_count > MAX_RETX_COUNT){
+			log_error("\nNo ACK from client, aborting transfer of session %u\n", sess->session_id);
+			cc_log_stats(&sess->cc);
+			sess->get_file_done = true;
+			close_get_file(sess);
+			return;
+		}
+		rto_backoff(&sess->rtt);
+		cc_on_timeout(&sess->cc);
+	}
+	if(window_mode == WINDOW_MODE_GBN){
+		for(seq_no = sess->send_ack_seq_arr_index; seq_no < sess->send_next_seq_index; seq_no++){
+			send_data_packet(sess, seq_no, true);
+		}
+		return;
+	}
+	send_data_packet(sess, seq_no, true);
+}
+
+/*----------------- set_session_peer() -------------------
+
+	@brief : Set the client address of a session and format its 
+			 peer name once, so the receive path never resolves or 
+			 formats addresses. No reverse DNS lookup is done.
+	
+	@param : sess - client session
+			 addr - client address/port
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void set_session_peer(struct session *sess, struct sockaddr_in *addr){
+	char addr_buf[INET_ADDRSTRLEN];
+	sess->clientaddr = *addr;
+	sess->clientlen = sizeof(sess->clientaddr);
+	if(inet_ntop(AF_INET, &addr->sin_addr, addr_buf, sizeof(addr_buf)) == NULL){
+		strcpy(addr_buf, "?");
+	}
+	snprintf(sess->peer_name, sizeof(sess->peer_name), "%s:%d", addr_buf, ntohs(addr->sin_port));
+}
+
+/*----------------- create_session() -------------------
+
+	@brief : Allocate a session for a new client in a free slot of 
+			 the worker's session table. Session IDs are random, so 
+			 they cannot be guessed to take a session over, with the 
+			 worker in the low bits (SESSION_WORKER()) - unique across 
+			 workers, and checked against the worker's table.
+	
+	@param : addr - client address/port
+	
+	@return : new session, NULL if the table is full
+
+-----------------------------------------------------------*/
+
+struct session *create_session(struct sockaddr_in *addr){
+	int var1,var2;
+	uint32_t session_id;
+	struct session *sess;
+	for(var1 = 0; var1 < MAX_SESSIONS; var1++){
+		if(session_table[var1] == NULL){break;}
+	}
+	if(var1 == MAX_SESSIONS){
+		log_error("\nSession table full, packet dropped");
+		return NULL;
+	}
+	do{
+		if(getrandom(&session_id, sizeof(session_id), 0) != sizeof(session_id)){
+			log_error("\nNo random session ID (%s), packet dropped", strerror(errno));
+			return NULL;
+		}
+		session_id = (session_id / MAX_WORKER_THREADS) * MAX_WORKER_THREADS + worker_index;
+		for(var2 = 0; var2 < MAX_SESSIONS; var2++){
+			if((session_table[var2] != NULL) && (session_table[var2]->session_id == session_id)){break;}
+		}
+	}while((session_id == 0) || (var2 < MAX_SESSIONS));	/* 0 - no session ID */
+	sess = calloc(1, sizeof(struct session));
+	if(sess == NULL){return NULL;}
+	sess->session_id = session_id;
+	set_session_peer(sess, addr);
+	rto_init(&sess->rtt);
+	sess->data_size = DATA_PACKET_DATA_SIZE;
+	for(var2 = 0; var2 < MAX_WINDOW_SIZE; var2++){
+		timer_init(&sess->send_pkt_timer_arr[var2], data_packet_timeout, sess, var2);
+	}
+	timer_init(&sess->pace_timer, send_paced_window, sess, 0);
+	sess->get_file_done = true;
+	sess->put_journal_fd = -1;
+	session_table[var1] = sess;
+	session_count++;
+	__atomic_add_fetch(&active_session_count, 1, __ATOMIC_RELAXED);
+	log_info("\nSession %u opened for %s (%d active)\n", sess->session_id, sess->peer_name, session_count);
+	return sess;
+}
+
+/*----------------- close_session() -------------------
+
+	@brief : Close the files of a session and free its slot in the 
+			 session table
+	
+	@param : sess - client session
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void close_session(struct session *sess){
+	int var1;
+	close_get_file(sess);
+	close_put_file(sess, false);
+	if(sess->ready_file != NULL){fclose(sess->ready_file);}
+	for(var1 = 0; var1 < MAX_SESSIONS; var1++){
+		if(session_table[var1] == sess){
+			session_table[var1] = NULL;
+			session_count--;
+			__atomic_sub_fetch(&active_session_count, 1, __ATOMIC_RELAXED);
+		}
+	}
+	log_info("\nSession %u closed (%d active)\n", sess->session_id, session_count);
+	free(sess);
+}
+
+/*----------------- forward_datagram() -------------------
+
+	@brief : Hand a datagram whose session ID belongs to another 
+			 worker to the inbox of that worker. The sockets of all 
+			 workers share the port, so the owner answers from its 
+			 own socket. A full inbox drops the datagram, the client 
+			 retransmits it.
+	
+	@param : info - decoded packet header
+			 pkt_ptr - ptr to received datagram
+			 pkt_len - length of received datagram
+	
+	@return : true if the datagram is not for this worker
+
+-----------------------------------------------------------*/
+
+bool forward_datagram(struct packet_info *info, char *pkt_ptr, int pkt_len){
+	struct worker_inbox *inbox;
+	struct forwarded_datagram *dgram;
+	uint64_t one = 1;
+	int owner;
+	if((info->session_id == 0) || (worker_count == 1)){return false;}
+	owner = SESSION_WORKER(info->session_id);
+	if((owner == worker_index) || (owner >= worker_count)){return false;}
+	if(pkt_len > BUFSIZE){return true;}
+	inbox = &worker_inbox_arr[owner];
+	pthread_mutex_lock(&inbox->lock);
+	if(inbox->count < FORWARD_QUEUE_SIZE){
+		dgram = &inbox->dgram_arr[inbox->count++];
+		dgram->addr = clientaddr;
+		dgram->addr_len = clientlen;
+		dgram->len = pkt_len;
+		memcpy(dgram->buf, pkt_ptr, pkt_len);
+	}
+	pthread_mutex_unlock(&inbox->lock);
+	if(write(inbox->wake_fd, &one, sizeof(one)) < 0){perror("\nERROR on eventfd write");}
+	log_trace("\nDatagram of session %u handed to worker %d", info->session_id, owner);
+	return true;
+}
+
+/*----------------- send_no_session() -------------------
+
+	@brief : Tell a client that the session ID of its command is not 
+			 known - the session was reclaimed as idle, or the server 
+			 restarted. No session is made up for the ID, its 
+			 defaults would not match what the client negotiated; 
+			 the client says hello again and resends the command. 
+			 The reply is a bare v2 header of type 'N' with the ID 
+			 and the command number.
+	
+	@param : info - decoded command header
+			 addr - address the command was received from
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void send_no_session(struct packet_info *info, struct sockaddr_in *addr){
+	char pkt_arr[BIN_HDR_SIZE];
+	uint32_t var32;
+	bzero(pkt_arr, sizeof(pkt_arr));
+	pkt_arr[0] = (char)HDR_MAGIC;
+	pkt_arr[1] = 2;
+	pkt_arr[2] = 'N';
+	pkt_arr[3] = info->cmd;
+	var32 = htonl((uint32_t)info->seq_no);
+	memcpy(pkt_arr + 8, &var32, 4);
+	var32 = htonl(info->session_id);
+	memcpy(pkt_arr + 12, &var32, 4);
+	if(sendto(sockfd, pkt_arr, sizeof(pkt_arr), 0, (struct sockaddr *)addr, sizeof(*addr)) < 0){
+		send_failed(addr, errno);
+	}
+	log_debug("\nCommand of unknown session %u answered 'N'", info->session_id);
+}
+
+/*----------------- uring_poll_forward() -------------------
+
+	@brief : Watch the inbox eventfd of the worker with a POLL_ADD 
+			 request, posted again after each completion
 	
-	struct dirent *pDirent;
-    DIR *pDir;
-    char *dirpath = "./";
-    pDir = opendir (dirpath);
-    if (pDir == NULL) {
-       	printf ("Cannot open directory - %s\n", dirpath);
-    }
-	while ((pDirent = readdir(pDir)) != NULL) {	
-		for(i=0;i<strlen(pDirent->d_name);i++){
-			*(ptr + var1) = *(pDirent->d_name + i);
-			var1++;
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void uring_poll_forward(void){
+	struct io_uring_sqe *sqe;
+	sqe = uring_get_sqe(&io_ring);
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = worker_inbox_arr[worker_index].wake_fd;
+	sqe->poll32_events = POLLIN;
+	sqe->user_data = URING_DATA(URING_OP_FORWARD, 0, 0);
+}
+
+/*----------------- session_rate_check() -------------------
+
+	@brief : Count a new session against its source address - a 
+			 token bucket of SESSION_RATE_BURST sessions, topped up 
+			 by one every SESSION_RATE_MSEC. One source cannot fill 
+			 the session table with datagrams from made-up ports. 
+			 The buckets are shared by the workers, as the kernel 
+			 spreads the ports of one source over all of them.
+	
+	@param : addr - client address/port
+	
+	@return : false if the source opened too many sessions
+
+-----------------------------------------------------------*/
+
+bool session_rate_check(struct sockaddr_in *addr){
+	struct session_rate *rate;
+	long unsigned int now;
+	int refill;
+	bool allowed;
+	rate = &session_rate_arr[((ntohl(addr->sin_addr.s_addr) * 2654435761u) >> 24) & (SESSION_RATE_SLOTS - 1)];
+	now = get_time_msec();
+	pthread_mutex_lock(&session_rate_lock);
+	if(rate->addr != addr->sin_addr.s_addr){
+		rate->addr = addr->sin_addr.s_addr;
+		rate->tokens = SESSION_RATE_BURST;
+		rate->time = now;
+	}
+	refill = (int)((now - rate->time) / SESSION_RATE_MSEC);
+	if(refill > 0){
+		rate->tokens = ((rate->tokens + refill) < SESSION_RATE_BURST) ? (rate->tokens + refill) : SESSION_RATE_BURST;
+		rate->time += (long unsigned int)refill * SESSION_RATE_MSEC;
+	}
+	allowed = (rate->tokens > 0);
+	if(allowed){rate->tokens--;}
+	pthread_mutex_unlock(&session_rate_lock);
+	return allowed;
+}
+
+/*----------------- session_packet_valid() -------------------
+
+	@brief : Check that a packet naming a session from another 
+			 address belongs to it before the session is moved - it 
+			 carries a checked CRC if the session has CRCs, and its 
+			 number fits the session: the last command or the next 
+			 one, an ACK inside the get window, data or repair 
+			 packets inside the put window. A made-up or replayed 
+			 datagram with the ID does not take the session over.
+	
+	@param : sess - session named by the packet
+			 info - decoded packet header
+	
+	@return : true if the session may follow the packet
+
+-----------------------------------------------------------*/
+
+bool session_packet_valid(struct session *sess, struct packet_info *info){
+	if(sess->crc && !(info->flags & HDR_FLAG_CRC)){return false;}	// parse_packet() checked a CRC that is there
+	switch(info->type){
+		case 'C':
+		case 'K':
+			return (info->seq_no != 0) && 
+				   ((info->seq_no == sess->last_cmd_seq_no) || (info->seq_no == ((sess->last_cmd_seq_no % CMD_SEQ_MAX) + 1)));
+		case 'A':
+			if(info->cmd == 'F'){return (sess->filefound == 1);}
+			return !sess->get_file_done && (info->seq_no >= sess->send_ack_seq_arr_index) && 
+				   (info->seq_no < sess->send_next_seq_index);
+		case 'D':
+			return (sess->put_file != NULL) && (info->seq_no >= sess->recv_ack_seq_arr_index) && 
+				   (info->seq_no < (sess->recv_ack_seq_arr_index + MAX_WINDOW_SIZE));
+		case 'R':
+			return (sess->put_file != NULL) && (sess->fec_dec.k > 0) && 
+				   (info->seq_no >= (sess->recv_ack_seq_arr_index - FEC_MAX_DATA)) && 
+				   (info->seq_no < (sess->recv_ack_seq_arr_index + MAX_WINDOW_SIZE));
+		default:
+			return false;
+	}
+}
+
+/*----------------- find_session() -------------------
+
+	@brief : Look up the session of a received packet - by the 
+			 session ID of a v2 header, else by client address/port. 
+			 A session found by ID follows the client to its current 
+			 address once a packet from there passes 
+			 session_packet_valid(), other packets from there are 
+			 dropped. An unknown ID gets no session, its commands are 
+			 answered with send_no_session(). Clients without an ID 
+			 get a new session, within session_rate_check(). Only the 
+			 worker's own table is searched - the kernel hashes a 
+			 client address/port to the same worker socket, and a 
+			 packet of a session of another worker (the client moved 
+			 to an address that hashes elsewhere) was handed to that 
+			 worker by forward_datagram().
+	
+	@param : info - decoded packet header
+			 addr - address the packet was received from
+	
+	@return : client session, NULL if the ID is unknown or the table 
+			  is full
+
+-----------------------------------------------------------*/
+
+struct session *find_session(struct packet_info *info, struct sockaddr_in *addr){
+	int var1;
+	struct session *sess;
+	if(info->session_id != 0){
+		for(var1 = 0; var1 < MAX_SESSIONS; var1++){
+			sess = session_table[var1];
+			if((sess != NULL) && (sess->session_id == info->session_id)){
+				if((sess->clientaddr.sin_addr.s_addr != addr->sin_addr.s_addr) || 
+				   (sess->clientaddr.sin_port != addr->sin_port)){
+					if(!session_packet_valid(sess, info)){
+						log_debug("\nPacket of session %u from another address dropped", sess->session_id);
+						return NULL;
+					}
+					set_session_peer(sess, addr);
+					log_debug("\nSession %u moved to %s", sess->session_id, sess->peer_name);
+				}
+				return sess;
+			}
 		}
-		*(ptr + var1) = '\n';
-		var1++;
-    }
-	closedir (pDir);
-	return var1;
+		if((info->type == 'C') && (info->cmd != 'H') && (info->cmd != 'M')){send_no_session(info, addr);}
+		return NULL;
+	}
+	for(var1 = 0; var1 < MAX_SESSIONS; var1++){
+		sess = session_table[var1];
+		if((sess != NULL) && (sess->clientaddr.sin_addr.s_addr == addr->sin_addr.s_addr) && 
+		   (sess->clientaddr.sin_port == addr->sin_port)){
+			return sess;
+		}
+	}
+	if(!session_rate_check(addr)){
+		log_debug("\nNew session refused, too many from %s", inet_ntoa(addr->sin_addr));
+		return NULL;
+	}
+	return create_session(addr);
 }
 
-/*----------------- send_recvd_data_ack() -------------------
+/*----------------- service_sessions() -------------------
 
-	@brief : Send ACK for each data packet received
+	@brief : Reclaim idle sessions and close the sessions whose get 
+			 map faulted in a send. Retransmissions run from the 
+			 timer wheel.
 	
 	@param : none
 	
@@ -507,238 +6584,540 @@ int create_file_list(char *ptr){
 
 -----------------------------------------------------------*/
 
-void send_recvd_data_ack(void){
-	int var1,var2;
-	char temp;
-	bzero(server_send_buf,BUFSIZE);
-	var1 = create_packet('A','D',server_send_buf,recv_ack_seq_arr_index,&temp,1);
-    var2 = sendto(sockfd, server_send_buf, var1, 0, (struct sockaddr *)&clientaddr,clientlen);
-			
-	if (var2 < 0){error("ERROR in sendto");}
-	else{
-		printf("\n ACK packet %d sent to client", recv_ack_seq_arr_index + 1);
+void service_sessions(void){
+	int var1;
+	long unsigned int now;
+	struct session *sess;
+	now = get_time_msec();
+	for(var1 = 0; var1 < MAX_SESSIONS; var1++){
+		sess = session_table[var1];
+		if(sess == NULL){continue;}
+		if((now - sess->last_active_time) > SESSION_IDLE_MSEC){
+			log_info("\nSession %u idle", sess->session_id);
+			close_session(sess);
+		}
+		else if(sess->send_map_fault){
+			log_error("\nGet file of session %u shrank under its map, closing the session", sess->session_id);
+			close_session(sess);
+		}
+	}
+}
+
+/*----------------- service_uring_sessions() -------------------
+
+	@brief : Continue the sessions whose io_uring file requests 
+			 completed - send the data packets read into the ring, 
+			 abort a get whose read failed, reply to a delete
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void service_uring_sessions(void){
+	int var1;
+	struct session *sess;
+	uring_kick = false;
+	for(var1 = 0; var1 < MAX_SESSIONS; var1++){
+		sess = session_table[var1];
+		if(sess == NULL){continue;}
+		if(sess->send_read_failed){
+			sess->send_read_failed = false;
+			if(!sess->get_file_done){
+				log_error("\nGet file read failed, transfer aborted");
+				sess->get_file_done = true;
+				close_get_file(sess);
+			}
+		}
+		else if(!sess->get_file_done){
+			send_data_window(sess);
+		}
+		if(sess->unlink_done){
+			sess->unlink_done = false;
+			if(sess->unlink_res == 0){
+				log_info("\nFile deleted successfully");
+				if(file_index_enable){index_remove(sess->unlink_name);}
+			}
+			else{log_info("\nUnable to delete the file");}
+			send_delete_reply(sess, 1);
+		}
+	}
+}
+
+/*----------------- service_compressed_sessions() -------------------
+
+	@brief : Send the data packets the compression threads finished - 
+			 poll() loop, the io_uring loop gets them through 
+			 service_uring_sessions()
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void service_compressed_sessions(void){
+	int var1;
+	uint64_t count;
+	struct session *sess;
+	if((read(compress_done_fd, &count, sizeof(count)) < 0) && (errno != EAGAIN)){perror("\nERROR on eventfd read");}
+	for(var1 = 0; var1 < MAX_SESSIONS; var1++){
+		sess = session_table[var1];
+		if((sess != NULL) && sess->compress && !sess->get_file_done){send_data_window(sess);}
 	}
 }
 
+/*----------------- stop_workers() -------------------
+
+	@brief : Signal every worker thread to leave its loop
+	
+	@param : none
+	
+	@return : none
+
+-----------------------------------------------------------*/
+
+void stop_workers(void){
+	uint64_t one = 1;
+	if(write(exit_fd, &one, sizeof(one)) < 0){error("ERROR on eventfd write");}
+}
+
 /*----------------- open_packet_server() -------------------
 
-	@brief : Opens packet received by the server.
+	@brief : Opens packet received by the server and hands it to 
+			 the session of the client that sent it.
 	
 	@param : pkt_ptr - ptr to packet buffer
 			 data_ptr - ptr to data buffer
+			 pkt_len - length of received packet
 	
 	@return : none
 
 -----------------------------------------------------------*/
 
-void open_packet_server(char *pkt_ptr, char *data_ptr){
-	char pkt_type;
-	pkt_type = *pkt_ptr;
+void open_packet_server(char *pkt_ptr, char *data_ptr, int pkt_len){
+	struct packet_info info, rebuilt_arr[FEC_MAX_REPAIR];
+	struct session *sess;
 	int data_len;
 	int loop_var1,var2;
 	char chat_msg_buff[150];
 	
-	switch(pkt_type){
+	if(!parse_packet(pkt_ptr,pkt_len,&info)){
+		log_error("\nMalformed packet dropped");
+		return;
+	}
+	if(forward_datagram(&info,pkt_ptr,pkt_len)){return;}
+	sess = find_session(&info,&clientaddr);
+	if(sess == NULL){return;}
+	sess->hdr_mode = info.version;
+	sess->last_active_time = get_time_msec();
+	log_trace("\nserver received datagram from %s\n", sess->peer_name);
+	data_len = info.data_len;
+	
+	switch(info.type){
 		case 'D':
-			pkt_ptr++;
-			recv_ack_seq_arr_index = str_to_int(pkt_ptr);
-			pkt_ptr += 6;
-			data_len = str_to_int(pkt_ptr);
-			printf("\nData packet %d\tsize : %d",recv_ack_seq_arr_index + 1, data_len);
-			pkt_ptr += 6;
-			for(var2=0;var2<data_len;var2++){
-				fputc(*(pkt_ptr + var2),put_file);
-			}
-			send_recvd_data_ack();
+			log_trace("\nData packet %ld\tsize : %d",info.seq_no + 1, data_len);
+			if(sess->put_file != NULL){
+				var2 = (sess->fec_dec.k > 0) ? fec_add_data(&sess->fec_dec, &info, rebuilt_arr) : 0;	// data as sent
+				if((info.flags & HDR_FLAG_COMPRESSED) && !unpack_data_packet(sess, &info)){
+					log_debug("\nCorrupt compressed data packet %ld dropped", info.seq_no);
+				}
+				else{
+					store_data_packet(sess, (int)info.seq_no,info.data_ptr,info.data_len,info.data_crc);
+					send_recvd_data_ack(sess, (int)info.seq_no);
+				}
+				store_rebuilt_packets(sess, rebuilt_arr, var2);
+			}
+		break;
+		case 'R':
+			if((sess->put_file != NULL) && (sess->fec_dec.k > 0)){
+				log_trace("\nRepair packet of block %ld", info.seq_no / sess->fec_dec.k);
+				store_rebuilt_packets(sess, rebuilt_arr, fec_add_repair(&sess->fec_dec, &info, rebuilt_arr));
+			}
 		break;
 		case 'C':
-			if(*(pkt_ptr + 13) == 'G'){					// Get Command Received
-				pkt_ptr += 12;
-				data_len = extract_num(pkt_ptr);		// Extract data length from packet
-				pkt_ptr += 2;
-				for(loop_var1 = 0; loop_var1 < data_len; loop_var1++){
-					*(data_ptr + loop_var1) = *pkt_ptr++;
+			if((info.cmd != 'H') && (info.cmd != 'M') && (info.seq_no != 0) && (info.seq_no == sess->last_cmd_seq_no)){
+				/* Retransmitted command - its reply was lost, resend it */
+				log_debug("\nDuplicate command %ld of session %u", info.seq_no, sess->session_id);
+				if(sess->reply_len > 0){send_reply(sess, sess->reply_buf, sess->reply_len);}
+				break;
+			}
+			if((info.cmd != 'H') && (info.cmd != 'M')){		// hello / probes carry no command number
+				sess->last_cmd_seq_no = info.seq_no;
+				sess->reply_len = 0;
+			}
+			if(info.cmd == 'H'){						// Header / payload size negotiation (connect)
+				log_debug("\nClient supports binary header v%ld", info.seq_no);
+				uint32_t hello_data[4];
+				hello_data[0] = htonl(sess->session_id);
+				loop_var1 = DATA_PACKET_MAX_SIZE;
+				if(data_len >= 4){						// largest payload of the client
+					var2 = (int)get_seq_field(info.data_ptr,true);
+					if(var2 < loop_var1){loop_var1 = var2;}
+				}
+				hello_data[1] = htonl(loop_var1);
+				var2 = 0;
+				if(data_len >= 8){						// features of the client
+					var2 = (int)get_seq_field(info.data_ptr + 4,true);
+				}
+				sess->compress = compress_opt && (info.seq_no >= 1) && (var2 & HELLO_FEATURE_COMPRESS);
+				sess->crc = (info.seq_no >= 1) && (var2 & HELLO_FEATURE_CRC);
+				loop_var1 = 0;
+				if(fec_opt && (info.seq_no >= 1) && (var2 & HELLO_FEATURE_FEC) && (data_len >= 12)){	// FEC block, K << 8 | M
+					loop_var1 = (int)get_seq_field(info.data_ptr + 8,true);
+					if(((loop_var1 >> 8) < 2) || ((loop_var1 >> 8) > FEC_MAX_DATA) || 
+					   ((loop_var1 & 0xff) < 1) || ((loop_var1 & 0xff) > FEC_MAX_REPAIR)){
+						loop_var1 = 0;
+					}
+				}
+				sess->fec_enc.k = sess->fec_dec.k = loop_var1 >> 8;
+				sess->fec_enc.m = sess->fec_dec.m = loop_var1 & 0xff;
+				hello_data[2] = htonl((sess->compress ? HELLO_FEATURE_COMPRESS : 0) | (sess->crc ? HELLO_FEATURE_CRC : 0) | 
+									  ((loop_var1 > 0) ? HELLO_FEATURE_FEC : 0));
+				hello_data[3] = htonl(loop_var1);
+				log_debug("\nCompression %s, CRCs %s, FEC %d + %d for session %u", sess->compress ? "on" : "off", 
+						  sess->crc ? "on" : "off", sess->fec_enc.k, sess->fec_enc.m, sess->session_id);
+				bzero(server_send_buf,BUFSIZE);
+				var2 = create_packet(sess,'A','H',server_send_buf,(info.seq_no < HDR_VERSION) ? info.seq_no : HDR_VERSION,
+									 (char *)hello_data,sizeof(hello_data));
+				loop_var1 = sendto(sockfd, server_send_buf, var2, 0, (struct sockaddr *)&sess->clientaddr,sess->clientlen);
+				if (loop_var1 < 0){send_failed(&sess->clientaddr, errno);}
+			}
+			if(info.cmd == 'M'){						// Path MTU probe (padded) / payload size commit (no data)
+				if((info.seq_no < DATA_PACKET_MIN_SIZE) || (info.seq_no > DATA_PACKET_MAX_SIZE)){break;}
+				if((data_len != 0) && (data_len != info.seq_no)){break;}
+				var2 = create_packet(sess,'A','M',server_send_buf,info.seq_no,info.data_ptr,data_len);
+				if(data_len == 0){
+					sess->data_size = (int)info.seq_no;
+					log_debug("\nData packet payload of session %u : %d bytes", sess->session_id, sess->data_size);
+					loop_var1 = sendto(sockfd, server_send_buf, var2, 0, (struct sockaddr *)&sess->clientaddr,sess->clientlen);
+					if (loop_var1 < 0){send_failed(&sess->clientaddr, errno);}
+				}
+				else if(!send_probe_reply(sess, server_send_buf, var2)){
+					log_debug("\nPath MTU probe of %d bytes too large to echo", data_len);
 				}
-				filefound = check_file(data_ptr,data_len);
-				strcpy(file_name_buffer,data_ptr);
-			}
-			if(*(pkt_ptr + 13) == 'X'){
-				pkt_ptr += 12;
-				data_len = extract_num(pkt_ptr);
-				pkt_ptr += 2;
-				memcpy(chat_msg_buff, pkt_ptr, data_len);
+			}
+			if(info.cmd == 'G'){						// Get Command Received
+				if(data_len < 1 || data_len > sizeof(sess->file_name_buffer)){break;}	// name, then "offset hash" for rg
+				memcpy(data_ptr, info.data_ptr, data_len);
+				sess->filefound = check_file(sess, data_ptr,data_len);
+				strcpy(sess->file_name_buffer,data_ptr);
+			}
+			if(info.cmd == 'X'){
+				if(data_len >= sizeof(chat_msg_buff)){data_len = sizeof(chat_msg_buff) - 1;}
+				memcpy(chat_msg_buff, info.data_ptr, data_len);
 				chat_msg_buff[data_len] = '\0';
-				printf("\nReceived message: %s", chat_msg_buff);
+				log_info("\nReceived message: %s", chat_msg_buff);
 				bzero(chat_msg_buff, strlen(chat_msg_buff) + 1);
 			}
-			if(*(pkt_ptr + 13) == 'P'){	
-				pkt_ptr += 7;
-				var2 = str_to_int(pkt_ptr);
-				pkt_ptr += 7;
-				char temp_arr[64];
-				for(loop_var1=0;loop_var1<var2;loop_var1++){
-					temp_arr[loop_var1] = *pkt_ptr++;
-				}
+			if(info.cmd == 'P'){	
+				/*
+				 * data : name, then '\0' "size resume" from newer 
+				 * clients. An rp that can resume is answered with 
+				 * name '\0' "offset hash" for the client to check.
+				 */
+				char temp_arr[64], temp_buffer[64];
+				long long put_size;
+				uint64_t put_hash;
+				off_t put_offset;
+				int put_resume;
+				var2 = (int)strnlen(info.data_ptr, data_len);
+				if(var2 >= sizeof(temp_arr)){break;}
+				memcpy(temp_arr, info.data_ptr, var2);
 				temp_arr[var2] = '\0';
-				printf("\nfilename : %s\t%d\t%ld",temp_arr, var2,strlen(temp_arr));
-				put_file = fopen(temp_arr,"wb");
+				put_size = -1;
+				put_resume = 0;
+				if((var2 + 1) < data_len){
+					snprintf(temp_buffer, sizeof(temp_buffer), "%.*s", data_len - var2 - 1, info.data_ptr + var2 + 1);
+					if(sscanf(temp_buffer, "%lld %d", &put_size, &put_resume) < 1){put_size = -1;}
+				}
+				log_debug("\nfilename : %s\t%d\t%ld",temp_arr, data_len,strlen(temp_arr));
+				close_put_file(sess, false);
+				put_offset = open_put_file(sess, temp_arr, (off_t)put_size, (put_resume == 1), &put_hash);
+				if(sess->put_file == NULL){		// refused, told with seq 2 like a gt of a missing file
+					bzero(server_send_buf,BUFSIZE);
+					var2 = create_packet(sess,'A','P',server_send_buf,2,temp_arr,strlen(temp_arr));
+					send_reply(sess, server_send_buf, var2);
+					break;
+				}
+				strcpy(sess->put_file_name, temp_arr);
+				sess->put_delta_failed = false;
+				sess->put_digest_failed = false;
+				sess->put_write_failed = false;
+				if(file_index_enable){index_update(temp_arr);}
 				bzero(server_send_buf,BUFSIZE);
-				var2 = create_packet('A','P',server_send_buf,0,temp_arr,strlen(temp_arr));
-				loop_var1 = sendto(sockfd, server_send_buf, var2, 0, (struct sockaddr *)&clientaddr,clientlen);
-				if (loop_var1 < 0){error("ERROR in sendto");}
+				var2 = (int)strlen(temp_arr);
+				if(put_offset > 0){
+					memcpy(temp_buffer, temp_arr, var2 + 1);
+					var2 += snprintf(temp_buffer + var2 + 1, sizeof(temp_buffer) - var2 - 1, "%lld %016llx", 
+									 (long long)put_offset, (unsigned long long)put_hash) + 1;
+					var2 = create_packet(sess,'A','P',server_send_buf,0,temp_buffer,var2);
+				}
 				else{
-					printf("\nPut file ACK packet sent to client\n");
+					var2 = create_packet(sess,'A','P',server_send_buf,0,temp_arr,var2);
+				}
+				send_reply(sess, server_send_buf, var2);
+				log_debug("\nPut file ACK packet sent to client\n");
+			}
+			if(info.cmd == 'S'){						// pd - signatures of the copy at server
+				if(data_len < 1 || data_len > sizeof(sess->file_name_buffer)){break;}
+				memcpy(data_ptr, info.data_ptr, data_len);
+				*(data_ptr + data_len - 1) = '\0';
+				sess->filefound = send_signature(sess, data_ptr);
+			}
+			if(info.cmd == 'Q'){						// pd - delta put : name '\0' delta size, answered like P
+				char temp_arr[64], temp_buffer[32];
+				struct stat st;
+				long long put_size;
+				var2 = (int)strnlen(info.data_ptr, data_len);
+				if(var2 >= sizeof(temp_arr)){break;}
+				memcpy(temp_arr, info.data_ptr, var2);
+				temp_arr[var2] = '\0';
+				put_size = -1;
+				if((var2 + 1) < data_len){
+					snprintf(temp_buffer, sizeof(temp_buffer), "%.*s", data_len - var2 - 1, info.data_ptr + var2 + 1);
+					if(sscanf(temp_buffer, "%lld", &put_size) != 1){put_size = -1;}
 				}
+				close_put_file(sess, false);
+				if(!valid_file_name(temp_arr) || 
+				   (lookup_file(temp_arr, &st, AT_SYMLINK_NOFOLLOW) && !S_ISREG(st.st_mode))){
+					log_error("\nDelta put of %s refused", temp_arr);
+					bzero(server_send_buf,BUFSIZE);
+					var2 = create_packet(sess,'A','P',server_send_buf,2,temp_arr,strlen(temp_arr));
+					send_reply(sess, server_send_buf, var2);
+					break;
+				}
+				sess->put_file = tmpfile();
+				if(sess->put_file == NULL){break;}
+				sess->put_delta = true;
+				sess->put_delta_failed = false;
+				sess->put_digest_failed = false;
+				sess->put_write_failed = false;
+				sess->put_file_crc = 0;
+				if(sess->crc){crc32c_shift_op(sess->recv_crc_op, sess->data_size);}
+				if(sess->fec_dec.k > 0){fec_decoder_start(&sess->fec_dec, sess->data_size);}
+				sess->put_file_size = (off_t)put_size;
+				sess->put_journal_fd = -1;
+				sess->recv_ack_seq_arr_index = 0;
+				bzero(sess->recv_data_seq_arr,sizeof(sess->recv_data_seq_arr));
+				strcpy(sess->put_file_name, temp_arr);
+				bzero(server_send_buf,BUFSIZE);
+				var2 = create_packet(sess,'A','P',server_send_buf,0,temp_arr,strlen(temp_arr));
+				send_reply(sess, server_send_buf, var2);
+				log_debug("\nDelta put ACK packet sent to client\n");
 			}
-			if(*(pkt_ptr + 13) == 'E'){
-				printf("\nFile exit command received from client");
-				exit_check = false;
+			if(info.cmd == 'E'){
+				log_info("\nFile exit command received from client");
+				if(info.seq_no != 0){					// numbered by a client that waits for the ACK
+					bzero(server_send_buf,BUFSIZE);
+					var2 = create_packet(sess,'A','E',server_send_buf,info.seq_no,chat_msg_buff,0);
+					send_reply(sess, server_send_buf, var2);
+				}
+				close_session(sess);
+				if(__atomic_load_n(&active_session_count, __ATOMIC_RELAXED) == 0){
+					stop_workers();
+				}
+				break;
 				
 			}
-			if(*(pkt_ptr + 13) == 'D'){
-				pkt_ptr += 7;
-				var2 = str_to_int(pkt_ptr);
-				pkt_ptr += 7;
-				printf("\nFile delete command received from client");
-				printf("\nChecking file status ....");
-				delete_file(pkt_ptr,var2);
-			}
-			if(*(pkt_ptr + 13) == 'L'){
-				printf("\nFile List request received");
-				char temp_buffer[1024];
-				var2 = create_file_list(temp_buffer);
+			if(info.cmd == 'D'){
+				if(data_len < 1){break;}
+				log_info("\nFile delete command received from client");
+				log_debug("\nChecking file status ....");
+				delete_file(sess, info.data_ptr,data_len);
+			}
+			if(info.cmd == 'L'){
+				/*
+				 * paged list : data '#' cursor '\0' pattern, the reply 
+				 * seq is 1 if more pages follow, 2 on the last page. 
+				 * Anything else is an older client - one page of names.
+				 */
+				log_info("\nFile List request received");
+				char temp_buffer[DATA_PACKET_MAX_SIZE];
+				char list_cursor[NAME_MAX + 1], list_pattern[NAME_MAX + 1];
+				bool list_paged, list_more;
+				list_paged = (data_len > 0) && (*info.data_ptr == '#');
+				list_cursor[0] = '\0';
+				list_pattern[0] = '\0';
+				if(list_paged){
+					var2 = (int)strnlen(info.data_ptr + 1, data_len - 1);
+					snprintf(list_cursor, sizeof(list_cursor), "%.*s", var2, info.data_ptr + 1);
+					if((var2 + 2) < data_len){
+						snprintf(list_pattern, sizeof(list_pattern), "%.*s", data_len - var2 - 2, info.data_ptr + var2 + 2);
+					}
+				}
+				var2 = create_file_list(temp_buffer, sess->data_size, list_cursor, list_pattern, list_paged, &list_more);
+				if(!list_paged && (var2 > 0)){var2--;}	// no newline after the last name
 				bzero(server_send_buf,BUFSIZE);
-				loop_var1 = create_packet('A','L',server_send_buf,0,temp_buffer,var2-1);
-				var2 = sendto(sockfd, server_send_buf, loop_var1, 0, (struct sockaddr *)&clientaddr,clientlen);
-				if (var2 < 0){error("ERROR in sendto");}
-				else{printf("\nFile List ACK sent to client");}
+				loop_var1 = create_packet(sess,'A','L',server_send_buf,list_paged ? (list_more ? 1 : 2) : 0,temp_buffer,var2);
+				send_reply(sess, server_send_buf, loop_var1);
+				log_debug("\nFile List ACK sent to client");
 			}
 			
 		break;
 		case 'A':
-			if(*(pkt_ptr + 13) == 'F'){
-				printf("\n\nFile Size ACK Received from client\n");
-				if(filefound == 1){
-					filefound = 0;
-					send_ack_seq_arr_index = 0;
-					send_next_packet = false;
-					file_data_init_ptr = file_data_buff;
-					file_data_current_ptr = file_data_buff;
+			if(info.cmd == 'F'){
+				log_debug("\n\nFile Size ACK Received from client\n");
+				if(sess->filefound == 1){
+					sess->filefound = 0;
+					if(!sess->get_file_done){close_get_file(sess);}
 					
-					get_file = fopen(file_name_buffer,"rb");
-					if(get_file == NULL){
-						printf("\nCould not open file\n");
+					if(!open_get_file(sess, sess->file_name_buffer)){
+						log_error("\nCould not open file\n");
+						break;
 					}
 					else{
-						printf("\nFile Opened\n");
+						log_debug("\nFile Opened%s\n", (sess->get_file_map == NULL) ? "" : (sess->compress ? ", mapped" : ", sending from a map"));
 					}
+					sess->send_max_pkt_count = (int)(sess->file_size_var/sess->data_size) + 1;
+					sess->send_read_seq_index = sess->send_start_seq;	// > 0 for an rg
+					sess->send_ready_seq_index = sess->send_start_seq;
 					
-					while(!(feof(get_file))){
-						*file_data_current_ptr++ = fgetc(get_file);
-					}
-					fclose(get_file);
-					file_data_end_ptr = file_data_current_ptr;
-					file_data_current_ptr = file_data_init_ptr;
-					send_max_pkt_count = (((int)(file_data_end_ptr - file_data_init_ptr))/DATA_PACKET_DATA_SIZE) + 1;
-					if((file_data_end_ptr - file_data_init_ptr) < DATA_PACKET_DATA_SIZE){
-						cmp_pkt_file_size = (int)(file_data_end_ptr - file_data_init_ptr);
-					} 
-					else{cmp_pkt_file_size = DATA_PACKET_DATA_SIZE;}
-					printf("\nfile size ptr diff : %d\n",(int)(file_data_end_ptr - file_data_init_ptr));
-					data_packet_init_ptr = data_packet_data_buff;
-					data_packet_current_ptr = data_packet_init_ptr;
-					printf("\ndata loop check - ");
-					for(loop_var1 = 0; loop_var1 < cmp_pkt_file_size; loop_var1++){
-						 *data_packet_current_ptr++ = *file_data_current_ptr++;
-						if(loop_var1 < 4){
-							printf("%c",*(data_packet_current_ptr - 1));
-						}
-					}
-					printf("\n");
-					data_packet_current_ptr = data_packet_init_ptr;
-					send_ack_seq_arr_index = 0;
-					bzero(server_send_buf, BUFSIZE);
-					loop_var1 = create_packet('D','0',server_send_buf,send_ack_seq_arr_index,data_packet_data_buff,cmp_pkt_file_size);
-					printf("\npacket size : %d\n",loop_var1);
-					var2 = sendto(sockfd, server_send_buf, loop_var1, 0, (struct sockaddr *)&clientaddr,clientlen);
-					if (var2 < 0){error("ERROR in sendto");}
-					else{
-						printf("\nSent data packet %d of %d bytes", send_ack_seq_arr_index, cmp_pkt_file_size);
-					}
+					/* Open send window and fill it */
+					bzero(sess->send_ack_seq_arr,sizeof(sess->send_ack_seq_arr));
+					sess->send_ack_seq_arr_index = sess->send_start_seq;
+					sess->send_next_seq_index = sess->send_start_seq;
+					sess->send_retx_count = 0;
+					sess->send_high_ack_seq = sess->send_start_seq - 1;
+					sess->compress_misses = 0;
+					sess->compress_in_bytes = 0;
+					sess->compress_out_bytes = 0;
+					sess->get_file_done = false;
+					if(sess->fec_enc.k > 0){fec_encoder_start(&sess->fec_enc, sess->data_size, sess->send_max_pkt_count - 1);}
+					cc_init(&sess->cc, cc_algo, sess->data_size);
+					send_data_window(sess);
 				}	
 			}
-			else if(*(pkt_ptr + 13) == 'D'){
-				
-				pkt_ptr++;
-				var2 = str_to_int(pkt_ptr);
-				if(send_ack_seq_arr_index < (send_max_pkt_count - 1)){
-					if(var2 == send_ack_seq_arr_index){
-						send_ack_seq_arr[send_ack_seq_arr_index] = true;
-						printf("\nACK for packet %d received\n",send_ack_seq_arr_index);
-						send_ack_seq_arr_index++;
-						send_next_packet = true;	
+			else if(info.cmd == 'D'){
+				if(sess->get_file_done){break;}
+				process_data_ack(sess, &info);
+				if(sess->send_ack_seq_arr_index >= sess->send_max_pkt_count){
+					sess->get_file_done = true;
+					close_get_file(sess);
+					log_info("\nAll packets sent!");
+					log_info("\nTotal packets sent to client : %d",sess->send_max_pkt_count);
+					cc_log_stats(&sess->cc);
+					compress_log_stats(sess);
+					if(sess->fec_enc.k > 0){
+						log_info("\nFEC : %ld repair packets sent, %d + %d per block", sess->fec_enc.repair_count, 
+								 sess->fec_enc.k, sess->fec_enc.m);
 					}
+					cache_log_stats();
 				}
-				else if(send_ack_seq_arr_index == (send_max_pkt_count - 1)){
-					get_file_done = true;
-					printf("\nACK for packet %d received\n",send_ack_seq_arr_index);
-					printf("\nAll packets sent!");
-					printf("\nTotal packets sent to client : %d",send_max_pkt_count);
-					send_next_packet = false;
-				}
-				else{printf("\nFile sequence error");}
-				if(send_next_packet){
-					send_next_packet = false;
-					if((file_data_end_ptr - file_data_current_ptr)){
-						if((file_data_end_ptr - file_data_current_ptr) < DATA_PACKET_DATA_SIZE){
-							cmp_pkt_file_size = (int)(file_data_end_ptr - file_data_current_ptr) - 1;
-						} 
-						else{cmp_pkt_file_size = DATA_PACKET_DATA_SIZE;}
-						bzero(data_packet_data_buff,DATA_PACKET_DATA_SIZE);
-						data_packet_init_ptr = data_packet_data_buff;
-						data_packet_current_ptr = data_packet_init_ptr;
-						for(loop_var1 = 0; loop_var1 < cmp_pkt_file_size; loop_var1++){
-							*data_packet_current_ptr++ = *file_data_current_ptr++;
-						}
-						data_packet_current_ptr = data_packet_init_ptr;
-						bzero(server_send_buf, BUFSIZE);
-						loop_var1 = create_packet('D','0',server_send_buf,send_ack_seq_arr_index,data_packet_data_buff,cmp_pkt_file_size);
-						var2 = sendto(sockfd, server_send_buf, loop_var1, 0, (struct sockaddr *)&clientaddr,clientlen);
-						if (var2 < 0){error("ERROR in sendto");}
-						else{
-							printf("\nSent data packet %d of %d bytes", send_ack_seq_arr_index, cmp_pkt_file_size);
-						}
-					}
+				else{
+					send_data_window(sess);
 				}
 			}
 		break;
 		case 'F':
 		break;
 		case 'K':
-			printf("\nAll packets received!\n");
-			fclose(put_file);
+			if(sess->put_file != NULL){
+				log_info("\nAll packets received!\n");
+				if(sess->fec_dec.k > 0){log_info("\nFEC : %ld packets rebuilt\n", sess->fec_dec.rebuilt_count);}
+				if(sess->crc && (data_len == CRC_HEX_SIZE)){	// digest of the file the client sent
+					memcpy(chat_msg_buff, info.data_ptr, CRC_HEX_SIZE);
+					chat_msg_buff[CRC_HEX_SIZE] = '\0';
+					sess->put_digest_failed = ((uint32_t)strtoul(chat_msg_buff, NULL, 16) != sess->put_file_crc);
+				}
+				if(sess->put_delta && (sess->put_digest_failed || sess->put_write_failed)){
+					log_error("\nDelta of %s %s", sess->put_file_name, 
+							  sess->put_write_failed ? "could not be written" : "does not match the client's digest");
+					close_put_file(sess, false);			// the client puts the whole file instead
+					sess->put_delta_failed = true;
+					sess->put_digest_failed = false;
+					sess->put_write_failed = false;
+				}
+				else if(sess->put_delta){sess->put_delta_failed = !apply_delta(sess);}
+				else{
+					close_put_file(sess, true);
+					if(sess->put_write_failed){
+						log_error("\n%s could not be written, removed", sess->put_file_name);
+						unlink(sess->put_file_name);
+					}
+					else if(sess->put_digest_failed){
+						log_error("\n%s does not match the client's digest, removed", sess->put_file_name);
+						unlink(sess->put_file_name);
+					}
+				}
+				if(file_index_enable){index_update(sess->put_file_name);}	// a gt right after sees the new size
+			}
+			if(info.seq_no != 0){						// numbered by a client that waits for the ACK
+				bzero(server_send_buf,BUFSIZE);
+				var2 = create_packet(sess,'A','K',server_send_buf,info.seq_no,
+									 sess->put_delta_failed ? "F" : (sess->put_write_failed ? "W" : "C"),
+									 (sess->put_delta_failed || sess->put_write_failed || sess->put_digest_failed) ? 1 : 0);	// F - pd not rebuilt, W - write failed, C - digest mismatch
+				loop_var1 = sendto(sockfd, server_send_buf, var2, 0, (struct sockaddr *)&sess->clientaddr,sess->clientlen);
+				if (loop_var1 < 0){send_failed(&sess->clientaddr, errno);}
+			}
 		break;
 		default:
 		break;
 	}
 }
 
-int main(int argc, char **argv) {
+/*----------------- recv_forwarded() -------------------
 
-	  bzero(server_send_buf, BUFSIZE);
-	  bzero(server_recv_buf, BUFSIZE);
+	@brief : Handle the datagrams other workers received for the 
+			 sessions of this worker, like received ones. The inbox 
+			 is copied out first so the other workers are not held 
+			 while they are handled.
+	
+	@param : none
+	
+	@return : none
 
-	  /* 
-	   * check command line arguments 
-	   */
-	  if (argc != 2) {
-		fprintf(stderr, "usage: %s <port>\n", argv[0]);
-		exit(1);
-	  }
-	  portno = atoi(argv[1]);
+-----------------------------------------------------------*/
+
+void recv_forwarded(void){
+	struct worker_inbox *inbox;
+	uint64_t count;
+	int var1, dgram_count;
+	inbox = &worker_inbox_arr[worker_index];
+	if((read(inbox->wake_fd, &count, sizeof(count)) < 0) && (errno != EAGAIN)){perror("\nERROR on eventfd read");}
+	pthread_mutex_lock(&inbox->lock);
+	dgram_count = inbox->count;
+	memcpy(forward_drain_arr, inbox->dgram_arr, (size_t)dgram_count * sizeof(struct forwarded_datagram));
+	inbox->count = 0;
+	pthread_mutex_unlock(&inbox->lock);
+	for(var1 = 0; var1 < dgram_count; var1++){
+		clientaddr = forward_drain_arr[var1].addr;
+		clientlen = forward_drain_arr[var1].addr_len;
+		open_packet_server(forward_drain_arr[var1].buf,server_data_buf,forward_drain_arr[var1].len);
+		bzero(server_send_buf, BUFSIZE);
+	}
+	flush_send_batch();
+	flush_file_writes();
+	if(uring_enable){uring_poll_forward();}
+}
+
+/*----------------- server_worker() -------------------
+
+	@brief : Worker thread - opens its own SO_REUSEPORT socket on the 
+			 server port, is pinned to one CPU and serves the 
+			 sessions of the clients the kernel hashes to it.
+	
+	@param : arg - worker number
+	
+	@return : NULL
+
+-----------------------------------------------------------*/
+
+void *server_worker(void *arg){
+	  int worker_id, sockopt_val, recv_count, recv_index;
+	  struct io_uring_sqe *sqe;
+	  socklen_t sockopt_len;
+	  cpu_set_t cpu_set;
+	  worker_id = (int)(long)arg;
+	  worker_index = worker_id;
+
+	  CPU_ZERO(&cpu_set);
+	  CPU_SET(worker_id % sysconf(_SC_NPROCESSORS_ONLN), &cpu_set);
+	  pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set);
 
 	  /* 
-	   * socket: create the parent socket 
+	   * socket: create the worker socket 
 	   */
 	  sockfd = socket(AF_INET, SOCK_DGRAM, 0);
 	  if (sockfd < 0) 
@@ -748,64 +7127,354 @@ int main(int argc, char **argv) {
 	   * us rerun the server immediately after we kill it; 
 	   * otherwise we have to wait about 20 secs. 
 	   * Eliminates "ERROR on binding: Address already in use" error. 
+	   * SO_REUSEPORT lets every worker bind the same port, the kernel 
+	   * spreads clients over the sockets by their address/port hash.
 	   */
-	  optval = 1;
+	  sockopt_val = 1;
 	  setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, 
-			 (const void *)&optval , sizeof(int));
+			 (const void *)&sockopt_val , sizeof(int));
+	  if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, 
+			 (const void *)&sockopt_val , sizeof(int)) < 0)
+		error("ERROR on SO_REUSEPORT");
 
-	  /*
-	   * build the server's Internet address
+	  /* 
+	   * socket buffers: the default holds only a few large data packets, 
+	   * the kernel caps the request at net.core.rmem_max / wmem_max
 	   */
-	  bzero((char *) &serveraddr, sizeof(serveraddr));
-	  serveraddr.sin_family = AF_INET;
-	  serveraddr.sin_addr.s_addr = htonl(INADDR_ANY);
-	  serveraddr.sin_port = htons((unsigned short)portno);
+	  sockopt_val = SOCKET_BUFSIZE;
+	  setsockopt(sockfd, SOL_SOCKET, SO_RCVBUF, (const void *)&sockopt_val , sizeof(int));
+	  setsockopt(sockfd, SOL_SOCKET, SO_SNDBUF, (const void *)&sockopt_val , sizeof(int));
+
+	  /* 
+	   * segmentation offload (-g): UDP_SEGMENT sends and UDP_GRO receives, 
+	   * each left off if the kernel does not know the option
+	   */
+	  udp_gso_enable = false;
+	  udp_gro_enable = false;
+	  if (udp_offload_opt) {
+		sockopt_len = sizeof(sockopt_val);
+		udp_gso_enable = (getsockopt(sockfd, SOL_UDP, UDP_SEGMENT, (void *)&sockopt_val, &sockopt_len) == 0);
+		recv_gro_buf = malloc((size_t)RECV_BATCH_SIZE * GRO_BUFSIZE);
+		sockopt_val = 1;
+		udp_gro_enable = (recv_gro_buf != NULL) && 
+						 (setsockopt(sockfd, SOL_UDP, UDP_GRO, (const void *)&sockopt_val, sizeof(int)) == 0);
+		if (worker_id == 0) {
+			log_info("UDP GSO %s, GRO %s\n", udp_gso_enable ? "on" : "not supported", udp_gro_enable ? "on" : "not supported");
+		}
+	  }
 
 	  /* 
-	   * bind: associate the parent socket with a port 
+	   * bind: associate the worker socket with the port 
 	   */
 	  if (bind(sockfd, (struct sockaddr *) &serveraddr, 
 		   sizeof(serveraddr)) < 0) 
 		error("ERROR on binding");
 
 	  /* 
-	   * main loop: wait for a datagram, then echo it
+	   * worker loop: wait for a datagram, then handle it
 	   */
 	  clientlen = sizeof(clientaddr);
-		
-	  
 	  exit_check = true;
+	  timer_wheel_init(&send_timer_wheel);
+
+	  /* 
+	   * io_uring: keep all receive batch messages posted as RECVMSG 
+	   * requests and watch the exit signal with POLL_ADD, then datagrams, 
+	   * sends and file requests all complete in the one ring
+	   */
+	  compress_done_fd = eventfd(0, EFD_NONBLOCK);
+	  if (compress_done_fd < 0)
+		error("ERROR opening eventfd");
+	  uring_enable = uring_opt && uring_init(&io_ring, URING_ENTRIES);
+	  if (worker_id == 0) {
+		log_info("Event loop : %s\n", uring_enable ? "io_uring" : "poll");
+	  }
+	  if (uring_enable) {
+		uring_exit = false;
+		uring_kick = false;
+		recv_batch_done_count = 0;
+		for (recv_index = 0; recv_index < RECV_BATCH_SIZE; recv_index++) {
+			uring_post_recv(recv_index);
+		}
+		sqe = uring_get_sqe(&io_ring);
+		sqe->opcode = IORING_OP_POLL_ADD;
+		sqe->fd = exit_fd;
+		sqe->poll32_events = POLLIN;
+		sqe->user_data = URING_DATA(URING_OP_EXIT, 0, 0);
+		uring_poll_compress_done();
+		forward_kick = false;
+		uring_poll_forward();
+	  }
 	  
-	  while (exit_check) {
+	  while (exit_check && uring_enable) {
 			/*
-			 * recvfrom: receive a UDP datagram from a client
+			 * io_uring_enter: submit the queued requests, wait for a 
+			 * completion or the next timer of the wheel, then handle 
+			 * what completed
 			 */
-			
-			n = recvfrom(sockfd, server_recv_buf, BUFSIZE, 0,
-				 (struct sockaddr *) &clientaddr, &clientlen);
-			if (n < 0){error("ERROR in recvfrom");}
-			else{
-				printf("server received %d bytes\n", n);
-				open_packet_server(server_recv_buf,server_data_buf);
-				bzero(server_send_buf, BUFSIZE);
-				bzero(server_recv_buf, BUFSIZE);
+			n = timer_wheel_next(&send_timer_wheel);
+			if ((recv_batch_done_count > 0) || uring_kick) {n = 0;}
+			uring_enter(&io_ring, 1, n);
+			uring_reap(&io_ring);
+			if (forward_kick) {
+				forward_kick = false;
+				recv_forwarded();
 			}
+			timer_wheel_run(&send_timer_wheel);
+			service_sessions();
+			if (uring_kick) {service_uring_sessions();}
+			flush_send_batch();
+			if (uring_exit) {break;}
+			if (recv_batch_done_count == 0) {continue;}
 
-			/* 
-			 * gethostbyaddr: determine who sent the datagram
+			recv_count = uring_recv_batch();
+			for (recv_index = 0; recv_index < recv_count; recv_index++) {
+				n = recv_seg_len_arr[recv_index];
+				clientaddr = recv_batch_addr[recv_seg_msg_arr[recv_index]];
+				clientlen = recv_batch_msg[recv_seg_msg_arr[recv_index]].msg_hdr.msg_namelen;
+				log_trace("server received %d bytes\n", n);
+				open_packet_server(recv_seg_ptr_arr[recv_index],server_data_buf,n);
+				bzero(server_send_buf, BUFSIZE);
+			}
+			uring_repost_recv();
+			flush_send_batch();
+	  }
+	  
+	  while (exit_check && !uring_enable) {
+			/*
+			 * poll: wait for a datagram, the next timer of the wheel 
+			 * (retransmit / pacing of any session), compressed data 
+			 * packets, datagrams handed over by other workers or the 
+			 * exit signal
+			 */
+			struct pollfd pfd[4] = {{sockfd, POLLIN, 0}, {exit_fd, POLLIN, 0}, {compress_done_fd, POLLIN, 0}, 
+									{worker_inbox_arr[worker_index].wake_fd, POLLIN, 0}};
+			n = poll(pfd, 4, timer_wheel_next(&send_timer_wheel));
+			if (pfd[3].revents & POLLIN) {recv_forwarded();}
+			timer_wheel_run(&send_timer_wheel);
+			service_sessions();
+			if (pfd[2].revents & POLLIN) {service_compressed_sessions();}
+			flush_send_batch();
+			if (pfd[1].revents & POLLIN) {break;}
+			if ((n <= 0) || !(pfd[0].revents & POLLIN)) {continue;}
+			
+			/*
+			 * recvmmsg: drain the waiting UDP datagrams, handle each 
+			 * and send the queued replies together
 			 */
-			hostp = gethostbyaddr((const char *)&clientaddr.sin_addr.s_addr, 
-					  sizeof(clientaddr.sin_addr.s_addr), AF_INET);
-			if (hostp == NULL)
-			  error("ERROR on gethostbyaddr");
-			hostaddrp = inet_ntoa(clientaddr.sin_addr);
-			if (hostaddrp == NULL)
-			  error("ERROR on inet_ntoa\n");
-			printf("\nserver received datagram from %s (%s)\n", hostp->h_name, hostaddrp);
 			
+			recv_count = recv_datagram_batch();
+			if (recv_count < 0){error("ERROR in recvmmsg");}
+			for (recv_index = 0; recv_index < recv_count; recv_index++) {
+				n = recv_seg_len_arr[recv_index];
+				clientaddr = recv_batch_addr[recv_seg_msg_arr[recv_index]];
+				clientlen = recv_batch_msg[recv_seg_msg_arr[recv_index]].msg_hdr.msg_namelen;
+				log_trace("server received %d bytes\n", n);
+				open_packet_server(recv_seg_ptr_arr[recv_index],server_data_buf,n);
+				bzero(server_send_buf, BUFSIZE);
+			}
+			flush_send_batch();
+			flush_file_writes();
+			
+		}
+		for (n = 0; n < MAX_SESSIONS; n++) {
+			if (session_table[n] != NULL) {close_session(session_table[n]);}
 		}
+		if (uring_enable) {uring_exit_ring(&io_ring);}
+		close(compress_done_fd);
 		close(sockfd);
-		printf("\nClosing socket ...\nExiting gracefully\nGoodbye!\n\n");
-		return 0;
+		free(recv_gro_buf);
+		cache_release_pending();
+		free(cache_release_arr);
+		return NULL;
 }
 
+int main(int argc, char **argv) {
+	  struct sigaction sig_act;
+
+	  static struct option long_options[] = {
+		{"threads", required_argument, 0, 't'},
+		{"no-uring", no_argument, 0, 'U'},
+		{"cache-mb", required_argument, 0, 'C'},
+		{"no-compress", no_argument, 0, 'Z'},
+		{"compress-threads", required_argument, 0, 'T'},
+		{"no-fec", no_argument, 0, 'F'},
+		{0, 0, 0, 0}
+	  };
+
+	  /* 
+	   * check command line arguments 
+	   */
+	  window_size = DEFAULT_WINDOW_SIZE;
+	  window_mode = WINDOW_MODE_SR;
+	  worker_count = 1;
+	  block_cache_limit = (long unsigned int)DEFAULT_BLOCK_CACHE_MB * 1024 * 1024;
+	  compress_thread_count = DEFAULT_COMPRESS_THREADS;
+	  while ((optval = getopt_long(argc, argv, "w:m:t:c:gv", long_options, NULL)) != -1) {
+		switch (optval) {
+			case 'w':
+				window_size = atoi(optarg);
+				break;
+			case 'm':
+				window_mode = (strcmp(optarg, "gbn") == 0) ? WINDOW_MODE_GBN : WINDOW_MODE_SR;
+				break;
+			case 't':
+				worker_count = atoi(optarg);
+				break;
+			case 'c':
+				cc_algo = find_cc_ops(optarg);
+				if (cc_algo == NULL) {
+					fprintf(stderr, "unknown congestion control %s (newreno|bbr)\n", optarg);
+					exit(1);
+				}
+				break;
+			case 'g':
+				udp_offload_opt = true;
+				break;
+			case 'U':
+				uring_opt = false;
+				break;
+			case 'C':
+				block_cache_limit = strtoul(optarg, NULL, 10) * 1024 * 1024;
+				break;
+			case 'Z':
+				compress_opt = false;
+				break;
+			case 'T':
+				compress_thread_count = atoi(optarg);
+				break;
+			case 'F':
+				fec_opt = false;
+				break;
+			case 'v':
+				log_level++;
+				break;
+			default:
+				break;
+		}
+	  }
+	  if (argc - optind != 1) {
+		fprintf(stderr, "usage: %s [-w window] [-m gbn|sr] [-c newreno|bbr] [--threads n] [-g] [--no-uring] [--cache-mb n] [--no-compress] [--compress-threads n] [--no-fec] [-v] <port>\n", argv[0]);
+		exit(1);
+	  }
+	  if (window_size < 1){window_size = 1;}
+	  if (window_size > MAX_WINDOW_SIZE){window_size = MAX_WINDOW_SIZE;}
+	  if (worker_count < 1){worker_count = (int)sysconf(_SC_NPROCESSORS_ONLN);}	/* 0 - one per core */
+	  if (worker_count > MAX_WORKER_THREADS){worker_count = MAX_WORKER_THREADS;}
+	  if (compress_thread_count < 0){compress_thread_count = 0;}
+	  if (compress_thread_count > MAX_COMPRESS_THREADS){compress_thread_count = MAX_COMPRESS_THREADS;}
+	  if (!compress_opt){compress_thread_count = 0;}
+	  portno = atoi(argv[optind]);
+	  worker_inbox_arr = calloc(worker_count, sizeof(struct worker_inbox));
+	  if (worker_inbox_arr == NULL)
+		error("ERROR allocating worker inboxes");
+	  for (optval = 0; optval < worker_count; optval++) {
+		pthread_mutex_init(&worker_inbox_arr[optval].lock, NULL);
+		worker_inbox_arr[optval].wake_fd = eventfd(0, EFD_NONBLOCK);
+		if (worker_inbox_arr[optval].wake_fd < 0)
+			error("ERROR opening eventfd");
+	  }
+	  mapped_file_max = MAX_SESSIONS * worker_count;
+	  mapped_file_arr = calloc(mapped_file_max, sizeof(struct mapped_file));
+	  if (mapped_file_arr == NULL)
+		error("ERROR allocating mapped file table");
+
+	  /*
+	   * build the server's Internet address
+	   */
+	  bzero((char *) &serveraddr, sizeof(serveraddr));
+	  serveraddr.sin_family = AF_INET;
+	  serveraddr.sin_addr.s_addr = htonl(INADDR_ANY);
+	  serveraddr.sin_port = htons((unsigned short)portno);
+
+	  exit_fd = eventfd(0, 0);
+	  if (exit_fd < 0)
+		error("ERROR opening eventfd");
+
+	  /*
+	   * a get map of a file that shrank faults with SIGBUS, caught 
+	   * by map_read_check() around the reads of the map
+	   */
+	  bzero(&sig_act, sizeof(sig_act));
+	  sig_act.sa_handler = map_fault_handler;
+	  sig_act.sa_flags = SA_NODEFER;			// sigsetjmp() does not save the mask
+	  sigaction(SIGBUS, &sig_act, NULL);
+
+	  /*
+	   * checksums: packet CRCs and file digests are CRC32C, with the 
+	   * SSE4.2 crc32 instruction where the CPU has it
+	   */
+	  crc32c_init();
+	  log_info("\nChecksums : CRC32C (%s)\n", crc32c_hw_enable ? "SSE4.2" : "table");
+
+	  /*
+	   * FEC: clients that ask for it get Reed-Solomon repair packets, 
+	   * GF(256) products with SSSE3 pshufb where the CPU has it
+	   */
+	  fec_init();
+	  if (fec_opt) {
+		log_info("\nFEC : on request, GF(256) %s\n", gf256_hw_enable ? "SSSE3" : "table");
+	  }
+	  else {
+		log_info("\nFEC : off\n");
+	  }
+
+	  /*
+	   * file index: served files by name, kept current by an inotify 
+	   * thread, else every lookup goes to the file system
+	   */
+	  state_dir_fd = state_dir_open();
+	  if (state_dir_fd < 0)
+		log_error("\nCannot open %s, pt is not resumable\n", STATE_DIR);
+
+	  file_index_enable = file_index_init();
+	  if (file_index_enable) {
+		if (pthread_create(&file_index_thread, NULL, file_index_worker, NULL) != 0)
+			error("ERROR creating file index thread");
+		log_info("\nFile index : %d files\n", file_index_count);
+	  }
+	  else {
+		log_info("\nFile index : inotify not available, looking files up on disk\n");
+	  }
+
+	  /*
+	   * compression: data packets of sessions that negotiated it are 
+	   * compressed off the workers, on a small shared pool of threads
+	   */
+	  for (optval = 0; optval < compress_thread_count; optval++) {
+		if (pthread_create(&compress_thread_arr[optval], NULL, compress_worker, NULL) != 0)
+			error("ERROR creating compression thread");
+	  }
+	  if (compress_opt) {
+		log_info("\nCompression : %d thread(s)\n", compress_thread_count);
+	  }
+	  else {
+		log_info("\nCompression : off\n");
+	  }
+
+	  /* 
+	   * start one worker per socket and wait until all have exited
+	   */
+	  log_info("\nStarting %d worker thread(s) on port %d\n", worker_count, portno);
+	  for (optval = 0; optval < worker_count; optval++) {
+		if (pthread_create(&worker_thread_arr[optval], NULL, server_worker, (void *)(long)optval) != 0)
+			error("ERROR creating worker thread");
+	  }
+	  for (optval = 0; optval < worker_count; optval++) {
+		pthread_join(worker_thread_arr[optval], NULL);
+	  }
+	  pthread_mutex_lock(&compress_lock);
+	  compress_exit = true;
+	  pthread_cond_broadcast(&compress_work_cond);
+	  pthread_mutex_unlock(&compress_lock);
+	  for (optval = 0; optval < compress_thread_count; optval++) {
+		pthread_join(compress_thread_arr[optval], NULL);
+	  }
+	  if (file_index_enable) {
+		pthread_join(file_index_thread, NULL);
+		close(inotify_fd);
+	  }
+		close(exit_fd);
+		log_info("\nClosing socket ...\nExiting gracefully\nGoodbye!\n\n");
+		return 0;
+}
@@ -0,0 +1,340 @@
+/*
+ * @file : uftp_shim.c
+ * @authors : Shivam Khandelwal & Samuel Solondz
+ * @brief : UDP relay between uftp client and server that adds loss,
+ *			delay and a rate limited bottleneck, for loopback testing
+ *
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <time.h>
+#include <getopt.h>
+
+#define BUFSIZE 								(64*1024)	/* largest UDP datagram */
+#define MAX_CLIENTS								(64)
+#define SHIM_RING_SIZE							(4096)		/* packets held per direction - queued + in the delay line */
+#define DEFAULT_QUEUE_PKTS						(100)		/* drop-tail bottleneck queue */
+#define UDP_IP_HDR_SIZE							(28)		/* IPv4 + UDP headers */
+
+#define DIR_UP									(0)			/* client -> server */
+#define DIR_DOWN								(1)			/* server -> client */
+
+/*-------------------- Relay Variables ----------------*/
+
+struct shim_pkt{
+	int client;												/* index into client_arr */
+	int len;
+	long unsigned int tx_done_usec;							/* leaves the bottleneck */
+	long unsigned int deliver_usec;							/* leaves the delay line */
+	char *buf;
+};
+
+struct shim_dir{
+	struct shim_pkt ring[SHIM_RING_SIZE];
+	int head, count;
+	long unsigned int link_free_usec;						/* bottleneck busy until */
+	long unsigned int sent, lost, dropped, too_big;
+};
+
+struct shim_client{
+	struct sockaddr_in addr;
+	int upstream_fd;										/* connected to the server */
+};
+
+struct shim_dir dir_arr[2];
+struct shim_client client_arr[MAX_CLIENTS];
+int client_count;
+
+int listen_fd;
+struct sockaddr_in server_addr;
+
+int loss_permille;											/* -l, in tenths of a percent */
+long unsigned int delay_usec;								/* -d, one way */
+long unsigned int rate_kbit;								/* -r, 0 is unlimited */
+int queue_pkts;												/* -q */
+int link_mtu;												/* -M, 0 is unlimited */
+
+/*------------------------------------------------------------------*/
+
+/*----------------- get_time_usec() -------------------
+
+	@brief : Get monotonic time in microseconds
+
+	@param : none
+
+	@return : time in usec
+
+--------------------------------------------------------*/
+
+long unsigned int get_time_usec(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (ts.tv_sec * 1000000UL) + (ts.tv_nsec / 1000);
+}
+
+/*----------------- error() -------------------
+
+	@brief : Print error message and exit
+
+	@param : msg - message
+
+	@return : none
+
+--------------------------------------------------------*/
+
+void error(char *msg) {
+	perror(msg);
+	exit(1);
+}
+
+/*----------------- find_client() -------------------
+
+	@brief : Find the client with the given address, opening an
+			 upstream socket to the server for a new one
+
+	@param : addr - client address
+
+	@return : client index, -1 if the table is full
+
+--------------------------------------------------------*/
+
+int find_client(struct sockaddr_in *addr){
+	int var;
+	for(var = 0; var < client_count; var++){
+		if((client_arr[var].addr.sin_addr.s_addr == addr->sin_addr.s_addr) &&
+		   (client_arr[var].addr.sin_port == addr->sin_port)){
+			return var;
+		}
+	}
+	if(client_count == MAX_CLIENTS){return -1;}
+	client_arr[client_count].addr = *addr;
+	client_arr[client_count].upstream_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if(client_arr[client_count].upstream_fd < 0){error("ERROR opening upstream socket");}
+	if(connect(client_arr[client_count].upstream_fd, (struct sockaddr *)&server_addr, sizeof(server_addr)) < 0){
+		error("ERROR connecting upstream socket");
+	}
+	printf("client %d : %s:%d\n", client_count, inet_ntoa(addr->sin_addr), ntohs(addr->sin_port));
+	return client_count++;
+}
+
+/*----------------- enqueue_packet() -------------------
+
+	@brief : Pass a packet through the link MTU, the loss, the drop-tail 
+			 bottleneck and the delay line of a direction. Packets 
+			 larger than the MTU are dropped, like a router does with 
+			 DF set. The link serves
+			 packets in order and the delay is constant, so the ring
+			 stays sorted by delivery time.
+
+	@param : dir - direction
+	@param : client - client index
+	@param : buf - packet
+	@param : len - packet length
+
+	@return : none
+
+--------------------------------------------------------*/
+
+void enqueue_packet(struct shim_dir *dir, int client, char *buf, int len){
+	struct shim_pkt *pkt;
+	long unsigned int now, start;
+	int var, queued;
+	if((link_mtu > 0) && ((len + UDP_IP_HDR_SIZE) > link_mtu)){
+		dir->too_big++;
+		return;
+	}
+	if((rand() % 1000) < loss_permille){
+		dir->lost++;
+		return;
+	}
+	now = get_time_usec();
+	queued = 0;
+	for(var = dir->count - 1; var >= 0; var--){
+		if(dir->ring[(dir->head + var) % SHIM_RING_SIZE].tx_done_usec <= now){break;}
+		queued++;
+	}
+	if((queued >= queue_pkts) || (dir->count == SHIM_RING_SIZE)){
+		dir->dropped++;
+		return;
+	}
+	pkt = &dir->ring[(dir->head + dir->count) % SHIM_RING_SIZE];
+	start = (dir->link_free_usec > now) ? dir->link_free_usec : now;
+	pkt->tx_done_usec = start;
+	if(rate_kbit > 0){
+		pkt->tx_done_usec += ((long unsigned int)len * 8 * 1000) / rate_kbit;
+	}
+	dir->link_free_usec = pkt->tx_done_usec;
+	pkt->deliver_usec = pkt->tx_done_usec + delay_usec;
+	pkt->client = client;
+	pkt->len = len;
+	if(pkt->buf == NULL){
+		pkt->buf = malloc(BUFSIZE);
+		if(pkt->buf == NULL){error("ERROR allocating packet buffer");}
+	}
+	memcpy(pkt->buf, buf, len);
+	dir->count++;
+}
+
+/*----------------- deliver_packets() -------------------
+
+	@brief : Send the packets of a direction whose delay has expired
+
+	@param : dir_id - DIR_UP or DIR_DOWN
+
+	@return : usec until the next delivery, -1 if the direction is empty
+
+--------------------------------------------------------*/
+
+long int deliver_packets(int dir_id){
+	struct shim_dir *dir = &dir_arr[dir_id];
+	struct shim_pkt *pkt;
+	long unsigned int now;
+	now = get_time_usec();
+	while(dir->count > 0){
+		pkt = &dir->ring[dir->head];
+		if(pkt->deliver_usec > now){
+			return pkt->deliver_usec - now;
+		}
+		if(dir_id == DIR_UP){
+			send(client_arr[pkt->client].upstream_fd, pkt->buf, pkt->len, 0);
+		}else{
+			sendto(listen_fd, pkt->buf, pkt->len, 0,
+				   (struct sockaddr *)&client_arr[pkt->client].addr, sizeof(struct sockaddr_in));
+		}
+		dir->sent++;
+		dir->head = (dir->head + 1) % SHIM_RING_SIZE;
+		dir->count--;
+	}
+	return -1;
+}
+
+/*----------------- print_stats() -------------------
+
+	@brief : Print per direction packet counters
+
+	@param : none
+
+	@return : none
+
+--------------------------------------------------------*/
+
+void print_stats(void){
+	printf("up : %lu sent, %lu lost, %lu queue drops, %lu too big | down : %lu sent, %lu lost, %lu queue drops, %lu too big\n",
+		   dir_arr[DIR_UP].sent, dir_arr[DIR_UP].lost, dir_arr[DIR_UP].dropped, dir_arr[DIR_UP].too_big,
+		   dir_arr[DIR_DOWN].sent, dir_arr[DIR_DOWN].lost, dir_arr[DIR_DOWN].dropped, dir_arr[DIR_DOWN].too_big);
+	fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	struct pollfd pfd_arr[MAX_CLIENTS + 1];
+	struct sockaddr_in listen_addr, client_addr;
+	socklen_t client_len;
+	struct hostent *server;
+	char buf[BUFSIZE];
+	long int wait_up, wait_down, wait_usec;
+	long unsigned int last_stats;
+	int optval, timeout, len, var, client;
+
+	/*
+	 * check command line arguments
+	 */
+	queue_pkts = DEFAULT_QUEUE_PKTS;
+	while ((optval = getopt(argc, argv, "l:d:r:q:M:")) != -1) {
+		switch (optval) {
+			case 'l':
+				loss_permille = (int)(atof(optarg) * 10);
+				break;
+			case 'd':
+				delay_usec = atol(optarg) * 1000;
+				break;
+			case 'r':
+				rate_kbit = atol(optarg);
+				break;
+			case 'q':
+				queue_pkts = atoi(optarg);
+				break;
+			case 'M':
+				link_mtu = atoi(optarg);
+				break;
+			default:
+				break;
+		}
+	}
+	if (argc - optind != 3) {
+		fprintf(stderr, "usage: %s [-l loss%%] [-d delay_ms] [-r rate_kbit] [-q queue_pkts] [-M mtu] <listen_port> <server_host> <server_port>\n", argv[0]);
+		exit(1);
+	}
+	srand(time(NULL));
+
+	server = gethostbyname(argv[optind + 1]);
+	if (server == NULL) {
+		fprintf(stderr,"ERROR, no such host as %s\n", argv[optind + 1]);
+		exit(1);
+	}
+	bzero((char *) &server_addr, sizeof(server_addr));
+	server_addr.sin_family = AF_INET;
+	bcopy((char *)server->h_addr, (char *)&server_addr.sin_addr.s_addr, server->h_length);
+	server_addr.sin_port = htons(atoi(argv[optind + 2]));
+
+	listen_fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (listen_fd < 0){error("ERROR opening socket");}
+	optval = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, (const void *)&optval , sizeof(int));
+	bzero((char *) &listen_addr, sizeof(listen_addr));
+	listen_addr.sin_family = AF_INET;
+	listen_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	listen_addr.sin_port = htons((unsigned short)atoi(argv[optind]));
+	if (bind(listen_fd, (struct sockaddr *) &listen_addr, sizeof(listen_addr)) < 0){error("ERROR on binding");}
+
+	printf("relaying :%s -> %s:%s, loss %d.%d%%, delay %lu ms, rate %lu kbit/s, queue %d packets, mtu %d\n",
+		   argv[optind], argv[optind + 1], argv[optind + 2], loss_permille / 10, loss_permille % 10,
+		   delay_usec / 1000, rate_kbit, queue_pkts, link_mtu);
+	fflush(stdout);
+
+	last_stats = get_time_usec();
+	while(1){
+		wait_up = deliver_packets(DIR_UP);
+		wait_down = deliver_packets(DIR_DOWN);
+		wait_usec = wait_up;
+		if((wait_usec < 0) || ((wait_down >= 0) && (wait_down < wait_usec))){wait_usec = wait_down;}
+		timeout = (wait_usec < 0) ? 1000 : (int)((wait_usec + 999) / 1000);
+
+		pfd_arr[0].fd = listen_fd;
+		pfd_arr[0].events = POLLIN;
+		for(var = 0; var < client_count; var++){
+			pfd_arr[var + 1].fd = client_arr[var].upstream_fd;
+			pfd_arr[var + 1].events = POLLIN;
+		}
+		if(poll(pfd_arr, client_count + 1, timeout) < 0){continue;}
+
+		if(pfd_arr[0].revents & POLLIN){
+			client_len = sizeof(client_addr);
+			len = recvfrom(listen_fd, buf, BUFSIZE, MSG_DONTWAIT, (struct sockaddr *)&client_addr, &client_len);
+			if(len > 0){
+				client = find_client(&client_addr);
+				if(client >= 0){enqueue_packet(&dir_arr[DIR_UP], client, buf, len);}
+			}
+		}
+		for(var = 0; var < client_count; var++){
+			if(!(pfd_arr[var + 1].revents & POLLIN)){continue;}
+			len = recv(client_arr[var].upstream_fd, buf, BUFSIZE, MSG_DONTWAIT);
+			if(len > 0){enqueue_packet(&dir_arr[DIR_DOWN], var, buf, len);}
+		}
+
+		if((get_time_usec() - last_stats) > 5000000){
+			print_stats();
+			last_stats = get_time_usec();
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,44 @@
+#!/bin/sh
+# Regression : gt by the ASCII client of the original assignment (client/u_client), which 
+# has no cumulative ACK and appends every data packet it gets. Any reordering or spurious 
+# retransmit on a lossless loopback shows up as a wrong file. Run with make test from the 
+# server directory, the server is tested with and without io_uring.
+
+PORT=${PORT:-5731}
+RUNS=${RUNS:-5}
+TESTS_DIR=$(cd "$(dirname "$0")" && pwd)
+ROOT_DIR=$(dirname "$TESTS_DIR")
+SERVER=${SERVER:-$ROOT_DIR/server/server}
+CLIENT=$ROOT_DIR/client/u_client
+FILES="$ROOT_DIR/server/foo1 $ROOT_DIR/client/birds.mp3"
+RESULT=0
+
+WORK_DIR=$(mktemp -d)
+trap 'rm -rf "$WORK_DIR"' EXIT
+
+for SERVER_OPT in "" "--no-uring"; do
+	RUN=1
+	while [ $RUN -le $RUNS ]; do
+		rm -rf "$WORK_DIR/server" "$WORK_DIR/client"
+		mkdir "$WORK_DIR/server" "$WORK_DIR/client"
+		cp $FILES "$WORK_DIR/server/"
+		(cd "$WORK_DIR/server" && exec "$SERVER" $SERVER_OPT $PORT > "$WORK_DIR/server.log" 2>&1) &
+		SERVER_PID=$!
+		sleep 0.3
+		(cd "$WORK_DIR/client" && (for FILE in $FILES; do printf 'gt %s\n' "$(basename $FILE)"; sleep 1; done; 
+			printf 'ex\n'; sleep 0.5) | timeout 10 "$CLIENT" 127.0.0.1 $PORT > "$WORK_DIR/client.log" 2>&1)
+		kill $SERVER_PID 2>/dev/null
+		wait $SERVER_PID 2>/dev/null
+		for FILE in $FILES; do
+			NAME=$(basename $FILE)
+			if cmp -s "$WORK_DIR/client/$NAME" "$FILE"; then
+				echo "PASS : ascii client gt $NAME ${SERVER_OPT:-(io_uring)} run $RUN"
+			else
+				echo "FAIL : ascii client gt $NAME ${SERVER_OPT:-(io_uring)} run $RUN"
+				RESULT=1
+			fi
+		done
+		RUN=$((RUN + 1))
+	done
+done
+exit $RESULT